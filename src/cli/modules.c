@@ -6,7 +6,9 @@
 #include "io.wren.inc"
 #include "process.wren.inc"
 #include "scheduler.wren.inc"
+#include "socket.wren.inc"
 #include "timer.wren.inc"
+#include "worker.wren.inc"
 
 extern void directoryList(WrenVM* vm);
 extern void fileAllocate(WrenVM* vm);
@@ -38,7 +40,34 @@ extern void statIsFile(WrenVM* vm);
 extern void stdinReadStart(WrenVM* vm);
 extern void stdinReadStop(WrenVM* vm);
 extern void schedulerCaptureMethods(WrenVM* vm);
+extern void schedulerNextReady(WrenVM* vm);
+extern void tcpSocketAllocate(WrenVM* vm);
+extern void tcpSocketFinalize(void* data);
+extern void tcpSocketConnect(WrenVM* vm);
+extern void tcpSocketListen(WrenVM* vm);
+extern void tcpSocketAccept(WrenVM* vm);
+extern void tcpSocketRead(WrenVM* vm);
+extern void tcpSocketWrite(WrenVM* vm);
+extern void tcpSocketFlush(WrenVM* vm);
+extern void tcpSocketPendingBytes(WrenVM* vm);
+extern void tcpSocketIsOpen(WrenVM* vm);
+extern void tcpSocketClose(WrenVM* vm);
+extern void udpSocketAllocate(WrenVM* vm);
+extern void udpSocketFinalize(void* data);
+extern void udpSocketBind(WrenVM* vm);
+extern void udpSocketSend(WrenVM* vm);
+extern void udpSocketReceive(WrenVM* vm);
+extern void udpSocketIsOpen(WrenVM* vm);
+extern void udpSocketClose(WrenVM* vm);
 extern void timerStartTimer(WrenVM* vm);
+extern void workerAllocate(WrenVM* vm);
+extern void workerFinalize(void* data);
+extern void workerSend(WrenVM* vm);
+extern void workerReceive(WrenVM* vm);
+extern void workerJoin(WrenVM* vm);
+extern void workerInWorker(WrenVM* vm);
+extern void workerSendToParent(WrenVM* vm);
+extern void workerReceiveFromParent(WrenVM* vm);
 
 // The maximum number of foreign methods a single class defines. Ideally, we
 // would use variable-length arrays for each class in the table below, but
@@ -153,6 +182,31 @@ static ModuleRegistry modules[] =
   MODULE(scheduler)
     CLASS(Scheduler)
       STATIC_METHOD("captureMethods_()", schedulerCaptureMethods)
+      STATIC_METHOD("nextReady_()", schedulerNextReady)
+    END_CLASS
+  END_MODULE
+  MODULE(socket)
+    CLASS(TcpSocket)
+      STATIC_METHOD("<allocate>", tcpSocketAllocate)
+      FINALIZER(tcpSocketFinalize)
+      METHOD("connect_(_,_,_)", tcpSocketConnect)
+      METHOD("listen_(_,_,_)", tcpSocketListen)
+      METHOD("accept_(_)", tcpSocketAccept)
+      METHOD("read_(_)", tcpSocketRead)
+      METHOD("write_(_)", tcpSocketWrite)
+      METHOD("flush_(_)", tcpSocketFlush)
+      METHOD("pendingBytes", tcpSocketPendingBytes)
+      METHOD("isOpen", tcpSocketIsOpen)
+      METHOD("close_(_)", tcpSocketClose)
+    END_CLASS
+    CLASS(UdpSocket)
+      STATIC_METHOD("<allocate>", udpSocketAllocate)
+      FINALIZER(udpSocketFinalize)
+      METHOD("bind_(_,_)", udpSocketBind)
+      METHOD("send_(_,_,_,_)", udpSocketSend)
+      METHOD("receive_(_)", udpSocketReceive)
+      METHOD("isOpen", udpSocketIsOpen)
+      METHOD("close_(_)", udpSocketClose)
     END_CLASS
   END_MODULE
   MODULE(timer)
@@ -160,6 +214,18 @@ static ModuleRegistry modules[] =
       STATIC_METHOD("startTimer_(_,_)", timerStartTimer)
     END_CLASS
   END_MODULE
+  MODULE(worker)
+    CLASS(Worker)
+      STATIC_METHOD("<allocate>", workerAllocate)
+      FINALIZER(workerFinalize)
+      METHOD("send_(_)", workerSend)
+      METHOD("receive_()", workerReceive)
+      METHOD("join()", workerJoin)
+      STATIC_METHOD("inWorker_", workerInWorker)
+      STATIC_METHOD("sendToParent_(_)", workerSendToParent)
+      STATIC_METHOD("receiveFromParent_()", workerReceiveFromParent)
+    END_CLASS
+  END_MODULE
 
   SENTINEL_MODULE
 };
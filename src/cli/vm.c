@@ -1,9 +1,17 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifndef _WIN32
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
 #include "io.h"
 #include "modules.h"
 #include "scheduler.h"
+#include "socket.h"
 #include "vm.h"
 
 #define MAX_LINE_LENGTH 1024 // TODO: Something less arbitrary.
@@ -22,6 +30,29 @@ static char const* rootDirectory = NULL;
 // The exit code to use unless some other error overrides it.
 int defaultExitCode = 0;
 
+// A module whose path has been resolved and whose source has been loaded. The
+// source has to stay alive (and, when mapped, stay mapped) until freeVM()
+// since the VM keeps pointers into it while the module is compiled.
+typedef struct
+{
+  // The module name as it appeared in the import.
+  char* name;
+
+  // The module's source: a file mapping when [mapped] is true, otherwise a
+  // heap-allocated buffer.
+  char* source;
+
+  // The length of the mapping when [mapped] is true.
+  size_t mappedLength;
+  bool mapped;
+} ModuleCacheEntry;
+
+// The modules loaded so far, so a name that has already been resolved doesn't
+// probe the filesystem again.
+static ModuleCacheEntry* moduleCache = NULL;
+static int moduleCacheCount = 0;
+static int moduleCacheCapacity = 0;
+
 // Reads the contents of the file at [path] and returns it as a heap allocated
 // string.
 //
@@ -60,6 +91,122 @@ static char* readFile(const char* path)
   return buffer;
 }
 
+// Maps the file at [path] into memory read-only and returns a pointer to its
+// contents, storing the mapping's length in [length]. The compiler only needs
+// a stable `const char*`, so this hands it the page cache directly instead of
+// copying the file into a heap buffer.
+//
+// Returns NULL if the file could not be mapped: it doesn't exist, isn't a
+// regular file, or its size is an exact multiple of the page size, which
+// leaves no zero byte after the contents to terminate the string. Callers
+// fall back to readFile() in that case.
+static char* mapFile(const char* path, size_t* length)
+{
+#ifdef _WIN32
+  return NULL;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) return NULL;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+  {
+    close(fd);
+    return NULL;
+  }
+
+  // The lexer scans to a terminating zero byte. The bytes between the end of
+  // the file and the end of the last mapped page read as zero, so the mapping
+  // is already terminated unless the file ends exactly on a page boundary.
+  size_t fileSize = (size_t)info.st_size;
+  size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+  if (fileSize == 0 || fileSize % pageSize == 0)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  void* mapping = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) return NULL;
+
+  *length = fileSize;
+  return (char*)mapping;
+#endif
+}
+
+// Looks up [name] in the module cache, or returns NULL if it hasn't been
+// loaded before.
+static ModuleCacheEntry* findCachedModule(const char* name)
+{
+  for (int i = 0; i < moduleCacheCount; i++)
+  {
+    if (strcmp(moduleCache[i].name, name) == 0) return &moduleCache[i];
+  }
+
+  return NULL;
+}
+
+// Records that [name] resolved to [source] so later imports skip the
+// filesystem and freeVM() can release the memory.
+static void cacheModule(const char* name, char* source, bool mapped,
+                        size_t mappedLength)
+{
+  if (moduleCacheCount == moduleCacheCapacity)
+  {
+    moduleCacheCapacity = moduleCacheCapacity == 0
+        ? 8 : moduleCacheCapacity * 2;
+    moduleCache = (ModuleCacheEntry*)realloc(moduleCache,
+        sizeof(ModuleCacheEntry) * moduleCacheCapacity);
+  }
+
+  ModuleCacheEntry* entry = &moduleCache[moduleCacheCount++];
+  entry->name = (char*)malloc(strlen(name) + 1);
+  strcpy(entry->name, name);
+  entry->source = source;
+  entry->mapped = mapped;
+  entry->mappedLength = mappedLength;
+}
+
+// Releases every cached module source. Only safe once the VM is gone.
+static void freeModuleCache()
+{
+  for (int i = 0; i < moduleCacheCount; i++)
+  {
+    free(moduleCache[i].name);
+#ifndef _WIN32
+    if (moduleCache[i].mapped)
+    {
+      munmap(moduleCache[i].source, moduleCache[i].mappedLength);
+      continue;
+    }
+#endif
+    free(moduleCache[i].source);
+  }
+
+  free(moduleCache);
+  moduleCache = NULL;
+  moduleCacheCount = 0;
+  moduleCacheCapacity = 0;
+}
+
+// Loads the source of the module file at [path], preferring a zero-copy
+// mapping and falling back to reading it into a buffer when the file can't
+// be mapped. Returns NULL if the path could not be found.
+static char* loadModuleFile(const char* path, bool* mapped,
+                            size_t* mappedLength)
+{
+  char* source = mapFile(path, mappedLength);
+  if (source != NULL)
+  {
+    *mapped = true;
+    return source;
+  }
+
+  *mapped = false;
+  return readFile(path);
+}
+
 // Converts the module [name] to a file path.
 static char* wrenFilePath(const char* name)
 {
@@ -89,30 +236,48 @@ static char* wrenFilePath(const char* name)
 static char* readModule(WrenVM* vm, const char* module)
 {
   char* source = readBuiltInModule(module);
-  if (source != NULL) return source;
-  
+  if (source != NULL)
+  {
+    // Cache it so the copy is freed along with the other module sources.
+    cacheModule(module, source, false, 0);
+    return source;
+  }
+
+  // If this name has been resolved before, skip the filesystem probing and
+  // hand back the source that's already loaded.
+  ModuleCacheEntry* cached = findCachedModule(module);
+  if (cached != NULL) return cached->source;
+
   // First try to load the module with a ".wren" extension.
+  bool mapped;
+  size_t mappedLength = 0;
   char* modulePath = wrenFilePath(module);
-  char* moduleContents = readFile(modulePath);
+  char* moduleContents = loadModuleFile(modulePath, &mapped, &mappedLength);
   free(modulePath);
-  
-  if (moduleContents != NULL) return moduleContents;
-  
-  // If no contents could be loaded treat the module name as specifying a
-  // directory and try to load the "module.wren" file in the directory.
-  size_t moduleLength = strlen(module);
-  size_t moduleDirLength = moduleLength + 7;
-  char* moduleDir = (char*)malloc(moduleDirLength + 1);
-  memcpy(moduleDir, module, moduleLength);
-  memcpy(moduleDir + moduleLength, "/module", 7);
-  moduleDir[moduleDirLength] = '\0';
-  
-  char* moduleDirPath = wrenFilePath(moduleDir);
-  free(moduleDir);
-  
-  moduleContents = readFile(moduleDirPath);
-  free(moduleDirPath);
-  
+
+  if (moduleContents == NULL)
+  {
+    // If no contents could be loaded treat the module name as specifying a
+    // directory and try to load the "module.wren" file in the directory.
+    size_t moduleLength = strlen(module);
+    size_t moduleDirLength = moduleLength + 7;
+    char* moduleDir = (char*)malloc(moduleDirLength + 1);
+    memcpy(moduleDir, module, moduleLength);
+    memcpy(moduleDir + moduleLength, "/module", 7);
+    moduleDir[moduleDirLength] = '\0';
+
+    char* moduleDirPath = wrenFilePath(moduleDir);
+    free(moduleDir);
+
+    moduleContents = loadModuleFile(moduleDirPath, &mapped, &mappedLength);
+    free(moduleDirPath);
+  }
+
+  if (moduleContents != NULL)
+  {
+    cacheModule(module, moduleContents, mapped, mappedLength);
+  }
+
   return moduleContents;
 }
 
@@ -150,7 +315,9 @@ static WrenForeignClassMethods bindForeignClass(
   return methods;
 }
 
-static void write(WrenVM* vm, const char* text)
+// Renamed from "write" so it doesn't collide with the POSIX function of that
+// name now that <unistd.h> is included for the module mapping code.
+static void writeOutput(WrenVM* vm, const char* text)
 {
   printf("%s", text);
   fflush(stdout);
@@ -183,7 +350,7 @@ static void initVM()
   config.bindForeignMethodFn = bindForeignMethod;
   config.bindForeignClassFn = bindForeignClass;
   config.loadModuleFn = readModule;
-  config.writeFn = write;
+  config.writeFn = writeOutput;
   config.errorFn = reportError;
 
   // Since we're running in a standalone process, be generous with memory.
@@ -198,6 +365,7 @@ static void initVM()
 static void freeVM()
 {
   ioShutdown();
+  socketShutdown();
   schedulerShutdown();
   
   uv_loop_close(loop);
@@ -205,6 +373,10 @@ static void freeVM()
   
   wrenFreeVM(vm);
 
+  // The VM kept pointers into the cached module sources, so they can only be
+  // released once it's gone.
+  freeModuleCache();
+
   uv_tty_reset_mode();
 }
 
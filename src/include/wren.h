@@ -2,6 +2,7 @@
 #define wren_h
 
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
 
@@ -104,6 +105,41 @@ typedef struct
 typedef WrenForeignClassMethods (*WrenBindForeignClassFn)(
     WrenVM* vm, const char* module, const char* className);
 
+// A snapshot of the garbage collector's behavior, queryable at any time with
+// wrenGetGCStats().
+typedef struct
+{
+  // The number of full collections completed since the VM was created.
+  unsigned long collections;
+
+  // The number of minor (nursery-only) collections completed. Zero unless
+  // generational collection is enabled.
+  unsigned long minorCollections;
+
+  // Nanoseconds the program was paused by the most recent collection. For an
+  // incremental cycle this covers the finishing stop-the-world pause, which
+  // is where nearly all of the blocking time goes.
+  unsigned long long lastPauseNs;
+
+  // Total nanoseconds the program has been paused by collections.
+  unsigned long long totalPauseNs;
+
+  // The bytes known to be in use just before and just after the most recent
+  // collection.
+  size_t bytesBefore;
+  size_t bytesAfter;
+
+  // The number of objects that survived the most recent full collection.
+  size_t liveObjects;
+} WrenGCStats;
+
+// Reports that a collection has just completed. [stats] reflects the
+// collection, including its pause time, and is only valid for the duration of
+// the call.
+//
+// The callback runs inside the collection pause, so it should be quick.
+typedef void (*WrenGCCallbackFn)(WrenVM* vm, const WrenGCStats* stats);
+
 typedef struct
 {
   // The callback Wren will use to allocate, reallocate, and deallocate memory.
@@ -193,6 +229,97 @@ typedef struct
   //
   // If zero, defaults to 50.
   int heapGrowthPercent;
+
+  // The maximum number of objects the garbage collector will mark in a single
+  // incremental step.
+  //
+  // If zero (the default), collections are not incremental: each collection
+  // marks and sweeps the entire heap in one stop-the-world pause. When
+  // non-zero, a collection instead starts by marking just the root objects
+  // and then marks at most this many objects per allocation, interleaving
+  // the rest of the mark phase with the program's own execution. Once
+  // everything reachable has been marked, a final short pause re-scans the
+  // roots and sweeps the heap.
+  //
+  // Smaller values give shorter pauses but let the program allocate more
+  // memory before a collection cycle finishes. On large heaps this bounds the
+  // worst-case pause at the cost of some collection throughput.
+  int incrementalGCBudget;
+
+  // The number of bytes the VM may allocate between minor garbage
+  // collections.
+  //
+  // If zero (the default), generational collection is disabled and every
+  // collection processes the entire heap. When non-zero, new objects are
+  // placed in a nursery, and once this many bytes have been allocated since
+  // the last collection, a minor collection frees the unreachable nursery
+  // objects and promotes the survivors, without touching the rest of the
+  // heap. Because most objects die young, minor collections reclaim most
+  // garbage at a fraction of the cost of a full collection.
+  //
+  // A few megabytes is a reasonable starting point for allocation-heavy
+  // programs.
+  size_t nurserySize;
+
+  // The maximum number of dead fibers whose stack and call frame arrays are
+  // retained for reuse by later fibers.
+  //
+  // Creating a fiber normally allocates a fresh value stack and call frame
+  // array, which is a measurable cost for programs that spawn and discard
+  // fibers at a high rate. Pooled allocations let those fibers start on warm
+  // memory instead. Set this to zero to disable the pool.
+  int fiberPoolCapacity;
+
+  // The multiplier applied to a fiber's stack and call frame capacity when it
+  // runs out of room mid-execution.
+  //
+  // Growing a stack reallocates the whole array and fixes up every pointer
+  // into it, so deeply recursive fibers can pay for a storm of copies. The
+  // default of 2 doubles the capacity each time it fills; a larger factor
+  // trades memory for fewer reallocations. Values less than 2 are treated
+  // as 2.
+  int stackGrowthFactor;
+
+  // The callback invoked after each completed garbage collection, or NULL for
+  // none.
+  WrenGCCallbackFn gcCallbackFn;
+
+  // A soft upper bound, in bytes, that the collector tries to pace the heap
+  // toward.
+  //
+  // If zero (the default), the heap grows by [heapGrowthPercent] without
+  // bound. When non-zero, the collector stops scheduling growth past the
+  // limit and instead collects as the heap approaches it, trading collection
+  // time for a bounded footprint. The limit is soft: live data larger than
+  // the limit is never freed, and the heap keeps a little headroom above the
+  // live size so it doesn't collect on every allocation.
+  size_t softHeapLimit;
+
+  // The number of threads used to mark live objects during a full garbage
+  // collection.
+  //
+  // Only used when the VM is compiled with `WREN_PARALLEL_MARK`. If zero or
+  // one (the default), marking runs on the thread that triggered the
+  // collection. Larger values split the mark phase across that thread and
+  // markThreads - 1 short-lived helper threads, which shortens the pause of a
+  // large full collection roughly linearly with the thread count. Minor and
+  // incremental collections are unaffected: their pauses do little marking,
+  // so threads would cost more in coordination than they save.
+  //
+  // When this is greater than one, [reallocateFn] may be called from the
+  // helper threads while they mark, so it must be thread-safe. The default
+  // realloc-based allocator is.
+  int markThreads;
+
+  // An existing VM whose frozen core this VM should share, or NULL (the
+  // default) to compile a private copy of the core library as usual.
+  //
+  // The shared VM must have been passed to wrenFreezeCore() first. The new VM
+  // then references the donor's classes, compiled code, interned strings, and
+  // loaded modules directly instead of rebuilding them, which makes creating
+  // it cheap and keeps its private heap small. The donor must stay alive
+  // until every VM sharing it has been freed.
+  WrenVM* sharedCoreVM;
 } WrenConfiguration;
 
 typedef enum
@@ -237,9 +364,130 @@ void wrenFreeVM(WrenVM* vm);
 // Immediately run the garbage collector to free unused memory.
 void wrenCollectGarbage(WrenVM* vm);
 
+// Fills [stats] with a snapshot of the garbage collector's counters.
+void wrenGetGCStats(WrenVM* vm, WrenGCStats* stats);
+
+// Freezes every object [vm] currently owns -- the core library, plus any
+// modules it has loaded -- into a permanent read-only region so that other
+// VMs in the same process can share it.
+//
+// After freezing, create the sharing VMs by setting [sharedCoreVM] in their
+// configuration to [vm]. Frozen objects are exempt from every sharing VM's
+// garbage collector and are freed only when [vm] itself is freed, so [vm]
+// must outlive all of them.
+//
+// Call this once, after loading the modules to be shared and before creating
+// any VM that shares them. Shared modules must be loaded under their own
+// names (typically by importing them from the setup code): the "main" module
+// is per-VM scratch and is dropped by freezing, so anything defined directly
+// in it is collected rather than shared. A sharing VM imports a shared
+// module like any other loaded module -- the import resolves without
+// invoking [loadModuleFn] or re-running the module body.
+//
+// The frozen VM should not run code afterwards, and the shared modules must
+// not rely on mutating their top-level state: the sharing VMs see one copy,
+// and they may run on different threads.
+void wrenFreezeCore(WrenVM* vm);
+
+// Starts the sampling profiler, discarding any previously collected samples.
+// While it runs, the interpreter periodically records the function being
+// executed and aggregates the samples per function.
+void wrenProfilerStart(WrenVM* vm);
+
+// Stops the sampling profiler. The collected samples are kept until the
+// profiler is started again.
+void wrenProfilerStop(WrenVM* vm);
+
+// Writes a report of the profiler's collected samples -- one line per
+// function, ordered by sample count -- through the configured [writeFn].
+//
+// The same report is available from within Wren as `Profiler.report`.
+void wrenProfilerReport(WrenVM* vm);
+
+// Starts the heap profiler, discarding any previously collected allocation
+// sites. While it runs, every allocation is attributed to the Wren function
+// making it, which adds a small cost to each allocation.
+void wrenHeapProfilerStart(WrenVM* vm);
+
+// Stops the heap profiler. The collected allocation sites are kept until the
+// heap profiler is started again.
+void wrenHeapProfilerStop(WrenVM* vm);
+
+// Writes a report of the heap's current contents through the configured
+// [writeFn]: one line per object type with its live count and bytes, and --
+// if the heap profiler has collected any -- one line per allocation site
+// ordered by attributed bytes.
+//
+// The same report is available from within Wren as `Profiler.heapReport`.
+void wrenHeapReport(WrenVM* vm);
+
+// Limits how much code [vm] may execute before the running fiber fails with
+// "Execution budget exhausted." -- a runtime error that Fiber.try() can catch
+// like any other. [operations] is a budget of loop iterations and method
+// calls. The interpreter tests it on the same periodic countdown the sampling
+// profiler uses, so a budget costs nothing on top of the existing dispatch
+// and exhaustion is detected within about a thousand operations of the limit.
+//
+// An exhausted budget keeps failing fibers until the host sets a new one, so
+// a script can't catch the error and run on. A budget of zero removes the
+// limit.
+void wrenSetExecutionBudget(WrenVM* vm, uint64_t operations);
+
+// Limits how much managed memory [vm] may hold before the running fiber fails
+// with "Allocation budget exhausted.". The heap size is tested on the same
+// periodic countdown as the execution budget, so allocations can briefly
+// overshoot [bytes] before the error is raised. Unlike the execution budget,
+// the error stops recurring if enough memory is freed to drop back under the
+// limit. A budget of zero removes the limit.
+void wrenSetAllocationBudget(WrenVM* vm, size_t bytes);
+
 // Runs [source], a string of Wren source code in a new fiber in [vm].
 WrenInterpretResult wrenInterpret(WrenVM* vm, const char* source);
 
+// Compiles [source] as the body of a module named [module] and serializes the
+// compiled result -- bytecode, constants, and symbol tables -- into a
+// snapshot. Returns the snapshot and stores its size in bytes in [length], or
+// returns NULL if [source] has a compile error. The module's code is not run,
+// and the module is not registered with the VM.
+//
+// A snapshot can be passed anywhere module source code is expected, most
+// usefully returned from a [WrenLoadModuleFn], and is loaded without invoking
+// the compiler. Snapshots are relocatable between VMs that share the same
+// core configuration: loading merges the snapshot's method names into the
+// VM's method table and rewrites the bytecode's method symbols to match, so a
+// module compiled in one VM loads into another even if each has seen
+// different modules first. This allows a host to compile many modules in
+// parallel -- one worker VM per thread, each compiling its share of the
+// import graph to snapshots -- and link the results into the main VM by
+// simply loading them. The module's variable table must still match, which
+// holds when the VMs' core modules are configured identically. Loading also
+// verifies the bytecode itself, so a corrupt or hand-crafted function is
+// rejected at load time instead of executed. The snapshot's internal length
+// fields are still trusted, so a truncated buffer is not detected.
+//
+// The caller owns the returned buffer and must free it with
+// [wrenFreeSnapshot].
+char* wrenSnapshotModule(WrenVM* vm, const char* module, const char* source,
+                         size_t* length);
+
+// Releases a snapshot buffer previously returned by [wrenSnapshotModule].
+void wrenFreeSnapshot(WrenVM* vm, char* snapshot);
+
+// Reports one module [name] imported by the source passed to
+// [wrenScanImports].
+typedef void (*WrenScanImportFn)(WrenVM* vm, const char* name);
+
+// Lexes [source], a string of Wren source code, and calls [importFn] with the
+// name of every `import` found, without compiling or running anything. This
+// is the cheap first stage of a parallel compilation pipeline: scan each
+// module to discover the import graph, then compile independent modules
+// concurrently on worker VMs with [wrenSnapshotModule] and load the snapshots
+// here.
+//
+// Imports whose names are built with string interpolation can't be resolved
+// statically and are not reported. [importFn] must not run Wren code.
+void wrenScanImports(WrenVM* vm, const char* source, WrenScanImportFn importFn);
+
 // Creates a handle that can be used to invoke a method with [signature] on
 // using a receiver and arguments that are set up on the stack.
 //
@@ -262,6 +510,41 @@ WrenValue* wrenMakeCallHandle(WrenVM* vm, const char* signature);
 // After this returns, you can access the return value from slot 0 on the stack.
 WrenInterpretResult wrenCall(WrenVM* vm, WrenValue* method);
 
+// A reusable, primed invocation of a call handle. See [wrenPrepareCall].
+typedef struct WrenPreparedCall WrenPreparedCall;
+
+// Binds [method], a handle created by [wrenMakeCallHandle], into a call
+// object that keeps its own fiber, stack reservation, and slot layout set up
+// so that repeat invocations skip wrenCall()'s per-call prologue. Use this
+// when the same method is called from C in a hot loop.
+//
+// The prepared call's slots become the current slot array: put the receiver
+// in slot zero and the arguments after it, then invoke the call with
+// [wrenCallPrepared]. The call object holds its own references to everything
+// it needs, so [method] may be released independently of it.
+//
+// When you are done with the call, it must be released using
+// [wrenReleasePreparedCall].
+WrenPreparedCall* wrenPrepareCall(WrenVM* vm, WrenValue* method);
+
+// Invokes [call] using the receiver and arguments in its slots.
+//
+// After this returns, the return value is in slot 0 and the call is primed
+// again: a repeat invocation only needs its arguments written. Unlike
+// wrenCall(), a runtime error leaves the call in a usable state. If the slot
+// array has been pointed elsewhere in between -- by wrenEnsureSlots() or by
+// another prepared call -- re-select this call with [wrenLoadPreparedCall]
+// before setting up the arguments.
+WrenInterpretResult wrenCallPrepared(WrenVM* vm, WrenPreparedCall* call);
+
+// Makes [call]'s slots the current slot array again so that its receiver and
+// arguments can be set up.
+void wrenLoadPreparedCall(WrenVM* vm, WrenPreparedCall* call);
+
+// Releases [call] and the references it holds. After calling this, [call]
+// can no longer be used.
+void wrenReleasePreparedCall(WrenVM* vm, WrenPreparedCall* call);
+
 // Releases the reference stored in [value]. After calling this, [value] can no
 // longer be used.
 void wrenReleaseValue(WrenVM* vm, WrenValue* value);
@@ -314,6 +597,16 @@ int wrenGetSlotCount(WrenVM* vm);
 // It is an error to call this from a finalizer.
 void wrenEnsureSlots(WrenVM* vm, int numSlots);
 
+// Reserves capacity for at least [numSlots] stack slots and [numFrames] call
+// frames on the stack used by the C API and by wrenCall(), growing it now if
+// needed.
+//
+// Growing a stack mid-call reallocates the whole array and fixes up every
+// pointer into it. Reserving capacity up front lets latency-critical code
+// take that cost at a convenient time instead. Unlike wrenEnsureSlots(), this
+// does not change the number of slots in use.
+void wrenReserveStack(WrenVM* vm, int numSlots, int numFrames);
+
 // Gets the type of the object in [slot].
 WrenType wrenGetSlotType(WrenVM* vm, int slot);
 
@@ -339,6 +632,28 @@ const char* wrenGetSlotBytes(WrenVM* vm, int slot, int* length);
 // It is an error to call this if the slot does not contain a number.
 double wrenGetSlotDouble(WrenVM* vm, int slot);
 
+// Copies up to [capacity] elements of the list stored in [slot] into
+// [values] in one call, and returns the number of elements in the list.
+//
+// If the list has more than [capacity] elements, only the first [capacity]
+// are copied. Call again with a larger buffer if the returned count is
+// larger than the capacity that was passed.
+//
+// It is an error to call this if the slot does not contain a list, or if any
+// copied element is not a number.
+int wrenGetSlotDoubleList(WrenVM* vm, int slot, double* values, int capacity);
+
+// Reads a float array from [slot], returning a pointer to its first element
+// and storing the number of elements in [count].
+//
+// The pointer refers to the array's own storage, so the elements can be read
+// and written in place without copying. You cannot keep the pointer after
+// the foreign method returns, since the garbage collector may reclaim the
+// array.
+//
+// It is an error to call this if the slot does not contain a float array.
+double* wrenGetSlotFloatArray(WrenVM* vm, int slot, int* count);
+
 // Reads a foreign object from [slot] and returns a pointer to the foreign data
 // stored with it.
 //
@@ -393,9 +708,25 @@ void wrenSetSlotDouble(WrenVM* vm, int slot, double value);
 // Returns a pointer to the foreign object's data.
 void* wrenSetSlotNewForeign(WrenVM* vm, int slot, int classSlot, size_t size);
 
+// Stores a new float array of [count] zeroed elements in [slot].
+//
+// Returns a pointer to the first element so the caller can fill the array in
+// place. The same lifetime rules as [wrenGetSlotFloatArray()] apply.
+double* wrenSetSlotNewFloatArray(WrenVM* vm, int slot, int count);
+
+// Stores a new list containing the [count] numbers in [values] in [slot].
+//
+// The whole array is transferred in one call, so large payloads don't pay a
+// function call per element like repeated [wrenInsertInList()] would.
+void wrenSetSlotNewDoubleList(WrenVM* vm, int slot, const double* values,
+                              int count);
+
 // Stores a new empty list in [slot].
 void wrenSetSlotNewList(WrenVM* vm, int slot);
 
+// Stores a new empty string buffer in [slot].
+void wrenSetSlotNewStringBuffer(WrenVM* vm, int slot);
+
 // Stores null in [slot].
 void wrenSetSlotNull(WrenVM* vm, int slot);
 
@@ -412,6 +743,15 @@ void wrenSetSlotString(WrenVM* vm, int slot, const char* text);
 // This does not release the handle for the value.
 void wrenSetSlotValue(WrenVM* vm, int slot, WrenValue* value);
 
+// Returns the number of elements in the list stored in [slot].
+int wrenGetListCount(WrenVM* vm, int slot);
+
+// Reads element [index] from the list in [listSlot] and stores it in
+// [elementSlot].
+//
+// As in Wren, negative indexes can be used to read from the end.
+void wrenGetListElement(WrenVM* vm, int listSlot, int index, int elementSlot);
+
 // Takes the value stored at [elementSlot] and inserts it into the list stored
 // at [listSlot] at [index].
 //
@@ -419,6 +759,14 @@ void wrenSetSlotValue(WrenVM* vm, int slot, WrenValue* value);
 // an element, use `-1` for the index.
 void wrenInsertInList(WrenVM* vm, int listSlot, int index, int elementSlot);
 
+// Appends [length] bytes from [text] to the end of the string buffer stored
+// in [bufferSlot].
+//
+// The bytes are copied, so you can free memory used by [text] after this is
+// called.
+void wrenAppendToStringBuffer(WrenVM* vm, int bufferSlot, const char* text,
+                              size_t length);
+
 // Looks up the top level variable with [name] in [module] and stores it in
 // [slot].
 void wrenGetVariable(WrenVM* vm, const char* module, const char* name,
@@ -30,8 +30,22 @@ typedef struct sFileRequestData
 {
   WrenValue* fiber;
   uv_buf_t buffer;
+
+  // The allocated size of [buffer]'s storage. The buffer is grown on demand
+  // and kept alive with the pooled request so that repeated reads and writes
+  // reuse one allocation instead of paying a malloc/free per operation.
+  size_t bufferCapacity;
 } FileRequestData;
 
+// Completed requests (and their data and buffers) are recycled through this
+// pool instead of being freed. Reads in a loop — tailing a large file, say —
+// churn through requests quickly, and reusing them keeps the buffer warm so
+// each read costs a single copy into the VM and no allocation.
+#define REQUEST_POOL_SIZE 16
+
+static uv_fs_t* requestPool[REQUEST_POOL_SIZE];
+static int requestPoolCount = 0;
+
 static const int stdinDescriptor = 0;
 
 // Handle to the Stat class object.
@@ -46,6 +60,12 @@ static WrenValue* stdinOnData = NULL;
 // The stream used to read from stdin. Initialized on the first read.
 static uv_stream_t* stdinStream = NULL;
 
+// Reusable buffer for data read from stdin. libuv only has one read in
+// flight on the stream at a time, so a single buffer, grown on demand,
+// serves every read.
+static char* stdinBuffer = NULL;
+static size_t stdinBufferCapacity = 0;
+
 // Frees all resources related to stdin.
 static void shutdownStdin()
 {
@@ -55,7 +75,11 @@ static void shutdownStdin()
     free(stdinStream);
     stdinStream = NULL;
   }
-  
+
+  free(stdinBuffer);
+  stdinBuffer = NULL;
+  stdinBufferCapacity = 0;
+
   if (stdinClass != NULL)
   {
     wrenReleaseValue(getVM(), stdinClass);
@@ -72,16 +96,50 @@ static void shutdownStdin()
 void ioShutdown()
 {
   shutdownStdin();
-  
+
   if (statClass != NULL)
   {
     wrenReleaseValue(getVM(), statClass);
     statClass = NULL;
   }
+
+  // Free the pooled requests and their buffers.
+  for (int i = 0; i < requestPoolCount; i++)
+  {
+    FileRequestData* data = (FileRequestData*)requestPool[i]->data;
+    free(data->buffer.base);
+    free(data);
+    free(requestPool[i]);
+  }
+
+  requestPoolCount = 0;
+}
+
+// Returns [request] to the pool, or frees it (and its buffer) if the pool is
+// already full.
+//
+// The request's buffer survives pooling, so bytes captured from it remain
+// valid until the request is reused. Reuse can only happen once resumed Wren
+// code issues another file operation, which is always after the callback has
+// copied the bytes into the VM.
+static void recycleRequest(uv_fs_t* request)
+{
+  uv_fs_req_cleanup(request);
+
+  if (requestPoolCount < REQUEST_POOL_SIZE)
+  {
+    requestPool[requestPoolCount++] = request;
+    return;
+  }
+
+  FileRequestData* data = (FileRequestData*)request->data;
+  free(data->buffer.base);
+  free(data);
+  free(request);
 }
 
 // If [request] failed with an error, sends the runtime error to the VM and
-// frees the request.
+// recycles the request.
 //
 // Returns true if an error was reported.
 static bool handleRequestError(uv_fs_t* request)
@@ -90,42 +148,70 @@ static bool handleRequestError(uv_fs_t* request)
 
   FileRequestData* data = (FileRequestData*)request->data;
   WrenValue* fiber = (WrenValue*)data->fiber;
-  
+
   schedulerResumeError(fiber, uv_strerror((int)request->result));
-  
-  free(data);
-  uv_fs_req_cleanup(request);
-  free(request);
+
+  recycleRequest(request);
   return true;
 }
 
-// Allocates a new request that resumes [fiber] when it completes.
+// Gets a request that resumes [fiber] when it completes, reusing a pooled
+// one if available.
 uv_fs_t* createRequest(WrenValue* fiber)
 {
-  uv_fs_t* request = (uv_fs_t*)malloc(sizeof(uv_fs_t));
-  
-  FileRequestData* data = (FileRequestData*)malloc(sizeof(FileRequestData));
-  data->fiber = fiber;
-  
-  request->data = data;
+  uv_fs_t* request;
+  if (requestPoolCount > 0)
+  {
+    request = requestPool[--requestPoolCount];
+  }
+  else
+  {
+    request = (uv_fs_t*)malloc(sizeof(uv_fs_t));
+
+    FileRequestData* data = (FileRequestData*)malloc(sizeof(FileRequestData));
+    data->buffer.base = NULL;
+    data->buffer.len = 0;
+    data->bufferCapacity = 0;
+
+    request->data = data;
+  }
+
+  ((FileRequestData*)request->data)->fiber = fiber;
   return request;
 }
 
-// Releases resources used by [request].
+// Releases resources used by [request] back to the pool.
 //
 // Returns the fiber that should be resumed after [request] completes.
 WrenValue* freeRequest(uv_fs_t* request)
 {
   FileRequestData* data = (FileRequestData*)request->data;
   WrenValue* fiber = data->fiber;
-  
-  free(data);
-  uv_fs_req_cleanup(request);
-  free(request);
-  
+
+  recycleRequest(request);
+
   return fiber;
 }
 
+// Ensures [request]'s buffer can hold [length] bytes and returns its storage.
+//
+// The buffer only ever grows, so a request recycled through the pool serves
+// subsequent reads of the same size with no allocation at all.
+static char* requestBuffer(uv_fs_t* request, size_t length)
+{
+  FileRequestData* data = (FileRequestData*)request->data;
+
+  if (data->bufferCapacity < length)
+  {
+    // TODO: Handle allocation failure.
+    data->buffer.base = (char*)realloc(data->buffer.base, length);
+    data->bufferCapacity = length;
+  }
+
+  data->buffer.len = length;
+  return data->buffer.base;
+}
+
 static void directoryListCallback(uv_fs_t* request)
 {
   if (handleRequestError(request)) return;
@@ -289,15 +375,13 @@ static void fileReadBytesCallback(uv_fs_t* request)
   uv_buf_t buffer = data->buffer;
   size_t count = request->result;
 
-  // TODO: Having to copy the bytes here is a drag. It would be good if Wren's
-  // embedding API supported a way to *give* it bytes that were previously
-  // allocated using Wren's own allocator.
+  // The buffer stays valid across freeRequest(): the pooled request can't be
+  // reused until the resumed fiber runs, and that doesn't happen until
+  // schedulerFinishResume(), after the bytes have been copied into the VM.
+  // This is the only copy the bytes make on their way in.
   schedulerResume(freeRequest(request), true);
   wrenSetSlotBytes(getVM(), 2, buffer.base, count);
   schedulerFinishResume();
-
-  // TODO: Likewise, freeing this after we resume is lame.
-  free(buffer.base);
 }
 
 void fileReadBytes(WrenVM* vm)
@@ -311,8 +395,7 @@ void fileReadBytes(WrenVM* vm)
   size_t length = (size_t)wrenGetSlotDouble(vm, 1);
   size_t offset = (size_t)wrenGetSlotDouble(vm, 2);
 
-  data->buffer.len = length;
-  data->buffer.base = (char*)malloc(length);
+  requestBuffer(request, length);
 
   uv_fs_read(getLoop(), request, fd, &data->buffer, 1, offset,
              fileReadBytesCallback);
@@ -380,9 +463,6 @@ void fileSize(WrenVM* vm)
 static void fileWriteBytesCallback(uv_fs_t* request)
 {
   if (handleRequestError(request)) return;
- 
-  FileRequestData* data = (FileRequestData*)request->data;
-  free(data->buffer.base);
 
   schedulerResume(freeRequest(request), false);
 }
@@ -397,12 +477,9 @@ void fileWriteBytes(WrenVM* vm)
   
   FileRequestData* data = (FileRequestData*)request->data;
 
-  data->buffer.len = length;
   // TODO: Instead of copying, just create a WrenValue for the byte string and
   // hold on to it in the request until the write is done.
-  // TODO: Handle allocation failure.
-  data->buffer.base = (char*)malloc(length);
-  memcpy(data->buffer.base, bytes, length);
+  memcpy(requestBuffer(request, length), bytes, length);
 
   uv_fs_write(getLoop(), request, fd, &data->buffer, 1, offset,
               fileWriteBytesCallback);
@@ -490,8 +567,14 @@ void statIsFile(WrenVM* vm)
 static void allocCallback(uv_handle_t* handle, size_t suggestedSize,
                           uv_buf_t* buf)
 {
-  // TODO: Handle allocation failure.
-  buf->base = (char*)malloc(suggestedSize);
+  if (stdinBufferCapacity < suggestedSize)
+  {
+    // TODO: Handle allocation failure.
+    stdinBuffer = (char*)realloc(stdinBuffer, suggestedSize);
+    stdinBufferCapacity = suggestedSize;
+  }
+
+  buf->base = stdinBuffer;
   buf->len = suggestedSize;
 }
 
@@ -526,16 +609,12 @@ static void stdinReadCallback(uv_stream_t* stream, ssize_t numRead,
 
   // TODO: Handle other errors.
 
-  // TODO: Having to copy the bytes here is a drag. It would be good if Wren's
-  // embedding API supported a way to *give* it bytes that were previously
-  // allocated using Wren's own allocator.
+  // This copies the bytes out of the reusable buffer, which is then free for
+  // the next read.
   wrenEnsureSlots(vm, 2);
   wrenSetSlotValue(vm, 0, stdinClass);
   wrenSetSlotBytes(vm, 1, buffer->base, numRead);
   wrenCall(vm, stdinOnData);
-
-  // TODO: Likewise, freeing this after we resume is lame.
-  free(buffer->base);
 }
 
 void stdinReadStart(WrenVM* vm)
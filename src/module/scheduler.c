@@ -10,17 +10,48 @@
 // A handle to the "Scheduler" class object. Used to call static methods on it.
 static WrenValue* schedulerClass;
 
-// This method resumes a fiber that is suspended waiting on an asynchronous
-// operation. The first resumes it with zero arguments, and the second passes
-// one.
-static WrenValue* resume1;
-static WrenValue* resume2;
-static WrenValue* resumeError;
-
-static void resume(WrenValue* method)
+// This method drains the queue of completed operations, resuming each
+// waiting fiber in turn. Handing the whole batch to one call amortizes the
+// cost of entering the VM across every resumption in it.
+static WrenValue* drainCall;
+
+// A completed asynchronous operation whose fiber has not been resumed yet.
+typedef struct
+{
+  // The fiber to resume.
+  WrenValue* fiber;
+
+  // The value to resume it with, or NULL to resume with no argument. For an
+  // error resumption, this is the error message string.
+  WrenValue* argument;
+
+  bool isError;
+} Resumption;
+
+// Completions are queued here as libuv delivers them, then drained in one
+// batch once libuv has finished dispatching callbacks for the current loop
+// iteration. Entries are in completion order, popped from [queueHead].
+static Resumption* queue = NULL;
+static int queueHead = 0;
+static int queueCount = 0;
+static int queueCapacity = 0;
+
+// The fiber staged by schedulerResume() while its module stores the argument
+// on the stack.
+static WrenValue* pendingFiber = NULL;
+
+// Runs after libuv's callback phases each loop iteration and drains the
+// queue. The idle handle keeps the poll timeout at zero while resumptions
+// are waiting so a queued batch is never stuck behind a blocking poll.
+// Both are unreferenced so they don't hold the loop open on their own.
+static uv_check_t checkHandle;
+static uv_idle_t idleHandle;
+static bool watchersInitialized = false;
+
+static WrenInterpretResult resume(WrenValue* method)
 {
   WrenInterpretResult result = wrenCall(getVM(), method);
-  
+
   // If a runtime error occurs in response to an async operation and nothing
   // catches the error in the fiber, then exit the CLI.
   if (result == WREN_RESULT_RUNTIME_ERROR)
@@ -28,6 +59,72 @@ static void resume(WrenValue* method)
     uv_stop(getLoop());
     setExitCode(70); // EX_SOFTWARE.
   }
+
+  return result;
+}
+
+static void idleCallback(uv_idle_t* handle)
+{
+  // Does nothing: the handle is only active to keep the poll timeout at
+  // zero while the queue is non-empty.
+}
+
+static void checkCallback(uv_check_t* handle)
+{
+  if (queueCount == 0) return;
+
+  uv_idle_stop(&idleHandle);
+
+  // One call delivers the whole batch. A resumed fiber can die without
+  // yielding, which ends the call early, so keep calling until the queue
+  // is empty.
+  while (queueCount > 0)
+  {
+    WrenVM* vm = getVM();
+    wrenEnsureSlots(vm, 1);
+    wrenSetSlotValue(vm, 0, schedulerClass);
+    if (resume(drainCall) == WREN_RESULT_RUNTIME_ERROR) break;
+  }
+}
+
+// Adds a resumption to the queue to be delivered by the next drain.
+static void enqueueResumption(WrenValue* fiber, WrenValue* argument,
+                              bool isError)
+{
+  if (!watchersInitialized)
+  {
+    uv_check_init(getLoop(), &checkHandle);
+    uv_check_start(&checkHandle, checkCallback);
+    uv_unref((uv_handle_t*)&checkHandle);
+
+    uv_idle_init(getLoop(), &idleHandle);
+    uv_unref((uv_handle_t*)&idleHandle);
+    watchersInitialized = true;
+  }
+
+  // Compact or grow the queue if the tail has hit the end.
+  if (queueHead + queueCount == queueCapacity)
+  {
+    if (queueHead > 0)
+    {
+      memmove(queue, queue + queueHead, queueCount * sizeof(Resumption));
+      queueHead = 0;
+    }
+
+    if (queueCount == queueCapacity)
+    {
+      queueCapacity = queueCapacity == 0 ? 16 : queueCapacity * 2;
+      queue = (Resumption*)realloc(queue, queueCapacity * sizeof(Resumption));
+    }
+  }
+
+  Resumption* entry = &queue[queueHead + queueCount];
+  entry->fiber = fiber;
+  entry->argument = argument;
+  entry->isError = isError;
+  queueCount++;
+
+  uv_idle_start(&idleHandle, idleCallback);
 }
 
 void schedulerCaptureMethods(WrenVM* vm)
@@ -35,45 +132,110 @@ void schedulerCaptureMethods(WrenVM* vm)
   wrenEnsureSlots(vm, 1);
   wrenGetVariable(vm, "scheduler", "Scheduler", 0);
   schedulerClass = wrenGetSlotValue(vm, 0);
-  
-  resume1 = wrenMakeCallHandle(vm, "resume_(_)");
-  resume2 = wrenMakeCallHandle(vm, "resume_(_,_)");
-  resumeError = wrenMakeCallHandle(vm, "resumeError_(_,_)");
+
+  drainCall = wrenMakeCallHandle(vm, "drain_()");
+}
+
+// Pops the next queued resumption and returns it to Wren as a
+// [fiber, argument, isError] list, or null if the queue is empty.
+void schedulerNextReady(WrenVM* vm)
+{
+  if (queueCount == 0)
+  {
+    wrenSetSlotNull(vm, 0);
+    return;
+  }
+
+  Resumption entry = queue[queueHead];
+  queueHead++;
+  queueCount--;
+  if (queueCount == 0) queueHead = 0;
+
+  wrenEnsureSlots(vm, 2);
+  wrenSetSlotNewList(vm, 0);
+
+  wrenSetSlotValue(vm, 1, entry.fiber);
+  wrenReleaseValue(vm, entry.fiber);
+  wrenInsertInList(vm, 0, -1, 1);
+
+  if (entry.argument != NULL)
+  {
+    wrenSetSlotValue(vm, 1, entry.argument);
+    wrenReleaseValue(vm, entry.argument);
+  }
+  else
+  {
+    wrenSetSlotNull(vm, 1);
+  }
+  wrenInsertInList(vm, 0, -1, 1);
+
+  wrenSetSlotBool(vm, 1, entry.isError);
+  wrenInsertInList(vm, 0, -1, 1);
 }
 
 void schedulerResume(WrenValue* fiber, bool hasArgument)
 {
-  WrenVM* vm = getVM();
-  wrenEnsureSlots(vm, 2 + (hasArgument ? 1 : 0));
-  wrenSetSlotValue(vm, 0, schedulerClass);
-  wrenSetSlotValue(vm, 1, fiber);
-  wrenReleaseValue(vm, fiber);
-  
-  // If we don't need to wait for an argument to be stored on the stack, resume
-  // it now.
-  if (!hasArgument) resume(resume1);
+  wrenEnsureSlots(getVM(), 3);
+
+  // If the module needs to store an argument on the stack first, wait for
+  // schedulerFinishResume() to complete the entry.
+  if (hasArgument)
+  {
+    pendingFiber = fiber;
+    return;
+  }
+
+  enqueueResumption(fiber, NULL, false);
 }
 
 void schedulerFinishResume()
 {
-  resume(resume2);
+  WrenValue* argument = wrenGetSlotValue(getVM(), 2);
+  WrenValue* fiber = pendingFiber;
+  pendingFiber = NULL;
+
+  enqueueResumption(fiber, argument, false);
 }
 
 void schedulerResumeError(WrenValue* fiber, const char* error)
 {
   schedulerResume(fiber, true);
   wrenSetSlotString(getVM(), 2, error);
-  resume(resumeError);
+
+  WrenValue* argument = wrenGetSlotValue(getVM(), 2);
+  pendingFiber = NULL;
+
+  enqueueResumption(fiber, argument, true);
 }
 
 void schedulerShutdown()
 {
   // If the module was never loaded, we don't have anything to release.
   if (schedulerClass == NULL) return;
-  
+
   WrenVM* vm = getVM();
+
+  // Release any resumptions that never got delivered.
+  while (queueCount > 0)
+  {
+    Resumption* entry = &queue[queueHead];
+    wrenReleaseValue(vm, entry->fiber);
+    if (entry->argument != NULL) wrenReleaseValue(vm, entry->argument);
+    queueHead++;
+    queueCount--;
+  }
+
+  free(queue);
+  queue = NULL;
+  queueHead = queueCount = queueCapacity = 0;
+
+  if (watchersInitialized)
+  {
+    uv_close((uv_handle_t*)&checkHandle, NULL);
+    uv_close((uv_handle_t*)&idleHandle, NULL);
+    watchersInitialized = false;
+  }
+
   wrenReleaseValue(vm, schedulerClass);
-  wrenReleaseValue(vm, resume1);
-  wrenReleaseValue(vm, resume2);
-  wrenReleaseValue(vm, resumeError);
+  wrenReleaseValue(vm, drainCall);
 }
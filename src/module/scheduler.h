@@ -3,13 +3,13 @@
 
 #include "wren.h"
 
-// Sets up the API stack to call one of the resume methods on Scheduler.
+// Queues [fiber] to be resumed in the next batch of completed operations.
 //
-// If [hasArgument] is false, this just sets up the stack to have another
-// argument stored in slot 2 and returns. The module must store the argument
-// on the stack and then call [schedulerFinishResume] to complete the call.
+// If [hasArgument] is true, this just sets up the stack to have the argument
+// stored in slot 2 and returns. The module must store the argument on the
+// stack and then call [schedulerFinishResume] to complete the entry.
 //
-// Otherwise, the call resumes immediately. Releases [fiber] when called.
+// Takes ownership of [fiber] and releases it once the fiber is resumed.
 void schedulerResume(WrenValue* fiber, bool hasArgument);
 
 void schedulerFinishResume();
@@ -0,0 +1,658 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "uv.h"
+
+#include "scheduler.h"
+#include "socket.h"
+#include "vm.h"
+#include "wren.h"
+
+// The state for a TCP socket, shared between the Wren object and the libuv
+// callbacks. It is allocated separately from the Wren object so that libuv
+// can keep a stable pointer to it, and freed by the finalizer once the
+// handle is closed.
+typedef struct sTcpSocketData
+{
+  uv_tcp_t handle;
+
+  // The fiber waiting on the current connect, accept, read, flush, or close.
+  WrenValue* fiber;
+
+  uv_connect_t connectRequest;
+  uv_write_t writeRequest;
+
+  // Writes queued by write() but not yet flushed. Each entry points directly
+  // at the bytes of a Wren string, kept alive by the handle in [bufStrings],
+  // so batching doesn't copy: flush() hands the whole array to uv_write() as
+  // one vectored send.
+  uv_buf_t* bufs;
+  WrenValue** bufStrings;
+  int numBufs;
+  int bufCapacity;
+  size_t pendingBytes;
+
+  // Connections accepted while no fiber was waiting in accept(), in arrival
+  // order.
+  struct sTcpSocketData** pending;
+  int numPending;
+  int pendingCapacity;
+
+  bool closed;
+} TcpSocketData;
+
+// The state for a UDP socket.
+typedef struct
+{
+  uv_udp_t handle;
+
+  // The fiber waiting on the current send, receive, or close.
+  WrenValue* fiber;
+
+  uv_udp_send_t sendRequest;
+
+  // Keeps the datagram's bytes alive while the send is in flight.
+  WrenValue* sendString;
+
+  bool closed;
+} UdpSocketData;
+
+// Handle to the TcpSocket class object, used to wrap accepted connections.
+static WrenValue* tcpSocketClass = NULL;
+
+// Reusable buffer for data read from sockets. The bytes are copied into the
+// VM before the read callback returns, so one buffer, grown on demand,
+// serves every socket.
+static char* socketBuffer = NULL;
+static size_t socketBufferCapacity = 0;
+
+void socketShutdown()
+{
+  if (tcpSocketClass != NULL)
+  {
+    wrenReleaseValue(getVM(), tcpSocketClass);
+    tcpSocketClass = NULL;
+  }
+
+  free(socketBuffer);
+  socketBuffer = NULL;
+  socketBufferCapacity = 0;
+}
+
+// Allocates and initializes the shared state for a TCP socket.
+static TcpSocketData* newTcpSocketData()
+{
+  TcpSocketData* data = (TcpSocketData*)malloc(sizeof(TcpSocketData));
+  memset(data, 0, sizeof(TcpSocketData));
+
+  uv_tcp_init(getLoop(), &data->handle);
+  data->handle.data = data;
+  return data;
+}
+
+// Releases the handles for any queued but unflushed writes.
+static void releaseQueuedWrites(TcpSocketData* data)
+{
+  WrenVM* vm = getVM();
+  for (int i = 0; i < data->numBufs; i++)
+  {
+    wrenReleaseValue(vm, data->bufStrings[i]);
+  }
+
+  data->numBufs = 0;
+  data->pendingBytes = 0;
+}
+
+// Frees [data] and everything it owns. The handle must already be closed.
+static void freeTcpSocketData(TcpSocketData* data)
+{
+  for (int i = 0; i < data->numPending; i++)
+  {
+    // Accepted but never claimed connections die with the listener.
+    uv_close((uv_handle_t*)&data->pending[i]->handle, NULL);
+  }
+
+  free(data->bufs);
+  free(data->bufStrings);
+  free(data->pending);
+  free(data);
+}
+
+// Called by libuv when a handle closed by the finalizer finishes closing.
+static void tcpFinalizeCloseCallback(uv_handle_t* handle)
+{
+  freeTcpSocketData((TcpSocketData*)handle->data);
+}
+
+void tcpSocketAllocate(WrenVM* vm)
+{
+  TcpSocketData** data = (TcpSocketData**)wrenSetSlotNewForeign(
+      vm, 0, 0, sizeof(TcpSocketData*));
+  *data = newTcpSocketData();
+}
+
+void tcpSocketFinalize(void* data)
+{
+  TcpSocketData* socket = *(TcpSocketData**)data;
+
+  if (socket->closed)
+  {
+    freeTcpSocketData(socket);
+  }
+  else
+  {
+    uv_close((uv_handle_t*)&socket->handle, tcpFinalizeCloseCallback);
+  }
+}
+
+// Parses [host] and [port] from slots 1 and 2 into [address].
+//
+// On failure, stores an error string in slot 0 and returns false.
+static bool parseAddress(WrenVM* vm, struct sockaddr_in* address)
+{
+  const char* host = wrenGetSlotString(vm, 1);
+  int port = (int)wrenGetSlotDouble(vm, 2);
+
+  int error = uv_ip4_addr(host, port, address);
+  if (error >= 0) return true;
+
+  wrenSetSlotString(vm, 0, uv_strerror(error));
+  return false;
+}
+
+static void tcpConnectCallback(uv_connect_t* request, int status)
+{
+  TcpSocketData* data = (TcpSocketData*)request->data;
+  WrenValue* fiber = data->fiber;
+  data->fiber = NULL;
+
+  if (status < 0)
+  {
+    schedulerResumeError(fiber, uv_strerror(status));
+    return;
+  }
+
+  schedulerResume(fiber, false);
+}
+
+void tcpSocketConnect(WrenVM* vm)
+{
+  TcpSocketData* data = *(TcpSocketData**)wrenGetSlotForeign(vm, 0);
+
+  struct sockaddr_in address;
+  if (!parseAddress(vm, &address)) return;
+
+  data->fiber = wrenGetSlotValue(vm, 3);
+  data->connectRequest.data = data;
+  uv_tcp_connect(&data->connectRequest, &data->handle,
+                 (const struct sockaddr*)&address, tcpConnectCallback);
+
+  wrenSetSlotNull(vm, 0);
+}
+
+// Captures a handle to the TcpSocket class the first time it's needed, using
+// [slot] as scratch space.
+static void captureTcpSocketClass(WrenVM* vm, int slot)
+{
+  if (tcpSocketClass != NULL) return;
+
+  wrenGetVariable(vm, "socket", "TcpSocket", slot);
+  tcpSocketClass = wrenGetSlotValue(vm, slot);
+}
+
+// Wraps [data] in a new TcpSocket object stored in [slot].
+static void wrapTcpSocket(WrenVM* vm, int slot, TcpSocketData* data)
+{
+  captureTcpSocketClass(vm, slot);
+
+  wrenSetSlotValue(vm, slot, tcpSocketClass);
+  TcpSocketData** foreign = (TcpSocketData**)wrenSetSlotNewForeign(
+      vm, slot, slot, sizeof(TcpSocketData*));
+  *foreign = data;
+}
+
+static void tcpConnectionCallback(uv_stream_t* server, int status)
+{
+  TcpSocketData* data = (TcpSocketData*)server->data;
+
+  if (status < 0)
+  {
+    if (data->fiber != NULL)
+    {
+      WrenValue* fiber = data->fiber;
+      data->fiber = NULL;
+      schedulerResumeError(fiber, uv_strerror(status));
+    }
+
+    return;
+  }
+
+  TcpSocketData* client = newTcpSocketData();
+  uv_accept(server, (uv_stream_t*)&client->handle);
+
+  if (data->fiber != NULL)
+  {
+    // A fiber is blocked in accept(), so hand the connection straight to it.
+    WrenValue* fiber = data->fiber;
+    data->fiber = NULL;
+
+    WrenVM* vm = getVM();
+    schedulerResume(fiber, true);
+    wrapTcpSocket(vm, 2, client);
+    schedulerFinishResume();
+    return;
+  }
+
+  // No one is waiting, so queue it for a later accept() call.
+  if (data->numPending >= data->pendingCapacity)
+  {
+    data->pendingCapacity = data->pendingCapacity == 0
+        ? 4 : data->pendingCapacity * 2;
+    data->pending = (TcpSocketData**)realloc(data->pending,
+        data->pendingCapacity * sizeof(TcpSocketData*));
+  }
+
+  data->pending[data->numPending++] = client;
+}
+
+void tcpSocketListen(WrenVM* vm)
+{
+  TcpSocketData* data = *(TcpSocketData**)wrenGetSlotForeign(vm, 0);
+  int backlog = (int)wrenGetSlotDouble(vm, 3);
+
+  struct sockaddr_in address;
+  if (!parseAddress(vm, &address)) return;
+
+  int error = uv_tcp_bind(&data->handle, (const struct sockaddr*)&address, 0);
+  if (error < 0)
+  {
+    wrenSetSlotString(vm, 0, uv_strerror(error));
+    return;
+  }
+
+  error = uv_listen((uv_stream_t*)&data->handle, backlog,
+                    tcpConnectionCallback);
+  if (error < 0)
+  {
+    wrenSetSlotString(vm, 0, uv_strerror(error));
+    return;
+  }
+
+  wrenSetSlotNull(vm, 0);
+}
+
+void tcpSocketAccept(WrenVM* vm)
+{
+  TcpSocketData* data = *(TcpSocketData**)wrenGetSlotForeign(vm, 0);
+
+  if (data->numPending > 0)
+  {
+    // A connection arrived before we got here, so return it immediately.
+    TcpSocketData* client = data->pending[0];
+    data->numPending--;
+    memmove(data->pending, data->pending + 1,
+            data->numPending * sizeof(TcpSocketData*));
+
+    wrapTcpSocket(vm, 0, client);
+    return;
+  }
+
+  data->fiber = wrenGetSlotValue(vm, 1);
+  wrenSetSlotNull(vm, 0);
+}
+
+static void socketAllocCallback(uv_handle_t* handle, size_t suggestedSize,
+                                uv_buf_t* buf)
+{
+  if (socketBufferCapacity < suggestedSize)
+  {
+    // TODO: Handle allocation failure.
+    socketBuffer = (char*)realloc(socketBuffer, suggestedSize);
+    socketBufferCapacity = suggestedSize;
+  }
+
+  buf->base = socketBuffer;
+  buf->len = suggestedSize;
+}
+
+static void tcpReadCallback(uv_stream_t* stream, ssize_t numRead,
+                            const uv_buf_t* buffer)
+{
+  // libuv may invoke this with nothing to report.
+  if (numRead == 0) return;
+
+  TcpSocketData* data = (TcpSocketData*)stream->data;
+
+  // One chunk per read() call: stopping here is what lets a slow consumer
+  // push back on the sender.
+  uv_read_stop(stream);
+
+  WrenValue* fiber = data->fiber;
+  data->fiber = NULL;
+
+  if (numRead == UV_EOF)
+  {
+    schedulerResume(fiber, true);
+    wrenSetSlotNull(getVM(), 2);
+    schedulerFinishResume();
+    return;
+  }
+
+  if (numRead < 0)
+  {
+    schedulerResumeError(fiber, uv_strerror((int)numRead));
+    return;
+  }
+
+  schedulerResume(fiber, true);
+  wrenSetSlotBytes(getVM(), 2, buffer->base, numRead);
+  schedulerFinishResume();
+}
+
+void tcpSocketRead(WrenVM* vm)
+{
+  TcpSocketData* data = *(TcpSocketData**)wrenGetSlotForeign(vm, 0);
+  WrenValue* fiber = wrenGetSlotValue(vm, 1);
+
+  int error = uv_read_start((uv_stream_t*)&data->handle, socketAllocCallback,
+                            tcpReadCallback);
+  if (error < 0)
+  {
+    wrenReleaseValue(vm, fiber);
+    wrenSetSlotString(vm, 0, uv_strerror(error));
+    return;
+  }
+
+  data->fiber = fiber;
+  wrenSetSlotNull(vm, 0);
+}
+
+void tcpSocketWrite(WrenVM* vm)
+{
+  TcpSocketData* data = *(TcpSocketData**)wrenGetSlotForeign(vm, 0);
+
+  int length;
+  const char* bytes = wrenGetSlotBytes(vm, 1, &length);
+
+  if (data->numBufs >= data->bufCapacity)
+  {
+    data->bufCapacity = data->bufCapacity == 0 ? 4 : data->bufCapacity * 2;
+    data->bufs = (uv_buf_t*)realloc(data->bufs,
+        data->bufCapacity * sizeof(uv_buf_t));
+    data->bufStrings = (WrenValue**)realloc(data->bufStrings,
+        data->bufCapacity * sizeof(WrenValue*));
+  }
+
+  // Point directly at the string's bytes. The handle keeps the string alive
+  // (and, since the GC doesn't move objects, its bytes in place) until the
+  // flush completes, so queueing doesn't copy.
+  data->bufs[data->numBufs].base = (char*)bytes;
+  data->bufs[data->numBufs].len = length;
+  data->bufStrings[data->numBufs] = wrenGetSlotValue(vm, 1);
+  data->numBufs++;
+  data->pendingBytes += length;
+}
+
+static void tcpWriteCallback(uv_write_t* request, int status)
+{
+  TcpSocketData* data = (TcpSocketData*)request->data;
+
+  releaseQueuedWrites(data);
+
+  WrenValue* fiber = data->fiber;
+  data->fiber = NULL;
+
+  if (status < 0)
+  {
+    schedulerResumeError(fiber, uv_strerror(status));
+    return;
+  }
+
+  schedulerResume(fiber, false);
+}
+
+void tcpSocketFlush(WrenVM* vm)
+{
+  TcpSocketData* data = *(TcpSocketData**)wrenGetSlotForeign(vm, 0);
+
+  if (data->numBufs == 0)
+  {
+    wrenSetSlotBool(vm, 0, true);
+    return;
+  }
+
+  WrenValue* fiber = wrenGetSlotValue(vm, 1);
+
+  data->writeRequest.data = data;
+  int error = uv_write(&data->writeRequest, (uv_stream_t*)&data->handle,
+                       data->bufs, data->numBufs, tcpWriteCallback);
+  if (error < 0)
+  {
+    wrenReleaseValue(vm, fiber);
+    releaseQueuedWrites(data);
+    wrenSetSlotString(vm, 0, uv_strerror(error));
+    return;
+  }
+
+  data->fiber = fiber;
+  wrenSetSlotBool(vm, 0, false);
+}
+
+void tcpSocketPendingBytes(WrenVM* vm)
+{
+  TcpSocketData* data = *(TcpSocketData**)wrenGetSlotForeign(vm, 0);
+  wrenSetSlotDouble(vm, 0, (double)data->pendingBytes);
+}
+
+void tcpSocketIsOpen(WrenVM* vm)
+{
+  TcpSocketData* data = *(TcpSocketData**)wrenGetSlotForeign(vm, 0);
+  wrenSetSlotBool(vm, 0, !data->closed);
+}
+
+static void tcpCloseCallback(uv_handle_t* handle)
+{
+  TcpSocketData* data = (TcpSocketData*)handle->data;
+
+  WrenValue* fiber = data->fiber;
+  data->fiber = NULL;
+
+  schedulerResume(fiber, false);
+}
+
+void tcpSocketClose(WrenVM* vm)
+{
+  TcpSocketData* data = *(TcpSocketData**)wrenGetSlotForeign(vm, 0);
+
+  // If it's already closed, we're done.
+  if (data->closed)
+  {
+    wrenSetSlotBool(vm, 0, true);
+    return;
+  }
+
+  data->closed = true;
+  releaseQueuedWrites(data);
+
+  data->fiber = wrenGetSlotValue(vm, 1);
+  uv_close((uv_handle_t*)&data->handle, tcpCloseCallback);
+  wrenSetSlotBool(vm, 0, false);
+}
+
+// Called by libuv when a handle closed by the finalizer finishes closing.
+static void udpFinalizeCloseCallback(uv_handle_t* handle)
+{
+  free(handle->data);
+}
+
+void udpSocketAllocate(WrenVM* vm)
+{
+  UdpSocketData** foreign = (UdpSocketData**)wrenSetSlotNewForeign(
+      vm, 0, 0, sizeof(UdpSocketData*));
+
+  UdpSocketData* data = (UdpSocketData*)malloc(sizeof(UdpSocketData));
+  memset(data, 0, sizeof(UdpSocketData));
+
+  uv_udp_init(getLoop(), &data->handle);
+  data->handle.data = data;
+  *foreign = data;
+}
+
+void udpSocketFinalize(void* data)
+{
+  UdpSocketData* socket = *(UdpSocketData**)data;
+
+  if (socket->closed)
+  {
+    free(socket);
+  }
+  else
+  {
+    uv_close((uv_handle_t*)&socket->handle, udpFinalizeCloseCallback);
+  }
+}
+
+void udpSocketBind(WrenVM* vm)
+{
+  UdpSocketData* data = *(UdpSocketData**)wrenGetSlotForeign(vm, 0);
+
+  struct sockaddr_in address;
+  if (!parseAddress(vm, &address)) return;
+
+  int error = uv_udp_bind(&data->handle, (const struct sockaddr*)&address, 0);
+  if (error < 0)
+  {
+    wrenSetSlotString(vm, 0, uv_strerror(error));
+    return;
+  }
+
+  wrenSetSlotNull(vm, 0);
+}
+
+static void udpSendCallback(uv_udp_send_t* request, int status)
+{
+  UdpSocketData* data = (UdpSocketData*)request->data;
+
+  wrenReleaseValue(getVM(), data->sendString);
+  data->sendString = NULL;
+
+  WrenValue* fiber = data->fiber;
+  data->fiber = NULL;
+
+  if (status < 0)
+  {
+    schedulerResumeError(fiber, uv_strerror(status));
+    return;
+  }
+
+  schedulerResume(fiber, false);
+}
+
+void udpSocketSend(WrenVM* vm)
+{
+  UdpSocketData* data = *(UdpSocketData**)wrenGetSlotForeign(vm, 0);
+
+  int length;
+  const char* bytes = wrenGetSlotBytes(vm, 1, &length);
+  const char* host = wrenGetSlotString(vm, 2);
+  int port = (int)wrenGetSlotDouble(vm, 3);
+
+  struct sockaddr_in address;
+  int error = uv_ip4_addr(host, port, &address);
+  if (error < 0)
+  {
+    wrenSetSlotString(vm, 0, uv_strerror(error));
+    return;
+  }
+
+  // Like TCP writes, the datagram points at the string's bytes and the
+  // handle keeps them alive until the send completes.
+  uv_buf_t buffer;
+  buffer.base = (char*)bytes;
+  buffer.len = length;
+
+  data->sendString = wrenGetSlotValue(vm, 1);
+  data->fiber = wrenGetSlotValue(vm, 4);
+  data->sendRequest.data = data;
+
+  uv_udp_send(&data->sendRequest, &data->handle, &buffer, 1,
+              (const struct sockaddr*)&address, udpSendCallback);
+
+  wrenSetSlotNull(vm, 0);
+}
+
+static void udpReceiveCallback(uv_udp_t* handle, ssize_t numRead,
+                               const uv_buf_t* buffer,
+                               const struct sockaddr* address, unsigned flags)
+{
+  // libuv may invoke this with nothing to report.
+  if (numRead == 0 && address == NULL) return;
+
+  UdpSocketData* data = (UdpSocketData*)handle->data;
+
+  uv_udp_recv_stop(handle);
+
+  WrenValue* fiber = data->fiber;
+  data->fiber = NULL;
+
+  if (numRead < 0)
+  {
+    schedulerResumeError(fiber, uv_strerror((int)numRead));
+    return;
+  }
+
+  schedulerResume(fiber, true);
+  wrenSetSlotBytes(getVM(), 2, buffer->base, numRead);
+  schedulerFinishResume();
+}
+
+void udpSocketReceive(WrenVM* vm)
+{
+  UdpSocketData* data = *(UdpSocketData**)wrenGetSlotForeign(vm, 0);
+  WrenValue* fiber = wrenGetSlotValue(vm, 1);
+
+  int error = uv_udp_recv_start(&data->handle, socketAllocCallback,
+                                udpReceiveCallback);
+  if (error < 0)
+  {
+    wrenReleaseValue(vm, fiber);
+    wrenSetSlotString(vm, 0, uv_strerror(error));
+    return;
+  }
+
+  data->fiber = fiber;
+  wrenSetSlotNull(vm, 0);
+}
+
+void udpSocketIsOpen(WrenVM* vm)
+{
+  UdpSocketData* data = *(UdpSocketData**)wrenGetSlotForeign(vm, 0);
+  wrenSetSlotBool(vm, 0, !data->closed);
+}
+
+static void udpCloseCallback(uv_handle_t* handle)
+{
+  UdpSocketData* data = (UdpSocketData*)handle->data;
+
+  WrenValue* fiber = data->fiber;
+  data->fiber = NULL;
+
+  schedulerResume(fiber, false);
+}
+
+void udpSocketClose(WrenVM* vm)
+{
+  UdpSocketData* data = *(UdpSocketData**)wrenGetSlotForeign(vm, 0);
+
+  // If it's already closed, we're done.
+  if (data->closed)
+  {
+    wrenSetSlotBool(vm, 0, true);
+    return;
+  }
+
+  data->closed = true;
+  data->fiber = wrenGetSlotValue(vm, 1);
+  uv_close((uv_handle_t*)&data->handle, udpCloseCallback);
+  wrenSetSlotBool(vm, 0, false);
+}
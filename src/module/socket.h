@@ -0,0 +1,9 @@
+#ifndef socket_h
+#define socket_h
+
+#include "wren.h"
+
+// Frees up any pending resources in use by the socket module.
+void socketShutdown();
+
+#endif
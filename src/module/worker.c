@@ -0,0 +1,524 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "uv.h"
+
+#include "modules.h"
+#include "wren.h"
+
+// How deeply lists in a message may nest. Messages are copied (and freed)
+// with one level of C recursion per nesting level, so the depth is capped to
+// keep a deeply nested -- or cyclic, and therefore infinitely deep -- list
+// from overflowing the native stack. The Wren side rejects such values with
+// the same cap before calling in; this is a backstop for direct calls to the
+// private foreign methods.
+#define MAX_MESSAGE_DEPTH 64
+
+// The kinds of value that can be copied between VMs.
+typedef enum
+{
+  MSG_NULL,
+  MSG_BOOL,
+  MSG_NUM,
+  MSG_STRING,
+  MSG_LIST
+} MessageType;
+
+// A value that has been copied out of the sending VM's heap so that a VM on
+// another thread can read it without the two racing.
+typedef struct Message
+{
+  MessageType type;
+
+  union
+  {
+    bool boolean;
+    double num;
+
+    struct
+    {
+      char* bytes;
+      int length;
+    } string;
+
+    struct
+    {
+      struct Message* elements;
+      int count;
+    } list;
+  } as;
+} Message;
+
+typedef struct MessageNode
+{
+  Message message;
+  struct MessageNode* next;
+} MessageNode;
+
+// A thread-safe FIFO of messages. Once closed, pushes are rejected and pops
+// return false instead of blocking.
+typedef struct
+{
+  uv_mutex_t mutex;
+  uv_cond_t notEmpty;
+
+  MessageNode* head;
+  MessageNode* tail;
+
+  bool closed;
+} MessageQueue;
+
+typedef struct
+{
+  uv_thread_t thread;
+
+  // The source code of the worker's main module.
+  char* source;
+
+  // Messages from the parent to the worker.
+  MessageQueue inbox;
+
+  // Messages from the worker to the parent.
+  MessageQueue outbox;
+
+  // The exit code the worker's script would have exited the CLI with. Only
+  // valid after the thread has been joined.
+  int exitCode;
+
+  bool joined;
+} Worker;
+
+// The worker owning the current thread, or NULL on the main thread.
+static uv_once_t workerKeyOnce = UV_ONCE_INIT;
+static uv_key_t workerKey;
+
+static void createWorkerKey()
+{
+  uv_key_create(&workerKey);
+}
+
+static Worker* currentWorker()
+{
+  uv_once(&workerKeyOnce, createWorkerKey);
+  return (Worker*)uv_key_get(&workerKey);
+}
+
+// Frees the memory owned by [message]. The recursion is bounded because
+// readMessage() never builds a message deeper than MAX_MESSAGE_DEPTH.
+static void freeMessage(Message* message)
+{
+  switch (message->type)
+  {
+    case MSG_STRING:
+      free(message->as.string.bytes);
+      break;
+
+    case MSG_LIST:
+      for (int i = 0; i < message->as.list.count; i++)
+      {
+        freeMessage(&message->as.list.elements[i]);
+      }
+      free(message->as.list.elements);
+      break;
+
+    default: break;
+  }
+}
+
+static void queueInit(MessageQueue* queue)
+{
+  uv_mutex_init(&queue->mutex);
+  uv_cond_init(&queue->notEmpty);
+  queue->head = NULL;
+  queue->tail = NULL;
+  queue->closed = false;
+}
+
+// Appends [message] to [queue], taking ownership of its memory. Returns false
+// (and frees the message) if the queue has been closed.
+static bool queuePush(MessageQueue* queue, Message* message)
+{
+  MessageNode* node = (MessageNode*)malloc(sizeof(MessageNode));
+  node->message = *message;
+  node->next = NULL;
+
+  uv_mutex_lock(&queue->mutex);
+  if (queue->closed)
+  {
+    uv_mutex_unlock(&queue->mutex);
+    freeMessage(&node->message);
+    free(node);
+    return false;
+  }
+
+  if (queue->tail == NULL)
+  {
+    queue->head = node;
+  }
+  else
+  {
+    queue->tail->next = node;
+  }
+  queue->tail = node;
+
+  uv_cond_signal(&queue->notEmpty);
+  uv_mutex_unlock(&queue->mutex);
+  return true;
+}
+
+// Removes the oldest message from [queue] into [message], blocking while the
+// queue is empty. Returns false if the queue was closed and drained.
+static bool queuePop(MessageQueue* queue, Message* message)
+{
+  uv_mutex_lock(&queue->mutex);
+  while (queue->head == NULL && !queue->closed)
+  {
+    uv_cond_wait(&queue->notEmpty, &queue->mutex);
+  }
+
+  MessageNode* node = queue->head;
+  if (node == NULL)
+  {
+    uv_mutex_unlock(&queue->mutex);
+    return false;
+  }
+
+  queue->head = node->next;
+  if (queue->head == NULL) queue->tail = NULL;
+  uv_mutex_unlock(&queue->mutex);
+
+  *message = node->message;
+  free(node);
+  return true;
+}
+
+// Marks [queue] closed and wakes every thread blocked on it.
+static void queueClose(MessageQueue* queue)
+{
+  uv_mutex_lock(&queue->mutex);
+  queue->closed = true;
+  uv_cond_broadcast(&queue->notEmpty);
+  uv_mutex_unlock(&queue->mutex);
+}
+
+static void queueDestroy(MessageQueue* queue)
+{
+  MessageNode* node = queue->head;
+  while (node != NULL)
+  {
+    MessageNode* next = node->next;
+    freeMessage(&node->message);
+    free(node);
+    node = next;
+  }
+
+  uv_cond_destroy(&queue->notEmpty);
+  uv_mutex_destroy(&queue->mutex);
+}
+
+// Deep-copies the value in [slot] out of [vm] into [message]. The value must
+// be copyable; the Wren side validates that before calling into here.
+//
+// Returns false if the value nests deeper than MAX_MESSAGE_DEPTH. The message
+// is then truncated at the point the cap was hit but still safe to pass to
+// freeMessage(), which the caller must do instead of sending it.
+static bool readMessage(WrenVM* vm, int slot, Message* message, int depth)
+{
+  switch (wrenGetSlotType(vm, slot))
+  {
+    case WREN_TYPE_BOOL:
+      message->type = MSG_BOOL;
+      message->as.boolean = wrenGetSlotBool(vm, slot);
+      break;
+
+    case WREN_TYPE_NUM:
+      message->type = MSG_NUM;
+      message->as.num = wrenGetSlotDouble(vm, slot);
+      break;
+
+    case WREN_TYPE_STRING:
+    {
+      int length;
+      const char* bytes = wrenGetSlotBytes(vm, slot, &length);
+      message->type = MSG_STRING;
+      message->as.string.bytes = (char*)malloc(length + 1);
+      memcpy(message->as.string.bytes, bytes, length);
+      message->as.string.bytes[length] = '\0';
+      message->as.string.length = length;
+      break;
+    }
+
+    case WREN_TYPE_LIST:
+    {
+      if (depth >= MAX_MESSAGE_DEPTH)
+      {
+        message->type = MSG_NULL;
+        return false;
+      }
+
+      int count = wrenGetListCount(vm, slot);
+      message->type = MSG_LIST;
+      message->as.list.count = count;
+      message->as.list.elements =
+          count == 0 ? NULL : (Message*)malloc(sizeof(Message) * count);
+
+      int scratch = wrenGetSlotCount(vm);
+      wrenEnsureSlots(vm, scratch + 1);
+      for (int i = 0; i < count; i++)
+      {
+        wrenGetListElement(vm, slot, i, scratch);
+        if (!readMessage(vm, scratch, &message->as.list.elements[i], depth + 1))
+        {
+          // Forget the unread elements so the copied prefix can be freed.
+          message->as.list.count = i + 1;
+          return false;
+        }
+      }
+      break;
+    }
+
+    default:
+      message->type = MSG_NULL;
+      break;
+  }
+
+  return true;
+}
+
+// Recreates [message] as a value in [slot] of [vm]. The recursion is bounded
+// because readMessage() never builds a message deeper than MAX_MESSAGE_DEPTH.
+static void writeMessage(WrenVM* vm, int slot, Message* message)
+{
+  switch (message->type)
+  {
+    case MSG_NULL:
+      wrenSetSlotNull(vm, slot);
+      break;
+
+    case MSG_BOOL:
+      wrenSetSlotBool(vm, slot, message->as.boolean);
+      break;
+
+    case MSG_NUM:
+      wrenSetSlotDouble(vm, slot, message->as.num);
+      break;
+
+    case MSG_STRING:
+      wrenSetSlotBytes(vm, slot, message->as.string.bytes,
+                       message->as.string.length);
+      break;
+
+    case MSG_LIST:
+    {
+      wrenSetSlotNewList(vm, slot);
+
+      int scratch = wrenGetSlotCount(vm);
+      wrenEnsureSlots(vm, scratch + 1);
+      for (int i = 0; i < message->as.list.count; i++)
+      {
+        writeMessage(vm, scratch, &message->as.list.elements[i]);
+        wrenInsertInList(vm, slot, i, scratch);
+      }
+      break;
+    }
+  }
+}
+
+// Takes the popped [message], wraps it in a single-element list in slot 0,
+// and frees it. The wrapper makes a received null distinguishable from a
+// closed channel.
+static void returnReceived(WrenVM* vm, Message* message)
+{
+  wrenEnsureSlots(vm, 2);
+  wrenSetSlotNewList(vm, 0);
+  writeMessage(vm, 1, message);
+  wrenInsertInList(vm, 0, 0, 1);
+  freeMessage(message);
+}
+
+static void workerWrite(WrenVM* vm, const char* text)
+{
+  printf("%s", text);
+  fflush(stdout);
+}
+
+static void workerReportError(WrenErrorType type,
+                              const char* module, int line,
+                              const char* message)
+{
+  switch (type)
+  {
+    case WREN_ERROR_COMPILE:
+      fprintf(stderr, "[%s line %d] %s\n", module, line, message);
+      break;
+
+    case WREN_ERROR_RUNTIME:
+      fprintf(stderr, "%s\n", message);
+      break;
+
+    case WREN_ERROR_STACK_TRACE:
+      fprintf(stderr, "[%s line %d] in %s\n", module, line, message);
+      break;
+  }
+}
+
+// Workers only see the built-in modules: loading from disk would race with
+// the main thread's notion of the root directory.
+static char* workerLoadModule(WrenVM* vm, const char* name)
+{
+  return readBuiltInModule(name);
+}
+
+// The entrypoint for a worker's thread. Runs the worker's source in a VM and
+// event loop owned entirely by this thread.
+static void workerEntry(void* arg)
+{
+  Worker* worker = (Worker*)arg;
+  uv_once(&workerKeyOnce, createWorkerKey);
+  uv_key_set(&workerKey, worker);
+
+  uv_loop_t loop;
+  uv_loop_init(&loop);
+
+  WrenConfiguration config;
+  wrenInitConfiguration(&config);
+  config.bindForeignMethodFn = bindBuiltInForeignMethod;
+  config.bindForeignClassFn = bindBuiltInForeignClass;
+  config.loadModuleFn = workerLoadModule;
+  config.writeFn = workerWrite;
+  config.errorFn = workerReportError;
+
+  WrenVM* vm = wrenNewVM(&config);
+  WrenInterpretResult result = wrenInterpret(vm, worker->source);
+
+  if (result == WREN_RESULT_SUCCESS) uv_run(&loop, UV_RUN_DEFAULT);
+
+  wrenFreeVM(vm);
+  uv_loop_close(&loop);
+
+  worker->exitCode = result == WREN_RESULT_COMPILE_ERROR ? 65 // EX_DATAERR.
+      : result == WREN_RESULT_RUNTIME_ERROR ? 70 // EX_SOFTWARE.
+      : 0;
+
+  // The worker will produce no more messages and read no more, so wake
+  // anything blocked on its channels.
+  queueClose(&worker->outbox);
+  queueClose(&worker->inbox);
+}
+
+void workerAllocate(WrenVM* vm)
+{
+  const char* source = wrenGetSlotString(vm, 1);
+
+  Worker* worker = (Worker*)malloc(sizeof(Worker));
+  size_t length = strlen(source);
+  worker->source = (char*)malloc(length + 1);
+  memcpy(worker->source, source, length + 1);
+  worker->exitCode = 0;
+  worker->joined = false;
+  queueInit(&worker->inbox);
+  queueInit(&worker->outbox);
+
+  Worker** data = (Worker**)wrenSetSlotNewForeign(vm, 0, 0, sizeof(Worker*));
+  *data = worker;
+
+  uv_thread_create(&worker->thread, workerEntry, worker);
+}
+
+void workerFinalize(void* data)
+{
+  Worker* worker = *(Worker**)data;
+
+  // Closing the inbox wakes the worker if it is blocked on receive, so the
+  // thread is guaranteed to finish.
+  queueClose(&worker->inbox);
+  if (!worker->joined) uv_thread_join(&worker->thread);
+
+  queueDestroy(&worker->inbox);
+  queueDestroy(&worker->outbox);
+  free(worker->source);
+  free(worker);
+}
+
+void workerSend(WrenVM* vm)
+{
+  Worker* worker = *(Worker**)wrenGetSlotForeign(vm, 0);
+
+  Message message;
+  if (!readMessage(vm, 1, &message, 0))
+  {
+    // Too deeply nested. Return null so the Wren side aborts with a type
+    // error distinct from a closed channel.
+    freeMessage(&message);
+    wrenSetSlotNull(vm, 0);
+    return;
+  }
+
+  wrenSetSlotBool(vm, 0, queuePush(&worker->inbox, &message));
+}
+
+void workerReceive(WrenVM* vm)
+{
+  Worker* worker = *(Worker**)wrenGetSlotForeign(vm, 0);
+
+  Message message;
+  if (!queuePop(&worker->outbox, &message))
+  {
+    wrenSetSlotNull(vm, 0);
+    return;
+  }
+
+  returnReceived(vm, &message);
+}
+
+void workerJoin(WrenVM* vm)
+{
+  Worker* worker = *(Worker**)wrenGetSlotForeign(vm, 0);
+
+  if (!worker->joined)
+  {
+    uv_thread_join(&worker->thread);
+    worker->joined = true;
+  }
+
+  wrenSetSlotDouble(vm, 0, worker->exitCode);
+}
+
+void workerInWorker(WrenVM* vm)
+{
+  wrenSetSlotBool(vm, 0, currentWorker() != NULL);
+}
+
+void workerSendToParent(WrenVM* vm)
+{
+  Worker* worker = currentWorker();
+  if (worker == NULL)
+  {
+    wrenSetSlotBool(vm, 0, false);
+    return;
+  }
+
+  Message message;
+  if (!readMessage(vm, 1, &message, 0))
+  {
+    freeMessage(&message);
+    wrenSetSlotNull(vm, 0);
+    return;
+  }
+
+  wrenSetSlotBool(vm, 0, queuePush(&worker->outbox, &message));
+}
+
+void workerReceiveFromParent(WrenVM* vm)
+{
+  Worker* worker = currentWorker();
+  Message message;
+  if (worker == NULL || !queuePop(&worker->inbox, &message))
+  {
+    wrenSetSlotNull(vm, 0);
+    return;
+  }
+
+  returnReceived(vm, &message);
+}
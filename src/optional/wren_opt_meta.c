@@ -7,6 +7,27 @@
 #include "wren_vm.h"
 #include "wren_opt_meta.wren.inc"
 
+// One compiled eval() snippet.
+//
+// Strings are interned, so two sources with the same contents are the same
+// ObjString and a cache lookup is just a pointer comparison. Holding the
+// source through a handle keeps it interned, which guarantees later equal
+// sources resolve to the same pointer.
+struct MetaCacheEntry
+{
+  // The module the snippet was compiled in. Compilation resolves module-level
+  // variables against the calling module, so the same source compiled from
+  // two different modules can't share an entry. Modules are never unloaded,
+  // so the bare pointer stays valid.
+  ObjModule* module;
+
+  // The snippet's source string.
+  WrenValue* source;
+
+  // The compiled closure for the snippet.
+  WrenValue* closure;
+};
+
 void metaCompile(WrenVM* vm)
 {
   // Evaluate the code in the module where the calling function was defined.
@@ -15,21 +36,68 @@ void metaCompile(WrenVM* vm)
   ObjClosure* caller = vm->fiber->frames[vm->fiber->numFrames - 2].closure;
   ObjModule* module = caller->fn->module;
 
+  ObjString* source = AS_STRING(vm->apiStack[1]);
+
+  // See if this snippet has already been compiled in this module.
+  for (int i = 0; i < vm->metaCacheCount; i++)
+  {
+    MetaCacheEntry* entry = &vm->metaCacheEntries[i];
+    if (entry->module == module &&
+        AS_STRING(entry->source->value) == source)
+    {
+      vm->apiStack[0] = entry->closure->value;
+      return;
+    }
+  }
+
   // Compile it.
-  ObjFn* fn = wrenCompile(vm, module, wrenGetSlotString(vm, 1), false);
+  ObjFn* fn = wrenCompile(vm, module, source->value, false);
 
   // Return the result. We can't use the public API for this since we have a
-  // bare ObjFn.
+  // bare ObjFn. Compile failures aren't cached; eval() aborts on them anyway.
   if (fn == NULL)
   {
     vm->apiStack[0] = NULL_VAL;
+    return;
   }
-  else
+
+  wrenPushRoot(vm, (Obj*)fn);
+  Value closure = OBJ_VAL(wrenNewClosure(vm, fn));
+  vm->apiStack[0] = closure;
+  wrenPopRoot(vm);
+
+  // Remember the closure so the next eval() of this source skips the
+  // compiler. Both values live in the fiber's stack through the API slots, so
+  // they survive any collection the growth or capture below triggers.
+  if (vm->metaCacheCount == vm->metaCacheCapacity)
+  {
+    int capacity = vm->metaCacheCapacity == 0 ? 16 : vm->metaCacheCapacity * 2;
+    vm->metaCacheEntries =
+        (MetaCacheEntry*)wrenReallocate(vm, vm->metaCacheEntries,
+            sizeof(MetaCacheEntry) * vm->metaCacheCapacity,
+            sizeof(MetaCacheEntry) * capacity);
+    vm->metaCacheCapacity = capacity;
+  }
+
+  MetaCacheEntry* entry = &vm->metaCacheEntries[vm->metaCacheCount++];
+  entry->module = module;
+  entry->source = wrenCaptureValue(vm, OBJ_VAL(source));
+  entry->closure = wrenCaptureValue(vm, closure);
+}
+
+void wrenMetaFreeCache(WrenVM* vm)
+{
+  for (int i = 0; i < vm->metaCacheCount; i++)
   {
-    wrenPushRoot(vm, (Obj*)fn);
-    vm->apiStack[0] = OBJ_VAL(wrenNewClosure(vm, fn));
-    wrenPopRoot(vm);
+    wrenReleaseValue(vm, vm->metaCacheEntries[i].source);
+    wrenReleaseValue(vm, vm->metaCacheEntries[i].closure);
   }
+
+  vm->metaCacheEntries =
+      (MetaCacheEntry*)wrenReallocate(vm, vm->metaCacheEntries,
+          sizeof(MetaCacheEntry) * vm->metaCacheCapacity, 0);
+  vm->metaCacheCount = 0;
+  vm->metaCacheCapacity = 0;
 }
 
 const char* wrenMetaSource()
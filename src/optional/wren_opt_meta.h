@@ -13,6 +13,10 @@ WrenForeignMethodFn wrenMetaBindForeignMethod(WrenVM* vm,
                                               bool isStatic,
                                               const char* signature);
 
+// Releases the Meta.eval() compile cache along with the handles it holds.
+// Called when [vm] is freed.
+void wrenMetaFreeCache(WrenVM* vm);
+
 #endif
 
 #endif
@@ -2,6 +2,7 @@
 
 #if WREN_OPT_RANDOM
 
+#include <math.h>
 #include <string.h>
 #include <time.h>
 
@@ -75,10 +76,9 @@ static void randomSeed16(WrenVM* vm)
   }
 }
 
-static void randomFloat(WrenVM* vm)
+// Generates a double from 0 to 1.0 (half-inclusive).
+static double wellFloat(Well512* well)
 {
-  Well512* well = (Well512*)wrenGetSlotForeign(vm, 0);
-
   // A double has 53 bits of precision in its mantissa, and we'd like to take
   // full advantage of that, so we need 53 bits of random source data.
 
@@ -90,9 +90,30 @@ static void randomFloat(WrenVM* vm)
 
   // Now we have a number from 0 - (2^53). Divide be the range to get a double
   // from 0 to 1.0 (half-inclusive).
-  result /= 9007199254740992.0;
+  return result / 9007199254740992.0;
+}
 
-  wrenSetSlotDouble(vm, 0, result);
+// Returns true if [end] is a range that randomWellInt()'s integer fast path
+// can draw from: a positive whole number of at most 32 bits.
+static bool canFastInt(double end)
+{
+  return end > 0 && end <= 4294967296.0 && trunc(end) == end;
+}
+
+// Generates an integer from 0 to [end] (half-inclusive), where [end] has
+// passed canFastInt(). One state advance and a fixed-point multiply instead
+// of building a 53-bit float and flooring the scaled product.
+static double wellInt(Well512* well, double end)
+{
+  uint64_t scaled = (uint64_t)advanceState(well) * (uint64_t)end;
+  return (double)(uint32_t)(scaled >> 32);
+}
+
+static void randomFloat(WrenVM* vm)
+{
+  Well512* well = (Well512*)wrenGetSlotForeign(vm, 0);
+
+  wrenSetSlotDouble(vm, 0, wellFloat(well));
 }
 
 static void randomInt0(WrenVM* vm)
@@ -102,6 +123,84 @@ static void randomInt0(WrenVM* vm)
   wrenSetSlotDouble(vm, 0, (double)advanceState(well));
 }
 
+static void randomInt1(WrenVM* vm)
+{
+  Well512* well = (Well512*)wrenGetSlotForeign(vm, 0);
+  double end = wrenGetSlotDouble(vm, 1);
+
+  // Fractional, negative, or oversized ranges keep the old float behavior.
+  double result = canFastInt(end)
+      ? wellInt(well, end)
+      : floor(wellFloat(well) * end);
+  wrenSetSlotDouble(vm, 0, result);
+}
+
+// Fills every element of the List or FloatArray in slot 1 with uniform
+// floats from [start] to [end] (half-inclusive). The argument types are
+// validated by the Wren wrappers before this is called.
+static void randomFill(WrenVM* vm)
+{
+  Well512* well = (Well512*)wrenGetSlotForeign(vm, 0);
+  Value arg = vm->apiStack[1];
+  double start = wrenGetSlotDouble(vm, 2);
+  double end = wrenGetSlotDouble(vm, 3);
+  double range = end - start;
+
+  if (IS_FLOAT_ARRAY(arg))
+  {
+    ObjFloatArray* array = AS_FLOAT_ARRAY(arg);
+    for (uint32_t i = 0; i < array->count; i++)
+    {
+      array->elements[i] = wellFloat(well) * range + start;
+    }
+  }
+  else
+  {
+    // Only numbers are stored, so no write barrier is needed.
+    ObjList* list = AS_LIST(arg);
+    for (int i = 0; i < list->elements.count; i++)
+    {
+      list->elements.data[i] = NUM_VAL(wellFloat(well) * range + start);
+    }
+  }
+
+  // Return the list for chaining.
+  vm->apiStack[0] = arg;
+}
+
+// Like randomFill(), but with integers from [start] to [end] (half-inclusive).
+static void randomFillInt(WrenVM* vm)
+{
+  Well512* well = (Well512*)wrenGetSlotForeign(vm, 0);
+  Value arg = vm->apiStack[1];
+  double start = wrenGetSlotDouble(vm, 2);
+  double end = wrenGetSlotDouble(vm, 3);
+  double range = end - start;
+  bool fast = canFastInt(range);
+
+  if (IS_FLOAT_ARRAY(arg))
+  {
+    ObjFloatArray* array = AS_FLOAT_ARRAY(arg);
+    for (uint32_t i = 0; i < array->count; i++)
+    {
+      array->elements[i] = fast ? wellInt(well, range) + start
+                                : floor(wellFloat(well) * range) + start;
+    }
+  }
+  else
+  {
+    ObjList* list = AS_LIST(arg);
+    for (int i = 0; i < list->elements.count; i++)
+    {
+      double value = fast ? wellInt(well, range) + start
+                          : floor(wellFloat(well) * range) + start;
+      list->elements.data[i] = NUM_VAL(value);
+    }
+  }
+
+  vm->apiStack[0] = arg;
+}
+
 const char* wrenRandomSource()
 {
   return randomModuleSource;
@@ -136,7 +235,10 @@ WrenForeignMethodFn wrenRandomBindForeignMethod(WrenVM* vm,
   
   if (strcmp(signature, "float()") == 0) return randomFloat;
   if (strcmp(signature, "int()") == 0) return randomInt0;
-  
+  if (strcmp(signature, "int_(_)") == 0) return randomInt1;
+  if (strcmp(signature, "fill_(_,_,_)") == 0) return randomFill;
+  if (strcmp(signature, "fillInt_(_,_,_)") == 0) return randomFillInt;
+
   ASSERT(false, "Unknown method.");
   return NULL;
 }
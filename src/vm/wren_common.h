@@ -44,6 +44,15 @@
   #endif
 #endif
 
+// If true, a full garbage collection can mark the heap with multiple threads.
+// This relies on pthreads, GCC-style atomic builtins, and `__thread`, so it
+// defaults to off. Compiling with it enables the `markThreads` field in
+// WrenConfiguration; the VM still marks on a single thread until that is set
+// to more than one.
+#ifndef WREN_PARALLEL_MARK
+  #define WREN_PARALLEL_MARK 0
+#endif
+
 // The VM includes a number of optional modules. You can choose to include
 // these or not. By default, they are all available. To disable one, set the
 // corresponding `WREN_OPT_<name>` define to `0`.
@@ -55,6 +64,15 @@
   #define WREN_OPT_RANDOM 1
 #endif
 
+// If true, the VM bootstraps the core module from the precompiled image in
+// "wren_core.snapshot.inc" instead of compiling its source every time a VM is
+// created. Regenerate the image with `make -f util/wren.mk core_snapshot`
+// after editing "wren_core.wren". Set this to `0` to fall back to compiling
+// the source at startup.
+#ifndef WREN_CORE_SNAPSHOT
+  #define WREN_CORE_SNAPSHOT 1
+#endif
+
 // These flags are useful for debugging and hacking on Wren itself. They are not
 // intended to be used for production code. They default to off.
 
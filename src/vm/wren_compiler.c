@@ -1,4 +1,5 @@
 #include <errno.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
@@ -344,6 +345,13 @@ struct sCompiler
   // don't need to double count them here.
   int numSlots;
 
+  // The number of CODE_CONSTANT instructions at the very end of the emitted
+  // bytecode, with nothing after them. When an operator is compiled and its
+  // operands are the trailing constants, the operation can be folded into a
+  // single constant instead of a runtime call. Emitting any other instruction
+  // resets this to zero.
+  int constantRun;
+
   // The current innermost loop being compiled, or NULL if not in a loop.
   Loop* loop;
 
@@ -471,6 +479,7 @@ static int addConstant(Compiler* compiler, Value constant)
     wrenValueBufferWrite(compiler->parser->vm, &compiler->fn->constants,
                          constant);
     if (IS_OBJ(constant)) wrenPopRoot(compiler->parser->vm);
+    wrenWriteBarrier(compiler->parser->vm, (Obj*)compiler->fn, constant);
   }
   else
   {
@@ -530,6 +539,7 @@ static void initCompiler(Compiler* compiler, Parser* parser, Compiler* parent,
   }
   
   compiler->numSlots = compiler->numLocals;
+  compiler->constantRun = 0;
 
   compiler->fn = wrenNewFunction(parser->vm, parser->module,
                                  compiler->numLocals);
@@ -1134,7 +1144,11 @@ static int emitByte(Compiler* compiler, int byte)
 static void emitOp(Compiler* compiler, Code instruction)
 {
   emitByte(compiler, instruction);
-  
+
+  // The bytecode no longer ends in a run of constants. (emitConstant() corrects
+  // this after emitting the CODE_CONSTANT itself.)
+  compiler->constantRun = 0;
+
   // Keep track of the stack's high water mark.
   compiler->numSlots += stackEffects[instruction];
   if (compiler->numSlots > compiler->fn->maxSlots)
@@ -1181,9 +1195,12 @@ static int emitJump(Compiler* compiler, Code instruction)
 static void emitConstant(Compiler* compiler, Value value)
 {
   int constant = addConstant(compiler, value);
-  
-  // Compile the code to load the constant.
+
+  // Compile the code to load the constant. emitOp() clears the constant run,
+  // so save it across the emit and extend it by this instruction.
+  int run = compiler->constantRun;
   emitShortArg(compiler, CODE_CONSTANT, constant);
+  compiler->constantRun = run + 1;
 }
 
 // Create a new local variable with [name]. Assumes the current scope is local
@@ -1457,6 +1474,10 @@ static void loadLocal(Compiler* compiler, int slot)
   emitByteArg(compiler, CODE_LOAD_LOCAL, slot);
 }
 
+static void threadJumps(ObjFn* fn);
+static void markTailCalls(ObjFn* fn);
+static void fuseInstructions(ObjFn* fn);
+
 // Finishes [compiler], which is compiling a function, method, or chunk of top
 // level code. If there is a parent compiler, then this emits code in the
 // parent compiler to load the resulting function.
@@ -1476,17 +1497,36 @@ static ObjFn* endCompiler(Compiler* compiler,
 
   wrenFunctionBindName(compiler->parser->vm, compiler->fn,
                        debugName, debugNameLength);
-  
+
+  // Now that all of the function's call sites have been emitted, we know how
+  // many inline caches it needs.
+  wrenFunctionAllocateCallCaches(compiler->parser->vm, compiler->fn);
+
+  // Retarget jumps that land on other jumps, mark calls in tail position,
+  // then rewrite fusable instruction pairs into superinstructions.
+  threadJumps(compiler->fn);
+  markTailCalls(compiler->fn);
+  fuseInstructions(compiler->fn);
+
   // In the function that contains this one, load the resulting function object.
   if (compiler->parent != NULL)
   {
-    int constant = addConstant(compiler->parent, OBJ_VAL(compiler->fn));
+    // The VM uniformly assumes all called objects are closures, so the
+    // function is always wrapped in one. When it captures no upvalues, the
+    // closure is immutable, so we build a single canonical closure here at
+    // compile time and CODE_CLOSURE just reloads it. Only functions that
+    // actually capture variables pay for an allocation per evaluation.
+    Value wrapped;
+    if (compiler->fn->numUpvalues == 0)
+    {
+      wrapped = OBJ_VAL(wrenNewClosure(compiler->parser->vm, compiler->fn));
+    }
+    else
+    {
+      wrapped = OBJ_VAL(compiler->fn);
+    }
 
-    // Wrap the function in a closure. We do this even if it has no upvalues so
-    // that the VM can uniformly assume all called objects are closures. This
-    // makes creating a function a little slower, but makes invoking them
-    // faster. Given that functions are invoked more often than they are
-    // created, this is a win.
+    int constant = addConstant(compiler->parent, wrapped);
     emitShortArg(compiler->parent, CODE_CLOSURE, constant);
 
     // Emit arguments for each upvalue to know whether to capture a local or
@@ -1774,6 +1814,29 @@ static void finishArgumentList(Compiler* compiler, Signature* signature)
   ignoreNewlines(compiler);
 }
 
+// Reserves an inline cache slot in the function being compiled for the method
+// call site being emitted, and emits the slot's index as a two-byte argument.
+static void emitCallCache(Compiler* compiler)
+{
+  int slot = compiler->fn->numCallCaches;
+
+  // In the unlikely event a function has more call sites than fit in two
+  // bytes, let the extra sites all share the last slot instead of wrapping
+  // around to unrelated ones. The cache stores the symbol it was filled for
+  // and the interpreter validates it on a hit, so sharing is safe -- it just
+  // makes those sites miss more often.
+  if (slot > UINT16_MAX)
+  {
+    slot = UINT16_MAX;
+  }
+  else
+  {
+    compiler->fn->numCallCaches++;
+  }
+
+  emitShort(compiler, slot);
+}
+
 // Compiles a method call with [signature] using [instruction].
 static void callSignature(Compiler* compiler, Code instruction,
                           Signature* signature)
@@ -1781,6 +1844,11 @@ static void callSignature(Compiler* compiler, Code instruction,
   int symbol = signatureSymbol(compiler, signature);
   emitShortArg(compiler, (Code)(instruction + signature->arity), symbol);
 
+  if (instruction == CODE_CALL_0)
+  {
+    emitCallCache(compiler);
+  }
+
   if (instruction == CODE_SUPER_0)
   {
     // Super calls need to be statically bound to the class's superclass. This
@@ -1801,6 +1869,7 @@ static void callMethod(Compiler* compiler, int numArgs, const char* name,
 {
   int symbol = methodSymbol(compiler, name, length);
   emitShortArg(compiler, (Code)(CODE_CALL_0 + numArgs), symbol);
+  emitCallCache(compiler);
 }
 
 // Compiles an (optional) argument list for a method call with [methodSignature]
@@ -1945,11 +2014,10 @@ static void grouping(Compiler* compiler, bool canAssign)
 // A list literal.
 static void list(Compiler* compiler, bool canAssign)
 {
-  // Instantiate a new list.
-  loadCoreVariable(compiler, "List");
-  callMethod(compiler, 0, "new()", 5);
-  
-  // Compile the list elements. Each one compiles to a ".add()" call.
+  // Compile the elements onto the stack, then build the list from them in one
+  // go. Passing the count in the instruction lets the list be allocated at
+  // exactly the right size instead of growing as elements are added.
+  int count = 0;
   do
   {
     ignoreNewlines(compiler);
@@ -1959,23 +2027,36 @@ static void list(Compiler* compiler, bool canAssign)
 
     // The element.
     expression(compiler);
-    callMethod(compiler, 1, "addCore_(_)", 11);
+
+    if (count == UINT16_MAX)
+    {
+      error(compiler, "Cannot have more than %d elements in a list literal.",
+            UINT16_MAX);
+    }
+    else
+    {
+      count++;
+    }
   } while (match(compiler, TOKEN_COMMA));
 
   // Allow newlines before the closing ']'.
   ignoreNewlines(compiler);
   consume(compiler, TOKEN_RIGHT_BRACKET, "Expect ']' after list elements.");
+
+  emitShortArg(compiler, CODE_LIST_LITERAL, count);
+
+  // The instruction's declared effect only covers the pushed list. Account for
+  // the popped elements here, where the count is known.
+  compiler->numSlots -= count;
 }
 
 // A map literal.
 static void map(Compiler* compiler, bool canAssign)
 {
-  // Instantiate a new map.
-  loadCoreVariable(compiler, "Map");
-  callMethod(compiler, 0, "new()", 5);
-
-  // Compile the map elements. Each one is compiled to just invoke the
-  // subscript setter on the map.
+  // Compile the entries onto the stack as key/value pairs, then build the map
+  // from them in one go. Passing the count in the instruction lets the map be
+  // sized for all of its entries up front instead of rehashing as it grows.
+  int count = 0;
   do
   {
     ignoreNewlines(compiler);
@@ -1990,15 +2071,203 @@ static void map(Compiler* compiler, bool canAssign)
 
     // The value.
     expression(compiler);
-    callMethod(compiler, 2, "addCore_(_,_)", 13);
+
+    if (count == UINT16_MAX)
+    {
+      error(compiler, "Cannot have more than %d entries in a map literal.",
+            UINT16_MAX);
+    }
+    else
+    {
+      count++;
+    }
   } while (match(compiler, TOKEN_COMMA));
 
   // Allow newlines before the closing '}'.
   ignoreNewlines(compiler);
   consume(compiler, TOKEN_RIGHT_BRACE, "Expect '}' after map entries.");
+
+  emitShortArg(compiler, CODE_MAP_LITERAL, count);
+
+  // The instruction's declared effect only covers the pushed map. Account for
+  // the popped entries here, where the count is known.
+  compiler->numSlots -= count * 2;
 }
 
 // Unary operators like `-foo`.
+// Constant folding ------------------------------------------------------------
+
+// If the last [count] emitted instructions are CODE_CONSTANT loads with
+// nothing following them, stores their operand values in [values] and returns
+// true. Otherwise returns false and leaves [values] untouched.
+static bool trailingConstants(Compiler* compiler, int count, Value* values)
+{
+  if (compiler->constantRun < count) return false;
+
+  uint8_t* code = compiler->fn->code.data;
+  int end = compiler->fn->code.count;
+  for (int i = 0; i < count; i++)
+  {
+    int offset = end - (count - i) * 3;
+    if (offset < 0 || code[offset] != CODE_CONSTANT) return false;
+
+    int constant = (code[offset + 1] << 8) | code[offset + 2];
+    values[i] = compiler->fn->constants.data[constant];
+  }
+
+  return true;
+}
+
+// Replaces the last [count] CODE_CONSTANT instructions with a single load of
+// [value]. The folded operands stay in the constant table -- a few unused
+// entries are cheaper than renumbering every other constant reference.
+static void replaceConstants(Compiler* compiler, int count, Value value)
+{
+  compiler->fn->code.count -= count * 3;
+  compiler->fn->debug->sourceLines.count = compiler->fn->code.count;
+  compiler->numSlots -= count;
+  compiler->constantRun -= count;
+  emitConstant(compiler, value);
+}
+
+// If the operand of the unary operator [name] is a literal number, evaluates
+// the operator at compile time and returns true. Safe because operators on
+// Num cannot be overridden: core classes are closed.
+static bool foldUnaryOp(Compiler* compiler, const char* name)
+{
+  Value operand;
+  if (name[1] != '\0') return false;
+  if (!trailingConstants(compiler, 1, &operand)) return false;
+  if (!IS_NUM(operand)) return false;
+
+  switch (name[0])
+  {
+    case '-':
+      replaceConstants(compiler, 1, NUM_VAL(-AS_NUM(operand)));
+      return true;
+
+    default: return false;
+  }
+}
+
+// If both operands of the infix operator [name] are literals, evaluates the
+// operator at compile time and returns true. Handles arithmetic and
+// comparison on numbers, concatenation of strings, and (in)equality of any
+// literals. Each fold mirrors the corresponding Num or String primitive
+// exactly, so behavior is indistinguishable from the runtime call.
+static bool foldInfixOp(Compiler* compiler, const char* name)
+{
+  Value operands[2];
+  if (!trailingConstants(compiler, 2, operands)) return false;
+
+  bool isEquality = (name[0] == '=' || name[0] == '!') && name[1] == '=';
+
+  if (IS_NUM(operands[0]) && IS_NUM(operands[1]))
+  {
+    double a = AS_NUM(operands[0]);
+    double b = AS_NUM(operands[1]);
+
+    // Compare the numeric values, not the bits: -0 == 0 and NaN != NaN, just
+    // like Num's == primitive.
+    if (isEquality)
+    {
+      bool equal = a == b;
+      if (name[0] == '!') equal = !equal;
+      replaceConstants(compiler, 2, BOOL_VAL(equal));
+      return true;
+    }
+
+    switch (name[0])
+    {
+      case '+': replaceConstants(compiler, 2, NUM_VAL(a + b)); return true;
+      case '-': replaceConstants(compiler, 2, NUM_VAL(a - b)); return true;
+      case '*': replaceConstants(compiler, 2, NUM_VAL(a * b)); return true;
+      case '/': replaceConstants(compiler, 2, NUM_VAL(a / b)); return true;
+      case '%': replaceConstants(compiler, 2, NUM_VAL(fmod(a, b))); return true;
+
+      case '<':
+        if (name[1] == '\0')
+        {
+          replaceConstants(compiler, 2, BOOL_VAL(a < b));
+          return true;
+        }
+        if (name[1] == '=')
+        {
+          replaceConstants(compiler, 2, BOOL_VAL(a <= b));
+          return true;
+        }
+        return false;
+
+      case '>':
+        if (name[1] == '\0')
+        {
+          replaceConstants(compiler, 2, BOOL_VAL(a > b));
+          return true;
+        }
+        if (name[1] == '=')
+        {
+          replaceConstants(compiler, 2, BOOL_VAL(a >= b));
+          return true;
+        }
+        return false;
+
+      default: return false;
+    }
+  }
+
+  if (isEquality)
+  {
+    bool equal = wrenValuesEqual(operands[0], operands[1]);
+    if (name[0] == '!') equal = !equal;
+    replaceConstants(compiler, 2, BOOL_VAL(equal));
+    return true;
+  }
+
+  if (IS_STRING(operands[0]) && IS_STRING(operands[1]) &&
+      name[0] == '+' && name[1] == '\0')
+  {
+    replaceConstants(compiler, 2, wrenStringFormat(compiler->parser->vm, "@@",
+                                                   operands[0], operands[1]));
+    return true;
+  }
+
+  return false;
+}
+
+// Maps the infix operator [name] to its specialized opcode, or CODE_END if
+// the operator doesn't have one.
+static Code operatorOpcode(const char* name)
+{
+  if (name[1] == '\0')
+  {
+    switch (name[0])
+    {
+      case '+': return CODE_ADD;
+      case '-': return CODE_SUBTRACT;
+      case '*': return CODE_MULTIPLY;
+      case '/': return CODE_DIVIDE;
+      case '%': return CODE_MOD;
+      case '<': return CODE_LESS;
+      case '>': return CODE_GREATER;
+      default:  return CODE_END;
+    }
+  }
+
+  if (name[1] == '=' && name[2] == '\0')
+  {
+    switch (name[0])
+    {
+      case '<': return CODE_LESS_EQUAL;
+      case '>': return CODE_GREATER_EQUAL;
+      case '=': return CODE_EQUAL;
+      case '!': return CODE_NOT_EQUAL;
+      default:  return CODE_END;
+    }
+  }
+
+  return CODE_END;
+}
+
 static void unaryOp(Compiler* compiler, bool canAssign)
 {
   GrammarRule* rule = getRule(compiler->parser->previous.type);
@@ -2008,6 +2277,9 @@ static void unaryOp(Compiler* compiler, bool canAssign)
   // Compile the argument.
   parsePrecedence(compiler, (Precedence)(PREC_UNARY + 1));
 
+  // A unary operator applied to a literal is evaluated at compile time.
+  if (foldUnaryOp(compiler, rule->name)) return;
+
   // Call the operator method on the left-hand side.
   callMethod(compiler, 0, rule->name, 1);
 }
@@ -2244,31 +2516,34 @@ static void literal(Compiler* compiler, bool canAssign)
 //     ["a ", b + c, " d"].join()
 static void stringInterpolation(Compiler* compiler, bool canAssign)
 {
-  // Instantiate a new list.
-  loadCoreVariable(compiler, "List");
+  // Build the string in a StringBuffer, which appends each segment -- and
+  // formats strings, numbers, booleans, and null -- directly into one byte
+  // array, instead of collecting a string per segment in a list and joining
+  // them.
+  loadCoreVariable(compiler, "StringBuffer");
   callMethod(compiler, 0, "new()", 5);
-  
+
   do
   {
     // The opening string part.
     literal(compiler, false);
     callMethod(compiler, 1, "addCore_(_)", 11);
-    
+
     // The interpolated expression.
     ignoreNewlines(compiler);
     expression(compiler);
     callMethod(compiler, 1, "addCore_(_)", 11);
-    
+
     ignoreNewlines(compiler);
   } while (match(compiler, TOKEN_INTERPOLATION));
-  
+
   // The trailing string part.
   consume(compiler, TOKEN_STRING, "Expect end of string interpolation.");
   literal(compiler, false);
   callMethod(compiler, 1, "addCore_(_)", 11);
-  
-  // The list of interpolated parts.
-  callMethod(compiler, 0, "join()", 6);
+
+  // The completed string.
+  callMethod(compiler, 0, "toString", 8);
 }
 
 static void super_(Compiler* compiler, bool canAssign)
@@ -2398,8 +2673,23 @@ void infixOp(Compiler* compiler, bool canAssign)
   // Compile the right-hand side.
   parsePrecedence(compiler, (Precedence)(rule->precedence + 1));
 
-  // Call the operator method on the left-hand side.
+  // An operator applied to two literals is evaluated at compile time.
+  if (foldInfixOp(compiler, rule->name)) return;
+
   Signature signature = { rule->name, (int)strlen(rule->name), SIG_METHOD, 1 };
+
+  // Arithmetic and comparison operators get specialized instructions with an
+  // inline fast path for numbers. They share CODE_CALL_1's operand layout so
+  // the interpreter can fall back to a generic send for other receivers.
+  Code specialized = operatorOpcode(rule->name);
+  if (specialized != CODE_END)
+  {
+    emitShortArg(compiler, specialized, signatureSymbol(compiler, &signature));
+    emitCallCache(compiler);
+    return;
+  }
+
+  // Call the operator method on the left-hand side.
   callSignature(compiler, CODE_CALL_0, &signature);
 }
 
@@ -2661,8 +2951,8 @@ void expression(Compiler* compiler)
 
 // Returns the number of arguments to the instruction at [ip] in [fn]'s
 // bytecode.
-static int getNumArguments(const uint8_t* bytecode, const Value* constants,
-                           int ip)
+int wrenGetNumArguments(const uint8_t* bytecode, const Value* constants,
+                        int ip)
 {
   Code instruction = (Code)bytecode[ip];
   switch (instruction)
@@ -2683,16 +2973,27 @@ static int getNumArguments(const uint8_t* bytecode, const Value* constants,
     case CODE_LOAD_LOCAL_6:
     case CODE_LOAD_LOCAL_7:
     case CODE_LOAD_LOCAL_8:
+    case CODE_LOAD_LOCAL_0_CALL:
+    case CODE_LOAD_LOCAL_1_CALL:
+    case CODE_LOAD_LOCAL_2_CALL:
+    case CODE_LOAD_LOCAL_3_CALL:
+    case CODE_LOAD_LOCAL_4_CALL:
+    case CODE_LOAD_LOCAL_5_CALL:
+    case CODE_LOAD_LOCAL_6_CALL:
+    case CODE_LOAD_LOCAL_7_CALL:
+    case CODE_LOAD_LOCAL_8_CALL:
     case CODE_CONSTRUCT:
     case CODE_FOREIGN_CONSTRUCT:
     case CODE_FOREIGN_CLASS:
       return 0;
 
     case CODE_LOAD_LOCAL:
+    case CODE_LOAD_LOCAL_CALL:
     case CODE_STORE_LOCAL:
     case CODE_LOAD_UPVALUE:
     case CODE_STORE_UPVALUE:
     case CODE_LOAD_FIELD_THIS:
+    case CODE_LOAD_FIELD_THIS_CALL:
     case CODE_STORE_FIELD_THIS:
     case CODE_LOAD_FIELD:
     case CODE_STORE_FIELD:
@@ -2700,8 +3001,36 @@ static int getNumArguments(const uint8_t* bytecode, const Value* constants,
       return 1;
 
     case CODE_CONSTANT:
+    case CODE_CONSTANT_CALL:
     case CODE_LOAD_MODULE_VAR:
     case CODE_STORE_MODULE_VAR:
+    case CODE_JUMP:
+    case CODE_LOOP:
+    case CODE_JUMP_IF:
+    case CODE_AND:
+    case CODE_OR:
+    case CODE_METHOD_INSTANCE:
+    case CODE_METHOD_STATIC:
+    case CODE_LIST_LITERAL:
+    case CODE_MAP_LITERAL:
+      return 2;
+
+    // The sequence and iterator slots, then two bytes for the jump offset.
+    case CODE_FOR_RANGE:
+      return 4;
+
+    // Two bytes for the symbol, then two for the inline cache slot.
+    case CODE_ADD:
+    case CODE_SUBTRACT:
+    case CODE_MULTIPLY:
+    case CODE_DIVIDE:
+    case CODE_MOD:
+    case CODE_LESS:
+    case CODE_LESS_EQUAL:
+    case CODE_GREATER:
+    case CODE_GREATER_EQUAL:
+    case CODE_EQUAL:
+    case CODE_NOT_EQUAL:
     case CODE_CALL_0:
     case CODE_CALL_1:
     case CODE_CALL_2:
@@ -2719,15 +3048,23 @@ static int getNumArguments(const uint8_t* bytecode, const Value* constants,
     case CODE_CALL_14:
     case CODE_CALL_15:
     case CODE_CALL_16:
-    case CODE_JUMP:
-    case CODE_LOOP:
-    case CODE_JUMP_IF:
-    case CODE_AND:
-    case CODE_OR:
-    case CODE_METHOD_INSTANCE:
-    case CODE_METHOD_STATIC:
-      return 2;
-
+    case CODE_TAIL_CALL_0:
+    case CODE_TAIL_CALL_1:
+    case CODE_TAIL_CALL_2:
+    case CODE_TAIL_CALL_3:
+    case CODE_TAIL_CALL_4:
+    case CODE_TAIL_CALL_5:
+    case CODE_TAIL_CALL_6:
+    case CODE_TAIL_CALL_7:
+    case CODE_TAIL_CALL_8:
+    case CODE_TAIL_CALL_9:
+    case CODE_TAIL_CALL_10:
+    case CODE_TAIL_CALL_11:
+    case CODE_TAIL_CALL_12:
+    case CODE_TAIL_CALL_13:
+    case CODE_TAIL_CALL_14:
+    case CODE_TAIL_CALL_15:
+    case CODE_TAIL_CALL_16:
     case CODE_SUPER_0:
     case CODE_SUPER_1:
     case CODE_SUPER_2:
@@ -2750,10 +3087,13 @@ static int getNumArguments(const uint8_t* bytecode, const Value* constants,
     case CODE_CLOSURE:
     {
       int constant = (bytecode[ip + 1] << 8) | bytecode[ip + 2];
-      ObjFn* loadedFn = AS_FN(constants[constant]);
+
+      // Zero-upvalue functions are stored as pre-built closures and have no
+      // capture arguments.
+      if (IS_CLOSURE(constants[constant])) return 2;
 
       // There are two bytes for the constant, then two for each upvalue.
-      return 2 + (loadedFn->numUpvalues * 2);
+      return 2 + (AS_FN(constants[constant])->numUpvalues * 2);
     }
 
     default:
@@ -2762,6 +3102,152 @@ static int getNumArguments(const uint8_t* bytecode, const Value* constants,
   }
 }
 
+// Returns true if [instruction] is one of the CODE_CALL_* instructions.
+static bool isCallInstruction(uint8_t instruction)
+{
+  return instruction >= CODE_CALL_0 && instruction <= CODE_CALL_16;
+}
+
+// Walks [fn]'s finished bytecode and retargets every forward jump that lands
+// on an unconditional CODE_JUMP to that jump's own destination.
+//
+// The if/else, `?:`, `&&`, and `||` emitters patch each jump independently, so
+// nested conditionals produce chains where taking one jump immediately takes
+// another. Following the chain here costs one dispatch instead of several at
+// runtime. Only the two offset bytes are rewritten, so the bytecode's length
+// and all other jump targets are unaffected.
+static void threadJumps(ObjFn* fn)
+{
+  uint8_t* code = fn->code.data;
+  int ip = 0;
+  for (;;)
+  {
+    Code instruction = (Code)code[ip];
+    switch (instruction)
+    {
+      case CODE_JUMP:
+      case CODE_JUMP_IF:
+      case CODE_AND:
+      case CODE_OR:
+      {
+        int offset = (code[ip + 1] << 8) | code[ip + 2];
+        for (;;)
+        {
+          int target = ip + 3 + offset;
+          if (code[target] != CODE_JUMP) break;
+
+          int through = offset + 3 + ((code[target + 1] << 8) | code[target + 2]);
+
+          // The combined offset has to fit back in the two operand bytes.
+          if (through > 0xffff) break;
+
+          offset = through;
+        }
+
+        code[ip + 1] = (offset >> 8) & 0xff;
+        code[ip + 2] = offset & 0xff;
+        break;
+      }
+
+      case CODE_END:
+        return;
+
+      default:
+        break;
+    }
+
+    ip += 1 + wrenGetNumArguments(code, fn->constants.data, ip);
+  }
+}
+
+// Walks [fn]'s finished bytecode and rewrites every CODE_CALL_* that is
+// immediately followed by CODE_RETURN to the corresponding CODE_TAIL_CALL_*.
+//
+// A call in tail position is the caller's last act: its frame exists only to
+// forward the callee's result. The tail call instructions let the interpreter
+// reuse that frame, so mutually recursive code runs in constant stack space.
+// Only the call's opcode byte is rewritten and the CODE_RETURN stays in
+// place, so the bytecode's length and all jump targets are unaffected.
+//
+// This runs before fuseInstructions so a push never fuses into a tail call:
+// the superinstructions only recognize the plain CODE_CALL_* forms.
+static void markTailCalls(ObjFn* fn)
+{
+  uint8_t* code = fn->code.data;
+  int ip = 0;
+  for (;;)
+  {
+    Code instruction = (Code)code[ip];
+    if (instruction == CODE_END) return;
+
+    if (isCallInstruction(instruction) && code[ip + 5] == CODE_RETURN)
+    {
+      code[ip] = (uint8_t)(CODE_TAIL_CALL_0 + (instruction - CODE_CALL_0));
+    }
+
+    ip += 1 + wrenGetNumArguments(code, fn->constants.data, ip);
+  }
+}
+
+// The peephole pass. Walks [fn]'s finished bytecode and rewrites fusable
+// instruction pairs into superinstructions.
+//
+// The compiler emits enormous runs of a cheap push -- a local or a constant
+// -- immediately followed by a method call. Fusing each pair into a single
+// instruction halves the dispatch overhead for the pattern. Only the first
+// opcode byte of a pair is rewritten, so the bytecode's length and all jump
+// targets are unaffected. See wren_opcodes.h for the fused instructions.
+static void fuseInstructions(ObjFn* fn)
+{
+  uint8_t* code = fn->code.data;
+  int ip = 0;
+  for (;;)
+  {
+    Code instruction = (Code)code[ip];
+    switch (instruction)
+    {
+      case CODE_LOAD_LOCAL_0:
+      case CODE_LOAD_LOCAL_1:
+      case CODE_LOAD_LOCAL_2:
+      case CODE_LOAD_LOCAL_3:
+      case CODE_LOAD_LOCAL_4:
+      case CODE_LOAD_LOCAL_5:
+      case CODE_LOAD_LOCAL_6:
+      case CODE_LOAD_LOCAL_7:
+      case CODE_LOAD_LOCAL_8:
+        if (isCallInstruction(code[ip + 1]))
+        {
+          code[ip] = (uint8_t)(CODE_LOAD_LOCAL_0_CALL +
+                               (instruction - CODE_LOAD_LOCAL_0));
+        }
+        break;
+
+      case CODE_LOAD_LOCAL:
+        if (isCallInstruction(code[ip + 2])) code[ip] = CODE_LOAD_LOCAL_CALL;
+        break;
+
+      case CODE_LOAD_FIELD_THIS:
+        if (isCallInstruction(code[ip + 2]))
+        {
+          code[ip] = CODE_LOAD_FIELD_THIS_CALL;
+        }
+        break;
+
+      case CODE_CONSTANT:
+        if (isCallInstruction(code[ip + 3])) code[ip] = CODE_CONSTANT_CALL;
+        break;
+
+      case CODE_END:
+        return;
+
+      default:
+        break;
+    }
+
+    ip += 1 + wrenGetNumArguments(code, fn->constants.data, ip);
+  }
+}
+
 // Marks the beginning of a loop. Keeps track of the current instruction so we
 // know what to loop back to at the end of the body.
 static void startLoop(Compiler* compiler, Loop* loop)
@@ -2813,7 +3299,7 @@ static void endLoop(Compiler* compiler)
     else
     {
       // Skip this instruction and its arguments.
-      i += 1 + getNumArguments(compiler->fn->code.data,
+      i += 1 + wrenGetNumArguments(compiler->fn->code.data,
                                compiler->fn->constants.data, i);
     }
   }
@@ -2879,6 +3365,16 @@ static void forStatement(Compiler* compiler)
   Loop loop;
   startLoop(compiler, &loop);
 
+  // Fast path for iterating a range: advances the iterator, stores it, and
+  // pushes the current value inline, then jumps straight to the body. For
+  // other sequences (and to exit the loop) it falls through to the protocol
+  // below.
+  emitOp(compiler, CODE_FOR_RANGE);
+  emitByte(compiler, seqSlot);
+  emitByte(compiler, iterSlot);
+  emitByte(compiler, 0xff);
+  int fastJump = emitByte(compiler, 0xff) - 1;
+
   // Advance the iterator by calling the ".iterate" method on the sequence.
   loadLocal(compiler, seqSlot);
   loadLocal(compiler, iterSlot);
@@ -2893,6 +3389,10 @@ static void forStatement(Compiler* compiler)
   loadLocal(compiler, iterSlot);
   callMethod(compiler, 1, "iteratorValue(_)", 16);
 
+  // The fast path skips all of the above and lands on the first instruction
+  // of the body.
+  patchJump(compiler, fastJump);
+
   // Bind the loop variable in its own scope. This ensures we get a fresh
   // variable each iteration so that closures for it don't all see the same one.
   pushScope(compiler);
@@ -3050,7 +3550,8 @@ static void createConstructor(Compiler* compiler, Signature* signature,
 {
   Compiler methodCompiler;
   initCompiler(&methodCompiler, compiler->parser, compiler, false);
-  
+  methodCompiler.fn->arity = signature->arity;
+
   // Allocate the instance.
   emitOp(&methodCompiler, compiler->enclosingClass->isForeign
        ? CODE_FOREIGN_CONSTRUCT : CODE_CONSTRUCT);
@@ -3058,7 +3559,8 @@ static void createConstructor(Compiler* compiler, Signature* signature,
   // Run its initializer.
   emitShortArg(&methodCompiler, (Code)(CODE_CALL_0 + signature->arity),
                initializerSymbol);
-  
+  emitCallCache(&methodCompiler);
+
   // Return the instance.
   emitOp(&methodCompiler, CODE_RETURN);
   
@@ -3138,7 +3640,8 @@ static bool method(Compiler* compiler, Variable classVariable)
 
   // Compile the method signature.
   signatureFn(&methodCompiler, &signature);
-  
+  methodCompiler.fn->arity = signature.arity;
+
   if (isStatic && signature.type == SIG_INITIALIZER)
   {
     error(compiler, "A constructor cannot be static.");
@@ -3272,7 +3775,7 @@ static void classDefinition(Compiler* compiler, bool isForeign)
   if (!isForeign)
   {
     compiler->fn->code.data[numFieldsInstruction] =
-        (uint8_t)classCompiler.fields.count;
+        (uint8_t)classCompiler.fields.names.count;
   }
   
   // Clear symbol tables for tracking field and method names.
@@ -3389,6 +3892,13 @@ void definition(Compiler* compiler)
 ObjFn* wrenCompile(WrenVM* vm, ObjModule* module, const char* source,
                    bool printErrors)
 {
+  // Variables the module already has were defined by an earlier compile. Only
+  // ones added during this compile can be implicit forward references, so the
+  // undefined-variable check below starts here. Without this, compiling more
+  // source into a running module -- Meta.eval() -- would mistake any existing
+  // variable whose current value happens to be a number for one.
+  int numExistingVariables = module->variables.count;
+
   Parser parser;
   parser.vm = vm;
   parser.module = module;
@@ -3437,14 +3947,14 @@ ObjFn* wrenCompile(WrenVM* vm, ObjModule* module, const char* source,
   // See if there are any implicitly declared module-level variables that never
   // got an explicit definition. They will have values that are numbers
   // indicating the line where the variable was first used.
-  for (int i = 0; i < parser.module->variables.count; i++)
+  for (int i = numExistingVariables; i < parser.module->variables.count; i++)
   {
     if (IS_NUM(parser.module->variables.data[i]))
     {
       // Synthesize a token for the original use site.
       parser.previous.type = TOKEN_NAME;
-      parser.previous.start = parser.module->variableNames.data[i].buffer;
-      parser.previous.length = parser.module->variableNames.data[i].length;
+      parser.previous.start = parser.module->variableNames.names.data[i].buffer;
+      parser.previous.length = parser.module->variableNames.names.data[i].length;
       parser.previous.line = (int)AS_NUM(parser.module->variables.data[i]);
       error(&compiler, "Variable is used but not defined.");
     }
@@ -3464,6 +3974,7 @@ void wrenBindMethodCode(ObjClass* classObj, ObjFn* fn)
       case CODE_LOAD_FIELD:
       case CODE_STORE_FIELD:
       case CODE_LOAD_FIELD_THIS:
+      case CODE_LOAD_FIELD_THIS_CALL:
       case CODE_STORE_FIELD_THIS:
         // Shift this class's fields down past the inherited ones. We don't
         // check for overflow here because we'll see if the number of fields
@@ -3500,11 +4011,14 @@ void wrenBindMethodCode(ObjClass* classObj, ObjFn* fn)
 
       case CODE_CLOSURE:
       {
-        // Bind the nested closure too.
+        // Bind the nested closure too. A zero-upvalue function is stored as
+        // a pre-built closure, so look through it to the function.
         int constant = (fn->code.data[ip] << 8) | fn->code.data[ip + 1];
-        wrenBindMethodCode(classObj, AS_FN(fn->constants.data[constant]));
+        Value nested = fn->constants.data[constant];
+        wrenBindMethodCode(classObj, IS_CLOSURE(nested)
+            ? AS_CLOSURE(nested)->fn : AS_FN(nested));
 
-        ip += getNumArguments(fn->code.data, fn->constants.data, ip - 1);
+        ip += wrenGetNumArguments(fn->code.data, fn->constants.data, ip - 1);
         break;
       }
 
@@ -3513,12 +4027,54 @@ void wrenBindMethodCode(ObjClass* classObj, ObjFn* fn)
 
       default:
         // Other instructions are unaffected, so just skip over them.
-        ip += getNumArguments(fn->code.data, fn->constants.data, ip - 1);
+        ip += wrenGetNumArguments(fn->code.data, fn->constants.data, ip - 1);
         break;
     }
   }
 }
 
+void wrenScanImports(WrenVM* vm, const char* source, WrenScanImportFn importFn)
+{
+  // Set up a lexing-only parser: no module, since nothing is compiled or
+  // resolved, and errors silently discarded -- a module that doesn't parse
+  // reports its errors when it's actually compiled.
+  Parser parser;
+  parser.vm = vm;
+  parser.module = NULL;
+  parser.source = source;
+
+  parser.tokenStart = source;
+  parser.currentChar = source;
+  parser.currentLine = 1;
+  parser.numParens = 0;
+
+  parser.current.type = TOKEN_ERROR;
+  parser.current.start = source;
+  parser.current.length = 0;
+  parser.current.line = 0;
+  parser.current.value = UNDEFINED_VAL;
+
+  parser.skipNewlines = true;
+  parser.printErrors = false;
+  parser.hasError = false;
+
+  nextToken(&parser);
+
+  while (parser.current.type != TOKEN_EOF)
+  {
+    bool wasImport = parser.current.type == TOKEN_IMPORT;
+    nextToken(&parser);
+
+    // Report the name right away: the token's string is only reachable
+    // through the token, so the next token's allocations could collect it.
+    if (wasImport && parser.current.type == TOKEN_STRING &&
+        IS_STRING(parser.current.value))
+    {
+      importFn(vm, AS_STRING(parser.current.value)->value);
+    }
+  }
+}
+
 void wrenMarkCompiler(WrenVM* vm, Compiler* compiler)
 {
   wrenGrayValue(vm, compiler->parser->current.value);
@@ -50,4 +50,10 @@ void wrenBindMethodCode(ObjClass* classObj, ObjFn* fn);
 // its parents) so that they are not collected by the GC.
 void wrenMarkCompiler(WrenVM* vm, Compiler* compiler);
 
+// Returns the number of operand bytes of the instruction at [ip] in
+// [bytecode]. CODE_CLOSURE's operand count depends on the function it loads,
+// so [constants] must be the constant pool the bytecode refers to.
+int wrenGetNumArguments(const uint8_t* bytecode, const Value* constants,
+                        int ip);
+
 #endif
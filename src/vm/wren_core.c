@@ -1,15 +1,33 @@
 #include <ctype.h>
 #include <errno.h>
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 #include "wren_common.h"
 #include "wren_core.h"
+#include "wren_debug.h"
 #include "wren_primitive.h"
 #include "wren_value.h"
 
-#include "wren_core.wren.inc"
+// When the precompiled image is in use the source isn't needed at all, so
+// only one of the two is compiled in.
+#if WREN_CORE_SNAPSHOT && !WREN_CORE_SNAPSHOT_GENERATOR
+  #include "wren_core.snapshot.inc"
+#else
+  #include "wren_core.wren.inc"
+#endif
+
+#if WREN_CORE_SNAPSHOT_GENERATOR
+  #include "wren_compiler.h"
+  #include "wren_snapshot.h"
+
+// The serialized core module image captured while bootstrapping the generator
+// tool's VM. See util/generate_core_snapshot.c.
+char* wrenCapturedCoreSnapshot = NULL;
+size_t wrenCapturedCoreSnapshotLength = 0;
+#endif
 
 DEF_PRIMITIVE(bool_not)
 {
@@ -63,6 +81,41 @@ DEF_PRIMITIVE(fiber_new)
   RETURN_OBJ(newFiber);
 }
 
+// Creates a fiber for the closure in args[1] with capacity reserved for
+// [stackSlots] stack slots and [numFrames] call frames, so the fiber won't
+// have to grow either array mid-execution.
+static bool newFiberWithCapacity(WrenVM* vm, Value* args, Value stackSlots,
+                                 Value numFrames)
+{
+  if (!validateFn(vm, args[1], "Argument")) return false;
+  if (!validateInt(vm, stackSlots, "Stack capacity")) return false;
+  if (AS_NUM(stackSlots) < 0) RETURN_ERROR("Stack capacity cannot be negative.");
+  if (!validateInt(vm, numFrames, "Frame capacity")) return false;
+  if (AS_NUM(numFrames) < 0) RETURN_ERROR("Frame capacity cannot be negative.");
+
+  ObjFiber* newFiber = wrenNewFiberWithCapacity(vm, AS_CLOSURE(args[1]),
+                                                (int)AS_NUM(stackSlots),
+                                                (int)AS_NUM(numFrames));
+
+  // The compiler expects the first slot of a function to hold the receiver.
+  // Since a fiber's stack is invoked directly, it doesn't have one, so put it
+  // in here.
+  newFiber->stack[0] = NULL_VAL;
+  newFiber->stackTop++;
+
+  RETURN_OBJ(newFiber);
+}
+
+DEF_PRIMITIVE(fiber_new2)
+{
+  return newFiberWithCapacity(vm, args, args[2], NUM_VAL(0));
+}
+
+DEF_PRIMITIVE(fiber_new3)
+{
+  return newFiberWithCapacity(vm, args, args[2], args[3]);
+}
+
 DEF_PRIMITIVE(fiber_abort)
 {
   vm->fiber->error = args[1];
@@ -134,6 +187,19 @@ DEF_PRIMITIVE(fiber_error)
   RETURN_VAL(AS_FIBER(args[0])->error);
 }
 
+DEF_PRIMITIVE(fiber_stackTrace)
+{
+  ObjFiber* runFiber = AS_FIBER(args[0]);
+
+  size_t length;
+  char* trace = wrenDebugStackTraceString(vm, runFiber, &length);
+  if (trace == NULL) RETURN_NULL;
+
+  Value result = wrenNewString(vm, trace, (uint32_t)length);
+  DEALLOCATE(vm, trace);
+  RETURN_VAL(result);
+}
+
 DEF_PRIMITIVE(fiber_isDone)
 {
   ObjFiber* runFiber = AS_FIBER(args[0]);
@@ -216,6 +282,108 @@ DEF_PRIMITIVE(fiber_yield1)
   return false;
 }
 
+DEF_PRIMITIVE(floatArray_new)
+{
+  if (!validateInt(vm, args[1], "Count")) return false;
+  if (AS_NUM(args[1]) < 0) RETURN_ERROR("Count cannot be negative.");
+
+  RETURN_OBJ(wrenNewFloatArray(vm, (uint32_t)AS_NUM(args[1])));
+}
+
+DEF_PRIMITIVE(floatArray_subscript)
+{
+  ObjFloatArray* array = AS_FLOAT_ARRAY(args[0]);
+
+  uint32_t index = validateIndex(vm, args[1], array->count, "Subscript");
+  if (index == UINT32_MAX) return false;
+
+  RETURN_NUM(array->elements[index]);
+}
+
+DEF_PRIMITIVE(floatArray_subscriptSetter)
+{
+  ObjFloatArray* array = AS_FLOAT_ARRAY(args[0]);
+
+  uint32_t index = validateIndex(vm, args[1], array->count, "Subscript");
+  if (index == UINT32_MAX) return false;
+
+  if (!validateNum(vm, args[2], "Value")) return false;
+
+  array->elements[index] = AS_NUM(args[2]);
+  RETURN_VAL(args[2]);
+}
+
+DEF_PRIMITIVE(floatArray_copyFrom)
+{
+  if (!IS_FLOAT_ARRAY(args[1]))
+  {
+    RETURN_ERROR("Argument must be a FloatArray.");
+  }
+
+  ObjFloatArray* array = AS_FLOAT_ARRAY(args[0]);
+  ObjFloatArray* source = AS_FLOAT_ARRAY(args[1]);
+
+  // Copy as many elements as both arrays have.
+  uint32_t count = array->count < source->count ? array->count
+                                                : source->count;
+  if (count > 0)
+  {
+    memcpy(array->elements, source->elements, count * sizeof(double));
+  }
+
+  RETURN_VAL(args[0]);
+}
+
+DEF_PRIMITIVE(floatArray_count)
+{
+  RETURN_NUM(AS_FLOAT_ARRAY(args[0])->count);
+}
+
+DEF_PRIMITIVE(floatArray_fill)
+{
+  if (!validateNum(vm, args[1], "Value")) return false;
+
+  ObjFloatArray* array = AS_FLOAT_ARRAY(args[0]);
+  double value = AS_NUM(args[1]);
+  for (uint32_t i = 0; i < array->count; i++)
+  {
+    array->elements[i] = value;
+  }
+
+  RETURN_VAL(args[0]);
+}
+
+DEF_PRIMITIVE(floatArray_iterate)
+{
+  ObjFloatArray* array = AS_FLOAT_ARRAY(args[0]);
+
+  // If we're starting the iteration, return the first index.
+  if (IS_NULL(args[1]))
+  {
+    if (array->count == 0) RETURN_FALSE;
+    RETURN_NUM(0);
+  }
+
+  if (!validateInt(vm, args[1], "Iterator")) return false;
+
+  // Stop if we're out of bounds. The count is unsigned, so convert it before
+  // subtracting to keep an empty array from wrapping around.
+  double index = AS_NUM(args[1]);
+  if (index < 0 || index >= (double)array->count - 1) RETURN_FALSE;
+
+  // Otherwise, move to the next index.
+  RETURN_NUM(index + 1);
+}
+
+DEF_PRIMITIVE(floatArray_iteratorValue)
+{
+  ObjFloatArray* array = AS_FLOAT_ARRAY(args[0]);
+  uint32_t index = validateIndex(vm, args[1], array->count, "Iterator");
+  if (index == UINT32_MAX) return false;
+
+  RETURN_NUM(array->elements[index]);
+}
+
 DEF_PRIMITIVE(fn_new)
 {
   if (!validateFn(vm, args[1], "Argument")) return false;
@@ -242,6 +410,35 @@ DEF_PRIMITIVE(list_new)
 DEF_PRIMITIVE(list_add)
 {
   wrenValueBufferWrite(vm, &AS_LIST(args[0])->elements, args[1]);
+  wrenWriteBarrier(vm, AS_OBJ(args[0]), args[1]);
+  RETURN_VAL(args[1]);
+}
+
+// Appends every element of another list in one step. addAll() calls this
+// after checking that the argument is a list; other sequences take the
+// iterate-and-add path in Wren.
+DEF_PRIMITIVE(list_addAll)
+{
+  if (!IS_LIST(args[1])) RETURN_ERROR("Argument must be a list.");
+
+  ObjList* list = AS_LIST(args[0]);
+  ObjList* other = AS_LIST(args[1]);
+  uint32_t count = (uint32_t)list->elements.count;
+  uint32_t otherCount = (uint32_t)other->elements.count;
+  if (otherCount == 0) RETURN_VAL(args[1]);
+
+  // Grow to the final size in one step instead of paying a grow-and-copy
+  // every time the buffer fills up along the way.
+  wrenListReserve(vm, list, count + otherCount);
+  memcpy(list->elements.data + count, other->elements.data,
+         otherCount * sizeof(Value));
+  list->elements.count = (int)(count + otherCount);
+
+  for (uint32_t i = 0; i < otherCount; i++)
+  {
+    wrenWriteBarrier(vm, (Obj*)list, list->elements.data[count + i]);
+  }
+
   RETURN_VAL(args[1]);
 }
 
@@ -251,7 +448,8 @@ DEF_PRIMITIVE(list_add)
 DEF_PRIMITIVE(list_addCore)
 {
   wrenValueBufferWrite(vm, &AS_LIST(args[0])->elements, args[1]);
-  
+  wrenWriteBarrier(vm, AS_OBJ(args[0]), args[1]);
+
   // Return the list.
   RETURN_VAL(args[0]);
 }
@@ -319,6 +517,63 @@ DEF_PRIMITIVE(list_removeAt)
   RETURN_VAL(wrenListRemoveAt(vm, list, index));
 }
 
+DEF_PRIMITIVE(list_reserve)
+{
+  if (!validateInt(vm, args[1], "Capacity")) return false;
+
+  double capacity = AS_NUM(args[1]);
+  if (capacity < 0) RETURN_ERROR("Capacity cannot be negative.");
+
+  wrenListReserve(vm, AS_LIST(args[0]), (uint32_t)capacity);
+  RETURN_NULL;
+}
+
+// Comparison callbacks for sorting a list's element array directly with
+// qsort() when every element is the same primitive type.
+static int sortCompareNum(const void* a, const void* b)
+{
+  double aNum = AS_NUM(*(const Value*)a);
+  double bNum = AS_NUM(*(const Value*)b);
+  if (aNum < bNum) return -1;
+  return aNum > bNum ? 1 : 0;
+}
+
+static int sortCompareString(const void* a, const void* b)
+{
+  ObjString* aString = AS_STRING(*(const Value*)a);
+  ObjString* bString = AS_STRING(*(const Value*)b);
+  uint32_t length = aString->length < bString->length ? aString->length
+                                                      : bString->length;
+  int comparison = memcmp(aString->value, bString->value, length);
+  if (comparison != 0) return comparison;
+  return (int)aString->length - (int)bString->length;
+}
+
+// Sorts the list in place and returns true if every element is a Num or
+// every element is a String, so no method sends are needed to compare them.
+// Returns false otherwise, and sort() falls back to the comparer-based sort
+// in Wren.
+DEF_PRIMITIVE(list_sort)
+{
+  ObjList* list = AS_LIST(args[0]);
+  uint32_t count = (uint32_t)list->elements.count;
+  if (count < 2) RETURN_TRUE;
+
+  bool allNums = true;
+  bool allStrings = true;
+  for (uint32_t i = 0; i < count; i++)
+  {
+    Value element = list->elements.data[i];
+    if (!IS_NUM(element)) allNums = false;
+    if (!IS_STRING(element)) allStrings = false;
+    if (!allNums && !allStrings) RETURN_FALSE;
+  }
+
+  qsort(list->elements.data, count, sizeof(Value),
+        allNums ? sortCompareNum : sortCompareString);
+  RETURN_TRUE;
+}
+
 DEF_PRIMITIVE(list_subscript)
 {
   ObjList* list = AS_LIST(args[0]);
@@ -354,11 +609,45 @@ DEF_PRIMITIVE(list_subscript)
 DEF_PRIMITIVE(list_subscriptSetter)
 {
   ObjList* list = AS_LIST(args[0]);
-  uint32_t index = validateIndex(vm, args[1], list->elements.count,
-                                 "Subscript");
-  if (index == UINT32_MAX) return false;
 
-  list->elements.data[index] = args[2];
+  if (IS_NUM(args[1]))
+  {
+    uint32_t index = validateIndex(vm, args[1], list->elements.count,
+                                   "Subscript");
+    if (index == UINT32_MAX) return false;
+
+    list->elements.data[index] = args[2];
+    wrenWriteBarrier(vm, (Obj*)list, args[2]);
+    RETURN_VAL(args[2]);
+  }
+
+  if (!IS_RANGE(args[1]))
+  {
+    RETURN_ERROR("Subscript must be a number or a range.");
+  }
+
+  // Assigning to a range splices the value's elements over the slice,
+  // growing or shrinking the list if the sizes differ.
+  if (!IS_LIST(args[2])) RETURN_ERROR("Slice value must be a list.");
+
+  ObjRange* range = AS_RANGE(args[1]);
+  int step;
+  uint32_t count = list->elements.count;
+  uint32_t start = calculateRange(vm, range, &count, &step);
+  if (start == UINT32_MAX) return false;
+  if (count > 1 && step < 0)
+  {
+    RETURN_ERROR("Slice must be a forward range.");
+  }
+
+  // calculateRange() anchors the empty at-the-end range at zero, but a
+  // splice there should append.
+  if (count == 0 && range->from == list->elements.count)
+  {
+    start = (uint32_t)list->elements.count;
+  }
+
+  wrenListReplaceRange(vm, list, start, count, AS_LIST(args[2]));
   RETURN_VAL(args[2]);
 }
 
@@ -434,14 +723,15 @@ DEF_PRIMITIVE(map_iterate)
     if (AS_NUM(args[1]) < 0) RETURN_FALSE;
     index = (uint32_t)AS_NUM(args[1]);
 
-    if (index >= map->capacity) RETURN_FALSE;
+    if (index >= map->entryCount) RETURN_FALSE;
 
     // Advance the iterator.
     index++;
   }
 
-  // Find a used entry, if any.
-  for (; index < map->capacity; index++)
+  // Entries are stored in insertion order, so just skip over any holes left
+  // by removed keys.
+  for (; index < map->entryCount; index++)
   {
     if (!IS_UNDEFINED(map->entries[index].key)) RETURN_NUM(index);
   }
@@ -460,7 +750,7 @@ DEF_PRIMITIVE(map_remove)
 DEF_PRIMITIVE(map_keyIteratorValue)
 {
   ObjMap* map = AS_MAP(args[0]);
-  uint32_t index = validateIndex(vm, args[1], map->capacity, "Iterator");
+  uint32_t index = validateIndex(vm, args[1], map->entryCount, "Iterator");
   if (index == UINT32_MAX) return false;
 
   MapEntry* entry = &map->entries[index];
@@ -475,7 +765,7 @@ DEF_PRIMITIVE(map_keyIteratorValue)
 DEF_PRIMITIVE(map_valueIteratorValue)
 {
   ObjMap* map = AS_MAP(args[0]);
-  uint32_t index = validateIndex(vm, args[1], map->capacity, "Iterator");
+  uint32_t index = validateIndex(vm, args[1], map->entryCount, "Iterator");
   if (index == UINT32_MAX) return false;
 
   MapEntry* entry = &map->entries[index];
@@ -506,6 +796,27 @@ DEF_PRIMITIVE(num_fromString)
   // Corner case: Can't parse an empty string.
   if (string->length == 0) RETURN_NULL;
 
+  // Fast path: a plain optionally-signed run of decimal digits is the common
+  // case when deserializing and doesn't need strtod(). Fifteen or fewer
+  // digits always fit in a double exactly.
+  const char* c = string->value;
+  bool negative = *c == '-';
+  if (*c == '-' || *c == '+') c++;
+
+  const char* digits = c;
+  int64_t integer = 0;
+  while (*c >= '0' && *c <= '9')
+  {
+    integer = integer * 10 + (*c - '0');
+    c++;
+  }
+
+  if (c > digits && c - digits <= 15 && c == string->value + string->length)
+  {
+    double number = (double)integer;
+    RETURN_NUM(negative ? -number : number);
+  }
+
   errno = 0;
   char* end;
   double number = strtod(string->value, &end);
@@ -862,6 +1173,13 @@ DEF_PRIMITIVE(string_codePointAt)
                             string->length - index));
 }
 
+DEF_PRIMITIVE(string_count)
+{
+  ObjString* string = AS_STRING(args[0]);
+  RETURN_NUM(wrenUtf8CountCodePoints((uint8_t*)string->value,
+                                     string->length));
+}
+
 DEF_PRIMITIVE(string_contains)
 {
   if (!validateString(vm, args[1], "Argument")) return false;
@@ -971,7 +1289,33 @@ DEF_PRIMITIVE(string_startsWith)
 DEF_PRIMITIVE(string_plus)
 {
   if (!validateString(vm, args[1], "Right operand")) return false;
-  RETURN_VAL(wrenStringFormat(vm, "@@", args[0], args[1]));
+  RETURN_VAL(wrenStringConcat(vm, AS_STRING(args[0]), AS_STRING(args[1])));
+}
+
+// Joins a list of strings with a separator in a single pass. This is called
+// by Sequence.join() instead of concatenating in a loop, which would copy the
+// accumulated result again for every element.
+DEF_PRIMITIVE(string_joinCore)
+{
+  ObjList* parts = AS_LIST(args[1]);
+
+  // Validate in the same order repeated concatenation would have: each
+  // element must be a string, and the separator is only checked once it's
+  // actually used.
+  for (int i = 0; i < parts->elements.count; i++)
+  {
+    if (i == 1 && !validateString(vm, args[2], "Right operand")) return false;
+
+    if (!IS_STRING(parts->elements.data[i]))
+    {
+      RETURN_ERROR("Right operand must be a string.");
+    }
+  }
+
+  if (parts->elements.count == 0) RETURN_VAL(CONST_STRING(vm, ""));
+  if (parts->elements.count == 1) RETURN_VAL(parts->elements.data[0]);
+
+  RETURN_VAL(wrenStringJoin(vm, parts, AS_STRING(args[2])));
 }
 
 DEF_PRIMITIVE(string_subscript)
@@ -1004,6 +1348,94 @@ DEF_PRIMITIVE(string_toString)
   RETURN_VAL(args[0]);
 }
 
+DEF_PRIMITIVE(stringBuffer_new)
+{
+  RETURN_OBJ(wrenNewStringBuffer(vm));
+}
+
+DEF_PRIMITIVE(stringBuffer_append)
+{
+  if (!validateString(vm, args[1], "Argument")) return false;
+
+  ObjString* string = AS_STRING(args[1]);
+  wrenStringBufferAppend(vm, AS_STRING_BUFFER(args[0]), string->value,
+                         string->length);
+  RETURN_VAL(args[1]);
+}
+
+DEF_PRIMITIVE(stringBuffer_appendNumber)
+{
+  if (!validateNum(vm, args[1], "Argument")) return false;
+
+  // Format straight into the buffer's byte array so appending a number
+  // doesn't allocate an intermediate string.
+  char buffer[24];
+  int length = wrenNumToCString(AS_NUM(args[1]), buffer);
+  wrenStringBufferAppend(vm, AS_STRING_BUFFER(args[0]), buffer, length);
+  RETURN_VAL(args[1]);
+}
+
+DEF_PRIMITIVE(stringBuffer_appendValue)
+{
+  // Appends values whose string form is known here without calling toString,
+  // so string interpolation can format them without allocating intermediate
+  // strings. Returns false for other values, which fall back to toString in
+  // Wren.
+  ObjStringBuffer* buffer = AS_STRING_BUFFER(args[0]);
+  Value value = args[1];
+
+  if (IS_STRING(value))
+  {
+    ObjString* string = AS_STRING(value);
+    wrenStringBufferAppend(vm, buffer, string->value, string->length);
+  }
+  else if (IS_NUM(value))
+  {
+    char bytes[24];
+    int length = wrenNumToCString(AS_NUM(value), bytes);
+    wrenStringBufferAppend(vm, buffer, bytes, length);
+  }
+  else if (IS_BOOL(value))
+  {
+    if (AS_BOOL(value))
+    {
+      wrenStringBufferAppend(vm, buffer, "true", 4);
+    }
+    else
+    {
+      wrenStringBufferAppend(vm, buffer, "false", 5);
+    }
+  }
+  else if (IS_NULL(value))
+  {
+    wrenStringBufferAppend(vm, buffer, "null", 4);
+  }
+  else
+  {
+    RETURN_FALSE;
+  }
+
+  RETURN_TRUE;
+}
+
+DEF_PRIMITIVE(stringBuffer_clear)
+{
+  wrenByteBufferClear(vm, &AS_STRING_BUFFER(args[0])->bytes);
+  RETURN_NULL;
+}
+
+DEF_PRIMITIVE(stringBuffer_count)
+{
+  RETURN_NUM(AS_STRING_BUFFER(args[0])->bytes.count);
+}
+
+DEF_PRIMITIVE(stringBuffer_toString)
+{
+  ObjStringBuffer* buffer = AS_STRING_BUFFER(args[0]);
+  RETURN_VAL(wrenNewString(vm, (const char*)buffer->bytes.data,
+                           buffer->bytes.count));
+}
+
 DEF_PRIMITIVE(system_clock)
 {
   RETURN_NUM((double)clock() / CLOCKS_PER_SEC);
@@ -1058,6 +1490,85 @@ DEF_PRIMITIVE(system_writeString)
   RETURN_VAL(args[1]);
 }
 
+DEF_PRIMITIVE(system_writeValue)
+{
+  // Writes values whose string form is known here straight to the host,
+  // without calling toString, so printing them doesn't allocate. Returns false
+  // for other values, which fall back to toString in Wren. The toStrings of
+  // these types have no side effects, so skipping them when there is no
+  // writeFn is not observable.
+  Value value = args[1];
+  const char* text;
+  char bytes[24];
+
+  if (IS_STRING(value))
+  {
+    text = AS_CSTRING(value);
+  }
+  else if (IS_NUM(value))
+  {
+    wrenNumToCString(AS_NUM(value), bytes);
+    text = bytes;
+  }
+  else if (IS_BOOL(value))
+  {
+    text = AS_BOOL(value) ? "true" : "false";
+  }
+  else if (IS_NULL(value))
+  {
+    text = "null";
+  }
+  else
+  {
+    RETURN_FALSE;
+  }
+
+  if (vm->config.writeFn != NULL) vm->config.writeFn(vm, text);
+  RETURN_TRUE;
+}
+
+DEF_PRIMITIVE(profiler_start)
+{
+  wrenProfilerStart(vm);
+  RETURN_NULL;
+}
+
+DEF_PRIMITIVE(profiler_stop)
+{
+  wrenProfilerStop(vm);
+  RETURN_NULL;
+}
+
+DEF_PRIMITIVE(profiler_report)
+{
+  size_t length;
+  char* report = wrenProfilerReportString(vm, &length);
+  Value result = wrenNewString(vm, report, (uint32_t)length);
+  DEALLOCATE(vm, report);
+  RETURN_VAL(result);
+}
+
+DEF_PRIMITIVE(profiler_startAllocations)
+{
+  wrenHeapProfilerStart(vm);
+  RETURN_NULL;
+}
+
+DEF_PRIMITIVE(profiler_stopAllocations)
+{
+  wrenHeapProfilerStop(vm);
+  RETURN_NULL;
+}
+
+DEF_PRIMITIVE(profiler_heapReport)
+{
+  size_t length;
+  char* report = wrenHeapReportString(vm, &length);
+  Value result = wrenNewString(vm, report, (uint32_t)length);
+  DEALLOCATE(vm, report);
+  RETURN_VAL(result);
+}
+
 // Creates either the Object or Class class in the core module with [name].
 static ObjClass* defineClass(WrenVM* vm, ObjModule* module, const char* name)
 {
@@ -1148,7 +1659,24 @@ void wrenInitializeCore(WrenVM* vm)
   //   '---------'   '-------------------'            -'
 
   // The rest of the classes can now be defined normally.
+#if WREN_CORE_SNAPSHOT_GENERATOR
+  // We're building the snapshot generator tool. The core module has to be
+  // captured right here: the compiler sees exactly the variables and method
+  // symbols a freshly created VM has, so the image it produces validates in
+  // any VM at this same point in bootstrap. Then bootstrap from the captured
+  // image so the tool also exercises the loading path it's generating for.
+  ObjFn* coreFn = wrenCompile(vm, coreModule, coreModuleSource, true);
+  wrenPushRoot(vm, (Obj*)coreFn);
+  wrenCapturedCoreSnapshot = wrenSnapshotSerialize(vm, coreFn,
+      &wrenCapturedCoreSnapshotLength);
+  wrenPopRoot(vm); // coreFn.
+
+  wrenInterpretInModule(vm, NULL, wrenCapturedCoreSnapshot);
+#elif WREN_CORE_SNAPSHOT
+  wrenInterpretInModule(vm, NULL, (const char*)coreModuleSnapshot);
+#else
   wrenInterpretInModule(vm, NULL, coreModuleSource);
+#endif
 
   vm->boolClass = AS_CLASS(wrenFindVariable(vm, coreModule, "Bool"));
   PRIMITIVE(vm->boolClass, "toString", bool_toString);
@@ -1156,6 +1684,8 @@ void wrenInitializeCore(WrenVM* vm)
 
   vm->fiberClass = AS_CLASS(wrenFindVariable(vm, coreModule, "Fiber"));
   PRIMITIVE(vm->fiberClass->obj.classObj, "new(_)", fiber_new);
+  PRIMITIVE(vm->fiberClass->obj.classObj, "new(_,_)", fiber_new2);
+  PRIMITIVE(vm->fiberClass->obj.classObj, "new(_,_,_)", fiber_new3);
   PRIMITIVE(vm->fiberClass->obj.classObj, "abort(_)", fiber_abort);
   PRIMITIVE(vm->fiberClass->obj.classObj, "current", fiber_current);
   PRIMITIVE(vm->fiberClass->obj.classObj, "suspend()", fiber_suspend);
@@ -1165,11 +1695,23 @@ void wrenInitializeCore(WrenVM* vm)
   PRIMITIVE(vm->fiberClass, "call(_)", fiber_call1);
   PRIMITIVE(vm->fiberClass, "error", fiber_error);
   PRIMITIVE(vm->fiberClass, "isDone", fiber_isDone);
+  PRIMITIVE(vm->fiberClass, "stackTrace", fiber_stackTrace);
   PRIMITIVE(vm->fiberClass, "transfer()", fiber_transfer);
   PRIMITIVE(vm->fiberClass, "transfer(_)", fiber_transfer1);
   PRIMITIVE(vm->fiberClass, "transferError(_)", fiber_transferError);
   PRIMITIVE(vm->fiberClass, "try()", fiber_try);
 
+  vm->floatArrayClass =
+      AS_CLASS(wrenFindVariable(vm, coreModule, "FloatArray"));
+  PRIMITIVE(vm->floatArrayClass->obj.classObj, "new(_)", floatArray_new);
+  PRIMITIVE(vm->floatArrayClass, "[_]", floatArray_subscript);
+  PRIMITIVE(vm->floatArrayClass, "[_]=(_)", floatArray_subscriptSetter);
+  PRIMITIVE(vm->floatArrayClass, "copyFrom(_)", floatArray_copyFrom);
+  PRIMITIVE(vm->floatArrayClass, "count", floatArray_count);
+  PRIMITIVE(vm->floatArrayClass, "fill(_)", floatArray_fill);
+  PRIMITIVE(vm->floatArrayClass, "iterate(_)", floatArray_iterate);
+  PRIMITIVE(vm->floatArrayClass, "iteratorValue(_)", floatArray_iteratorValue);
+
   vm->fnClass = AS_CLASS(wrenFindVariable(vm, coreModule, "Fn"));
   PRIMITIVE(vm->fnClass->obj.classObj, "new(_)", fn_new);
 
@@ -1244,12 +1786,14 @@ void wrenInitializeCore(WrenVM* vm)
 
   vm->stringClass = AS_CLASS(wrenFindVariable(vm, coreModule, "String"));
   PRIMITIVE(vm->stringClass->obj.classObj, "fromCodePoint(_)", string_fromCodePoint);
+  PRIMITIVE(vm->stringClass->obj.classObj, "joinCore_(_,_)", string_joinCore);
   PRIMITIVE(vm->stringClass, "+(_)", string_plus);
   PRIMITIVE(vm->stringClass, "[_]", string_subscript);
   PRIMITIVE(vm->stringClass, "byteAt_(_)", string_byteAt);
   PRIMITIVE(vm->stringClass, "byteCount_", string_byteCount);
   PRIMITIVE(vm->stringClass, "codePointAt_(_)", string_codePointAt);
   PRIMITIVE(vm->stringClass, "contains(_)", string_contains);
+  PRIMITIVE(vm->stringClass, "count", string_count);
   PRIMITIVE(vm->stringClass, "endsWith(_)", string_endsWith);
   PRIMITIVE(vm->stringClass, "indexOf(_)", string_indexOf);
   PRIMITIVE(vm->stringClass, "iterate(_)", string_iterate);
@@ -1258,11 +1802,24 @@ void wrenInitializeCore(WrenVM* vm)
   PRIMITIVE(vm->stringClass, "startsWith(_)", string_startsWith);
   PRIMITIVE(vm->stringClass, "toString", string_toString);
 
+  vm->stringBufferClass =
+      AS_CLASS(wrenFindVariable(vm, coreModule, "StringBuffer"));
+  PRIMITIVE(vm->stringBufferClass->obj.classObj, "new()", stringBuffer_new);
+  PRIMITIVE(vm->stringBufferClass, "append(_)", stringBuffer_append);
+  PRIMITIVE(vm->stringBufferClass, "appendNumber(_)",
+            stringBuffer_appendNumber);
+  PRIMITIVE(vm->stringBufferClass, "appendValue_(_)",
+            stringBuffer_appendValue);
+  PRIMITIVE(vm->stringBufferClass, "clear()", stringBuffer_clear);
+  PRIMITIVE(vm->stringBufferClass, "count", stringBuffer_count);
+  PRIMITIVE(vm->stringBufferClass, "toString", stringBuffer_toString);
+
   vm->listClass = AS_CLASS(wrenFindVariable(vm, coreModule, "List"));
   PRIMITIVE(vm->listClass->obj.classObj, "new()", list_new);
   PRIMITIVE(vm->listClass, "[_]", list_subscript);
   PRIMITIVE(vm->listClass, "[_]=(_)", list_subscriptSetter);
   PRIMITIVE(vm->listClass, "add(_)", list_add);
+  PRIMITIVE(vm->listClass, "addAll_(_)", list_addAll);
   PRIMITIVE(vm->listClass, "addCore_(_)", list_addCore);
   PRIMITIVE(vm->listClass, "clear()", list_clear);
   PRIMITIVE(vm->listClass, "count", list_count);
@@ -1270,6 +1827,8 @@ void wrenInitializeCore(WrenVM* vm)
   PRIMITIVE(vm->listClass, "iterate(_)", list_iterate);
   PRIMITIVE(vm->listClass, "iteratorValue(_)", list_iteratorValue);
   PRIMITIVE(vm->listClass, "removeAt(_)", list_removeAt);
+  PRIMITIVE(vm->listClass, "reserve(_)", list_reserve);
+  PRIMITIVE(vm->listClass, "sort_()", list_sort);
 
   vm->mapClass = AS_CLASS(wrenFindVariable(vm, coreModule, "Map"));
   PRIMITIVE(vm->mapClass->obj.classObj, "new()", map_new);
@@ -1302,6 +1861,18 @@ void wrenInitializeCore(WrenVM* vm)
   PRIMITIVE(systemClass->obj.classObj, "getModuleVariable(_,_)", system_getModuleVariable);
   PRIMITIVE(systemClass->obj.classObj, "importModule(_)", system_importModule);
   PRIMITIVE(systemClass->obj.classObj, "writeString_(_)", system_writeString);
+  PRIMITIVE(systemClass->obj.classObj, "writeValue_(_)", system_writeValue);
+
+  ObjClass* profilerClass =
+      AS_CLASS(wrenFindVariable(vm, coreModule, "Profiler"));
+  PRIMITIVE(profilerClass->obj.classObj, "start()", profiler_start);
+  PRIMITIVE(profilerClass->obj.classObj, "stop()", profiler_stop);
+  PRIMITIVE(profilerClass->obj.classObj, "report", profiler_report);
+  PRIMITIVE(profilerClass->obj.classObj, "startAllocations()",
+            profiler_startAllocations);
+  PRIMITIVE(profilerClass->obj.classObj, "stopAllocations()",
+            profiler_stopAllocations);
+  PRIMITIVE(profilerClass->obj.classObj, "heapReport", profiler_heapReport);
 
   // While bootstrapping the core types and running the core module, a number
   // of string objects have been created, many of which were instantiated
@@ -1315,4 +1886,10 @@ void wrenInitializeCore(WrenVM* vm)
   {
     if (obj->type == OBJ_STRING) obj->classObj = vm->stringClass;
   }
+
+  // When generational collection is enabled, they're in the nursery instead.
+  for (Obj* obj = vm->nursery; obj != NULL; obj = obj->next)
+  {
+    if (obj->type == OBJ_STRING) obj->classObj = vm->stringClass;
+  }
 }
@@ -20,4 +20,12 @@
 
 void wrenInitializeCore(WrenVM* vm);
 
+#if WREN_CORE_SNAPSHOT_GENERATOR
+// When building the core snapshot generator, wrenInitializeCore() captures
+// the serialized core module image here instead of compiling the core source
+// into the VM directly. See util/generate_core_snapshot.c.
+extern char* wrenCapturedCoreSnapshot;
+extern size_t wrenCapturedCoreSnapshotLength;
+#endif
+
 #endif
@@ -1,12 +1,33 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "wren_debug.h"
 
+void wrenDebugCaptureStackTrace(WrenVM* vm, ObjFiber* fiber)
+{
+  if (fiber->numFrames > fiber->traceCapacity)
+  {
+    int capacity = wrenPowerOf2Ceil(fiber->numFrames);
+    fiber->trace = (TraceFrame*)wrenReallocate(vm, fiber->trace,
+        sizeof(TraceFrame) * fiber->traceCapacity,
+        sizeof(TraceFrame) * capacity);
+    fiber->traceCapacity = capacity;
+  }
+
+  fiber->traceCount = fiber->numFrames;
+  for (int i = 0; i < fiber->numFrames; i++)
+  {
+    CallFrame* frame = &fiber->frames[i];
+    fiber->trace[i].fn = frame->closure->fn;
+    fiber->trace[i].ip = (int)(frame->ip - frame->closure->fn->code.data);
+  }
+}
+
 void wrenDebugPrintStackTrace(WrenVM* vm)
 {
   // Bail if the host doesn't enable printing errors.
   if (vm->config.errorFn == NULL) return;
-  
+
   ObjFiber* fiber = vm->fiber;
   if (IS_STRING(fiber->error))
   {
@@ -19,26 +40,73 @@ void wrenDebugPrintStackTrace(WrenVM* vm)
     vm->config.errorFn(WREN_ERROR_RUNTIME, NULL, -1, "[error object]");
   }
 
-  for (int i = fiber->numFrames - 1; i >= 0; i--)
+  for (int i = fiber->traceCount - 1; i >= 0; i--)
   {
-    CallFrame* frame = &fiber->frames[i];
-    ObjFn* fn = frame->closure->fn;
+    ObjFn* fn = fiber->trace[i].fn;
 
     // Skip over stub functions for calling methods from the C API.
     if (fn->module == NULL) continue;
-    
+
     // The built-in core module has no name. We explicitly omit it from stack
     // traces since we don't want to highlight to a user the implementation
     // detail of what part of the core module is written in C and what is Wren.
     if (fn->module->name == NULL) continue;
-    
+
     // -1 because IP has advanced past the instruction that it just executed.
-    int line = fn->debug->sourceLines.data[frame->ip - fn->code.data - 1];
+    int line = fn->debug->sourceLines.data[fiber->trace[i].ip - 1];
     vm->config.errorFn(WREN_ERROR_STACK_TRACE, fn->module->name->value, line,
                        fn->debug->name);
   }
 }
 
+// Appends [count] bytes from [bytes] to the trace being built in [buffer].
+static void appendTrace(WrenVM* vm, ByteBuffer* buffer, const char* bytes,
+                        int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    wrenByteBufferWrite(vm, buffer, (uint8_t)bytes[i]);
+  }
+}
+
+char* wrenDebugStackTraceString(WrenVM* vm, ObjFiber* fiber, size_t* length)
+{
+  if (fiber->traceCount == 0) return NULL;
+
+  ByteBuffer buffer;
+  wrenByteBufferInit(&buffer);
+
+  // Line numbers are formatted into [piece]; the names, whose lengths aren't
+  // bounded, are appended directly.
+  char piece[64];
+  for (int i = fiber->traceCount - 1; i >= 0; i--)
+  {
+    ObjFn* fn = fiber->trace[i].fn;
+
+    // Apply the same filtering as wrenDebugPrintStackTrace() so the string
+    // form matches what an uncaught error would have printed.
+    if (fn->module == NULL) continue;
+    if (fn->module->name == NULL) continue;
+
+    int line = fn->debug->sourceLines.data[fiber->trace[i].ip - 1];
+    appendTrace(vm, &buffer, "[", 1);
+    appendTrace(vm, &buffer, fn->module->name->value,
+                (int)fn->module->name->length);
+    appendTrace(vm, &buffer, piece, sprintf(piece, " line %d] in ", line));
+    appendTrace(vm, &buffer, fn->debug->name, (int)strlen(fn->debug->name));
+    appendTrace(vm, &buffer, "\n", 1);
+  }
+
+  // Copy the result into a null-terminated buffer of exactly the right size.
+  char* trace = ALLOCATE_ARRAY(vm, char, buffer.count + 1);
+  if (buffer.count > 0) memcpy(trace, buffer.data, buffer.count);
+  trace[buffer.count] = '\0';
+  *length = (size_t)buffer.count;
+
+  wrenByteBufferClear(vm, &buffer);
+  return trace;
+}
+
 static void dumpObject(Obj* obj)
 {
   switch (obj->type)
@@ -48,6 +116,7 @@ static void dumpObject(Obj* obj)
       break;
     case OBJ_CLOSURE: printf("[closure %p]", obj); break;
     case OBJ_FIBER: printf("[fiber %p]", obj); break;
+    case OBJ_FLOAT_ARRAY: printf("[float array %p]", obj); break;
     case OBJ_FN: printf("[fn %p]", obj); break;
     case OBJ_FOREIGN: printf("[foreign %p]", obj); break;
     case OBJ_INSTANCE: printf("[instance %p]", obj); break;
@@ -56,6 +125,7 @@ static void dumpObject(Obj* obj)
     case OBJ_MODULE: printf("[module %p]", obj); break;
     case OBJ_RANGE: printf("[range %p]", obj); break;
     case OBJ_STRING: printf("%s", ((ObjString*)obj)->value); break;
+    case OBJ_STRING_BUFFER: printf("[string buffer %p]", obj); break;
     case OBJ_UPVALUE: printf("[upvalue %p]", obj); break;
     default: printf("[unknown object %d]", obj->type); break;
   }
@@ -122,6 +192,15 @@ static int dumpInstruction(WrenVM* vm, ObjFn* fn, int i, int* lastLine)
       printf("%-16s %5d\n", name, READ_BYTE()); \
       break; \
 
+  #define OPERATOR_INSTRUCTION(name) \
+      { \
+        int symbol = READ_SHORT(); \
+        int cache = READ_SHORT(); \
+        printf("%-16s %5d '%s' cache %d\n", name, symbol, \
+               vm->methodNames.names.data[symbol].buffer, cache); \
+        break; \
+      }
+
   switch (code)
   {
     case CODE_CONSTANT:
@@ -147,7 +226,27 @@ static int dumpInstruction(WrenVM* vm, ObjFn* fn, int i, int* lastLine)
     case CODE_LOAD_LOCAL_7: printf("LOAD_LOCAL_7\n"); break;
     case CODE_LOAD_LOCAL_8: printf("LOAD_LOCAL_8\n"); break;
 
+    case CODE_LOAD_LOCAL_0_CALL: printf("LOAD_LOCAL_0_CALL\n"); break;
+    case CODE_LOAD_LOCAL_1_CALL: printf("LOAD_LOCAL_1_CALL\n"); break;
+    case CODE_LOAD_LOCAL_2_CALL: printf("LOAD_LOCAL_2_CALL\n"); break;
+    case CODE_LOAD_LOCAL_3_CALL: printf("LOAD_LOCAL_3_CALL\n"); break;
+    case CODE_LOAD_LOCAL_4_CALL: printf("LOAD_LOCAL_4_CALL\n"); break;
+    case CODE_LOAD_LOCAL_5_CALL: printf("LOAD_LOCAL_5_CALL\n"); break;
+    case CODE_LOAD_LOCAL_6_CALL: printf("LOAD_LOCAL_6_CALL\n"); break;
+    case CODE_LOAD_LOCAL_7_CALL: printf("LOAD_LOCAL_7_CALL\n"); break;
+    case CODE_LOAD_LOCAL_8_CALL: printf("LOAD_LOCAL_8_CALL\n"); break;
+
+    case CODE_CONSTANT_CALL:
+    {
+      int constant = READ_SHORT();
+      printf("%-16s %5d '", "CONSTANT_CALL", constant);
+      wrenDumpValue(fn->constants.data[constant]);
+      printf("'\n");
+      break;
+    }
+
     case CODE_LOAD_LOCAL: BYTE_INSTRUCTION("LOAD_LOCAL");
+    case CODE_LOAD_LOCAL_CALL: BYTE_INSTRUCTION("LOAD_LOCAL_CALL");
     case CODE_STORE_LOCAL: BYTE_INSTRUCTION("STORE_LOCAL");
     case CODE_LOAD_UPVALUE: BYTE_INSTRUCTION("LOAD_UPVALUE");
     case CODE_STORE_UPVALUE: BYTE_INSTRUCTION("STORE_UPVALUE");
@@ -156,7 +255,7 @@ static int dumpInstruction(WrenVM* vm, ObjFn* fn, int i, int* lastLine)
     {
       int slot = READ_SHORT();
       printf("%-16s %5d '%s'\n", "LOAD_MODULE_VAR", slot,
-             fn->module->variableNames.data[slot].buffer);
+             fn->module->variableNames.names.data[slot].buffer);
       break;
     }
 
@@ -164,17 +263,57 @@ static int dumpInstruction(WrenVM* vm, ObjFn* fn, int i, int* lastLine)
     {
       int slot = READ_SHORT();
       printf("%-16s %5d '%s'\n", "STORE_MODULE_VAR", slot,
-             fn->module->variableNames.data[slot].buffer);
+             fn->module->variableNames.names.data[slot].buffer);
       break;
     }
 
     case CODE_LOAD_FIELD_THIS: BYTE_INSTRUCTION("LOAD_FIELD_THIS");
+    case CODE_LOAD_FIELD_THIS_CALL:
+      BYTE_INSTRUCTION("LOAD_FIELD_THIS_CALL");
     case CODE_STORE_FIELD_THIS: BYTE_INSTRUCTION("STORE_FIELD_THIS");
     case CODE_LOAD_FIELD: BYTE_INSTRUCTION("LOAD_FIELD");
     case CODE_STORE_FIELD: BYTE_INSTRUCTION("STORE_FIELD");
 
     case CODE_POP: printf("POP\n"); break;
 
+    case CODE_ADD:           OPERATOR_INSTRUCTION("ADD");
+    case CODE_SUBTRACT:      OPERATOR_INSTRUCTION("SUBTRACT");
+    case CODE_MULTIPLY:      OPERATOR_INSTRUCTION("MULTIPLY");
+    case CODE_DIVIDE:        OPERATOR_INSTRUCTION("DIVIDE");
+    case CODE_MOD:           OPERATOR_INSTRUCTION("MOD");
+    case CODE_LESS:          OPERATOR_INSTRUCTION("LESS");
+    case CODE_LESS_EQUAL:    OPERATOR_INSTRUCTION("LESS_EQUAL");
+    case CODE_GREATER:       OPERATOR_INSTRUCTION("GREATER");
+    case CODE_GREATER_EQUAL: OPERATOR_INSTRUCTION("GREATER_EQUAL");
+    case CODE_EQUAL:         OPERATOR_INSTRUCTION("EQUAL");
+    case CODE_NOT_EQUAL:     OPERATOR_INSTRUCTION("NOT_EQUAL");
+
+    case CODE_TAIL_CALL_0:
+    case CODE_TAIL_CALL_1:
+    case CODE_TAIL_CALL_2:
+    case CODE_TAIL_CALL_3:
+    case CODE_TAIL_CALL_4:
+    case CODE_TAIL_CALL_5:
+    case CODE_TAIL_CALL_6:
+    case CODE_TAIL_CALL_7:
+    case CODE_TAIL_CALL_8:
+    case CODE_TAIL_CALL_9:
+    case CODE_TAIL_CALL_10:
+    case CODE_TAIL_CALL_11:
+    case CODE_TAIL_CALL_12:
+    case CODE_TAIL_CALL_13:
+    case CODE_TAIL_CALL_14:
+    case CODE_TAIL_CALL_15:
+    case CODE_TAIL_CALL_16:
+    {
+      int numArgs = bytecode[i - 1] - CODE_TAIL_CALL_0;
+      int symbol = READ_SHORT();
+      int cache = READ_SHORT();
+      printf("TAIL_CALL_%-6d %5d '%s' cache %d\n", numArgs, symbol,
+             vm->methodNames.names.data[symbol].buffer, cache);
+      break;
+    }
+
     case CODE_CALL_0:
     case CODE_CALL_1:
     case CODE_CALL_2:
@@ -195,8 +334,9 @@ static int dumpInstruction(WrenVM* vm, ObjFn* fn, int i, int* lastLine)
     {
       int numArgs = bytecode[i - 1] - CODE_CALL_0;
       int symbol = READ_SHORT();
-      printf("CALL_%-11d %5d '%s'\n", numArgs, symbol,
-             vm->methodNames.data[symbol].buffer);
+      int cache = READ_SHORT();
+      printf("CALL_%-11d %5d '%s' cache %d\n", numArgs, symbol,
+             vm->methodNames.names.data[symbol].buffer, cache);
       break;
     }
 
@@ -222,7 +362,17 @@ static int dumpInstruction(WrenVM* vm, ObjFn* fn, int i, int* lastLine)
       int symbol = READ_SHORT();
       int superclass = READ_SHORT();
       printf("SUPER_%-10d %5d '%s' %5d\n", numArgs, symbol,
-             vm->methodNames.data[symbol].buffer, superclass);
+             vm->methodNames.names.data[symbol].buffer, superclass);
+      break;
+    }
+
+    case CODE_FOR_RANGE:
+    {
+      int seqSlot = READ_BYTE();
+      int iterSlot = READ_BYTE();
+      int offset = READ_SHORT();
+      printf("%-16s %5d %5d to %d\n", "FOR_RANGE", seqSlot, iterSlot,
+             i + offset);
       break;
     }
 
@@ -268,9 +418,14 @@ static int dumpInstruction(WrenVM* vm, ObjFn* fn, int i, int* lastLine)
     {
       int constant = READ_SHORT();
       printf("%-16s %5d ", "CLOSURE", constant);
-      wrenDumpValue(fn->constants.data[constant]);
+      Value loaded = fn->constants.data[constant];
+      wrenDumpValue(loaded);
       printf(" ");
-      ObjFn* loadedFn = AS_FN(fn->constants.data[constant]);
+
+      // A zero-upvalue function is stored as a pre-built closure and has no
+      // capture arguments.
+      ObjFn* loadedFn = IS_CLOSURE(loaded) ? AS_CLOSURE(loaded)->fn
+                                           : AS_FN(loaded);
       for (int j = 0; j < loadedFn->numUpvalues; j++)
       {
         int isLocal = READ_BYTE();
@@ -282,6 +437,20 @@ static int dumpInstruction(WrenVM* vm, ObjFn* fn, int i, int* lastLine)
       break;
     }
 
+    case CODE_LIST_LITERAL:
+    {
+      int numElements = READ_SHORT();
+      printf("%-16s %5d\n", "LIST_LITERAL", numElements);
+      break;
+    }
+
+    case CODE_MAP_LITERAL:
+    {
+      int numEntries = READ_SHORT();
+      printf("%-16s %5d\n", "MAP_LITERAL", numEntries);
+      break;
+    }
+
     case CODE_CONSTRUCT:         printf("CONSTRUCT\n"); break;
     case CODE_FOREIGN_CONSTRUCT: printf("FOREIGN_CONSTRUCT\n"); break;
       
@@ -298,7 +467,7 @@ static int dumpInstruction(WrenVM* vm, ObjFn* fn, int i, int* lastLine)
     {
       int symbol = READ_SHORT();
       printf("%-16s %5d '%s'\n", "METHOD_INSTANCE", symbol,
-             vm->methodNames.data[symbol].buffer);
+             vm->methodNames.names.data[symbol].buffer);
       break;
     }
 
@@ -306,7 +475,7 @@ static int dumpInstruction(WrenVM* vm, ObjFn* fn, int i, int* lastLine)
     {
       int symbol = READ_SHORT();
       printf("%-16s %5d '%s'\n", "METHOD_STATIC", symbol,
-             vm->methodNames.data[symbol].buffer);
+             vm->methodNames.names.data[symbol].buffer);
       break;
     }
 
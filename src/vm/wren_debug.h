@@ -4,11 +4,24 @@
 #include "wren_value.h"
 #include "wren_vm.h"
 
-// Prints the stack trace for the current fiber.
+// Records the call stack of [fiber] into its compact trace buffer.
+//
+// Called when a runtime error is thrown. Only the function and instruction
+// offset of each frame are stored; no lines are resolved and no strings are
+// built, so fibers whose errors are caught with "try" and then discarded pay
+// almost nothing. The buffer is grown as needed and reused by later errors.
+void wrenDebugCaptureStackTrace(WrenVM* vm, ObjFiber* fiber);
+
+// Prints the captured stack trace for the current fiber.
 //
 // Used when a fiber throws a runtime error which is not caught.
 void wrenDebugPrintStackTrace(WrenVM* vm);
 
+// Builds the printable form of the stack trace captured on [fiber] and
+// returns it as a heap-allocated string, storing its length in [length]. The
+// caller owns the returned memory. Returns NULL if no trace was captured.
+char* wrenDebugStackTraceString(WrenVM* vm, ObjFiber* fiber, size_t* length);
+
 // The "dump" functions are used for debugging Wren itself. Normal code paths
 // will not call them unless one of the various DEBUG_ flags is enabled.
 
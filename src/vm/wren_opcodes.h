@@ -117,6 +117,88 @@ OPCODE(SUPER_14, -14)
 OPCODE(SUPER_15, -15)
 OPCODE(SUPER_16, -16)
 
+// Superinstructions created by the compiler's peephole pass. These are never
+// emitted directly. Instead, when a cheap push is immediately followed by a
+// CODE_CALL_* instruction, the pass rewrites the push's opcode byte to the
+// fused form. The fused instruction performs the push and then executes the
+// call that follows it in a single trip through the dispatch loop. The
+// operand bytes and the call instruction itself are left in place, so a jump
+// that targets either instruction of the pair still lands on valid bytecode.
+
+// Pushes the value in the given local slot and executes the following call.
+OPCODE(LOAD_LOCAL_0_CALL, 1)
+OPCODE(LOAD_LOCAL_1_CALL, 1)
+OPCODE(LOAD_LOCAL_2_CALL, 1)
+OPCODE(LOAD_LOCAL_3_CALL, 1)
+OPCODE(LOAD_LOCAL_4_CALL, 1)
+OPCODE(LOAD_LOCAL_5_CALL, 1)
+OPCODE(LOAD_LOCAL_6_CALL, 1)
+OPCODE(LOAD_LOCAL_7_CALL, 1)
+OPCODE(LOAD_LOCAL_8_CALL, 1)
+
+// Pushes the value in local slot [arg] and executes the following call.
+OPCODE(LOAD_LOCAL_CALL, 1)
+
+// Pushes the constant at index [arg] and executes the following call.
+OPCODE(CONSTANT_CALL, 1)
+
+// Pushes the value of field slot [arg] of the receiver of the current
+// function and executes the following call.
+OPCODE(LOAD_FIELD_THIS_CALL, 1)
+
+// Tail calls, also created by the peephole pass. A CODE_CALL_* immediately
+// followed by CODE_RETURN is rewritten to the corresponding one of these.
+// They behave exactly like the call they replace except that invoking a Wren
+// function or closure reuses the current call frame and stack window instead
+// of pushing a new frame, so recursion in tail position runs in constant
+// stack space. The CODE_RETURN is left in place: it still executes after
+// primitive and foreign methods, which return directly into the caller.
+OPCODE(TAIL_CALL_0, 0)
+OPCODE(TAIL_CALL_1, -1)
+OPCODE(TAIL_CALL_2, -2)
+OPCODE(TAIL_CALL_3, -3)
+OPCODE(TAIL_CALL_4, -4)
+OPCODE(TAIL_CALL_5, -5)
+OPCODE(TAIL_CALL_6, -6)
+OPCODE(TAIL_CALL_7, -7)
+OPCODE(TAIL_CALL_8, -8)
+OPCODE(TAIL_CALL_9, -9)
+OPCODE(TAIL_CALL_10, -10)
+OPCODE(TAIL_CALL_11, -11)
+OPCODE(TAIL_CALL_12, -12)
+OPCODE(TAIL_CALL_13, -13)
+OPCODE(TAIL_CALL_14, -14)
+OPCODE(TAIL_CALL_15, -15)
+OPCODE(TAIL_CALL_16, -16)
+
+// Specialized sends for the arithmetic and comparison operators. Each takes
+// the same operands as CODE_CALL_1: a two-byte method symbol followed by a
+// two-byte inline cache index. When the receiver and the argument are both
+// numbers, the interpreter performs the operation directly without a method
+// lookup. Otherwise the instruction behaves exactly like CODE_CALL_1 with
+// the operator's symbol.
+OPCODE(ADD, -1)
+OPCODE(SUBTRACT, -1)
+OPCODE(MULTIPLY, -1)
+OPCODE(DIVIDE, -1)
+OPCODE(MOD, -1)
+OPCODE(LESS, -1)
+OPCODE(LESS_EQUAL, -1)
+OPCODE(GREATER, -1)
+OPCODE(GREATER_EQUAL, -1)
+OPCODE(EQUAL, -1)
+OPCODE(NOT_EQUAL, -1)
+
+// The fused header of a for loop. Takes the byte slots of the hidden sequence
+// and iterator locals followed by a two-byte jump offset. If the sequence is
+// a range and the iterator is valid, advances the iterator in place, pushes
+// the current value, and jumps [arg] forward to the loop body, skipping the
+// iterate()/iteratorValue() protocol that follows this instruction. Otherwise
+// does nothing and falls through to that protocol, which also handles exiting
+// the loop. The stack effect is zero because the push only happens when the
+// protocol's own push is jumped over.
+OPCODE(FOR_RANGE, 0)
+
 // Jump the instruction pointer [arg] forward.
 OPCODE(JUMP, 0)
 
@@ -151,6 +233,22 @@ OPCODE(RETURN, 0)
 // Pushes the created closure.
 OPCODE(CLOSURE, 1)
 
+// Creates a list from a literal. The 2-byte argument is the number of
+// elements, which are on the stack in order. Pops the elements and pushes the
+// new list.
+//
+// The declared stack effect assumes an empty literal. The compiler adjusts it
+// for the popped elements, and the verifier reads the count from the operand.
+OPCODE(LIST_LITERAL, 1)
+
+// Creates a map from a literal. The 2-byte argument is the number of entries,
+// which are on the stack as key/value pairs in order. Pops the entries and
+// pushes the new map.
+//
+// The declared stack effect assumes an empty literal. The compiler adjusts it
+// for the popped entries, and the verifier reads the count from the operand.
+OPCODE(MAP_LITERAL, 1)
+
 // Creates a new instance of a class.
 //
 // Assumes the class object is in slot zero, and replaces it with the new
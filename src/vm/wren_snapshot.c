@@ -0,0 +1,447 @@
+#include <string.h>
+
+#include "wren_compiler.h"
+#include "wren_snapshot.h"
+#include "wren_verify.h"
+#include "wren_vm.h"
+
+// The first bytes of every snapshot. The leading control character can't
+// begin valid Wren source, so it's enough to distinguish a snapshot from
+// source code. The trailing null is included to make accidental matches with
+// text even less likely.
+static const char snapshotMagic[] = "\x17wrensnap";
+
+// Bumped whenever the format below changes incompatibly. Versions 2 through 4
+// renumbered the opcodes when the specialized operator instructions,
+// CODE_FOR_RANGE, and the tail call instructions were added. Version 5 added
+// closure constants for functions that capture no upvalues. Versions 6 and 7
+// renumbered the opcodes again for the fused field loads and the literal
+// instructions.
+#define SNAPSHOT_VERSION 7
+
+// The constant pool tags. Compile-time constants can only be a handful of
+// types.
+#define CONSTANT_NUM     0
+#define CONSTANT_STRING  1
+#define CONSTANT_FN      2
+#define CONSTANT_NULL    3
+#define CONSTANT_FALSE   4
+#define CONSTANT_TRUE    5
+#define CONSTANT_CLOSURE 6
+
+typedef struct
+{
+  WrenVM* vm;
+  ByteBuffer bytes;
+} SnapshotWriter;
+
+static void writeByte(SnapshotWriter* writer, uint8_t byte)
+{
+  wrenByteBufferWrite(writer->vm, &writer->bytes, byte);
+}
+
+static void writeBytes(SnapshotWriter* writer, const void* bytes,
+                       uint32_t count)
+{
+  for (uint32_t i = 0; i < count; i++)
+  {
+    writeByte(writer, ((const uint8_t*)bytes)[i]);
+  }
+}
+
+// Writes [n] as four little-endian bytes.
+static void writeInt(SnapshotWriter* writer, uint32_t n)
+{
+  writeByte(writer, (uint8_t)(n & 0xff));
+  writeByte(writer, (uint8_t)((n >> 8) & 0xff));
+  writeByte(writer, (uint8_t)((n >> 16) & 0xff));
+  writeByte(writer, (uint8_t)((n >> 24) & 0xff));
+}
+
+// Writes a length-prefixed string.
+static void writeString(SnapshotWriter* writer, const char* string,
+                        uint32_t length)
+{
+  writeInt(writer, length);
+  writeBytes(writer, string, length);
+}
+
+static void writeFn(SnapshotWriter* writer, ObjFn* fn)
+{
+  writeInt(writer, (uint32_t)fn->arity);
+  writeInt(writer, (uint32_t)fn->maxSlots);
+  writeInt(writer, (uint32_t)fn->numUpvalues);
+  writeInt(writer, (uint32_t)fn->numCallCaches);
+
+  const char* name = fn->debug->name != NULL ? fn->debug->name : "";
+  writeString(writer, name, (uint32_t)strlen(name));
+
+  writeInt(writer, (uint32_t)fn->code.count);
+  writeBytes(writer, fn->code.data, (uint32_t)fn->code.count);
+
+  writeInt(writer, (uint32_t)fn->debug->sourceLines.count);
+  for (int i = 0; i < fn->debug->sourceLines.count; i++)
+  {
+    writeInt(writer, (uint32_t)fn->debug->sourceLines.data[i]);
+  }
+
+  writeInt(writer, (uint32_t)fn->constants.count);
+  for (int i = 0; i < fn->constants.count; i++)
+  {
+    Value constant = fn->constants.data[i];
+    if (IS_NUM(constant))
+    {
+      double num = AS_NUM(constant);
+      uint8_t bytes[sizeof(double)];
+      memcpy(bytes, &num, sizeof(double));
+
+      writeByte(writer, CONSTANT_NUM);
+      writeBytes(writer, bytes, sizeof(double));
+    }
+    else if (IS_STRING(constant))
+    {
+      ObjString* string = AS_STRING(constant);
+      writeByte(writer, CONSTANT_STRING);
+      writeString(writer, string->value, string->length);
+    }
+    else if (IS_FN(constant))
+    {
+      // A nested function, created by a closure or method body.
+      writeByte(writer, CONSTANT_FN);
+      writeFn(writer, AS_FN(constant));
+    }
+    else if (IS_CLOSURE(constant))
+    {
+      // A nested function that captures no upvalues, pre-wrapped in its
+      // canonical closure by the compiler. Only the function is recorded; the
+      // loader rebuilds the wrapper.
+      writeByte(writer, CONSTANT_CLOSURE);
+      writeFn(writer, AS_CLOSURE(constant)->fn);
+    }
+    else if (IS_NULL(constant))
+    {
+      writeByte(writer, CONSTANT_NULL);
+    }
+    else if (IS_BOOL(constant))
+    {
+      writeByte(writer, AS_BOOL(constant) ? CONSTANT_TRUE : CONSTANT_FALSE);
+    }
+    else
+    {
+      UNREACHABLE();
+    }
+  }
+}
+
+char* wrenSnapshotSerialize(WrenVM* vm, ObjFn* fn, size_t* length)
+{
+  SnapshotWriter writer;
+  writer.vm = vm;
+  wrenByteBufferInit(&writer.bytes);
+
+  writeBytes(&writer, snapshotMagic, sizeof(snapshotMagic));
+  writeInt(&writer, SNAPSHOT_VERSION);
+
+  // The method names the bytecode's call sites refer to. The entire table is
+  // recorded so the loader can check that every symbol resolves to the same
+  // index.
+  writeInt(&writer, (uint32_t)vm->methodNames.names.count);
+  for (int i = 0; i < vm->methodNames.names.count; i++)
+  {
+    writeString(&writer, vm->methodNames.names.data[i].buffer,
+                vm->methodNames.names.data[i].length);
+  }
+
+  // The module's variable names, in slot order. This includes the core
+  // module's variables, which are copied into every module before it's
+  // compiled.
+  ObjModule* module = fn->module;
+  writeInt(&writer, (uint32_t)module->variableNames.names.count);
+  for (int i = 0; i < module->variableNames.names.count; i++)
+  {
+    writeString(&writer, module->variableNames.names.data[i].buffer,
+                module->variableNames.names.data[i].length);
+  }
+
+  writeFn(&writer, fn);
+
+  // Copy the result into a buffer of exactly the right size.
+  char* snapshot = ALLOCATE_ARRAY(vm, char, writer.bytes.count);
+  memcpy(snapshot, writer.bytes.data, writer.bytes.count);
+  *length = (size_t)writer.bytes.count;
+
+  wrenByteBufferClear(vm, &writer.bytes);
+  return snapshot;
+}
+
+typedef struct
+{
+  const uint8_t* bytes;
+} SnapshotReader;
+
+static uint8_t readByte(SnapshotReader* reader)
+{
+  return *reader->bytes++;
+}
+
+static uint32_t readInt(SnapshotReader* reader)
+{
+  uint32_t n = (uint32_t)readByte(reader);
+  n |= (uint32_t)readByte(reader) << 8;
+  n |= (uint32_t)readByte(reader) << 16;
+  n |= (uint32_t)readByte(reader) << 24;
+  return n;
+}
+
+// Reads a length-prefixed string. The returned pointer aliases the snapshot
+// itself and is not null-terminated.
+static const char* readSnapshotString(SnapshotReader* reader, uint32_t* length)
+{
+  *length = readInt(reader);
+  const char* string = (const char*)reader->bytes;
+  reader->bytes += *length;
+  return string;
+}
+
+// Reports [message] through the configured error function and returns NULL so
+// callers can `return fail(...)`.
+static ObjFn* fail(WrenVM* vm, ObjModule* module, const char* message)
+{
+  if (vm->config.errorFn != NULL)
+  {
+    const char* moduleName =
+        module->name != NULL ? module->name->value : "<unknown>";
+    vm->config.errorFn(WREN_ERROR_COMPILE, moduleName, -1, message);
+  }
+
+  return NULL;
+}
+
+static ObjFn* readFn(WrenVM* vm, SnapshotReader* reader, ObjModule* module)
+{
+  int arity = (int)readInt(reader);
+  int maxSlots = (int)readInt(reader);
+  int numUpvalues = (int)readInt(reader);
+  int numCallCaches = (int)readInt(reader);
+
+  ObjFn* fn = wrenNewFunction(vm, module, maxSlots);
+  wrenPushRoot(vm, (Obj*)fn);
+
+  fn->arity = arity;
+  fn->numUpvalues = numUpvalues;
+  fn->numCallCaches = numCallCaches;
+  wrenFunctionAllocateCallCaches(vm, fn);
+
+  uint32_t nameLength;
+  const char* name = readSnapshotString(reader, &nameLength);
+  wrenFunctionBindName(vm, fn, name, (int)nameLength);
+
+  uint32_t codeCount = readInt(reader);
+  for (uint32_t i = 0; i < codeCount; i++)
+  {
+    wrenByteBufferWrite(vm, &fn->code, readByte(reader));
+  }
+
+  uint32_t lineCount = readInt(reader);
+  for (uint32_t i = 0; i < lineCount; i++)
+  {
+    wrenIntBufferWrite(vm, &fn->debug->sourceLines, (int)readInt(reader));
+  }
+
+  uint32_t constantCount = readInt(reader);
+  for (uint32_t i = 0; i < constantCount; i++)
+  {
+    Value constant;
+    switch (readByte(reader))
+    {
+      case CONSTANT_NUM:
+      {
+        double num;
+        memcpy(&num, reader->bytes, sizeof(double));
+        reader->bytes += sizeof(double);
+        constant = NUM_VAL(num);
+        break;
+      }
+
+      case CONSTANT_STRING:
+      {
+        uint32_t stringLength;
+        const char* string = readSnapshotString(reader, &stringLength);
+        constant = wrenNewString(vm, string, stringLength);
+        break;
+      }
+
+      case CONSTANT_FN:
+      {
+        ObjFn* nested = readFn(vm, reader, module);
+        constant = OBJ_VAL(nested);
+        break;
+      }
+
+      case CONSTANT_CLOSURE:
+      {
+        ObjFn* nested = readFn(vm, reader, module);
+        wrenPushRoot(vm, (Obj*)nested);
+        constant = OBJ_VAL(wrenNewClosure(vm, nested));
+        wrenPopRoot(vm);
+        break;
+      }
+
+      case CONSTANT_NULL:  constant = NULL_VAL; break;
+      case CONSTANT_FALSE: constant = FALSE_VAL; break;
+      case CONSTANT_TRUE:  constant = TRUE_VAL; break;
+
+      default:
+        UNREACHABLE();
+        constant = NULL_VAL;
+    }
+
+    if (IS_OBJ(constant)) wrenPushRoot(vm, AS_OBJ(constant));
+    wrenValueBufferWrite(vm, &fn->constants, constant);
+    if (IS_OBJ(constant)) wrenPopRoot(vm);
+    wrenWriteBarrier(vm, (Obj*)fn, constant);
+  }
+
+  wrenPopRoot(vm); // fn.
+  return fn;
+}
+
+// Rewrites every method symbol in [fn]'s bytecode -- and, recursively, in the
+// functions in its constant pool -- through [symbolMap], which maps the
+// [mapCount] symbol indices of the VM the snapshot was compiled in to this
+// VM's. The bytecode must already be verified: the walk trusts the
+// instruction sizes. A verified symbol can still exceed [mapCount] -- the
+// verifier only bounds it by this VM's table, which may be larger than the
+// snapshot's -- and such a symbol has no recorded name, so it's left alone.
+static void remapMethodSymbols(ObjFn* fn, const int* symbolMap,
+                               uint32_t mapCount)
+{
+  uint8_t* code = fn->code.data;
+  int ip = 0;
+  while (code[ip] != CODE_END)
+  {
+    Code op = (Code)code[ip];
+    if ((op >= CODE_CALL_0 && op <= CODE_CALL_16) ||
+        (op >= CODE_SUPER_0 && op <= CODE_SUPER_16) ||
+        (op >= CODE_TAIL_CALL_0 && op <= CODE_TAIL_CALL_16) ||
+        (op >= CODE_ADD && op <= CODE_NOT_EQUAL) ||
+        op == CODE_METHOD_INSTANCE || op == CODE_METHOD_STATIC)
+    {
+      uint32_t raw = (uint32_t)((code[ip + 1] << 8) | code[ip + 2]);
+      if (raw < mapCount)
+      {
+        int symbol = symbolMap[raw];
+        code[ip + 1] = (uint8_t)((symbol >> 8) & 0xff);
+        code[ip + 2] = (uint8_t)(symbol & 0xff);
+      }
+    }
+
+    ip += 1 + wrenGetNumArguments(code, fn->constants.data, ip);
+  }
+
+  for (int i = 0; i < fn->constants.count; i++)
+  {
+    Value constant = fn->constants.data[i];
+    if (IS_FN(constant))
+    {
+      remapMethodSymbols(AS_FN(constant), symbolMap, mapCount);
+    }
+    if (IS_CLOSURE(constant))
+    {
+      remapMethodSymbols(AS_CLOSURE(constant)->fn, symbolMap, mapCount);
+    }
+  }
+}
+
+bool wrenIsSnapshot(const char* source)
+{
+  return source != NULL && source[0] == snapshotMagic[0];
+}
+
+ObjFn* wrenSnapshotLoadModule(WrenVM* vm, ObjModule* module,
+                              const char* snapshot)
+{
+  SnapshotReader reader;
+  reader.bytes = (const uint8_t*)snapshot;
+
+  if (memcmp(reader.bytes, snapshotMagic, sizeof(snapshotMagic)) != 0)
+  {
+    return fail(vm, module, "Malformed snapshot.");
+  }
+  reader.bytes += sizeof(snapshotMagic);
+
+  if (readInt(&reader) != SNAPSHOT_VERSION)
+  {
+    return fail(vm, module, "Snapshot has an unsupported version.");
+  }
+
+  // Merge the method name table. Bytecode refers to methods by their index in
+  // the method table of the VM that compiled it, so resolve every recorded
+  // name in this VM -- defining the ones it hasn't seen -- and remember where
+  // each one landed. When the tables diverge (the snapshot was compiled in a
+  // different VM, or after different modules) the bytecode's method symbols
+  // are rewritten below; when they don't, which the common case of loading
+  // snapshots in the order they were compiled guarantees, the map is the
+  // identity and the bytecode is used as is.
+  uint32_t methodCount = readInt(&reader);
+  int* symbolMap = ALLOCATE_ARRAY(vm, int, methodCount);
+  bool remap = false;
+  for (uint32_t i = 0; i < methodCount; i++)
+  {
+    uint32_t length;
+    const char* name = readSnapshotString(&reader, &length);
+    int symbol = wrenSymbolTableEnsure(vm, &vm->methodNames, name, length);
+    if (symbol > UINT16_MAX)
+    {
+      DEALLOCATE(vm, symbolMap);
+      return fail(vm, module, "Too many method names.");
+    }
+
+    symbolMap[i] = symbol;
+    if (symbol != (int)i) remap = true;
+  }
+
+  // Validate and recreate the module's variable table the same way. Variables
+  // already defined in the module (the core module's, or earlier definitions
+  // when reloading) must match by name; the rest are defined here and get
+  // their values when the module body runs.
+  uint32_t variableCount = readInt(&reader);
+  for (uint32_t i = 0; i < variableCount; i++)
+  {
+    uint32_t length;
+    const char* name = readSnapshotString(&reader, &length);
+    if ((int)i < module->variableNames.names.count)
+    {
+      String* existing = &module->variableNames.names.data[i];
+      if (existing->length != length ||
+          memcmp(existing->buffer, name, length) != 0)
+      {
+        DEALLOCATE(vm, symbolMap);
+        return fail(vm, module,
+            "Snapshot's variables don't match the module's variable table.");
+      }
+    }
+    else if (wrenDefineVariable(vm, module, name, length, NULL_VAL) != (int)i)
+    {
+      DEALLOCATE(vm, symbolMap);
+      return fail(vm, module,
+          "Snapshot's variables don't match the module's variable table.");
+    }
+  }
+
+  ObjFn* fn = readFn(vm, &reader, module);
+
+  // The interpreter runs bytecode without per-instruction checks, and
+  // nothing past this point looks at it again, so prove it well-formed now.
+  // Verifying also makes the bytecode safe to walk for symbol rewriting: the
+  // raw symbols index the snapshot's table, every entry of which was resolved
+  // above, so they're within this VM's table too and pass the range checks.
+  wrenPushRoot(vm, (Obj*)fn);
+  const char* error = wrenVerifyFn(vm, fn);
+  if (error == NULL && remap) remapMethodSymbols(fn, symbolMap, methodCount);
+  wrenPopRoot(vm); // fn.
+  DEALLOCATE(vm, symbolMap);
+  if (error != NULL) return fail(vm, module, error);
+
+  return fn;
+}
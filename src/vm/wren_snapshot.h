@@ -0,0 +1,41 @@
+#ifndef wren_snapshot_h
+#define wren_snapshot_h
+
+#include "wren.h"
+#include "wren_value.h"
+
+// Serialization of compiled modules.
+//
+// A snapshot captures a module's compiled form -- its body function's
+// bytecode, constants, and debug information, plus the symbol tables the
+// bytecode's operands refer to -- in a stable binary format. Loading a
+// snapshot recreates the module without invoking the compiler, which makes
+// starting a process that imports many modules near-instant.
+//
+// Bytecode operands index into the VM's method name table and the module's
+// variable table, so a snapshot is only valid in a VM where those tables line
+// up with the ones in the VM that produced it. Loading validates both tables
+// and fails cleanly on a mismatch, and runs the loaded bytecode through the
+// verifier (see wren_verify.h) so a corrupt function is rejected instead of
+// executed. The container framing -- the length and count fields that say how
+// many bytes to read -- is still trusted, so a truncated buffer can read past
+// its end.
+
+// Returns true if [source] begins with the snapshot magic number, meaning it
+// should be loaded with wrenSnapshotLoadModule() instead of being compiled.
+bool wrenIsSnapshot(const char* source);
+
+// Serializes the compiled module body function [fn], along with its module's
+// variable table and the VM's method name table, into a newly allocated
+// buffer. Stores the buffer's size in [length].
+char* wrenSnapshotSerialize(WrenVM* vm, ObjFn* fn, size_t* length);
+
+// Deserializes [snapshot] into [module] and returns the module's body
+// function.
+//
+// Returns NULL if the snapshot's symbol tables don't match the VM's, after
+// reporting the mismatch through the configured error function.
+ObjFn* wrenSnapshotLoadModule(WrenVM* vm, ObjModule* module,
+                              const char* snapshot);
+
+#endif
@@ -7,19 +7,62 @@ DEFINE_BUFFER(Byte, uint8_t);
 DEFINE_BUFFER(Int, int);
 DEFINE_BUFFER(String, String);
 
+// Hashes [name] using FNV-1a.
+static uint32_t hashName(const char* name, size_t length)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++)
+  {
+    hash ^= (uint8_t)name[i];
+    hash *= 16777619;
+  }
+
+  return hash;
+}
+
+// Inserts [symbol] into the hash index. Assumes the index has a free entry.
+static void insertSymbol(SymbolTable* symbols, int symbol)
+{
+  uint32_t mask = symbols->indexCapacity - 1;
+  uint32_t i = hashName(symbols->names.data[symbol].buffer,
+                        symbols->names.data[symbol].length) & mask;
+  while (symbols->index[i] != -1) i = (i + 1) & mask;
+
+  symbols->index[i] = symbol;
+}
+
+// Doubles the capacity of the hash index and re-inserts all of the symbols.
+static void growIndex(WrenVM* vm, SymbolTable* symbols)
+{
+  uint32_t capacity = symbols->indexCapacity == 0
+      ? 16 : symbols->indexCapacity * 2;
+  symbols->index = (int*)wrenReallocate(vm, symbols->index,
+      symbols->indexCapacity * sizeof(int), capacity * sizeof(int));
+  symbols->indexCapacity = capacity;
+
+  for (uint32_t i = 0; i < capacity; i++) symbols->index[i] = -1;
+  for (int i = 0; i < symbols->names.count; i++) insertSymbol(symbols, i);
+}
+
 void wrenSymbolTableInit(SymbolTable* symbols)
 {
-  wrenStringBufferInit(symbols);
+  wrenStringBufferInit(&symbols->names);
+  symbols->index = NULL;
+  symbols->indexCapacity = 0;
 }
 
 void wrenSymbolTableClear(WrenVM* vm, SymbolTable* symbols)
 {
-  for (int i = 0; i < symbols->count; i++)
+  for (int i = 0; i < symbols->names.count; i++)
   {
-    DEALLOCATE(vm, symbols->data[i].buffer);
+    DEALLOCATE(vm, symbols->names.data[i].buffer);
   }
 
-  wrenStringBufferClear(vm, symbols);
+  wrenStringBufferClear(vm, &symbols->names);
+
+  wrenReallocate(vm, symbols->index, symbols->indexCapacity * sizeof(int), 0);
+  symbols->index = NULL;
+  symbols->indexCapacity = 0;
 }
 
 int wrenSymbolTableAdd(WrenVM* vm, SymbolTable* symbols,
@@ -31,8 +74,20 @@ int wrenSymbolTableAdd(WrenVM* vm, SymbolTable* symbols,
   symbol.buffer[length] = '\0';
   symbol.length = (int)length;
 
-  wrenStringBufferWrite(vm, symbols, symbol);
-  return symbols->count - 1;
+  wrenStringBufferWrite(vm, &symbols->names, symbol);
+
+  // Keep the hash index at most three-quarters full so probe sequences stay
+  // short.
+  if ((uint32_t)symbols->names.count * 4 > symbols->indexCapacity * 3)
+  {
+    growIndex(vm, symbols);
+  }
+  else
+  {
+    insertSymbol(symbols, symbols->names.count - 1);
+  }
+
+  return symbols->names.count - 1;
 }
 
 int wrenSymbolTableEnsure(WrenVM* vm, SymbolTable* symbols,
@@ -48,15 +103,23 @@ int wrenSymbolTableEnsure(WrenVM* vm, SymbolTable* symbols,
 
 int wrenSymbolTableFind(SymbolTable* symbols, const char* name, size_t length)
 {
-  // See if the symbol is already defined.
-  // TODO: O(n). Do something better.
-  for (int i = 0; i < symbols->count; i++)
+  if (symbols->index == NULL) return -1;
+
+  uint32_t mask = symbols->indexCapacity - 1;
+  uint32_t i = hashName(name, length) & mask;
+  while (true)
   {
-    if (symbols->data[i].length == length &&
-        memcmp(symbols->data[i].buffer, name, length) == 0) return i;
-  }
+    int symbol = symbols->index[i];
+    if (symbol == -1) return -1;
 
-  return -1;
+    if (symbols->names.data[symbol].length == length &&
+        memcmp(symbols->names.data[symbol].buffer, name, length) == 0)
+    {
+      return symbol;
+    }
+
+    i = (i + 1) & mask;
+  }
 }
 
 int wrenUtf8EncodeNumBytes(int value)
@@ -176,6 +239,40 @@ int wrenUtf8DecodeNumBytes(uint8_t byte)
   return 1;
 }
 
+int wrenUtf8CountCodePoints(const uint8_t* bytes, uint32_t length)
+{
+  int count = 0;
+  uint32_t i = 0;
+
+  // Process a word at a time. Every byte that is not a continuation byte
+  // (10xxxxxx) starts a code point, and a whole word can be tested for
+  // continuation bytes with bit arithmetic instead of a compare per byte.
+  while (length - i >= sizeof(uint64_t))
+  {
+    uint64_t word;
+    memcpy(&word, bytes + i, sizeof(word));
+
+    // A continuation byte has bit 7 set and bit 6 clear, so mark bit 7 of
+    // every byte whose bit 6 is clear and mask it with the actual bit 7s.
+    uint64_t continuations =
+        word & ((~word & UINT64_C(0x4040404040404040)) << 1);
+
+    // Sum the marked bytes in parallel: moving the marks to each byte's low
+    // bit and multiplying accumulates the total into the top byte.
+    count += (int)(sizeof(uint64_t) -
+        (((continuations >> 7) * UINT64_C(0x0101010101010101)) >> 56));
+    i += sizeof(uint64_t);
+  }
+
+  // Count the remaining bytes one at a time.
+  for (; i < length; i++)
+  {
+    if ((bytes[i] & 0xc0) != 0x80) count++;
+  }
+
+  return count;
+}
+
 // From: http://graphics.stanford.edu/~seander/bithacks.html#RoundUpPowerOf2Float
 int wrenPowerOf2Ceil(int n)
 {
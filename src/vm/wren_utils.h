@@ -70,8 +70,21 @@ DECLARE_BUFFER(Byte, uint8_t);
 DECLARE_BUFFER(Int, int);
 DECLARE_BUFFER(String, String);
 
-// TODO: Change this to use a map.
-typedef StringBuffer SymbolTable;
+// A growable list of distinct symbols. Each symbol is identified by the index
+// at which it was added, and a hash index over the names makes looking a
+// symbol up by name O(1).
+typedef struct
+{
+  // The symbols' names, in the order they were added.
+  StringBuffer names;
+
+  // An open-addressed hash index mapping name hashes to indices in [names].
+  // Empty entries are -1. This is NULL until the first symbol is added.
+  int* index;
+
+  // The number of entries in [index]. Always a power of two.
+  uint32_t indexCapacity;
+} SymbolTable;
 
 // Initializes the symbol table.
 void wrenSymbolTableInit(SymbolTable* symbols);
@@ -115,6 +128,12 @@ int wrenUtf8Decode(const uint8_t* bytes, uint32_t length);
 // returns 0.
 int wrenUtf8DecodeNumBytes(uint8_t byte);
 
+// Returns the number of code points in the [length] bytes of UTF-8 text
+// starting at [bytes]. Every byte that is not a continuation byte starts a
+// code point, so invalid sequences are counted the same way iteration steps
+// over them.
+int wrenUtf8CountCodePoints(const uint8_t* bytes, uint32_t length);
+
 // Returns the smallest power of two that is equal to or greater than [n].
 int wrenPowerOf2Ceil(int n);
 
@@ -32,15 +32,28 @@
 #define INITIAL_CALL_FRAMES 4
 
 DEFINE_BUFFER(Value, Value);
-DEFINE_BUFFER(Method, Method);
 
 static void initObj(WrenVM* vm, Obj* obj, ObjType type, ObjClass* classObj)
 {
   obj->type = type;
   obj->isDark = false;
+  obj->isRemembered = false;
   obj->classObj = classObj;
-  obj->next = vm->first;
-  vm->first = obj;
+
+  if (vm->config.nurserySize > 0)
+  {
+    // New objects start out in the nursery and are promoted to the main heap
+    // if they survive a collection.
+    obj->isYoung = true;
+    obj->next = vm->nursery;
+    vm->nursery = obj;
+  }
+  else
+  {
+    obj->isYoung = false;
+    obj->next = vm->first;
+    vm->first = obj;
+  }
 }
 
 ObjClass* wrenNewSingleClass(WrenVM* vm, int numFields, ObjString* name)
@@ -51,9 +64,9 @@ ObjClass* wrenNewSingleClass(WrenVM* vm, int numFields, ObjString* name)
   classObj->numFields = numFields;
   classObj->name = name;
 
-  wrenPushRoot(vm, (Obj*)classObj);
-  wrenMethodBufferInit(&classObj->methods);
-  wrenPopRoot(vm);
+  classObj->methods = NULL;
+  classObj->numMethods = 0;
+  classObj->methodCapacity = 0;
 
   return classObj;
 }
@@ -76,9 +89,12 @@ void wrenBindSuperclass(WrenVM* vm, ObjClass* subclass, ObjClass* superclass)
   }
 
   // Inherit methods from its superclass.
-  for (int i = 0; i < superclass->methods.count; i++)
+  for (uint32_t i = 0; i < superclass->methodCapacity; i++)
   {
-    wrenBindMethod(vm, subclass, i, superclass->methods.data[i]);
+    MethodEntry* entry = &superclass->methods[i];
+    if (entry->symbol == -1) continue;
+
+    wrenBindMethod(vm, subclass, entry->symbol, entry->method);
   }
 }
 
@@ -116,18 +132,68 @@ ObjClass* wrenNewClass(WrenVM* vm, ObjClass* superclass, int numFields,
   return classObj;
 }
 
+// Inserts [method] into [classObj]'s method table under [symbol], replacing
+// any method already bound to it. The table must have a free entry.
+static void insertMethod(ObjClass* classObj, int symbol, Method method)
+{
+  uint32_t mask = classObj->methodCapacity - 1;
+  uint32_t i = (uint32_t)symbol & mask;
+  while (true)
+  {
+    MethodEntry* entry = &classObj->methods[i];
+    if (entry->symbol == symbol)
+    {
+      entry->method = method;
+      return;
+    }
+
+    if (entry->symbol == -1)
+    {
+      entry->symbol = symbol;
+      entry->method = method;
+      classObj->numMethods++;
+      return;
+    }
+
+    i = (i + 1) & mask;
+  }
+}
+
 void wrenBindMethod(WrenVM* vm, ObjClass* classObj, int symbol, Method method)
 {
-  // Make sure the buffer is big enough to contain the symbol's index.
-  if (symbol >= classObj->methods.count)
+  // Grow the table when it gets three quarters full so probe sequences stay
+  // short.
+  if ((classObj->numMethods + 1) * 4 > classObj->methodCapacity * 3)
   {
-    Method noMethod;
-    noMethod.type = METHOD_NONE;
-    wrenMethodBufferFill(vm, &classObj->methods, noMethod,
-                         symbol - classObj->methods.count + 1);
+    uint32_t capacity = classObj->methodCapacity == 0
+        ? 8 : classObj->methodCapacity * 2;
+    MethodEntry* entries = ALLOCATE_ARRAY(vm, MethodEntry, capacity);
+    for (uint32_t i = 0; i < capacity; i++) entries[i].symbol = -1;
+
+    // Swap in the new table, then rehash the old entries into it. The
+    // allocation above can trigger a GC, so the class's table fields must
+    // stay consistent until it completes.
+    MethodEntry* oldEntries = classObj->methods;
+    uint32_t oldCapacity = classObj->methodCapacity;
+    classObj->methods = entries;
+    classObj->methodCapacity = capacity;
+    classObj->numMethods = 0;
+
+    for (uint32_t i = 0; i < oldCapacity; i++)
+    {
+      if (oldEntries[i].symbol == -1) continue;
+      insertMethod(classObj, oldEntries[i].symbol, oldEntries[i].method);
+    }
+
+    DEALLOCATE(vm, oldEntries);
   }
 
-  classObj->methods.data[symbol] = method;
+  insertMethod(classObj, symbol, method);
+
+  if (method.type == METHOD_BLOCK)
+  {
+    wrenWriteBarrierObj(vm, (Obj*)classObj, (Obj*)method.fn.obj);
+  }
 }
 
 ObjClosure* wrenNewClosure(WrenVM* vm, ObjFn* fn)
@@ -147,22 +213,68 @@ ObjClosure* wrenNewClosure(WrenVM* vm, ObjFn* fn)
 
 ObjFiber* wrenNewFiber(WrenVM* vm, ObjClosure* closure)
 {
-  // Allocate the arrays before the fiber in case it triggers a GC.
-  CallFrame* frames = ALLOCATE_ARRAY(vm, CallFrame, INITIAL_CALL_FRAMES);
-  
+  return wrenNewFiberWithCapacity(vm, closure, 0, 0);
+}
+
+ObjFiber* wrenNewFiberWithCapacity(WrenVM* vm, ObjClosure* closure,
+                                   int stackSlots, int numFrames)
+{
   // Add one slot for the unused implicit receiver slot that the compiler
   // assumes all functions have.
-  int stackCapacity = closure == NULL
-      ? 1
-      : wrenPowerOf2Ceil(closure->fn->maxSlots + 1);
-  Value* stack = ALLOCATE_ARRAY(vm, Value, stackCapacity);
-  
+  int minSlots = closure == NULL ? 1 : closure->fn->maxSlots + 1;
+  if (minSlots < stackSlots) minSlots = stackSlots;
+  int stackCapacity = wrenPowerOf2Ceil(minSlots);
+
+  int frameCapacity = numFrames > INITIAL_CALL_FRAMES
+      ? numFrames
+      : INITIAL_CALL_FRAMES;
+
+  // Reuse a dead fiber's allocations if any have been pooled, otherwise
+  // allocate the arrays before the fiber in case it triggers a GC.
+  CallFrame* frames;
+  Value* stack;
+  FiberAllocation pooled;
+  if (wrenReuseFiberAllocation(vm, &pooled))
+  {
+    if (pooled.frameCapacity >= frameCapacity)
+    {
+      frames = pooled.frames;
+      frameCapacity = pooled.frameCapacity;
+    }
+    else
+    {
+      frames = (CallFrame*)wrenReallocate(vm, pooled.frames,
+                                          sizeof(CallFrame) * pooled.frameCapacity,
+                                          sizeof(CallFrame) * frameCapacity);
+    }
+
+    if (pooled.stackCapacity >= stackCapacity)
+    {
+      stack = pooled.stack;
+      stackCapacity = pooled.stackCapacity;
+    }
+    else
+    {
+      stack = (Value*)wrenReallocate(vm, pooled.stack,
+                                     sizeof(Value) * pooled.stackCapacity,
+                                     sizeof(Value) * stackCapacity);
+    }
+  }
+  else
+  {
+    frames = ALLOCATE_ARRAY(vm, CallFrame, frameCapacity);
+    stack = ALLOCATE_ARRAY(vm, Value, stackCapacity);
+  }
+
   ObjFiber* fiber = ALLOCATE(vm, ObjFiber);
   initObj(vm, &fiber->obj, OBJ_FIBER, vm->fiberClass);
   fiber->frames = frames;
-  fiber->frameCapacity = INITIAL_CALL_FRAMES;
+  fiber->frameCapacity = frameCapacity;
   fiber->stack = stack;
   fiber->stackCapacity = stackCapacity;
+  fiber->trace = NULL;
+  fiber->traceCount = 0;
+  fiber->traceCapacity = 0;
   wrenResetFiber(vm, fiber, closure);
 
   return fiber;
@@ -175,6 +287,7 @@ void wrenResetFiber(WrenVM* vm, ObjFiber* fiber, ObjClosure* closure)
   fiber->openUpvalues = NULL;
   fiber->caller = NULL;
   fiber->error = NULL_VAL;
+  fiber->traceCount = 0;
   fiber->callerIsTrying = false;
   fiber->numFrames = 0;
 
@@ -185,9 +298,10 @@ void wrenResetFiber(WrenVM* vm, ObjFiber* fiber, ObjClosure* closure)
 void wrenEnsureStack(WrenVM* vm, ObjFiber* fiber, int needed)
 {
   if (fiber->stackCapacity >= needed) return;
-  
-  int capacity = wrenPowerOf2Ceil(needed);
-  
+
+  int capacity = fiber->stackCapacity * vm->config.stackGrowthFactor;
+  if (capacity < needed) capacity = wrenPowerOf2Ceil(needed);
+
   Value* oldStack = fiber->stack;
   fiber->stack = (Value*)wrenReallocate(vm, fiber->stack,
                                         sizeof(Value) * fiber->stackCapacity,
@@ -245,6 +359,8 @@ ObjFn* wrenNewFunction(WrenVM* vm, ObjModule* module, int maxSlots)
   
   wrenValueBufferInit(&fn->constants);
   wrenByteBufferInit(&fn->code);
+  fn->callCaches = NULL;
+  fn->numCallCaches = 0;
   fn->module = module;
   fn->maxSlots = maxSlots;
   fn->numUpvalues = 0;
@@ -254,6 +370,18 @@ ObjFn* wrenNewFunction(WrenVM* vm, ObjModule* module, int maxSlots)
   return fn;
 }
 
+void wrenFunctionAllocateCallCaches(WrenVM* vm, ObjFn* fn)
+{
+  if (fn->numCallCaches == 0) return;
+
+  fn->callCaches = ALLOCATE_ARRAY(vm, CallCache, fn->numCallCaches);
+  for (int i = 0; i < fn->numCallCaches; i++)
+  {
+    fn->callCaches[i].classObj = NULL;
+    fn->callCaches[i].symbol = 0;
+  }
+}
+
 void wrenFunctionBindName(WrenVM* vm, ObjFn* fn, const char* name, int length)
 {
   fn->debug->name = ALLOCATE_ARRAY(vm, char, length + 1);
@@ -261,6 +389,24 @@ void wrenFunctionBindName(WrenVM* vm, ObjFn* fn, const char* name, int length)
   fn->debug->name[length] = '\0';
 }
 
+ObjFloatArray* wrenNewFloatArray(WrenVM* vm, uint32_t count)
+{
+  // Allocate this before the array object in case it triggers a GC which
+  // would free the array.
+  double* elements = NULL;
+  if (count > 0)
+  {
+    elements = ALLOCATE_ARRAY(vm, double, count);
+    memset(elements, 0, count * sizeof(double));
+  }
+
+  ObjFloatArray* array = ALLOCATE(vm, ObjFloatArray);
+  initObj(vm, &array->obj, OBJ_FLOAT_ARRAY, vm->floatArrayClass);
+  array->count = count;
+  array->elements = elements;
+  return array;
+}
+
 Value wrenNewInstance(WrenVM* vm, ObjClass* classObj)
 {
   ObjInstance* instance = ALLOCATE_FLEX(vm, ObjInstance,
@@ -311,6 +457,7 @@ void wrenListInsert(WrenVM* vm, ObjList* list, Value value, uint32_t index)
 
   // Store the new element.
   list->elements.data[index] = value;
+  wrenWriteBarrier(vm, (Obj*)list, value);
 }
 
 Value wrenListRemoveAt(WrenVM* vm, ObjList* list, uint32_t index)
@@ -340,13 +487,81 @@ Value wrenListRemoveAt(WrenVM* vm, ObjList* list, uint32_t index)
   return removed;
 }
 
+void wrenListReserve(WrenVM* vm, ObjList* list, uint32_t capacity)
+{
+  if ((int)capacity <= list->elements.capacity) return;
+
+  int newCapacity = wrenPowerOf2Ceil((int)capacity);
+  list->elements.data = (Value*)wrenReallocate(vm, list->elements.data,
+      sizeof(Value) * list->elements.capacity, sizeof(Value) * newCapacity);
+  list->elements.capacity = newCapacity;
+}
+
+void wrenListReplaceRange(WrenVM* vm, ObjList* list, uint32_t start,
+                          uint32_t count, ObjList* other)
+{
+  uint32_t oldCount = (uint32_t)list->elements.count;
+  uint32_t otherCount = (uint32_t)other->elements.count;
+
+  if (otherCount == count)
+  {
+    // The replacement is the same size as the slice, so overwrite it in
+    // place. memmove() since [other] may be [list] itself.
+    if (count > 0)
+    {
+      memmove(list->elements.data + start, other->elements.data,
+              count * sizeof(Value));
+    }
+  }
+  else
+  {
+    // The list changes size, so build a new element array. Copying instead
+    // of shifting in place also means a list being spliced into itself still
+    // reads its old elements.
+    uint32_t newCount = oldCount - count + otherCount;
+    int capacity = wrenPowerOf2Ceil((int)newCount);
+    Value* elements = ALLOCATE_ARRAY(vm, Value, capacity);
+
+    if (start > 0)
+    {
+      memcpy(elements, list->elements.data, start * sizeof(Value));
+    }
+
+    if (otherCount > 0)
+    {
+      memcpy(elements + start, other->elements.data,
+             otherCount * sizeof(Value));
+    }
+
+    uint32_t tail = oldCount - start - count;
+    if (tail > 0)
+    {
+      memcpy(elements + start + otherCount,
+             list->elements.data + start + count, tail * sizeof(Value));
+    }
+
+    DEALLOCATE(vm, list->elements.data);
+    list->elements.data = elements;
+    list->elements.capacity = capacity;
+    list->elements.count = (int)newCount;
+  }
+
+  for (uint32_t i = 0; i < otherCount; i++)
+  {
+    wrenWriteBarrier(vm, (Obj*)list, list->elements.data[start + i]);
+  }
+}
+
 ObjMap* wrenNewMap(WrenVM* vm)
 {
   ObjMap* map = ALLOCATE(vm, ObjMap);
   initObj(vm, &map->obj, OBJ_MAP, vm->mapClass);
-  map->capacity = 0;
+  map->indexCapacity = 0;
+  map->entryCapacity = 0;
+  map->entryCount = 0;
   map->count = 0;
   map->entries = NULL;
+  map->index = NULL;
   return map;
 }
 
@@ -412,149 +627,245 @@ static uint32_t hashValue(Value value)
 #endif
 }
 
-// Inserts [key] and [value] in the array of [entries] with the given
-// [capacity].
+// Inserts [entry], the position of an entry in [entries], into [index], which
+// must have a free slot for it. The probe starts at slot [i], which is
+// [distance] slots past the entry's home slot, so a caller that has already
+// walked part of the chain doesn't walk it again.
 //
-// Returns `true` if this is the first time [key] was added to the map.
-static bool addEntry(MapEntry* entries, uint32_t capacity,
-                     Value key, Value value)
+// Uses Robin Hood displacement: when the entry being inserted has probed
+// further from its home slot than the occupant of a slot, the two trade
+// places and the displaced occupant continues probing. This evens out probe
+// chain lengths, so the worst chains stay short even near the load factor
+// limit.
+static void insertIndex(MapEntry* entries, int32_t* index, uint32_t capacity,
+                        int32_t entry, uint32_t i, uint32_t distance)
 {
-  // Figure out where to insert it in the table. Use open addressing and
-  // basic linear probing.
-  uint32_t index = hashValue(key) % capacity;
+  uint32_t mask = capacity - 1;
 
-  // We don't worry about an infinite loop here because resizeMap() ensures
-  // there are open slots in the array.
-  while (true)
+  while (index[i] >= 0)
   {
-    MapEntry* entry = &entries[index];
-
-    // If we found an open slot, the key is not in the table.
-    if (IS_UNDEFINED(entry->key))
+    // If the occupant is closer to its home slot than we are to ours, it can
+    // better afford the longer probe. Take its slot and move it along.
+    uint32_t occupantDistance = (i - (entries[index[i]].hash & mask)) & mask;
+    if (occupantDistance < distance)
     {
-      entry->key = key;
-      entry->value = value;
-      return true;
-    }
-    else if (wrenValuesEqual(entry->key, key))
-    {
-      // If the key already exists, just replace the value.
-      entry->value = value;
-      return false;
+      int32_t displaced = index[i];
+      index[i] = entry;
+      entry = displaced;
+      distance = occupantDistance;
     }
 
-    // Try the next slot.
-    index = (index + 1) % capacity;
+    i = (i + 1) & mask;
+    distance++;
   }
+
+  index[i] = entry;
 }
 
-// Updates [map]'s entry array to [capacity].
-static void resizeMap(WrenVM* vm, ObjMap* map, uint32_t capacity)
+// Resizes [map]'s index to [indexCapacity] slots. This compacts the dense
+// entry array, discarding the holes left by removed keys. The entries' cached
+// hashes are reused, so no key is rehashed.
+static void resizeMap(WrenVM* vm, ObjMap* map, uint32_t indexCapacity)
 {
-  // Create the new empty hash table.
-  MapEntry* entries = ALLOCATE_ARRAY(vm, MapEntry, capacity);
-  for (uint32_t i = 0; i < capacity; i++)
-  {
-    entries[i].key = UNDEFINED_VAL;
-    entries[i].value = FALSE_VAL;
-  }
+  uint32_t entryCapacity = indexCapacity * MAP_LOAD_PERCENT / 100;
 
-  // Re-add the existing entries.
-  if (map->capacity > 0)
+  MapEntry* entries = ALLOCATE_ARRAY(vm, MapEntry, entryCapacity);
+  int32_t* index = ALLOCATE_ARRAY(vm, int32_t, indexCapacity);
+  for (uint32_t i = 0; i < indexCapacity; i++) index[i] = MAP_SLOT_EMPTY;
+
+  // Copy the live entries over, keeping their insertion order.
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < map->entryCount; i++)
   {
-    for (uint32_t i = 0; i < map->capacity; i++)
-    {
-      MapEntry* entry = &map->entries[i];
-      if (IS_UNDEFINED(entry->key)) continue;
+    MapEntry* entry = &map->entries[i];
+    if (IS_UNDEFINED(entry->key)) continue;
 
-      addEntry(entries, capacity, entry->key, entry->value);
-    }
+    entries[count] = *entry;
+    insertIndex(entries, index, indexCapacity, (int32_t)count,
+                entry->hash & (indexCapacity - 1), 0);
+    count++;
   }
 
-  // Replace the array.
   DEALLOCATE(vm, map->entries);
+  DEALLOCATE(vm, map->index);
   map->entries = entries;
-  map->capacity = capacity;
+  map->index = index;
+  map->indexCapacity = indexCapacity;
+  map->entryCapacity = entryCapacity;
+  map->entryCount = count;
+  map->count = count;
 }
 
-static MapEntry *findEntry(ObjMap* map, Value key)
+// Probes [map]'s index for [key], whose hash is [hash]. Returns a pointer to
+// the slot holding the key's entry if it's present, or NULL if it's not.
+static int32_t* findSlot(ObjMap* map, Value key, uint32_t hash)
 {
-  // If there is no entry array (an empty map), we definitely won't find it.
-  if (map->capacity == 0) return NULL;
+  if (map->indexCapacity == 0) return NULL;
 
-  // Figure out where to insert it in the table. Use open addressing and
-  // basic linear probing.
-  uint32_t index = hashValue(key) % map->capacity;
+  uint32_t mask = map->indexCapacity - 1;
+  uint32_t i = hash & mask;
+  uint32_t distance = 0;
 
-  // We don't worry about an infinite loop here because ensureMapCapacity()
-  // ensures there are empty (i.e. UNDEFINED) spaces in the table.
+  // We don't worry about an infinite loop here because the index always has
+  // empty slots.
   while (true)
   {
-    MapEntry* entry = &map->entries[index];
+    int32_t* slot = &map->index[i];
+    if (*slot == MAP_SLOT_EMPTY) return NULL;
 
-    if (IS_UNDEFINED(entry->key))
-    {
-      // If we found an empty slot, the key is not in the table. If we found a
-      // slot that contains a deleted key, we have to keep looking.
-      if (IS_FALSE(entry->value)) return NULL;
-    }
-    else if (wrenValuesEqual(entry->key, key))
-    {
-      // If the key matches, we found it.
-      return entry;
-    }
+    MapEntry* entry = &map->entries[*slot];
+
+    // Robin Hood insertion keeps every chain sorted by probe distance. An
+    // occupant closer to its home slot than we are to ours would have been
+    // displaced if the key were present, so the probe can stop early.
+    if (((i - (entry->hash & mask)) & mask) < distance) return NULL;
+
+    // Compare the cached hashes before the keys themselves so that walking
+    // over colliding slots doesn't pay for deep value comparisons.
+    if (entry->hash == hash && wrenValuesEqual(entry->key, key)) return slot;
 
     // Try the next slot.
-    index = (index + 1) % map->capacity;
+    i = (i + 1) & mask;
+    distance++;
   }
 }
 
 Value wrenMapGet(ObjMap* map, Value key)
 {
-  MapEntry *entry = findEntry(map, key);
-  if (entry != NULL) return entry->value;
+  if (map->count == 0) return UNDEFINED_VAL;
+
+  int32_t* slot = findSlot(map, key, hashValue(key));
+  if (slot != NULL) return map->entries[*slot].value;
 
   return UNDEFINED_VAL;
 }
 
+void wrenMapReserve(WrenVM* vm, ObjMap* map, uint32_t count)
+{
+  if (count <= map->entryCapacity) return;
+
+  uint32_t indexCapacity = MIN_CAPACITY;
+  while (count * 100 > indexCapacity * MAP_LOAD_PERCENT)
+  {
+    indexCapacity *= GROW_FACTOR;
+  }
+
+  resizeMap(vm, map, indexCapacity);
+}
+
 void wrenMapSet(WrenVM* vm, ObjMap* map, Value key, Value value)
 {
-  // If the map is getting too full, make room first.
-  if (map->count + 1 > map->capacity * MAP_LOAD_PERCENT / 100)
+  // Make room if the dense array is full. Resizing compacts away removed
+  // entries, so this only grows the index when the live entries alone would
+  // overload it.
+  if (map->entryCount + 1 > map->entryCapacity)
   {
-    // Figure out the new hash table size.
-    uint32_t capacity = map->capacity * GROW_FACTOR;
-    if (capacity < MIN_CAPACITY) capacity = MIN_CAPACITY;
+    uint32_t indexCapacity = MIN_CAPACITY;
+    while ((map->count + 1) * 100 > indexCapacity * MAP_LOAD_PERCENT)
+    {
+      indexCapacity *= GROW_FACTOR;
+    }
 
-    resizeMap(vm, map, capacity);
+    resizeMap(vm, map, indexCapacity);
   }
 
-  if (addEntry(map->entries, map->capacity, key, value))
+  // Walk the probe chain once, looking for the key. This duplicates
+  // findSlot() so that when the key turns out to be new, the insertion can
+  // pick up the Robin Hood displacement right where the probe stopped instead
+  // of walking the chain a second time.
+  uint32_t hash = hashValue(key);
+  uint32_t mask = map->indexCapacity - 1;
+  uint32_t i = hash & mask;
+  uint32_t distance = 0;
+  MapEntry* found = NULL;
+
+  while (true)
   {
-    // A new key was added.
+    int32_t slot = map->index[i];
+    if (slot == MAP_SLOT_EMPTY) break;
+
+    MapEntry* entry = &map->entries[slot];
+    if (((i - (entry->hash & mask)) & mask) < distance) break;
+
+    if (entry->hash == hash && wrenValuesEqual(entry->key, key))
+    {
+      found = entry;
+      break;
+    }
+
+    i = (i + 1) & mask;
+    distance++;
+  }
+
+  if (found != NULL)
+  {
+    // The key already exists, so just replace the value.
+    found->value = value;
+  }
+  else
+  {
+    // Append the new entry and add it to the index.
+    MapEntry* entry = &map->entries[map->entryCount];
+    entry->key = key;
+    entry->value = value;
+    entry->hash = hash;
+    insertIndex(map->entries, map->index, map->indexCapacity,
+                (int32_t)map->entryCount, i, distance);
+    map->entryCount++;
     map->count++;
   }
+
+  wrenWriteBarrier(vm, (Obj*)map, key);
+  wrenWriteBarrier(vm, (Obj*)map, value);
 }
 
 void wrenMapClear(WrenVM* vm, ObjMap* map)
 {
   DEALLOCATE(vm, map->entries);
+  DEALLOCATE(vm, map->index);
   map->entries = NULL;
-  map->capacity = 0;
+  map->index = NULL;
+  map->indexCapacity = 0;
+  map->entryCapacity = 0;
+  map->entryCount = 0;
   map->count = 0;
 }
 
 Value wrenMapRemoveKey(WrenVM* vm, ObjMap* map, Value key)
 {
-  MapEntry *entry = findEntry(map, key);
-  if (entry == NULL) return NULL_VAL;
+  if (map->count == 0) return NULL_VAL;
+
+  int32_t* slot = findSlot(map, key, hashValue(key));
+  if (slot == NULL) return NULL_VAL;
 
-  // Remove the entry from the map. Set this value to true, which marks it as a
-  // deleted slot. When searching for a key, we will stop on empty slots, but
-  // continue past deleted slots.
+  // Leave a hole in the dense array: iteration skips it, and it's discarded
+  // the next time the map is resized.
+  MapEntry* entry = &map->entries[*slot];
   Value value = entry->value;
   entry->key = UNDEFINED_VAL;
-  entry->value = TRUE_VAL;
+  entry->value = NULL_VAL;
+
+  // Instead of a tombstone, shift the occupants after the removed slot back
+  // towards their home slots. Robin Hood chains have no gaps, so sliding each
+  // occupant that's away from home back one slot keeps every probe sequence
+  // intact.
+  uint32_t mask = map->indexCapacity - 1;
+  uint32_t i = (uint32_t)(slot - map->index);
+  while (true)
+  {
+    uint32_t next = (i + 1) & mask;
+    int32_t occupant = map->index[next];
+    if (occupant == MAP_SLOT_EMPTY ||
+        next == (map->entries[occupant].hash & mask))
+    {
+      break;
+    }
+
+    map->index[i] = occupant;
+    i = next;
+  }
+
+  map->index[i] = MAP_SLOT_EMPTY;
 
   if (IS_OBJ(value)) wrenPushRoot(vm, AS_OBJ(value));
 
@@ -562,18 +873,16 @@ Value wrenMapRemoveKey(WrenVM* vm, ObjMap* map, Value key)
 
   if (map->count == 0)
   {
-    // Removed the last item, so free the array.
+    // Removed the last item, so free the arrays.
     wrenMapClear(vm, map);
   }
-  else if (map->capacity > MIN_CAPACITY &&
-           map->count < map->capacity / GROW_FACTOR * MAP_LOAD_PERCENT / 100)
+  else if (map->indexCapacity > MIN_CAPACITY &&
+           map->count < map->indexCapacity / GROW_FACTOR * MAP_LOAD_PERCENT
+               / 100)
   {
-    uint32_t capacity = map->capacity / GROW_FACTOR;
-    if (capacity < MIN_CAPACITY) capacity = MIN_CAPACITY;
-
-    // The map is getting empty, so shrink the entry array back down.
+    // The map is getting empty, so shrink it back down.
     // TODO: Should we do this less aggressively than we grow?
-    resizeMap(vm, map, capacity);
+    resizeMap(vm, map, map->indexCapacity / GROW_FACTOR);
   }
 
   if (IS_OBJ(value)) wrenPopRoot(vm);
@@ -624,8 +933,8 @@ static ObjString* allocateString(WrenVM* vm, size_t length)
   return string;
 }
 
-// Calculates and stores the hash code for [string].
-static void hashString(ObjString* string)
+// Calculates the hash code for [length] bytes of [chars].
+static uint32_t hashChars(const char* chars, size_t length)
 {
   // FNV-1a hash. See: http://www.isthe.com/chongo/tech/comp/fnv/
   uint32_t hash = 2166136261u;
@@ -633,13 +942,144 @@ static void hashString(ObjString* string)
   // This is O(n) on the length of the string, but we only call this when a new
   // string is created. Since the creation is also O(n) (to copy/initialize all
   // the bytes), we allow this here.
-  for (uint32_t i = 0; i < string->length; i++)
+  for (size_t i = 0; i < length; i++)
   {
-    hash ^= string->value[i];
+    hash ^= chars[i];
     hash *= 16777619;
   }
 
-  string->hash = hash;
+  return hash;
+}
+
+// Calculates and stores the hash code for [string].
+static void hashString(ObjString* string)
+{
+  string->hash = hashChars(string->value, string->length);
+}
+
+// A slot in the intern table whose string has been collected. Probes continue
+// past these the way they continue past a live non-matching string. The
+// sentinel is never dereferenced; only its address matters.
+static char internTombstoneSentinel;
+#define INTERN_TOMBSTONE ((ObjString*)(void*)&internTombstoneSentinel)
+
+// Looks for an already-interned string whose contents are the [length] bytes
+// of [text] with the given [hash]. Returns NULL if there isn't one.
+static ObjString* findInterned(WrenVM* vm, uint32_t hash, const char* text,
+                               size_t length)
+{
+  if (vm->internedCapacity == 0) return NULL;
+
+  uint32_t mask = vm->internedCapacity - 1;
+  for (uint32_t i = hash & mask;; i = (i + 1) & mask)
+  {
+    ObjString* string = vm->interned[i];
+    if (string == NULL) return NULL;
+    if (string == INTERN_TOMBSTONE) continue;
+
+    if (string->hash == hash && string->length == length &&
+        memcmp(string->value, text, length) == 0)
+    {
+      return string;
+    }
+  }
+}
+
+// Inserts [string] into [table], which must have a free slot for it.
+static void internInsert(ObjString** table, uint32_t capacity,
+                         ObjString* string)
+{
+  uint32_t mask = capacity - 1;
+  uint32_t i = string->hash & mask;
+  while (table[i] != NULL) i = (i + 1) & mask;
+  table[i] = string;
+}
+
+// Adds [string], which must not already be interned, to the intern table.
+//
+// This can allocate if the table needs to grow, so [string] must be reachable
+// or rooted.
+static void addInterned(WrenVM* vm, ObjString* string)
+{
+  // Grow when live strings and tombstones together fill three quarters of
+  // the table, so probes always find empty slots. Resizing discards the
+  // tombstones, and sizes the table for the live strings alone.
+  if ((vm->internedCount + vm->internedTombstones + 1) * 4 >
+      vm->internedCapacity * 3)
+  {
+    uint32_t capacity = vm->internedCapacity == 0
+        ? 64 : vm->internedCapacity;
+    while ((vm->internedCount + 1) * 4 > capacity * 3) capacity *= 2;
+
+    ObjString** table = ALLOCATE_ARRAY(vm, ObjString*, capacity);
+    for (uint32_t i = 0; i < capacity; i++) table[i] = NULL;
+
+    // The allocation above can collect strings, removing them from the old
+    // table, so recount the live entries as they're copied over.
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < vm->internedCapacity; i++)
+    {
+      ObjString* interned = vm->interned[i];
+      if (interned == NULL || interned == INTERN_TOMBSTONE) continue;
+
+      internInsert(table, capacity, interned);
+      count++;
+    }
+
+    DEALLOCATE(vm, vm->interned);
+    vm->interned = table;
+    vm->internedCapacity = capacity;
+    vm->internedCount = count;
+    vm->internedTombstones = 0;
+  }
+
+  // Insert at the first free slot, reusing a tombstone if the probe chain
+  // has one.
+  uint32_t mask = vm->internedCapacity - 1;
+  uint32_t i = string->hash & mask;
+  while (vm->interned[i] != NULL && vm->interned[i] != INTERN_TOMBSTONE)
+  {
+    i = (i + 1) & mask;
+  }
+
+  if (vm->interned[i] == INTERN_TOMBSTONE) vm->internedTombstones--;
+  vm->interned[i] = string;
+  vm->internedCount++;
+}
+
+// Removes [string] from the intern table when it's collected. This is what
+// makes the table weak: a string kept alive only by the table doesn't stay
+// alive.
+static void removeInterned(WrenVM* vm, ObjString* string)
+{
+  if (vm->internedCapacity == 0) return;
+
+  uint32_t mask = vm->internedCapacity - 1;
+  for (uint32_t i = string->hash & mask;; i = (i + 1) & mask)
+  {
+    if (vm->interned[i] == NULL) return;
+    if (vm->interned[i] != string) continue;
+
+    vm->interned[i] = INTERN_TOMBSTONE;
+    vm->internedCount--;
+    vm->internedTombstones++;
+    return;
+  }
+}
+
+// Interns [string], a freshly created string that isn't in the table yet. If
+// an equal string is already interned, returns it and leaves [string] for the
+// collector; otherwise adds [string] and returns it.
+static Value internString(WrenVM* vm, ObjString* string)
+{
+  ObjString* existing = findInterned(vm, string->hash, string->value,
+                                     string->length);
+  if (existing != NULL) return OBJ_VAL(existing);
+
+  wrenPushRoot(vm, (Obj*)string);
+  addInterned(vm, string);
+  wrenPopRoot(vm);
+  return OBJ_VAL(string);
 }
 
 Value wrenNewString(WrenVM* vm, const char* text, size_t length)
@@ -648,19 +1088,103 @@ Value wrenNewString(WrenVM* vm, const char* text, size_t length)
   // characters for a zero-length string.
   ASSERT(length == 0 || text != NULL, "Unexpected NULL string.");
 
+  // See if the string is already interned, before allocating anything.
+  uint32_t hash = hashChars(text, length);
+  ObjString* existing = findInterned(vm, hash, text, length);
+  if (existing != NULL) return OBJ_VAL(existing);
+
   ObjString* string = allocateString(vm, length);
 
   // Copy the string (if given one).
   if (length > 0 && text != NULL) memcpy(string->value, text, length);
 
-  hashString(string);
+  string->hash = hash;
+
+  wrenPushRoot(vm, (Obj*)string);
+  addInterned(vm, string);
+  wrenPopRoot(vm);
   return OBJ_VAL(string);
 }
 
+Value wrenStringConcat(WrenVM* vm, ObjString* left, ObjString* right)
+{
+  // Concatenating with an empty string can reuse the other operand, since
+  // strings are immutable.
+  if (left->length == 0) return OBJ_VAL(right);
+  if (right->length == 0) return OBJ_VAL(left);
+
+  ObjString* result = allocateString(vm,
+      (size_t)left->length + right->length);
+  memcpy(result->value, left->value, left->length);
+  memcpy(result->value + left->length, right->value, right->length);
+
+  hashString(result);
+  return internString(vm, result);
+}
+
+Value wrenStringJoin(WrenVM* vm, ObjList* strings, ObjString* separator)
+{
+  // Total up the result's length so it can be built with one allocation.
+  size_t totalLength = 0;
+  for (int i = 0; i < strings->elements.count; i++)
+  {
+    if (i > 0) totalLength += separator->length;
+    totalLength += AS_STRING(strings->elements.data[i])->length;
+  }
+
+  ObjString* result = allocateString(vm, totalLength);
+
+  char* to = result->value;
+  for (int i = 0; i < strings->elements.count; i++)
+  {
+    if (i > 0)
+    {
+      memcpy(to, separator->value, separator->length);
+      to += separator->length;
+    }
+
+    ObjString* part = AS_STRING(strings->elements.data[i]);
+    memcpy(to, part->value, part->length);
+    to += part->length;
+  }
+
+  hashString(result);
+  return internString(vm, result);
+}
+
 Value wrenNewStringFromRange(WrenVM* vm, ObjString* source, int start,
                              uint32_t count, int step)
 {
   uint8_t* from = (uint8_t*)source->value;
+
+  // A slice that covers the whole string is the string: it's immutable, so
+  // the receiver can be reused without copying anything.
+  if (step == 1 && start == 0 && count == (uint32_t)source->length)
+  {
+    return OBJ_VAL(source);
+  }
+
+  // A contiguous slice of ASCII bytes is exactly those bytes, so it can go
+  // through wrenNewString(), which checks the intern table before it
+  // allocates. Parsers that slice the same tokens out of every line get the
+  // interned string back with no allocation at all. (With multi-byte
+  // sequences the loop below re-encodes whole code points, so the result can
+  // differ from the raw bytes and has to be built the long way.)
+  if (step == 1)
+  {
+    bool ascii = true;
+    for (uint32_t i = 0; i < count; i++)
+    {
+      if (from[start + i] & 0x80)
+      {
+        ascii = false;
+        break;
+      }
+    }
+
+    if (ascii) return wrenNewString(vm, source->value + start, count);
+  }
+
   int length = 0;
   for (uint32_t i = 0; i < count; i++)
   {
@@ -683,18 +1207,52 @@ Value wrenNewStringFromRange(WrenVM* vm, ObjString* source, int start,
   }
 
   hashString(result);
-  return OBJ_VAL(result);
+  return internString(vm, result);
 }
 
-Value wrenNumToString(WrenVM* vm, double value)
+int wrenNumToCString(double value, char* buffer)
 {
   // Corner case: If the value is NaN, different versions of libc produce
   // different outputs (some will format it signed and some won't). To get
   // reliable output, handle that ourselves.
-  if (value != value) return CONST_STRING(vm, "nan");
-  if (value == INFINITY) return CONST_STRING(vm, "infinity");
-  if (value == -INFINITY) return CONST_STRING(vm, "-infinity");
+  if (value != value) { memcpy(buffer, "nan", 4); return 3; }
+  if (value == INFINITY) { memcpy(buffer, "infinity", 9); return 8; }
+  if (value == -INFINITY) { memcpy(buffer, "-infinity", 10); return 9; }
+
+  // An integer-valued double below 10^14 has at most fourteen significant
+  // digits, so "%.14g" formats it as a plain run of digits. Produce those
+  // digits directly instead of round-tripping through the libc formatter.
+  // This is the common case when serializing counts, indices, and ids.
+  if (trunc(value) == value && fabs(value) < 1e14)
+  {
+    int64_t integer = (int64_t)value;
+    uint64_t magnitude = (uint64_t)(integer < 0 ? -integer : integer);
+
+    // Emit the digits backwards from the end of the buffer, then slide them
+    // down to the front.
+    char* end = buffer + 23;
+    char* start = end;
+    do
+    {
+      *--start = (char)('0' + magnitude % 10);
+      magnitude /= 10;
+    }
+    while (magnitude > 0);
 
+    // "%.14g" keeps the sign on negative zero.
+    if (integer < 0 || (integer == 0 && signbit(value))) *--start = '-';
+
+    int length = (int)(end - start);
+    memmove(buffer, start, length);
+    buffer[length] = '\0';
+    return length;
+  }
+
+  return sprintf(buffer, "%.14g", value);
+}
+
+Value wrenNumToString(WrenVM* vm, double value)
+{
   // This is large enough to hold any double converted to a string using
   // "%.14g". Example:
   //
@@ -712,7 +1270,7 @@ Value wrenNumToString(WrenVM* vm, double value)
   // + 1 char for "\0"
   // = 24
   char buffer[24];
-  int length = sprintf(buffer, "%.14g", value);
+  int length = wrenNumToCString(value, buffer);
   return wrenNewString(vm, buffer, length);
 }
 
@@ -721,12 +1279,13 @@ Value wrenStringFromCodePoint(WrenVM* vm, int value)
   int length = wrenUtf8EncodeNumBytes(value);
   ASSERT(length != 0, "Value out of range.");
 
-  ObjString* string = allocateString(vm, length);
-
-  wrenUtf8Encode(value, (uint8_t*)string->value);
-  hashString(string);
+  // Encode into a local buffer so wrenNewString() can return an already
+  // interned string without allocating. Iterating a string character by
+  // character hits this for every character.
+  uint8_t bytes[4];
+  wrenUtf8Encode(value, bytes);
 
-  return OBJ_VAL(string);
+  return wrenNewString(vm, (const char*)bytes, length);
 }
 
 Value wrenStringFormat(WrenVM* vm, const char* format, ...)
@@ -791,7 +1350,7 @@ Value wrenStringFormat(WrenVM* vm, const char* format, ...)
 
   hashString(result);
 
-  return OBJ_VAL(result);
+  return internString(vm, result);
 }
 
 Value wrenStringCodePointAt(WrenVM* vm, ObjString* string, uint32_t index)
@@ -821,17 +1380,26 @@ uint32_t wrenStringFind(ObjString* haystack, ObjString* needle)
   // If the needle is longer than the haystack it won't be found.
   if (needle->length > haystack->length) return UINT32_MAX;
 
+  // A single character needle is a plain byte search, which memchr() does
+  // faster than we can since the C library typically vectorizes it.
+  if (needle->length == 1)
+  {
+    const char* found = memchr(haystack->value, needle->value[0],
+                               haystack->length);
+    return found == NULL ? UINT32_MAX : (uint32_t)(found - haystack->value);
+  }
+
   // Pre-calculate the shift table. For each character (8-bit value), we
   // determine how far the search window can be advanced if that character is
   // the last character in the haystack where we are searching for the needle
   // and the needle doesn't match there.
-  uint32_t shift[UINT8_MAX];
+  uint32_t shift[UINT8_MAX + 1];
   uint32_t needleEnd = needle->length - 1;
 
   // By default, we assume the character is not the needle at all. In that case
   // case, if a match fails on that character, we can advance one whole needle
   // width since.
-  for (uint32_t index = 0; index < UINT8_MAX; index++)
+  for (uint32_t index = 0; index <= UINT8_MAX; index++)
   {
     shift[index] = needle->length;
   }
@@ -847,30 +1415,54 @@ uint32_t wrenStringFind(ObjString* haystack, ObjString* needle)
   }
 
   // Slide the needle across the haystack, looking for the first match or
-  // stopping if the needle goes off the end.
+  // stopping if the needle goes off the end. Instead of testing one window
+  // per iteration, let memchr() scan for the next place the needle's last
+  // character occurs at the end of a window, since that rules out every
+  // window in between with vectorized code.
   char lastChar = needle->value[needleEnd];
   uint32_t range = haystack->length - needle->length;
 
   for (uint32_t index = 0; index <= range; )
   {
-    // Compare the last character in the haystack's window to the last character
-    // in the needle. If it matches, see if the whole needle matches.
-    char c = haystack->value[index + needleEnd];
-    if (lastChar == c &&
-        memcmp(haystack->value + index, needle->value, needleEnd) == 0)
+    const char* found = memchr(haystack->value + index + needleEnd, lastChar,
+                               range - index + 1);
+    if (found == NULL) break;
+    index = (uint32_t)(found - haystack->value) - needleEnd;
+
+    // The last character lines up, so see if the whole needle matches.
+    if (memcmp(haystack->value + index, needle->value, needleEnd) == 0)
     {
       // Found a match.
       return index;
     }
 
     // Otherwise, slide the needle forward.
-    index += shift[(uint8_t)c];
+    index += shift[(uint8_t)lastChar];
   }
 
   // Not found.
   return UINT32_MAX;
 }
 
+ObjStringBuffer* wrenNewStringBuffer(WrenVM* vm)
+{
+  ObjStringBuffer* buffer = ALLOCATE(vm, ObjStringBuffer);
+  initObj(vm, &buffer->obj, OBJ_STRING_BUFFER, vm->stringBufferClass);
+  wrenByteBufferInit(&buffer->bytes);
+  return buffer;
+}
+
+void wrenStringBufferAppend(WrenVM* vm, ObjStringBuffer* buffer,
+                            const char* bytes, size_t length)
+{
+  if (length == 0) return;
+
+  // Grow the buffer to fit the new bytes, then copy them in at the end.
+  int start = buffer->bytes.count;
+  wrenByteBufferFill(vm, &buffer->bytes, 0, (int)length);
+  memcpy(buffer->bytes.data + start, bytes, length);
+}
+
 ObjUpvalue* wrenNewUpvalue(WrenVM* vm, Value* value)
 {
   ObjUpvalue* upvalue = ALLOCATE(vm, ObjUpvalue);
@@ -888,6 +1480,21 @@ void wrenGrayObj(WrenVM* vm, Obj* obj)
 {
   if (obj == NULL) return;
 
+#if WREN_PARALLEL_MARK
+  // While a parallel mark is running, ownership of newly reached objects has
+  // to be decided atomically, and each worker keeps its own stack of them.
+  if (wrenCurrentMarkWorker != NULL)
+  {
+    wrenMarkWorkerGray(wrenCurrentMarkWorker, obj);
+    return;
+  }
+#endif
+
+  // A minor collection only traverses the nursery. Old objects are never
+  // freed by it, and any young objects they reference are found through the
+  // remembered set instead.
+  if (vm->collectingNursery && !obj->isYoung) return;
+
   // Stop if the object is already darkened so we don't get stuck in a cycle.
   if (obj->isDark) return;
 
@@ -920,6 +1527,18 @@ void wrenGrayBuffer(WrenVM* vm, ValueBuffer* buffer)
   }
 }
 
+// Adds [size] bytes to the count of live memory. The blacken functions call
+// this instead of adding to [bytesAllocated] directly because a parallel mark
+// runs them on several threads against the same VM.
+static void countMemory(WrenVM* vm, size_t size)
+{
+#if WREN_PARALLEL_MARK
+  __atomic_fetch_add(&vm->bytesAllocated, size, __ATOMIC_RELAXED);
+#else
+  vm->bytesAllocated += size;
+#endif
+}
+
 static void blackenClass(WrenVM* vm, ObjClass* classObj)
 {
   // The metaclass.
@@ -929,19 +1548,20 @@ static void blackenClass(WrenVM* vm, ObjClass* classObj)
   wrenGrayObj(vm, (Obj*)classObj->superclass);
 
   // Method function objects.
-  for (int i = 0; i < classObj->methods.count; i++)
+  for (uint32_t i = 0; i < classObj->methodCapacity; i++)
   {
-    if (classObj->methods.data[i].type == METHOD_BLOCK)
+    MethodEntry* entry = &classObj->methods[i];
+    if (entry->symbol != -1 && entry->method.type == METHOD_BLOCK)
     {
-      wrenGrayObj(vm, (Obj*)classObj->methods.data[i].fn.obj);
+      wrenGrayObj(vm, (Obj*)entry->method.fn.obj);
     }
   }
 
   wrenGrayObj(vm, (Obj*)classObj->name);
 
   // Keep track of how much memory is still in use.
-  vm->bytesAllocated += sizeof(ObjClass);
-  vm->bytesAllocated += classObj->methods.capacity * sizeof(Method);
+  countMemory(vm, sizeof(ObjClass));
+  countMemory(vm, classObj->methodCapacity * sizeof(MethodEntry));
 }
 
 static void blackenClosure(WrenVM* vm, ObjClosure* closure)
@@ -956,8 +1576,8 @@ static void blackenClosure(WrenVM* vm, ObjClosure* closure)
   }
 
   // Keep track of how much memory is still in use.
-  vm->bytesAllocated += sizeof(ObjClosure);
-  vm->bytesAllocated += sizeof(ObjUpvalue*) * closure->fn->numUpvalues;
+  countMemory(vm, sizeof(ObjClosure));
+  countMemory(vm, sizeof(ObjUpvalue*) * closure->fn->numUpvalues);
 }
 
 static void blackenFiber(WrenVM* vm, ObjFiber* fiber)
@@ -986,10 +1606,21 @@ static void blackenFiber(WrenVM* vm, ObjFiber* fiber)
   wrenGrayObj(vm, (Obj*)fiber->caller);
   wrenGrayValue(vm, fiber->error);
 
+  // The functions referenced by the captured stack trace.
+  for (int i = 0; i < fiber->traceCount; i++)
+  {
+    wrenGrayObj(vm, (Obj*)fiber->trace[i].fn);
+  }
+
   // Keep track of how much memory is still in use.
-  vm->bytesAllocated += sizeof(ObjFiber);
-  vm->bytesAllocated += fiber->frameCapacity * sizeof(CallFrame);
-  vm->bytesAllocated += fiber->stackCapacity * sizeof(Value);
+  countMemory(vm, sizeof(ObjFiber));
+  countMemory(vm, fiber->frameCapacity * sizeof(CallFrame));
+  countMemory(vm, fiber->stackCapacity * sizeof(Value));
+  countMemory(vm, fiber->traceCapacity * sizeof(TraceFrame));
+
+  // The fiber may push more values onto its stack while the incremental cycle
+  // is running, so it has to be scanned again when the cycle finishes.
+  if (vm->gcPhase == GC_PHASE_MARKING) wrenRememberBlackenedFiber(vm, fiber);
 }
 
 static void blackenFn(WrenVM* vm, ObjFn* fn)
@@ -997,13 +1628,32 @@ static void blackenFn(WrenVM* vm, ObjFn* fn)
   // Mark the constants.
   wrenGrayBuffer(vm, &fn->constants);
 
+  // Mark the objects the inline caches reference. The receiver classes are
+  // compared by pointer, so letting one be collected could alias a stale
+  // cache entry with a newly-allocated class at the same address.
+  if (fn->callCaches != NULL)
+  {
+    for (int i = 0; i < fn->numCallCaches; i++)
+    {
+      CallCache* cache = &fn->callCaches[i];
+      if (cache->classObj == NULL) continue;
+
+      wrenGrayObj(vm, (Obj*)cache->classObj);
+      if (cache->method.type == METHOD_BLOCK)
+      {
+        wrenGrayObj(vm, (Obj*)cache->method.fn.obj);
+      }
+    }
+  }
+
   // Keep track of how much memory is still in use.
-  vm->bytesAllocated += sizeof(ObjFn);
-  vm->bytesAllocated += sizeof(uint8_t) * fn->code.capacity;
-  vm->bytesAllocated += sizeof(Value) * fn->constants.capacity;
+  countMemory(vm, sizeof(ObjFn));
+  countMemory(vm, sizeof(CallCache) * fn->numCallCaches);
+  countMemory(vm, sizeof(uint8_t) * fn->code.capacity);
+  countMemory(vm, sizeof(Value) * fn->constants.capacity);
   
   // The debug line number buffer.
-  vm->bytesAllocated += sizeof(int) * fn->code.capacity;
+  countMemory(vm, sizeof(int) * fn->code.capacity);
   // TODO: What about the function name?
 }
 
@@ -1027,8 +1677,8 @@ static void blackenInstance(WrenVM* vm, ObjInstance* instance)
   }
 
   // Keep track of how much memory is still in use.
-  vm->bytesAllocated += sizeof(ObjInstance);
-  vm->bytesAllocated += sizeof(Value) * instance->obj.classObj->numFields;
+  countMemory(vm, sizeof(ObjInstance));
+  countMemory(vm, sizeof(Value) * instance->obj.classObj->numFields);
 }
 
 static void blackenList(WrenVM* vm, ObjList* list)
@@ -1037,14 +1687,14 @@ static void blackenList(WrenVM* vm, ObjList* list)
   wrenGrayBuffer(vm, &list->elements);
 
   // Keep track of how much memory is still in use.
-  vm->bytesAllocated += sizeof(ObjList);
-  vm->bytesAllocated += sizeof(Value) * list->elements.capacity;
+  countMemory(vm, sizeof(ObjList));
+  countMemory(vm, sizeof(Value) * list->elements.capacity);
 }
 
 static void blackenMap(WrenVM* vm, ObjMap* map)
 {
   // Mark the entries.
-  for (uint32_t i = 0; i < map->capacity; i++)
+  for (uint32_t i = 0; i < map->entryCount; i++)
   {
     MapEntry* entry = &map->entries[i];
     if (IS_UNDEFINED(entry->key)) continue;
@@ -1054,8 +1704,9 @@ static void blackenMap(WrenVM* vm, ObjMap* map)
   }
 
   // Keep track of how much memory is still in use.
-  vm->bytesAllocated += sizeof(ObjMap);
-  vm->bytesAllocated += sizeof(MapEntry) * map->capacity;
+  countMemory(vm, sizeof(ObjMap));
+  countMemory(vm, sizeof(MapEntry) * map->entryCapacity);
+  countMemory(vm, sizeof(int32_t) * map->indexCapacity);
 }
 
 static void blackenModule(WrenVM* vm, ObjModule* module)
@@ -1069,20 +1720,34 @@ static void blackenModule(WrenVM* vm, ObjModule* module)
   wrenGrayObj(vm, (Obj*)module->name);
 
   // Keep track of how much memory is still in use.
-  vm->bytesAllocated += sizeof(ObjModule);
+  countMemory(vm, sizeof(ObjModule));
   // TODO: Track memory for symbol table and buffer.
 }
 
 static void blackenRange(WrenVM* vm, ObjRange* range)
 {
   // Keep track of how much memory is still in use.
-  vm->bytesAllocated += sizeof(ObjRange);
+  countMemory(vm, sizeof(ObjRange));
+}
+
+static void blackenFloatArray(WrenVM* vm, ObjFloatArray* array)
+{
+  // Keep track of how much memory is still in use.
+  countMemory(vm, sizeof(ObjFloatArray));
+  countMemory(vm, array->count * sizeof(double));
 }
 
 static void blackenString(WrenVM* vm, ObjString* string)
 {
   // Keep track of how much memory is still in use.
-  vm->bytesAllocated += sizeof(ObjString) + string->length + 1;
+  countMemory(vm, sizeof(ObjString) + string->length + 1);
+}
+
+static void blackenStringBuffer(WrenVM* vm, ObjStringBuffer* buffer)
+{
+  // Keep track of how much memory is still in use.
+  countMemory(vm, sizeof(ObjStringBuffer));
+  countMemory(vm, buffer->bytes.capacity * sizeof(uint8_t));
 }
 
 static void blackenUpvalue(WrenVM* vm, ObjUpvalue* upvalue)
@@ -1091,10 +1756,10 @@ static void blackenUpvalue(WrenVM* vm, ObjUpvalue* upvalue)
   wrenGrayValue(vm, upvalue->closed);
 
   // Keep track of how much memory is still in use.
-  vm->bytesAllocated += sizeof(ObjUpvalue);
+  countMemory(vm, sizeof(ObjUpvalue));
 }
 
-static void blackenObject(WrenVM* vm, Obj* obj)
+void wrenBlackenObject(WrenVM* vm, Obj* obj)
 {
 #if WREN_DEBUG_TRACE_MEMORY
   printf("mark ");
@@ -1108,6 +1773,9 @@ static void blackenObject(WrenVM* vm, Obj* obj)
     case OBJ_CLASS:    blackenClass(   vm, (ObjClass*)   obj); break;
     case OBJ_CLOSURE:  blackenClosure( vm, (ObjClosure*) obj); break;
     case OBJ_FIBER:    blackenFiber(   vm, (ObjFiber*)   obj); break;
+    case OBJ_FLOAT_ARRAY:
+      blackenFloatArray(vm, (ObjFloatArray*)obj);
+      break;
     case OBJ_FN:       blackenFn(      vm, (ObjFn*)      obj); break;
     case OBJ_FOREIGN:  blackenForeign( vm, (ObjForeign*) obj); break;
     case OBJ_INSTANCE: blackenInstance(vm, (ObjInstance*)obj); break;
@@ -1116,6 +1784,9 @@ static void blackenObject(WrenVM* vm, Obj* obj)
     case OBJ_MODULE:   blackenModule(  vm, (ObjModule*)  obj); break;
     case OBJ_RANGE:    blackenRange(   vm, (ObjRange*)   obj); break;
     case OBJ_STRING:   blackenString(  vm, (ObjString*)  obj); break;
+    case OBJ_STRING_BUFFER:
+      blackenStringBuffer(vm, (ObjStringBuffer*)obj);
+      break;
     case OBJ_UPVALUE:  blackenUpvalue( vm, (ObjUpvalue*) obj); break;
   }
 }
@@ -1126,8 +1797,127 @@ void wrenBlackenObjects(WrenVM* vm)
   {
     // Pop an item from the gray stack.
     Obj* obj = vm->gray[--vm->grayCount];
-    blackenObject(vm, obj);
+    wrenBlackenObject(vm, obj);
+  }
+}
+
+bool wrenBlackenObjectsBudgeted(WrenVM* vm, int budget)
+{
+  while (vm->grayCount > 0)
+  {
+    if (budget-- == 0) return false;
+
+    // Pop an item from the gray stack.
+    Obj* obj = vm->gray[--vm->grayCount];
+    wrenBlackenObject(vm, obj);
+  }
+
+  return true;
+}
+
+size_t wrenObjectSize(Obj* obj)
+{
+  switch (obj->type)
+  {
+    case OBJ_CLASS:
+    {
+      ObjClass* classObj = (ObjClass*)obj;
+      return sizeof(ObjClass) + classObj->methodCapacity * sizeof(MethodEntry);
+    }
+
+    case OBJ_CLOSURE:
+    {
+      ObjClosure* closure = (ObjClosure*)obj;
+      return sizeof(ObjClosure) +
+             sizeof(ObjUpvalue*) * closure->fn->numUpvalues;
+    }
+
+    case OBJ_FIBER:
+    {
+      ObjFiber* fiber = (ObjFiber*)obj;
+      return sizeof(ObjFiber) + fiber->frameCapacity * sizeof(CallFrame) +
+             fiber->stackCapacity * sizeof(Value) +
+             fiber->traceCapacity * sizeof(TraceFrame);
+    }
+
+    case OBJ_FLOAT_ARRAY:
+    {
+      ObjFloatArray* array = (ObjFloatArray*)obj;
+      return sizeof(ObjFloatArray) + array->count * sizeof(double);
+    }
+
+    case OBJ_FN:
+    {
+      ObjFn* fn = (ObjFn*)obj;
+      return sizeof(ObjFn) + sizeof(CallCache) * fn->numCallCaches +
+             sizeof(uint8_t) * fn->code.capacity +
+             sizeof(Value) * fn->constants.capacity +
+             sizeof(int) * fn->code.capacity;
+    }
+
+    // The size of the foreign data isn't stored, so only the header is
+    // counted, matching blackenForeign().
+    case OBJ_FOREIGN: return sizeof(ObjForeign);
+
+    case OBJ_INSTANCE:
+    {
+      ObjInstance* instance = (ObjInstance*)obj;
+      return sizeof(ObjInstance) +
+             sizeof(Value) * instance->obj.classObj->numFields;
+    }
+
+    case OBJ_LIST:
+    {
+      ObjList* list = (ObjList*)obj;
+      return sizeof(ObjList) + sizeof(Value) * list->elements.capacity;
+    }
+
+    case OBJ_MAP:
+    {
+      ObjMap* map = (ObjMap*)obj;
+      return sizeof(ObjMap) + sizeof(MapEntry) * map->entryCapacity +
+             sizeof(int32_t) * map->indexCapacity;
+    }
+
+    case OBJ_MODULE: return sizeof(ObjModule);
+    case OBJ_RANGE: return sizeof(ObjRange);
+
+    case OBJ_STRING:
+    {
+      ObjString* string = (ObjString*)obj;
+      return sizeof(ObjString) + string->length + 1;
+    }
+
+    case OBJ_STRING_BUFFER:
+    {
+      ObjStringBuffer* buffer = (ObjStringBuffer*)obj;
+      return sizeof(ObjStringBuffer) +
+             buffer->bytes.capacity * sizeof(uint8_t);
+    }
+
+    case OBJ_UPVALUE: return sizeof(ObjUpvalue);
   }
+
+  UNREACHABLE();
+  return 0;
+}
+
+void wrenRescanFiber(WrenVM* vm, ObjFiber* fiber)
+{
+  // blackenFiber() counts the fiber's memory toward the live total, and this
+  // fiber was already counted when it was first blackened during the current
+  // cycle. Compensate so it isn't counted twice.
+  vm->bytesAllocated -= sizeof(ObjFiber);
+  vm->bytesAllocated -= fiber->frameCapacity * sizeof(CallFrame);
+  vm->bytesAllocated -= fiber->stackCapacity * sizeof(Value);
+  vm->bytesAllocated -= fiber->traceCapacity * sizeof(TraceFrame);
+
+  blackenFiber(vm, fiber);
+}
+
+void wrenScanRemembered(WrenVM* vm, Obj* obj)
+{
+  wrenBlackenObject(vm, obj);
 }
 
 void wrenFreeObj(WrenVM* vm, Obj* obj)
@@ -1141,14 +1931,20 @@ void wrenFreeObj(WrenVM* vm, Obj* obj)
   switch (obj->type)
   {
     case OBJ_CLASS:
-      wrenMethodBufferClear(vm, &((ObjClass*)obj)->methods);
+      DEALLOCATE(vm, ((ObjClass*)obj)->methods);
       break;
 
     case OBJ_FIBER:
     {
+      // Hand the stack and frame arrays to the fiber pool so a later fiber
+      // can reuse them. If the pool is full they are freed as usual.
       ObjFiber* fiber = (ObjFiber*)obj;
-      DEALLOCATE(vm, fiber->frames);
-      DEALLOCATE(vm, fiber->stack);
+      if (!wrenPoolFiberAllocations(vm, fiber))
+      {
+        DEALLOCATE(vm, fiber->frames);
+        DEALLOCATE(vm, fiber->stack);
+      }
+      DEALLOCATE(vm, fiber->trace);
       break;
     }
       
@@ -1157,12 +1953,17 @@ void wrenFreeObj(WrenVM* vm, Obj* obj)
       ObjFn* fn = (ObjFn*)obj;
       wrenValueBufferClear(vm, &fn->constants);
       wrenByteBufferClear(vm, &fn->code);
+      DEALLOCATE(vm, fn->callCaches);
       wrenIntBufferClear(vm, &fn->debug->sourceLines);
       DEALLOCATE(vm, fn->debug->name);
       DEALLOCATE(vm, fn->debug);
       break;
     }
 
+    case OBJ_FLOAT_ARRAY:
+      DEALLOCATE(vm, ((ObjFloatArray*)obj)->elements);
+      break;
+
     case OBJ_FOREIGN:
       wrenFinalizeForeign(vm, (ObjForeign*)obj);
       break;
@@ -1173,6 +1974,7 @@ void wrenFreeObj(WrenVM* vm, Obj* obj)
 
     case OBJ_MAP:
       DEALLOCATE(vm, ((ObjMap*)obj)->entries);
+      DEALLOCATE(vm, ((ObjMap*)obj)->index);
       break;
 
     case OBJ_MODULE:
@@ -1180,10 +1982,17 @@ void wrenFreeObj(WrenVM* vm, Obj* obj)
       wrenValueBufferClear(vm, &((ObjModule*)obj)->variables);
       break;
 
+    case OBJ_STRING:
+      removeInterned(vm, (ObjString*)obj);
+      break;
+
+    case OBJ_STRING_BUFFER:
+      wrenByteBufferClear(vm, &((ObjStringBuffer*)obj)->bytes);
+      break;
+
     case OBJ_CLOSURE:
     case OBJ_INSTANCE:
     case OBJ_RANGE:
-    case OBJ_STRING:
     case OBJ_UPVALUE:
       break;
   }
@@ -1221,16 +2030,9 @@ bool wrenValuesEqual(Value a, Value b)
              aRange->isInclusive == bRange->isInclusive;
     }
 
-    case OBJ_STRING:
-    {
-      ObjString* aString = (ObjString*)aObj;
-      ObjString* bString = (ObjString*)bObj;
-      return aString->length == bString->length &&
-             aString->hash == bString->hash &&
-             memcmp(aString->value, bString->value, aString->length) == 0;
-    }
-
     default:
+      // Strings are interned, so two distinct string objects always have
+      // distinct contents and the identity check above already handled them.
       // All other types are only equal if they are same, which they aren't if
       // we get here.
       return false;
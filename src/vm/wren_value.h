@@ -47,6 +47,7 @@
 #define AS_CLASS(value)     ((ObjClass*)AS_OBJ(value))          // ObjClass*
 #define AS_CLOSURE(value)   ((ObjClosure*)AS_OBJ(value))        // ObjClosure*
 #define AS_FIBER(v)         ((ObjFiber*)AS_OBJ(v))              // ObjFiber*
+#define AS_FLOAT_ARRAY(v)   ((ObjFloatArray*)AS_OBJ(v))         // ObjFloatArray*
 #define AS_FN(value)        ((ObjFn*)AS_OBJ(value))             // ObjFn*
 #define AS_FOREIGN(v)       ((ObjForeign*)AS_OBJ(v))            // ObjForeign*
 #define AS_INSTANCE(value)  ((ObjInstance*)AS_OBJ(value))       // ObjInstance*
@@ -57,6 +58,7 @@
 #define AS_RANGE(v)         ((ObjRange*)AS_OBJ(v))              // ObjRange*
 #define AS_STRING(v)        ((ObjString*)AS_OBJ(v))             // ObjString*
 #define AS_CSTRING(v)       (AS_STRING(v)->value)               // const char*
+#define AS_STRING_BUFFER(v) ((ObjStringBuffer*)AS_OBJ(v))       // ObjStringBuffer*
 
 // These macros promote a primitive C value to a full Wren Value. There are
 // more defined below that are specific to the Nan tagged or other
@@ -71,12 +73,14 @@
 #define IS_CLASS(value) (wrenIsObjType(value, OBJ_CLASS))       // ObjClass
 #define IS_CLOSURE(value) (wrenIsObjType(value, OBJ_CLOSURE))   // ObjClosure
 #define IS_FIBER(value) (wrenIsObjType(value, OBJ_FIBER))       // ObjFiber
+#define IS_FLOAT_ARRAY(value) (wrenIsObjType(value, OBJ_FLOAT_ARRAY)) // ObjFloatArray
 #define IS_FN(value) (wrenIsObjType(value, OBJ_FN))             // ObjFn
 #define IS_FOREIGN(value) (wrenIsObjType(value, OBJ_FOREIGN))   // ObjForeign
 #define IS_INSTANCE(value) (wrenIsObjType(value, OBJ_INSTANCE)) // ObjInstance
 #define IS_LIST(value) (wrenIsObjType(value, OBJ_LIST))         // ObjList
 #define IS_RANGE(value) (wrenIsObjType(value, OBJ_RANGE))       // ObjRange
 #define IS_STRING(value) (wrenIsObjType(value, OBJ_STRING))     // ObjString
+#define IS_STRING_BUFFER(value) (wrenIsObjType(value, OBJ_STRING_BUFFER)) // ObjStringBuffer
 
 // Creates a new string object from [text], which should be a bare C string
 // literal. This determines the length of the string automatically at compile
@@ -88,6 +92,7 @@ typedef enum {
   OBJ_CLASS,
   OBJ_CLOSURE,
   OBJ_FIBER,
+  OBJ_FLOAT_ARRAY,
   OBJ_FN,
   OBJ_FOREIGN,
   OBJ_INSTANCE,
@@ -96,6 +101,7 @@ typedef enum {
   OBJ_MODULE,
   OBJ_RANGE,
   OBJ_STRING,
+  OBJ_STRING_BUFFER,
   OBJ_UPVALUE
 } ObjType;
 
@@ -107,6 +113,15 @@ typedef struct sObj
   ObjType type;
   bool isDark;
 
+  // True if the object is in the nursery: it was allocated after the last
+  // collection and hasn't been promoted to the main heap yet. Always false
+  // when generational collection is disabled.
+  bool isYoung;
+
+  // True if the object is in the remembered set: it's an old object that a
+  // young object has been stored into, so a minor collection has to scan it.
+  bool isRemembered;
+
   // The object's class.
   ObjClass* classObj;
 
@@ -159,6 +174,32 @@ typedef struct
   char value[FLEXIBLE_ARRAY];
 } ObjString;
 
+// A fixed-size array of unboxed doubles. Unlike ObjList, which stores boxed
+// Values, the elements are stored contiguously as raw doubles, so bulk
+// numeric data gets better locality and can be handed to foreign methods
+// without boxing each element.
+typedef struct
+{
+  Obj obj;
+
+  // The number of elements.
+  uint32_t count;
+
+  // The elements themselves.
+  double* elements;
+} ObjFloatArray;
+
+// A mutable buffer for incrementally building up a string. Unlike ObjString,
+// which is immutable and stores its bytes inline, this stores them out of
+// line so appending can grow the buffer with amortized cost.
+typedef struct
+{
+  Obj obj;
+
+  // The bytes accumulated so far, without a null terminator.
+  ByteBuffer bytes;
+} ObjStringBuffer;
+
 // The dynamically allocated data structure for a variable that has been used
 // by a closure. Whenever a function accesses a variable declared in an
 // enclosing function, it will get to it through this.
@@ -243,10 +284,16 @@ typedef struct
 typedef struct
 {
   Obj obj;
-  
+
   ByteBuffer code;
   ValueBuffer constants;
-  
+
+  // Inline caches for the method call sites in [code], one per `CODE_CALL_*`
+  // instruction, indexed by the instruction's cache slot argument. See
+  // [CallCache].
+  struct sCallCache* callCaches;
+  int numCallCaches;
+
   // The module where this function was defined.
   ObjModule* module;
 
@@ -291,6 +338,18 @@ typedef struct
   Value* stackStart;
 } CallFrame;
 
+// One frame of a captured stack trace. Just enough to reconstruct the
+// printable form later: the line is looked up from [fn]'s debug info using
+// [ip] only if the trace is actually printed or read.
+typedef struct
+{
+  // The function that was executing in this frame.
+  ObjFn* fn;
+
+  // The offset of the next instruction within [fn]'s bytecode.
+  int ip;
+} TraceFrame;
+
 typedef struct sObjFiber
 {
   Obj obj;
@@ -328,7 +387,16 @@ typedef struct sObjFiber
   // If the fiber failed because of a runtime error, this will contain the
   // error object. Otherwise, it will be null.
   Value error;
-  
+
+  // The call stack captured when [error] was set, innermost frame last, or
+  // NULL if no error has occurred. Only the function and instruction offset
+  // are recorded, so fibers whose errors are caught and discarded don't pay
+  // for resolving lines or formatting strings; the printable form is built
+  // on demand. The array is grown as needed and reused by later errors.
+  TraceFrame* trace;
+  int traceCount;
+  int traceCapacity;
+
   // This will be true if the caller that called this fiber did so using "try".
   // In that case, if this fiber fails with an error, the error will be given
   // to the caller.
@@ -370,7 +438,41 @@ typedef struct
   } fn;
 } Method;
 
-DECLARE_BUFFER(Method, Method);
+// An entry in a class's method table. [symbol] is the method's index in the
+// VM's method name table, or -1 if the entry is unused.
+typedef struct
+{
+  int symbol;
+  Method method;
+} MethodEntry;
+
+// A monomorphic inline cache for a single method call site.
+//
+// Method lookup is already just an index into the receiving class's method
+// table, but at a hot call site even that load is measurable, and the
+// receiver's class rarely changes from one execution of the site to the next.
+// So each `CODE_CALL_*` instruction remembers the class it saw last time and
+// the method that lookup resolved to. When the class and symbol match, the
+// call skips the method table entirely.
+//
+// The method is stored by value since a class's method buffer may be
+// reallocated while it is being defined, which would invalidate a pointer
+// into it. A class's methods never change after the class is defined, so a
+// cached copy can't go stale.
+typedef struct sCallCache
+{
+  // The receiver's class the last time this call site executed, or NULL if
+  // the site has never been executed.
+  ObjClass* classObj;
+
+  // The method symbol the last send from this site looked up. A function with
+  // more call sites than slot indices shares its last slot among the extras,
+  // so a hit must match the symbol as well as the class.
+  uint16_t symbol;
+
+  // The method [classObj] resolved to for [symbol].
+  Method method;
+} CallCache;
 
 struct sObjClass
 {
@@ -381,15 +483,19 @@ struct sObjClass
   // of its superclass fields.
   int numFields;
 
-  // The table of methods that are defined in or inherited by this class.
-  // Methods are called by symbol, and the symbol directly maps to an index in
-  // this table. This makes method calls fast at the expense of empty cells in
-  // the list for methods the class doesn't support.
-  //
-  // You can think of it as a hash table that never has collisions but has a
-  // really low load factor. Since methods are pretty small (just a type and a
-  // pointer), this should be a worthwhile trade-off.
-  MethodBuffer methods;
+  // The table of methods that are defined in or inherited by this class,
+  // keyed by method symbol. It's a hash table using open addressing with
+  // linear probing, so a class only pays for the methods it actually has, no
+  // matter how many method names exist in the whole program. Since the keys
+  // are already small dense integers, "hashing" is just masking the symbol,
+  // and a lookup usually hits on the first probe.
+  MethodEntry* methods;
+
+  // The number of entries in [methods] that are in use.
+  uint32_t numMethods;
+
+  // The allocated size of [methods]. Zero or a power of two.
+  uint32_t methodCapacity;
 
   // The name of the class.
   ObjString* name;
@@ -417,46 +523,65 @@ typedef struct
 
 typedef struct
 {
-  // The entry's key, or UNDEFINED_VAL if the entry is not in use.
+  // The entry's key, or UNDEFINED_VAL if the entry has been removed.
   Value key;
 
-  // The value associated with the key. If the key is UNDEFINED_VAL, this will
-  // be false to indicate an open available entry or true to indicate a
-  // tombstone -- an entry that was previously in use but was then deleted.
+  // The value associated with the key.
   Value value;
+
+  // The cached hash of the key. Probes compare this before the key itself,
+  // and resizes rebuild the index from it without rehashing.
+  uint32_t hash;
 } MapEntry;
 
 // A hash table mapping keys to values.
 //
-// We use something very simple: open addressing with linear probing. The hash
-// table is an array of entries. Each entry is a key-value pair. If the key is
-// the special UNDEFINED_VAL, it indicates no value is currently in that slot.
-// Otherwise, it's a valid key, and the value is the value associated with it.
-//
-// When entries are added, the array is dynamically scaled by GROW_FACTOR to
-// keep the number of filled slots under MAP_LOAD_PERCENT. Likewise, if the map
-// gets empty enough, it will be resized to a smaller array. When this happens,
-// all existing entries are rehashed and re-added to the new array.
-//
-// When an entry is removed, its slot is replaced with a "tombstone". This is an
-// entry whose key is UNDEFINED_VAL and whose value is TRUE_VAL. When probing
-// for a key, we will continue past tombstones, because the desired key may be
-// found after them if the key that was removed was part of a prior collision.
-// When the array gets resized, all tombstones are discarded.
+// The storage is split in two, in the style of "compact" or "ordered" hash
+// maps. The entries themselves live in a dense array in insertion order. A
+// separate sparse index array is the actual hash table: each slot holds the
+// position of an entry in the dense array, or is empty. Probing uses open
+// addressing with Robin Hood linear probing: an insertion that has probed
+// further from its home slot than the entry occupying a slot displaces that
+// entry and sends it probing instead. That keeps every chain sorted by probe
+// distance, which bounds the longest chains near the load factor limit and
+// lets an unsuccessful probe stop as soon as it passes an entry closer to
+// home than itself.
+//
+// Iteration walks the dense array directly, which means it visits entries in
+// the order they were inserted and never strides over empty index slots.
+//
+// Removing an entry empties its index slot and shifts the occupants after it
+// back towards their home slots, so the index never accumulates tombstones.
+// The dense entry's key becomes UNDEFINED_VAL so iteration skips it, and the
+// hole is discarded the next time the map is resized.
 typedef struct
 {
   Obj obj;
 
-  // The number of entries allocated.
-  uint32_t capacity;
+  // The number of slots in [index]. Always zero or a power of two.
+  uint32_t indexCapacity;
+
+  // The number of entries allocated in [entries].
+  uint32_t entryCapacity;
+
+  // The number of slots used in [entries], including holes left by removed
+  // keys.
+  uint32_t entryCount;
 
-  // The number of entries in the map.
+  // The number of live entries in the map.
   uint32_t count;
 
-  // Pointer to a contiguous array of [capacity] entries.
+  // The dense array of entries, in insertion order.
   MapEntry* entries;
+
+  // The sparse hash table. Each slot is an index into [entries], or
+  // MAP_SLOT_EMPTY.
+  int32_t* index;
 } ObjMap;
 
+// An unused slot in an ObjMap's index array.
+#define MAP_SLOT_EMPTY (-1)
+
 typedef struct
 {
   Obj obj;
@@ -621,6 +746,21 @@ ObjClass* wrenNewClass(WrenVM* vm, ObjClass* superclass, int numFields,
 
 void wrenBindMethod(WrenVM* vm, ObjClass* classObj, int symbol, Method method);
 
+// Looks up the method with [symbol] on [classObj]. Returns NULL if the class
+// doesn't have a method with that symbol.
+static inline Method* wrenClassGetMethod(ObjClass* classObj, int symbol)
+{
+  if (classObj->methodCapacity == 0) return NULL;
+
+  uint32_t mask = classObj->methodCapacity - 1;
+  for (uint32_t i = (uint32_t)symbol & mask;; i = (i + 1) & mask)
+  {
+    MethodEntry* entry = &classObj->methods[i];
+    if (entry->symbol == symbol) return &entry->method;
+    if (entry->symbol == -1) return NULL;
+  }
+}
+
 // Creates a new closure object that invokes [fn]. Allocates room for its
 // upvalues, but assumes outside code will populate it.
 ObjClosure* wrenNewClosure(WrenVM* vm, ObjFn* fn);
@@ -628,6 +768,12 @@ ObjClosure* wrenNewClosure(WrenVM* vm, ObjFn* fn);
 // Creates a new fiber object that will invoke [closure].
 ObjFiber* wrenNewFiber(WrenVM* vm, ObjClosure* closure);
 
+// Like wrenNewFiber(), but reserves capacity for at least [stackSlots] stack
+// slots and [numFrames] call frames up front so the fiber doesn't have to
+// grow them mid-execution. Either may be zero to use the default capacity.
+ObjFiber* wrenNewFiberWithCapacity(WrenVM* vm, ObjClosure* closure,
+                                   int stackSlots, int numFrames);
+
 // Resets [fiber] back to an initial state where it is ready to invoke
 // [closure].
 void wrenResetFiber(WrenVM* vm, ObjFiber* fiber, ObjClosure* closure);
@@ -657,6 +803,13 @@ ObjFn* wrenNewFunction(WrenVM* vm, ObjModule* module, int maxSlots);
 
 void wrenFunctionBindName(WrenVM* vm, ObjFn* fn, const char* name, int length);
 
+// Allocates [fn]'s inline cache array now that compilation is done and
+// [fn->numCallCaches] is known. All caches start out empty.
+void wrenFunctionAllocateCallCaches(WrenVM* vm, ObjFn* fn);
+
+// Creates a new float array with [count] elements, all initialized to zero.
+ObjFloatArray* wrenNewFloatArray(WrenVM* vm, uint32_t count);
+
 // Creates a new instance of the given [classObj].
 Value wrenNewInstance(WrenVM* vm, ObjClass* classObj);
 
@@ -670,6 +823,16 @@ void wrenListInsert(WrenVM* vm, ObjList* list, Value value, uint32_t index);
 // Removes and returns the item at [index] from [list].
 Value wrenListRemoveAt(WrenVM* vm, ObjList* list, uint32_t index);
 
+// Grows [list]'s element buffer so it can hold at least [capacity] elements
+// without reallocating. Does nothing if it's already that large.
+void wrenListReserve(WrenVM* vm, ObjList* list, uint32_t capacity);
+
+// Replaces the [count] elements of [list] starting at [start] with the
+// elements of [other], growing or shrinking the list as needed. [other] may
+// be [list] itself.
+void wrenListReplaceRange(WrenVM* vm, ObjList* list, uint32_t start,
+                          uint32_t count, ObjList* other);
+
 // Creates a new empty map.
 ObjMap* wrenNewMap(WrenVM* vm);
 
@@ -677,6 +840,10 @@ ObjMap* wrenNewMap(WrenVM* vm);
 // `UNDEFINED_VAL`.
 Value wrenMapGet(ObjMap* map, Value key);
 
+// Grows [map] as needed so that it can hold at least [count] entries without
+// resizing.
+void wrenMapReserve(WrenVM* vm, ObjMap* map, uint32_t count);
+
 // Associates [key] with [value] in [map].
 void wrenMapSet(WrenVM* vm, ObjMap* map, Value key, Value value);
 
@@ -697,12 +864,32 @@ Value wrenNewRange(WrenVM* vm, double from, double to, bool isInclusive);
 // [text] may be NULL if [length] is zero.
 Value wrenNewString(WrenVM* vm, const char* text, size_t length);
 
+// Creates a new string containing the concatenation of [left] and [right].
+Value wrenStringConcat(WrenVM* vm, ObjString* left, ObjString* right);
+
+// Creates a new string containing every string in [strings] separated by
+// [separator], with a single allocation. Every element of [strings] must be
+// a string.
+Value wrenStringJoin(WrenVM* vm, ObjList* strings, ObjString* separator);
+
+// Creates a new empty string buffer.
+ObjStringBuffer* wrenNewStringBuffer(WrenVM* vm);
+
+// Appends [length] bytes from [bytes] to the end of [buffer].
+void wrenStringBufferAppend(WrenVM* vm, ObjStringBuffer* buffer,
+                            const char* bytes, size_t length);
+
 // Creates a new string object by taking a range of characters from [source].
 // The range starts at [start], contains [count] bytes, and increments by
 // [step].
 Value wrenNewStringFromRange(WrenVM* vm, ObjString* source, int start,
                              uint32_t count, int step);
 
+// Formats [value] into [buffer], which must be at least 24 bytes, and
+// returns the number of characters written, not counting the terminating
+// NUL. The output is identical to what wrenNumToString() produces.
+int wrenNumToCString(double value, char* buffer);
+
 // Produces a string representation of [value].
 Value wrenNumToString(WrenVM* vm, double value);
 
@@ -750,6 +937,30 @@ void wrenGrayBuffer(WrenVM* vm, ValueBuffer* buffer);
 // (in use and fully traversed).
 void wrenBlackenObjects(WrenVM* vm);
 
+// Like wrenBlackenObjects(), but processes at most [budget] objects from the
+// gray stack. Returns true if the gray stack was fully drained.
+bool wrenBlackenObjectsBudgeted(WrenVM* vm, int budget);
+
+// Traverses the objects referenced by the single gray object [obj] and counts
+// its memory toward the live total.
+void wrenBlackenObject(WrenVM* vm, Obj* obj);
+
+// The number of bytes [obj] keeps allocated, including its owned arrays.
+// Matches what the blacken functions count toward the live total, so summing
+// this over the heap approximates [bytesAllocated] after a collection.
+size_t wrenObjectSize(Obj* obj);
+
+// Re-traverses the objects referenced by [fiber] even though it has already
+// been blackened during the current collection cycle. Fiber stacks don't have
+// a write barrier, so fibers that were marked during an incremental cycle are
+// scanned again when the cycle finishes.
+void wrenRescanFiber(WrenVM* vm, ObjFiber* fiber);
+
+// Traverses the objects [obj] references without marking [obj] itself. Used
+// during a minor collection to scan remembered-set objects: they stay in the
+// old generation, but the young objects they reference need to be marked.
+void wrenScanRemembered(WrenVM* vm, Obj* obj);
+
 // Releases all memory owned by [obj], including [obj] itself.
 void wrenFreeObj(WrenVM* vm, Obj* obj);
 
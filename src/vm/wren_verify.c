@@ -0,0 +1,613 @@
+#include <string.h>
+
+#include "wren_verify.h"
+#include "wren_vm.h"
+
+// The net stack effect of each instruction, from wren_opcodes.h. The compiler
+// has an identical table; this one is named differently so the amalgamation
+// can concatenate both files into one translation unit.
+#define OPCODE(_, effect) effect,
+static const int verifyStackEffects[] = {
+  #include "wren_opcodes.h"
+};
+#undef OPCODE
+
+// Matches MAX_UPVALUES and MAX_PARAMETERS in wren_compiler.c.
+#define MAX_UPVALUES 256
+#define MAX_PARAMETERS 16
+
+// Early-returns [message] from the enclosing verification function.
+#define FAIL(message) return (message)
+
+#define CHECK(condition, message)                                    \
+    do                                                               \
+    {                                                                \
+      if (!(condition)) FAIL(message);                               \
+    }                                                                \
+    while (false)
+
+// The state threaded through the verification passes for one function.
+typedef struct
+{
+  WrenVM* vm;
+  ObjFn* fn;
+
+  // The stack depth when the function is entered: zero for a module body,
+  // whose frame starts empty, or the receiver plus the arguments for a
+  // function entered through a call.
+  int entryDepth;
+
+  // The deepest the stack may grow. The compiler's maxSlots accounting
+  // starts every called function at depth one and never counts the
+  // parameters, which sit below that, so the frame's true capacity is
+  // maxSlots plus the arity. (The interpreter sizes the stack to hold
+  // numArgs + maxSlots, one more than that.)
+  int maxDepth;
+
+  // For each bytecode offset, true if an instruction starts there.
+  bool* starts;
+
+  // For each instruction start, the byte count of the instruction's
+  // operands. Unused elsewhere.
+  int* sizes;
+
+  // For each instruction start, the stack depth on entry to it, or -1 if
+  // the dataflow pass hasn't reached it yet.
+  int* depths;
+
+  // Instruction offsets whose depth is known but whose successors haven't
+  // been followed yet.
+  int* work;
+  int workCount;
+} Verifier;
+
+// Reads the big-endian two-byte operand at [ip].
+static int readShort(const uint8_t* code, int ip)
+{
+  return (code[ip] << 8) | code[ip + 1];
+}
+
+// Checks that the instruction following the fused push at [ip] (whose
+// operands span [size] bytes) is a plain call, which is all the peephole
+// pass fuses into. The fused opcode executes that call in the same dispatch
+// without looking at what it is.
+static const char* verifyFusedCall(Verifier* v, int ip, int size)
+{
+  int next = ip + 1 + size;
+  CHECK(next < v->fn->code.count &&
+        v->fn->code.data[next] >= CODE_CALL_0 &&
+        v->fn->code.data[next] <= CODE_CALL_16,
+        "A fused push must be followed by a call instruction.");
+  return NULL;
+}
+
+// Validates the operands of the instruction at [ip] -- everything that
+// doesn't depend on the stack depth or on other instruction boundaries --
+// and stores the number of operand bytes in [size]. Returns NULL on success
+// or a description of the violation.
+static const char* verifyOperands(Verifier* v, int ip, int* size)
+{
+  ObjFn* fn = v->fn;
+  const uint8_t* code = fn->code.data;
+  int count = fn->code.count;
+  Code op = (Code)code[ip];
+
+  // Assume no operands; the cases below override this as needed. Operand
+  // reads check that the bytes fit before the terminating CODE_END.
+  *size = 0;
+
+  switch (op)
+  {
+    case CODE_NULL:
+    case CODE_FALSE:
+    case CODE_TRUE:
+    case CODE_POP:
+    case CODE_CLOSE_UPVALUE:
+    case CODE_RETURN:
+    case CODE_CONSTRUCT:
+    case CODE_FOREIGN_CONSTRUCT:
+    case CODE_FOREIGN_CLASS:
+      return NULL;
+
+    case CODE_END:
+      CHECK(ip == count - 1, "CODE_END in the middle of the bytecode.");
+      return NULL;
+
+    case CODE_LOAD_LOCAL_0:
+    case CODE_LOAD_LOCAL_1:
+    case CODE_LOAD_LOCAL_2:
+    case CODE_LOAD_LOCAL_3:
+    case CODE_LOAD_LOCAL_4:
+    case CODE_LOAD_LOCAL_5:
+    case CODE_LOAD_LOCAL_6:
+    case CODE_LOAD_LOCAL_7:
+    case CODE_LOAD_LOCAL_8:
+      CHECK((int)(op - CODE_LOAD_LOCAL_0) < v->maxDepth,
+            "Local slot out of range.");
+      return NULL;
+
+    case CODE_LOAD_LOCAL_0_CALL:
+    case CODE_LOAD_LOCAL_1_CALL:
+    case CODE_LOAD_LOCAL_2_CALL:
+    case CODE_LOAD_LOCAL_3_CALL:
+    case CODE_LOAD_LOCAL_4_CALL:
+    case CODE_LOAD_LOCAL_5_CALL:
+    case CODE_LOAD_LOCAL_6_CALL:
+    case CODE_LOAD_LOCAL_7_CALL:
+    case CODE_LOAD_LOCAL_8_CALL:
+      CHECK((int)(op - CODE_LOAD_LOCAL_0_CALL) < v->maxDepth,
+            "Local slot out of range.");
+      return verifyFusedCall(v, ip, 0);
+
+    case CODE_LOAD_LOCAL:
+    case CODE_STORE_LOCAL:
+    case CODE_LOAD_LOCAL_CALL:
+      *size = 1;
+      CHECK(ip + 1 < count - 1, "Truncated instruction.");
+      CHECK(code[ip + 1] < v->maxDepth, "Local slot out of range.");
+      return op == CODE_LOAD_LOCAL_CALL ? verifyFusedCall(v, ip, 1) : NULL;
+
+    case CODE_LOAD_UPVALUE:
+    case CODE_STORE_UPVALUE:
+      *size = 1;
+      CHECK(ip + 1 < count - 1, "Truncated instruction.");
+      CHECK(code[ip + 1] < fn->numUpvalues, "Upvalue index out of range.");
+      return NULL;
+
+    // Field slots are rewritten when the method is bound to its class, and
+    // checked against the class's field count when the class is created, so
+    // there is nothing to prove here.
+    case CODE_LOAD_FIELD_THIS:
+    case CODE_STORE_FIELD_THIS:
+    case CODE_LOAD_FIELD:
+    case CODE_STORE_FIELD:
+    case CODE_CLASS:
+      *size = 1;
+      CHECK(ip + 1 < count - 1, "Truncated instruction.");
+      return NULL;
+
+    case CODE_LOAD_FIELD_THIS_CALL:
+      *size = 1;
+      CHECK(ip + 1 < count - 1, "Truncated instruction.");
+      return verifyFusedCall(v, ip, 1);
+
+    case CODE_CONSTANT:
+    case CODE_CONSTANT_CALL:
+      *size = 2;
+      CHECK(ip + 2 < count - 1, "Truncated instruction.");
+      CHECK(readShort(code, ip + 1) < fn->constants.count,
+            "Constant index out of range.");
+      return op == CODE_CONSTANT_CALL ? verifyFusedCall(v, ip, 2) : NULL;
+
+    case CODE_LOAD_MODULE_VAR:
+    case CODE_STORE_MODULE_VAR:
+      *size = 2;
+      CHECK(ip + 2 < count - 1, "Truncated instruction.");
+      CHECK(fn->module != NULL &&
+            readShort(code, ip + 1) < fn->module->variables.count,
+            "Module variable out of range.");
+      return NULL;
+
+    // Jump targets need the full set of instruction boundaries, so the
+    // dataflow pass validates them.
+    case CODE_JUMP:
+    case CODE_LOOP:
+    case CODE_JUMP_IF:
+    case CODE_AND:
+    case CODE_OR:
+      *size = 2;
+      CHECK(ip + 2 < count - 1, "Truncated instruction.");
+      return NULL;
+
+    case CODE_METHOD_INSTANCE:
+    case CODE_METHOD_STATIC:
+      *size = 2;
+      CHECK(ip + 2 < count - 1, "Truncated instruction.");
+      CHECK(readShort(code, ip + 1) < v->vm->methodNames.names.count,
+            "Method symbol out of range.");
+      return NULL;
+
+    // The element count is validated by the dataflow pass, which checks that
+    // the stack is deep enough to pop that many elements.
+    case CODE_LIST_LITERAL:
+    case CODE_MAP_LITERAL:
+      *size = 2;
+      CHECK(ip + 2 < count - 1, "Truncated instruction.");
+      return NULL;
+
+    case CODE_CALL_0:
+    case CODE_CALL_1:
+    case CODE_CALL_2:
+    case CODE_CALL_3:
+    case CODE_CALL_4:
+    case CODE_CALL_5:
+    case CODE_CALL_6:
+    case CODE_CALL_7:
+    case CODE_CALL_8:
+    case CODE_CALL_9:
+    case CODE_CALL_10:
+    case CODE_CALL_11:
+    case CODE_CALL_12:
+    case CODE_CALL_13:
+    case CODE_CALL_14:
+    case CODE_CALL_15:
+    case CODE_CALL_16:
+    case CODE_TAIL_CALL_0:
+    case CODE_TAIL_CALL_1:
+    case CODE_TAIL_CALL_2:
+    case CODE_TAIL_CALL_3:
+    case CODE_TAIL_CALL_4:
+    case CODE_TAIL_CALL_5:
+    case CODE_TAIL_CALL_6:
+    case CODE_TAIL_CALL_7:
+    case CODE_TAIL_CALL_8:
+    case CODE_TAIL_CALL_9:
+    case CODE_TAIL_CALL_10:
+    case CODE_TAIL_CALL_11:
+    case CODE_TAIL_CALL_12:
+    case CODE_TAIL_CALL_13:
+    case CODE_TAIL_CALL_14:
+    case CODE_TAIL_CALL_15:
+    case CODE_TAIL_CALL_16:
+    case CODE_ADD:
+    case CODE_SUBTRACT:
+    case CODE_MULTIPLY:
+    case CODE_DIVIDE:
+    case CODE_MOD:
+    case CODE_LESS:
+    case CODE_LESS_EQUAL:
+    case CODE_GREATER:
+    case CODE_GREATER_EQUAL:
+    case CODE_EQUAL:
+    case CODE_NOT_EQUAL:
+      *size = 4;
+      CHECK(ip + 4 < count - 1, "Truncated instruction.");
+      CHECK(readShort(code, ip + 1) < v->vm->methodNames.names.count,
+            "Method symbol out of range.");
+      CHECK(readShort(code, ip + 3) < fn->numCallCaches,
+            "Call cache index out of range.");
+      return NULL;
+
+    case CODE_SUPER_0:
+    case CODE_SUPER_1:
+    case CODE_SUPER_2:
+    case CODE_SUPER_3:
+    case CODE_SUPER_4:
+    case CODE_SUPER_5:
+    case CODE_SUPER_6:
+    case CODE_SUPER_7:
+    case CODE_SUPER_8:
+    case CODE_SUPER_9:
+    case CODE_SUPER_10:
+    case CODE_SUPER_11:
+    case CODE_SUPER_12:
+    case CODE_SUPER_13:
+    case CODE_SUPER_14:
+    case CODE_SUPER_15:
+    case CODE_SUPER_16:
+      *size = 4;
+      CHECK(ip + 4 < count - 1, "Truncated instruction.");
+      CHECK(readShort(code, ip + 1) < v->vm->methodNames.names.count,
+            "Method symbol out of range.");
+      // The constant is a placeholder that wrenBindMethodCode() fills with
+      // the superclass, so only the index can be checked.
+      CHECK(readShort(code, ip + 3) < fn->constants.count,
+            "Constant index out of range.");
+      return NULL;
+
+    case CODE_FOR_RANGE:
+      *size = 4;
+      CHECK(ip + 4 < count - 1, "Truncated instruction.");
+      CHECK(code[ip + 1] < v->maxDepth && code[ip + 2] < v->maxDepth,
+            "Local slot out of range.");
+      return NULL;
+
+    case CODE_CLOSURE:
+    {
+      CHECK(ip + 2 < count - 1, "Truncated instruction.");
+      int constant = readShort(code, ip + 1);
+      CHECK(constant < fn->constants.count, "Constant index out of range.");
+      Value value = fn->constants.data[constant];
+
+      // A function that captures nothing is stored pre-wrapped in its
+      // canonical closure and has no capture operands.
+      if (IS_CLOSURE(value))
+      {
+        *size = 2;
+        return NULL;
+      }
+
+      CHECK(IS_FN(value), "CODE_CLOSURE operand is not a function.");
+      ObjFn* nested = AS_FN(value);
+      *size = 2 + nested->numUpvalues * 2;
+      CHECK(ip + *size < count - 1, "Truncated instruction.");
+
+      // Each capture reads either a local slot of this (the enclosing)
+      // function or one of its upvalues.
+      for (int i = 0; i < nested->numUpvalues; i++)
+      {
+        uint8_t isLocal = code[ip + 3 + i * 2];
+        uint8_t index = code[ip + 4 + i * 2];
+        CHECK(isLocal <= 1, "Malformed upvalue capture.");
+        CHECK(index < (isLocal ? v->maxDepth : fn->numUpvalues),
+              "Upvalue capture out of range.");
+      }
+      return NULL;
+    }
+  }
+
+  UNREACHABLE();
+  return NULL;
+}
+
+// The number of stack slots the instruction at [op] reads below the current
+// top, which must all exist before it executes.
+static int requiredDepth(Code op, int effect)
+{
+  // Calls read the receiver as well as the arguments.
+  if (op >= CODE_CALL_0 && op <= CODE_CALL_16) return op - CODE_CALL_0 + 1;
+  if (op >= CODE_SUPER_0 && op <= CODE_SUPER_16)
+  {
+    return op - CODE_SUPER_0 + 1;
+  }
+  if (op >= CODE_TAIL_CALL_0 && op <= CODE_TAIL_CALL_16)
+  {
+    return op - CODE_TAIL_CALL_0 + 1;
+  }
+
+  // The operators are one-argument calls.
+  if (op >= CODE_ADD && op <= CODE_NOT_EQUAL) return 2;
+
+  switch (op)
+  {
+    // These peek at the top of the stack without popping it...
+    case CODE_STORE_LOCAL:
+    case CODE_STORE_UPVALUE:
+    case CODE_STORE_MODULE_VAR:
+    case CODE_STORE_FIELD_THIS:
+    case CODE_RETURN:
+    // ...these replace the top of the stack in place...
+    case CODE_LOAD_FIELD:
+    case CODE_CONSTRUCT:
+    case CODE_FOREIGN_CONSTRUCT:
+    // ...and these read the receiver in slot zero, which a method's frame
+    // always holds.
+    case CODE_LOAD_FIELD_THIS:
+    case CODE_LOAD_FIELD_THIS_CALL:
+      return 1;
+
+    // ...and these read one value below the one they pop.
+    case CODE_STORE_FIELD:
+    case CODE_CLASS:
+    case CODE_FOREIGN_CLASS:
+      return 2;
+
+    // Everything else only consumes what its stack effect pops.
+    default:
+      return effect < 0 ? -effect : 0;
+  }
+}
+
+// Records that execution reaches the instruction at [target] with [depth]
+// values on the stack, queueing it for the dataflow pass if this is the
+// first path to reach it.
+static const char* meetDepth(Verifier* v, int target, int depth)
+{
+  CHECK(target >= 0 && target < v->fn->code.count && v->starts[target],
+        "Jump target is not an instruction.");
+
+  if (v->depths[target] == -1)
+  {
+    v->depths[target] = depth;
+    v->work[v->workCount++] = target;
+    return NULL;
+  }
+
+  CHECK(v->depths[target] == depth,
+        "Inconsistent stack depth where paths meet.");
+  return NULL;
+}
+
+// Runs all of the checks on [v]'s function. The arrays in [v] are allocated
+// (but not initialized) by the caller.
+static const char* verifyCode(Verifier* v)
+{
+  ObjFn* fn = v->fn;
+  const uint8_t* code = fn->code.data;
+  int count = fn->code.count;
+
+  CHECK(fn->arity >= 0 && fn->arity <= MAX_PARAMETERS &&
+        fn->maxSlots >= 0 && v->maxDepth >= v->entryDepth,
+        "Function header is malformed.");
+  CHECK(fn->numUpvalues >= 0 && fn->numUpvalues <= MAX_UPVALUES &&
+        fn->numCallCaches >= 0,
+        "Function header is malformed.");
+  CHECK(count > 0, "Function has no bytecode.");
+
+  // The interpreter looks up a line for any instruction that errors.
+  CHECK(fn->debug->sourceLines.count == count,
+        "Source line table doesn't cover the bytecode.");
+
+  memset(v->starts, 0, sizeof(bool) * count);
+
+  // First pass: decode linearly to find the instruction boundaries, and
+  // validate each instruction's operands as it goes by.
+  int ip = 0;
+  int lastIp = 0;
+  while (ip < count)
+  {
+    CHECK(code[ip] <= CODE_END, "Unknown opcode.");
+    v->starts[ip] = true;
+    v->depths[ip] = -1;
+
+    const char* error = verifyOperands(v, ip, &v->sizes[ip]);
+    if (error != NULL) return error;
+
+    lastIp = ip;
+    ip += 1 + v->sizes[ip];
+  }
+  CHECK(code[lastIp] == CODE_END, "Bytecode doesn't end with CODE_END.");
+
+  // Second pass: flow the stack depth from the entry point through every
+  // reachable instruction.
+  v->workCount = 0;
+  const char* error = meetDepth(v, 0, v->entryDepth);
+  if (error != NULL) return error;
+
+  while (v->workCount > 0)
+  {
+    ip = v->work[--v->workCount];
+    int depth = v->depths[ip];
+    Code op = (Code)code[ip];
+    int next = ip + 1 + v->sizes[ip];
+
+    // CODE_END is a marker, not an instruction: every path must leave the
+    // function through CODE_RETURN before reaching it.
+    CHECK(op != CODE_END, "Execution can reach CODE_END.");
+
+    int effect = verifyStackEffects[op];
+    int required = requiredDepth(op, effect);
+
+    // The literal instructions pop a number of values given by their operand,
+    // so neither their table effect nor requiredDepth() covers them.
+    if (op == CODE_LIST_LITERAL || op == CODE_MAP_LITERAL)
+    {
+      int elements = readShort(code, ip + 1);
+      if (op == CODE_MAP_LITERAL) elements *= 2;
+      required = elements;
+      effect = 1 - elements;
+    }
+
+    CHECK(depth >= required, "Stack underflow.");
+    int after = depth + effect;
+    CHECK(after >= 0 && after <= v->maxDepth,
+          "Stack overflows the function's maxSlots.");
+
+    // A local load must read a slot that has been pushed on every path here;
+    // anything at or above the current depth is stale.
+    int loadSlot = -1;
+    if (op >= CODE_LOAD_LOCAL_0 && op <= CODE_LOAD_LOCAL_8)
+    {
+      loadSlot = op - CODE_LOAD_LOCAL_0;
+    }
+    else if (op >= CODE_LOAD_LOCAL_0_CALL && op <= CODE_LOAD_LOCAL_8_CALL)
+    {
+      loadSlot = op - CODE_LOAD_LOCAL_0_CALL;
+    }
+    else if (op == CODE_LOAD_LOCAL || op == CODE_LOAD_LOCAL_CALL)
+    {
+      loadSlot = code[ip + 1];
+    }
+    else if (op == CODE_FOR_RANGE)
+    {
+      loadSlot = code[ip + 1] > code[ip + 2] ? code[ip + 1] : code[ip + 2];
+    }
+    CHECK(loadSlot < depth, "Load of an uninitialized local slot.");
+
+    switch (op)
+    {
+      case CODE_RETURN:
+        // No successors.
+        break;
+
+      case CODE_JUMP:
+        error = meetDepth(v, next + readShort(code, ip + 1), after);
+        break;
+
+      case CODE_LOOP:
+        error = meetDepth(v, next - readShort(code, ip + 1), after);
+        break;
+
+      case CODE_JUMP_IF:
+        // The condition is popped whether or not the jump is taken.
+        error = meetDepth(v, next + readShort(code, ip + 1), after);
+        if (error == NULL) error = meetDepth(v, next, after);
+        break;
+
+      case CODE_AND:
+      case CODE_OR:
+        // Taking the jump keeps the tested value; falling through pops it.
+        error = meetDepth(v, next + readShort(code, ip + 1), depth);
+        if (error == NULL) error = meetDepth(v, next, after);
+        break;
+
+      case CODE_FOR_RANGE:
+        // Taking the jump pushes the iterator's value.
+        CHECK(depth + 1 <= v->maxDepth,
+              "Stack overflows the function's maxSlots.");
+        error = meetDepth(v, next + readShort(code, ip + 3), depth + 1);
+        if (error == NULL) error = meetDepth(v, next, after);
+        break;
+
+      default:
+        error = meetDepth(v, next, after);
+        break;
+    }
+    if (error != NULL) return error;
+  }
+
+  return NULL;
+}
+
+// Verifies one function entered with [entryDepth] slots on its frame, then
+// recurses into the functions in its constant pool, which are all entered
+// through calls.
+static const char* verifyFn(WrenVM* vm, ObjFn* fn, int entryDepth)
+{
+  Verifier v;
+  v.vm = vm;
+  v.fn = fn;
+  v.entryDepth = entryDepth;
+  v.maxDepth = fn->maxSlots + fn->arity;
+
+  int count = fn->code.count > 0 ? fn->code.count : 1;
+  v.starts = ALLOCATE_ARRAY(vm, bool, count);
+  v.sizes = ALLOCATE_ARRAY(vm, int, count);
+  v.depths = ALLOCATE_ARRAY(vm, int, count);
+  v.work = ALLOCATE_ARRAY(vm, int, count);
+  v.workCount = 0;
+
+  const char* error = verifyCode(&v);
+
+  DEALLOCATE(vm, v.starts);
+  DEALLOCATE(vm, v.sizes);
+  DEALLOCATE(vm, v.depths);
+  DEALLOCATE(vm, v.work);
+  if (error != NULL) return error;
+
+  // Verify the nested functions created by closures and method definitions.
+  for (int i = 0; i < fn->constants.count; i++)
+  {
+    Value constant = fn->constants.data[i];
+    ObjFn* nested = NULL;
+    if (IS_FN(constant))
+    {
+      nested = AS_FN(constant);
+    }
+    else if (IS_CLOSURE(constant))
+    {
+      // A pre-built closure must not expect captures: its upvalue array is
+      // never filled in.
+      nested = AS_CLOSURE(constant)->fn;
+      if (nested->numUpvalues != 0)
+      {
+        return "A pre-built closure's function captures upvalues.";
+      }
+    }
+
+    if (nested != NULL)
+    {
+      // A call pushes the receiver and the arguments before entering.
+      error = verifyFn(vm, nested, nested->arity + 1);
+      if (error != NULL) return error;
+    }
+  }
+
+  return NULL;
+}
+
+const char* wrenVerifyFn(WrenVM* vm, ObjFn* fn)
+{
+  // [fn] is a module body, so its frame starts empty.
+  return verifyFn(vm, fn, 0);
+}
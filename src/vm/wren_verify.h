@@ -0,0 +1,26 @@
+#ifndef wren_verify_h
+#define wren_verify_h
+
+#include "wren.h"
+#include "wren_value.h"
+
+// Load-time bytecode verification.
+//
+// The interpreter dispatches on bytecode without per-instruction checks:
+// operand bytes index directly into the constant pool, local slots, and
+// symbol tables, and the stack is sized up front from the function's
+// maxSlots. That is sound for code the compiler just produced, but a
+// snapshot is input from outside the process. The verifier proves the
+// properties the interpreter relies on -- instruction boundaries, operand
+// ranges, and stack discipline -- once when a function is loaded, so
+// execution stays check-free afterwards.
+//
+// A function's declared arity is taken at face value: it decides how many
+// slots are assumed live when the function is entered.
+
+// Verifies the bytecode of the module body [fn] and, recursively, of every
+// function in its constant pool. Returns NULL if it is all well-formed, or a
+// static description of the first violation found.
+const char* wrenVerifyFn(WrenVM* vm, ObjFn* fn);
+
+#endif
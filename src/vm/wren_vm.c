@@ -1,11 +1,16 @@
+#include <math.h>
 #include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "wren.h"
 #include "wren_common.h"
 #include "wren_compiler.h"
 #include "wren_core.h"
 #include "wren_debug.h"
+#include "wren_snapshot.h"
+#include "wren_verify.h"
 #include "wren_vm.h"
 
 #if WREN_OPT_META
@@ -15,11 +20,15 @@
   #include "wren_opt_random.h"
 #endif
 
-#if WREN_DEBUG_TRACE_MEMORY || WREN_DEBUG_TRACE_GC
-  #include <time.h>
-  #include <stdio.h>
+#if WREN_PARALLEL_MARK
+  #include <pthread.h>
 #endif
 
+// How many loop iterations and method calls pass between profiler samples.
+// Prime so the sampling doesn't sync up with the program's own periodicity
+// and always hit the same function.
+#define PROFILE_INTERVAL 1021
+
 // The behavior of realloc() when the size is 0 is implementation defined. It
 // may return a non-NULL pointer which must not be dereferenced but nevertheless
 // should be freed. To prevent that, we avoid calling realloc() with a zero
@@ -46,6 +55,69 @@ void wrenInitConfiguration(WrenConfiguration* config)
   config->initialHeapSize = 1024 * 1024 * 10;
   config->minHeapSize = 1024 * 1024;
   config->heapGrowthPercent = 50;
+  config->incrementalGCBudget = 0;
+  config->nurserySize = 0;
+  config->fiberPoolCapacity = 16;
+  config->stackGrowthFactor = 2;
+  config->gcCallbackFn = NULL;
+  config->softHeapLimit = 0;
+  config->markThreads = 0;
+  config->sharedCoreVM = NULL;
+}
+
+// Points [vm] at [donor]'s frozen core instead of initializing a private
+// copy. See wrenFreezeCore() for the contract.
+static void adoptSharedCore(WrenVM* vm, WrenVM* donor)
+{
+  ASSERT(donor->permanent != NULL, "Shared core VM has not been frozen.");
+
+  vm->boolClass = donor->boolClass;
+  vm->classClass = donor->classClass;
+  vm->fiberClass = donor->fiberClass;
+  vm->floatArrayClass = donor->floatArrayClass;
+  vm->fnClass = donor->fnClass;
+  vm->listClass = donor->listClass;
+  vm->mapClass = donor->mapClass;
+  vm->nullClass = donor->nullClass;
+  vm->numClass = donor->numClass;
+  vm->objectClass = donor->objectClass;
+  vm->rangeClass = donor->rangeClass;
+  vm->stringBufferClass = donor->stringBufferClass;
+  vm->stringClass = donor->stringClass;
+
+  // The frozen method tables and bytecode refer to method names by their
+  // index in the donor's symbol table, so this VM's table has to start as an
+  // exact copy. Symbols this VM's own compiles add land after them.
+  for (int i = 0; i < donor->methodNames.names.count; i++)
+  {
+    wrenSymbolTableAdd(vm, &vm->methodNames,
+                       donor->methodNames.names.data[i].buffer,
+                       donor->methodNames.names.data[i].length);
+  }
+
+  // String equality is a pointer comparison, so interning a string the donor
+  // also interned has to find the donor's object. Start from a copy of its
+  // table; the frozen strings are never collected, so the weak references
+  // can't go stale.
+  if (donor->internedCapacity > 0)
+  {
+    vm->interned = ALLOCATE_ARRAY(vm, ObjString*, donor->internedCapacity);
+    memcpy(vm->interned, donor->interned,
+           donor->internedCapacity * sizeof(ObjString*));
+    vm->internedCount = donor->internedCount;
+    vm->internedTombstones = donor->internedTombstones;
+    vm->internedCapacity = donor->internedCapacity;
+  }
+
+  // Share every module the donor had loaded when it was frozen. The map
+  // itself is private so this VM can load modules of its own.
+  vm->modules = wrenNewMap(vm);
+  for (uint32_t i = 0; i < donor->modules->entryCount; i++)
+  {
+    MapEntry* entry = &donor->modules->entries[i];
+    if (IS_UNDEFINED(entry->key)) continue;
+    wrenMapSet(vm, vm->modules, entry->key, entry->value);
+  }
 }
 
 WrenVM* wrenNewVM(WrenConfiguration* config)
@@ -66,6 +138,10 @@ WrenVM* wrenNewVM(WrenConfiguration* config)
     wrenInitConfiguration(&vm->config);
   }
 
+  // Growing by less than 2x wouldn't leave room for the frame triggering the
+  // growth, so treat anything smaller (including an uninitialized zero) as 2.
+  if (vm->config.stackGrowthFactor < 2) vm->config.stackGrowthFactor = 2;
+
   // TODO: Should we allocate and free this during a GC?
   vm->grayCount = 0;
   // TODO: Tune this.
@@ -73,16 +149,83 @@ WrenVM* wrenNewVM(WrenConfiguration* config)
   vm->gray = (Obj**)reallocate(NULL, vm->grayCapacity * sizeof(Obj*));
   vm->nextGC = vm->config.initialHeapSize;
 
+  vm->gcPhase = GC_PHASE_IDLE;
+  vm->grayAgainFibers = NULL;
+  vm->grayAgainCount = 0;
+  vm->grayAgainCapacity = 0;
+
+  vm->nursery = NULL;
+  vm->permanent = NULL;
+  vm->nextMinorGC = vm->config.nurserySize;
+  vm->collectingNursery = false;
+  vm->remembered = NULL;
+  vm->rememberedCount = 0;
+  vm->rememberedCapacity = 0;
+
+  vm->interned = NULL;
+  vm->internedCount = 0;
+  vm->internedTombstones = 0;
+  vm->internedCapacity = 0;
+
+  // The countdown cycles even while the profiler is off, so it has to start
+  // above zero or it would count away from the sampling trigger.
+  vm->profileCountdown = PROFILE_INTERVAL;
+
+  vm->metering = false;
+  vm->budgetTicks = 0;
+  vm->allocationBudget = 0;
+
   wrenSymbolTableInit(&vm->methodNames);
 
-  vm->modules = wrenNewMap(vm);
-  wrenInitializeCore(vm);
+  if (vm->config.sharedCoreVM != NULL)
+  {
+    adoptSharedCore(vm, vm->config.sharedCoreVM);
+  }
+  else
+  {
+    vm->modules = wrenNewMap(vm);
+    wrenInitializeCore(vm);
+  }
   return vm;
 }
 
+void wrenFreezeCore(WrenVM* vm)
+{
+  // The "main" module is the entry module wrenInterpret() compiles into:
+  // per-VM scratch, not shared library code. Sharing it would make a sharing
+  // VM's first wrenInterpret() recompile into frozen memory, so drop it here.
+  // Any setup code it held is then collected below instead of frozen.
+  wrenMapRemoveKey(vm, vm->modules, wrenNewString(vm, "main", 4));
+
+  // Drop the fiber that ran the last module body and collect, so compile-time
+  // garbage doesn't get frozen along with the live objects.
+  vm->fiber = NULL;
+  wrenCollectGarbage(vm);
+
+  // Move everything that survived into the permanent region. Marking the
+  // objects permanently dark makes wrenGrayObj() ignore them, so no sharing
+  // VM's collector ever traces into the region; taking them off [first]
+  // keeps this VM's sweep from clearing the mark or freeing them.
+  Obj* obj = vm->first;
+  vm->first = NULL;
+  while (obj != NULL)
+  {
+    Obj* next = obj->next;
+    obj->isDark = true;
+    obj->isRemembered = false;
+    obj->next = vm->permanent;
+    vm->permanent = obj;
+    obj = next;
+  }
+
+  // The remembered set is only needed to find old-to-young references, and
+  // frozen objects can never hold any.
+  vm->rememberedCount = 0;
+}
+
 void wrenFreeVM(WrenVM* vm)
 {
-  ASSERT(vm->methodNames.count > 0, "VM appears to have already been freed.");
+  ASSERT(vm->methodNames.names.count > 0, "VM appears to have already been freed.");
 
   // Free all of the GC objects.
   Obj* obj = vm->first;
@@ -93,40 +236,87 @@ void wrenFreeVM(WrenVM* vm)
     obj = next;
   }
 
+  obj = vm->nursery;
+  while (obj != NULL)
+  {
+    Obj* next = obj->next;
+    wrenFreeObj(vm, obj);
+    obj = next;
+  }
+
+  // Free the frozen region, if this VM was a shared core donor. Any VM
+  // sharing it must already have been freed.
+  obj = vm->permanent;
+  while (obj != NULL)
+  {
+    Obj* next = obj->next;
+    wrenFreeObj(vm, obj);
+    obj = next;
+  }
+
+  // Free the pooled fiber allocations. Freeing the fibers above may have
+  // filled the pool back up, so this has to happen after them.
+  for (int i = 0; i < vm->fiberPoolCount; i++)
+  {
+    vm->config.reallocateFn(vm->fiberPool[i].stack, 0);
+    vm->config.reallocateFn(vm->fiberPool[i].frames, 0);
+  }
+  vm->fiberPool = (FiberAllocation*)vm->config.reallocateFn(vm->fiberPool, 0);
+
+  // Free the profiler's samples.
+  for (int i = 0; i < vm->profileCount; i++)
+  {
+    vm->config.reallocateFn(vm->profileEntries[i].module, 0);
+    vm->config.reallocateFn(vm->profileEntries[i].name, 0);
+  }
+  vm->profileEntries =
+      (ProfileEntry*)vm->config.reallocateFn(vm->profileEntries, 0);
+
+  // Free the heap profiler's allocation sites.
+  for (int i = 0; i < vm->allocEntryCount; i++)
+  {
+    vm->config.reallocateFn(vm->allocEntries[i].module, 0);
+    vm->config.reallocateFn(vm->allocEntries[i].name, 0);
+  }
+  vm->allocEntries =
+      (AllocationEntry*)vm->config.reallocateFn(vm->allocEntries, 0);
+
+#if WREN_OPT_META
+  // Release the Meta.eval() compile cache and the handles it holds. This has
+  // to happen before the handle table is torn down below.
+  wrenMetaFreeCache(vm);
+#endif
+
   // Free up the GC gray set.
   vm->gray = (Obj**)vm->config.reallocateFn(vm->gray, 0);
+  vm->grayAgainFibers =
+      (ObjFiber**)vm->config.reallocateFn(vm->grayAgainFibers, 0);
+  vm->remembered = (Obj**)vm->config.reallocateFn(vm->remembered, 0);
+  vm->interned = (ObjString**)vm->config.reallocateFn(vm->interned, 0);
 
   // Tell the user if they didn't free any handles. We don't want to just free
   // them here because the host app may still have pointers to them that they
   // may try to use. Better to tell them about the bug early.
-  ASSERT(vm->valueHandles == NULL, "All values have not been released.");
+  ASSERT(vm->handleCount == 0, "All values have not been released.");
+
+  // Free the handle table's slabs.
+  WrenHandleSlab* slab = vm->handleSlabs;
+  while (slab != NULL)
+  {
+    WrenHandleSlab* next = slab->next;
+    DEALLOCATE(vm, slab);
+    slab = next;
+  }
 
   wrenSymbolTableClear(vm, &vm->methodNames);
 
   DEALLOCATE(vm, vm);
 }
 
-void wrenCollectGarbage(WrenVM* vm)
+// Marks the root objects: everything that is directly reachable by the VM
+// without going through another object.
+static void markRoots(WrenVM* vm)
 {
-#if WREN_DEBUG_TRACE_MEMORY || WREN_DEBUG_TRACE_GC
-  printf("-- gc --\n");
-
-  size_t before = vm->bytesAllocated;
-  double startTime = (double)clock() / CLOCKS_PER_SEC;
-#endif
-
-  // Mark all reachable objects.
-
-  // Reset this. As we mark objects, their size will be counted again so that
-  // we can track how much memory is in use without needing to know the size
-  // of each *freed* object.
-  //
-  // This is important because when freeing an unmarked object, we don't always
-  // know how much memory it is using. For example, when freeing an instance,
-  // we need to know its class to know how big it is, but its class may have
-  // already been freed.
-  vm->bytesAllocated = 0;
-
   wrenGrayObj(vm, (Obj*)vm->modules);
 
   // Temporary roots.
@@ -138,22 +328,415 @@ void wrenCollectGarbage(WrenVM* vm)
   // The current fiber.
   wrenGrayObj(vm, (Obj*)vm->fiber);
 
-  // The value handles.
-  for (WrenValue* value = vm->valueHandles;
-       value != NULL;
-       value = value->next)
+  // The value handles. The slabs are scanned linearly; free handles hold
+  // UNDEFINED_VAL, which isn't an object, so graying them is a no-op. The
+  // slabs themselves are counted here since no live object owns them.
+  for (WrenHandleSlab* slab = vm->handleSlabs; slab != NULL; slab = slab->next)
   {
-    wrenGrayValue(vm, value->value);
+    for (int i = 0; i < WREN_HANDLES_PER_SLAB; i++)
+    {
+      wrenGrayValue(vm, slab->handles[i].value);
+    }
+
+    vm->bytesAllocated += sizeof(WrenHandleSlab);
   }
 
   // Any object the compiler is using (if there is one).
   if (vm->compiler != NULL) wrenMarkCompiler(vm, vm->compiler);
 
+  // The fiber pool holds memory that no live object owns, so count it here
+  // where the byte total is being rebuilt.
+  for (int i = 0; i < vm->fiberPoolCount; i++)
+  {
+    vm->bytesAllocated += vm->fiberPool[i].stackCapacity * sizeof(Value);
+    vm->bytesAllocated += vm->fiberPool[i].frameCapacity * sizeof(CallFrame);
+  }
+}
+
+bool wrenPoolFiberAllocations(WrenVM* vm, ObjFiber* fiber)
+{
+  if (vm->fiberPoolCount >= vm->config.fiberPoolCapacity) return false;
+
+  // The pool array itself is allocated on first use so that VMs that never
+  // discard a fiber don't pay for it.
+  if (vm->fiberPool == NULL)
+  {
+    vm->fiberPool = (FiberAllocation*)vm->config.reallocateFn(NULL,
+        vm->config.fiberPoolCapacity * sizeof(FiberAllocation));
+  }
+
+  FiberAllocation* allocation = &vm->fiberPool[vm->fiberPoolCount++];
+  allocation->stack = fiber->stack;
+  allocation->stackCapacity = fiber->stackCapacity;
+  allocation->frames = fiber->frames;
+  allocation->frameCapacity = fiber->frameCapacity;
+  return true;
+}
+
+bool wrenReuseFiberAllocation(WrenVM* vm, FiberAllocation* allocation)
+{
+  if (vm->fiberPoolCount == 0) return false;
+
+  *allocation = vm->fiberPool[--vm->fiberPoolCount];
+  return true;
+}
+
+void wrenRememberObj(WrenVM* vm, Obj* obj)
+{
+  obj->isRemembered = true;
+
+  if (vm->rememberedCount >= vm->rememberedCapacity)
+  {
+    vm->rememberedCapacity = vm->rememberedCapacity == 0
+        ? 4 : vm->rememberedCapacity * 2;
+    vm->remembered = (Obj**)vm->config.reallocateFn(
+        vm->remembered, vm->rememberedCapacity * sizeof(Obj*));
+  }
+
+  vm->remembered[vm->rememberedCount++] = obj;
+}
+
+// Moves the surviving young object [obj] out of the nursery and into the main
+// heap. Objects can't be moved in memory -- the embedding API hands out
+// direct pointers -- so promotion just relinks [obj] onto the old
+// generation's list.
+static void promoteObj(WrenVM* vm, Obj* obj)
+{
+  obj->isDark = false;
+  obj->isYoung = false;
+  obj->next = vm->first;
+  vm->first = obj;
+
+  // Stores into fiber stacks aren't barriered, so old fibers stay in the
+  // remembered set permanently and are re-scanned by every minor collection.
+  if (obj->type == OBJ_FIBER) wrenRememberObj(vm, obj);
+}
+
+#if WREN_PARALLEL_MARK
+
+// The largest number of objects moved between the shared pool and a worker's
+// local stack in one transfer. Batching amortizes the pool's lock over many
+// objects.
+#define MARK_BATCH 64
+
+// When a worker's local stack grows past this, it donates half to the shared
+// pool even if no other worker is asking for work yet.
+#define MARK_LOCAL_MAX 512
+
+// The work-sharing state for one parallel mark phase. It lives on
+// wrenCollectGarbage()'s stack for the duration of the phase.
+//
+// Workers trace objects from a private local stack and exchange work through
+// the [objects] pool here, which is protected by [mutex]. That is coarser
+// than per-worker stealable deques, but transfers are batched so the lock is
+// taken roughly once per MARK_BATCH objects and contention stays negligible
+// next to the tracing itself.
+typedef struct
+{
+  WrenVM* vm;
+
+  // Gray objects available for any worker to claim. Seeded with the root set
+  // and grown with the VM's allocator as workers donate surplus work.
+  Obj** objects;
+  int count;
+  int capacity;
+
+  // The number of workers with nothing to do, waiting on [hasWork]. When
+  // every worker is idle at once, no gray objects remain anywhere and the
+  // trace is complete.
+  int idle;
+  int numWorkers;
+  bool done;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t hasWork;
+} MarkPool;
+
+struct MarkWorker
+{
+  MarkPool* pool;
+
+  // The worker's private stack of gray objects. Only the owning thread
+  // touches it, so pushes and pops need no synchronization.
+  Obj** objects;
+  int count;
+  int capacity;
+
+  pthread_t thread;
+  bool started;
+};
+
+__thread MarkWorker* wrenCurrentMarkWorker = NULL;
+
+void wrenMarkWorkerGray(MarkWorker* worker, Obj* obj)
+{
+  // Claim the object. The swap is atomic, so when two workers reach the same
+  // object at once, exactly one of them sees it white and traces it.
+  if (__atomic_test_and_set(&obj->isDark, __ATOMIC_ACQUIRE)) return;
+
+  if (worker->count >= worker->capacity)
+  {
+    worker->capacity *= 2;
+    worker->objects = (Obj**)worker->pool->vm->config.reallocateFn(
+        worker->objects, worker->capacity * sizeof(Obj*));
+  }
+
+  worker->objects[worker->count++] = obj;
+}
+
+// Refills [worker]'s empty local stack from the shared pool, blocking until
+// work appears. Returns false if the trace is complete instead.
+static bool takeMarkWork(MarkWorker* worker)
+{
+  MarkPool* pool = worker->pool;
+  pthread_mutex_lock(&pool->mutex);
+
+  while (pool->count == 0 && !pool->done)
+  {
+    // [idle] changes only under the lock, but runMarkWorker() peeks at it
+    // without the lock, so the updates have to be atomic as well.
+    if (__atomic_add_fetch(&pool->idle, 1, __ATOMIC_RELAXED) ==
+        pool->numWorkers)
+    {
+      // Every worker is out of work, so no gray objects remain and the last
+      // one here ends the phase.
+      pool->done = true;
+      pthread_cond_broadcast(&pool->hasWork);
+      break;
+    }
+
+    pthread_cond_wait(&pool->hasWork, &pool->mutex);
+    __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_RELAXED);
+  }
+
+  if (pool->done)
+  {
+    pthread_mutex_unlock(&pool->mutex);
+    return false;
+  }
+
+  // Take a batch, but leave some behind for the other workers when the pool
+  // is running low.
+  int take = pool->count < MARK_BATCH * 2 ? (pool->count + 1) / 2 : MARK_BATCH;
+  memcpy(worker->objects, &pool->objects[pool->count - take],
+         take * sizeof(Obj*));
+  pool->count -= take;
+  worker->count = take;
+
+  pthread_mutex_unlock(&pool->mutex);
+  return true;
+}
+
+// Moves half of [worker]'s local stack into the shared pool so idle workers
+// have something to do.
+static void donateMarkWork(MarkWorker* worker)
+{
+  MarkPool* pool = worker->pool;
+
+  // Skip the handoff if the pool's lock is busy; the surplus stays local and
+  // the next donation attempt will try again.
+  if (pthread_mutex_trylock(&pool->mutex) != 0) return;
+
+  int give = worker->count / 2;
+  if (pool->count + give > pool->capacity)
+  {
+    while (pool->count + give > pool->capacity) pool->capacity *= 2;
+    pool->objects = (Obj**)pool->vm->config.reallocateFn(
+        pool->objects, pool->capacity * sizeof(Obj*));
+  }
+
+  // Donate the bottom of the stack: those are the oldest entries, whose
+  // subtrees tend to be the widest.
+  memcpy(&pool->objects[pool->count], worker->objects, give * sizeof(Obj*));
+  pool->count += give;
+  memmove(worker->objects, worker->objects + give,
+          (worker->count - give) * sizeof(Obj*));
+  worker->count -= give;
+
+  pthread_cond_broadcast(&pool->hasWork);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+// The tracing loop each worker runs, on the main thread for worker zero and
+// on a helper thread for the rest.
+static void runMarkWorker(MarkWorker* worker)
+{
+  wrenCurrentMarkWorker = worker;
+
+  while (worker->count > 0 || takeMarkWork(worker))
+  {
+    Obj* obj = worker->objects[--worker->count];
+    wrenBlackenObject(worker->pool->vm, obj);
+
+    // Share surplus work. Reading [idle] without the lock can only see a
+    // stale value, which at worst delays a donation by one iteration.
+    if (worker->count > 1 &&
+        (worker->count > MARK_LOCAL_MAX ||
+         __atomic_load_n(&worker->pool->idle, __ATOMIC_RELAXED) > 0))
+    {
+      donateMarkWork(worker);
+    }
+  }
+
+  wrenCurrentMarkWorker = NULL;
+}
+
+static void* markWorkerMain(void* arg)
+{
+  runMarkWorker((MarkWorker*)arg);
+  return NULL;
+}
+
+// Drains the gray stack with [numWorkers] threads instead of
+// wrenBlackenObjects(). Runs only inside a full collection's stop-the-world
+// pause, after any incremental cycle has been wound down, so the blacken
+// functions never race with the mutator or the incremental machinery.
+static void parallelMark(WrenVM* vm, int numWorkers)
+{
+  MarkPool pool;
+  pool.vm = vm;
+
+  // Seed the pool with the root set by taking over the gray stack's storage.
+  // It is handed back below, so repeated collections reuse the same array.
+  pool.objects = vm->gray;
+  pool.count = vm->grayCount;
+  pool.capacity = vm->grayCapacity;
+  vm->grayCount = 0;
+
+  pool.idle = 0;
+  pool.numWorkers = numWorkers;
+  pool.done = false;
+  pthread_mutex_init(&pool.mutex, NULL);
+  pthread_cond_init(&pool.hasWork, NULL);
+
+  MarkWorker* workers = (MarkWorker*)vm->config.reallocateFn(
+      NULL, numWorkers * sizeof(MarkWorker));
+  for (int i = 0; i < numWorkers; i++)
+  {
+    workers[i].pool = &pool;
+    workers[i].capacity = MARK_LOCAL_MAX;
+    workers[i].objects = (Obj**)vm->config.reallocateFn(
+        NULL, workers[i].capacity * sizeof(Obj*));
+    workers[i].count = 0;
+  }
+
+  for (int i = 1; i < numWorkers; i++)
+  {
+    workers[i].started = pthread_create(&workers[i].thread, NULL,
+                                        markWorkerMain, &workers[i]) == 0;
+    if (!workers[i].started)
+    {
+      // Mark with the threads that did start. The count is read under the
+      // lock by the idle-worker check, so it has to change under it too.
+      pthread_mutex_lock(&pool.mutex);
+      pool.numWorkers--;
+      pthread_mutex_unlock(&pool.mutex);
+    }
+  }
+
+  // The collecting thread is worker zero.
+  runMarkWorker(&workers[0]);
+
+  for (int i = 1; i < numWorkers; i++)
+  {
+    if (workers[i].started) pthread_join(workers[i].thread, NULL);
+  }
+
+  for (int i = 0; i < numWorkers; i++)
+  {
+    vm->config.reallocateFn(workers[i].objects, 0);
+  }
+  vm->config.reallocateFn(workers, 0);
+
+  pthread_mutex_destroy(&pool.mutex);
+  pthread_cond_destroy(&pool.hasWork);
+
+  // Hand the (possibly regrown) storage back to the gray stack.
+  vm->gray = pool.objects;
+  vm->grayCapacity = pool.capacity;
+  ASSERT(pool.count == 0, "Parallel mark ended with unprocessed objects.");
+}
+
+#endif
+
+void wrenCollectGarbage(WrenVM* vm)
+{
+#if WREN_DEBUG_TRACE_MEMORY || WREN_DEBUG_TRACE_GC
+  printf("-- gc --\n");
+#endif
+
+  size_t before = vm->bytesAllocated;
+  double startTime = (double)clock() / CLOCKS_PER_SEC;
+
+  // Mark all reachable objects.
+
+  if (vm->gcPhase == GC_PHASE_IDLE)
+  {
+    // Reset this. As we mark objects, their size will be counted again so
+    // that we can track how much memory is in use without needing to know the
+    // size of each *freed* object.
+    //
+    // This is important because when freeing an unmarked object, we don't
+    // always know how much memory it is using. For example, when freeing an
+    // instance, we need to know its class to know how big it is, but its
+    // class may have already been freed.
+    vm->bytesAllocated = 0;
+  }
+  else
+  {
+    // We're finishing an incremental collection cycle, so the count has
+    // already been reset and most reachable objects are already marked. The
+    // rest of this collection is the cycle's final pause.
+    //
+    // Leave the incremental phase first so that re-scanning below doesn't
+    // re-register fibers or trip the write barriers.
+    vm->gcPhase = GC_PHASE_IDLE;
+
+    // Fiber stacks don't have a write barrier, so any fiber that was marked
+    // while the program was still running may have since acquired references
+    // to unmarked objects. Re-scan them.
+    int numFibers = vm->grayAgainCount;
+    vm->grayAgainCount = 0;
+    for (int i = 0; i < numFibers; i++)
+    {
+      wrenRescanFiber(vm, vm->grayAgainFibers[i]);
+    }
+  }
+
+  markRoots(vm);
+
   // Now that we have grayed the roots, do a depth-first search over all of the
   // reachable objects.
-  wrenBlackenObjects(vm);
+#if WREN_PARALLEL_MARK
+  if (vm->config.markThreads > 1 && vm->grayCount > 0)
+  {
+    parallelMark(vm, vm->config.markThreads);
+  }
+  else
+#endif
+  {
+    wrenBlackenObjects(vm);
+  }
+
+  // The nursery is emptied below, so only fibers need to stay in the
+  // remembered set (see collectNursery()), and only the ones that survive.
+  int kept = 0;
+  for (int i = 0; i < vm->rememberedCount; i++)
+  {
+    Obj* remembered = vm->remembered[i];
+    if (remembered->type == OBJ_FIBER && remembered->isDark)
+    {
+      vm->remembered[kept++] = remembered;
+    }
+    else
+    {
+      remembered->isRemembered = false;
+    }
+  }
+  vm->rememberedCount = kept;
 
   // Collect the white objects.
+  size_t liveObjects = 0;
   Obj** obj = &vm->first;
   while (*obj != NULL)
   {
@@ -170,7 +753,27 @@ void wrenCollectGarbage(WrenVM* vm)
       // the next.
       (*obj)->isDark = false;
       obj = &(*obj)->next;
+      liveObjects++;
+    }
+  }
+
+  // Collect the white objects in the nursery and promote the survivors to the
+  // main heap.
+  Obj* young = vm->nursery;
+  vm->nursery = NULL;
+  while (young != NULL)
+  {
+    Obj* next = young->next;
+    if (!young->isDark)
+    {
+      wrenFreeObj(vm, young);
+    }
+    else
+    {
+      promoteObj(vm, young);
+      liveObjects++;
     }
+    young = next;
   }
 
   // +100 here because the configuration gives us the *additional* size of
@@ -179,8 +782,30 @@ void wrenCollectGarbage(WrenVM* vm)
   vm->nextGC = vm->bytesAllocated * (100 + vm->config.heapGrowthPercent) / 100;
   if (vm->nextGC < vm->config.minHeapSize) vm->nextGC = vm->config.minHeapSize;
 
-#if WREN_DEBUG_TRACE_MEMORY || WREN_DEBUG_TRACE_GC
+  // Pace the heap toward the soft limit: grow normally while well below it,
+  // but collect at the limit instead of scheduling growth past it. If the
+  // live data alone is already near or over the limit, keep a little headroom
+  // so we don't collect on every allocation.
+  if (vm->config.softHeapLimit != 0 && vm->nextGC > vm->config.softHeapLimit)
+  {
+    size_t headroom = vm->bytesAllocated + vm->bytesAllocated / 10;
+    vm->nextGC = vm->config.softHeapLimit > headroom
+        ? vm->config.softHeapLimit
+        : headroom;
+  }
+
+  vm->nextMinorGC = vm->bytesAllocated + vm->config.nurserySize;
+
   double elapsed = ((double)clock() / CLOCKS_PER_SEC) - startTime;
+
+  vm->gcStats.collections++;
+  vm->gcStats.lastPauseNs = (unsigned long long)(elapsed * 1e9);
+  vm->gcStats.totalPauseNs += vm->gcStats.lastPauseNs;
+  vm->gcStats.bytesBefore = before;
+  vm->gcStats.bytesAfter = vm->bytesAllocated;
+  vm->gcStats.liveObjects = liveObjects;
+
+#if WREN_DEBUG_TRACE_MEMORY || WREN_DEBUG_TRACE_GC
   // Explicit cast because size_t has different sizes on 32-bit and 64-bit and
   // we need a consistent type for the format string.
   printf("GC %lu before, %lu after (%lu collected), next at %lu. Took %.3fs.\n",
@@ -190,6 +815,516 @@ void wrenCollectGarbage(WrenVM* vm)
          (unsigned long)vm->nextGC,
          elapsed);
 #endif
+
+  if (vm->config.gcCallbackFn != NULL)
+  {
+    vm->config.gcCallbackFn(vm, &vm->gcStats);
+  }
+}
+
+// Begins an incremental collection cycle by marking just the roots. The rest
+// of the mark phase happens a budgeted step at a time in wrenIncrementalGC(),
+// interleaved with the program's own allocations.
+static void startIncrementalGC(WrenVM* vm)
+{
+  // See wrenCollectGarbage() for why this is reset at the start of a cycle.
+  vm->bytesAllocated = 0;
+  vm->grayAgainCount = 0;
+  vm->gcPhase = GC_PHASE_MARKING;
+
+  markRoots(vm);
+}
+
+void wrenIncrementalGC(WrenVM* vm)
+{
+  ASSERT(vm->gcPhase == GC_PHASE_MARKING, "Not in a collection cycle.");
+
+  if (!wrenBlackenObjectsBudgeted(vm, vm->config.incrementalGCBudget)) return;
+
+  // The gray set is exhausted, so everything reachable when the cycle started
+  // has been marked. Finish the cycle: re-scan the roots and fiber stacks for
+  // references acquired since then, then sweep.
+  wrenCollectGarbage(vm);
+}
+
+void wrenRememberBlackenedFiber(WrenVM* vm, ObjFiber* fiber)
+{
+  if (vm->grayAgainCount >= vm->grayAgainCapacity)
+  {
+    vm->grayAgainCapacity = vm->grayAgainCapacity == 0
+        ? 4 : vm->grayAgainCapacity * 2;
+    vm->grayAgainFibers = (ObjFiber**)vm->config.reallocateFn(
+        vm->grayAgainFibers, vm->grayAgainCapacity * sizeof(ObjFiber*));
+  }
+
+  vm->grayAgainFibers[vm->grayAgainCount++] = fiber;
+}
+
+// Performs a minor collection: frees the unreachable objects in the nursery
+// and promotes the survivors to the main heap. Old objects are never freed
+// here, so only the nursery and the remembered set need to be traversed.
+static void collectNursery(WrenVM* vm)
+{
+#if WREN_DEBUG_TRACE_MEMORY || WREN_DEBUG_TRACE_GC
+  printf("-- minor gc --\n");
+#endif
+
+  double startTime = (double)clock() / CLOCKS_PER_SEC;
+
+  // Marking counts object sizes toward the live total, but a minor collection
+  // doesn't recount the whole heap, so the count is left as it is. Any dead
+  // nursery bytes that stay counted are corrected by the next full collection.
+  size_t bytesAllocated = vm->bytesAllocated;
+
+  vm->collectingNursery = true;
+
+  markRoots(vm);
+
+  // Scan the remembered set for references from old objects into the nursery.
+  // wrenGrayObj() ignores old objects while [collectingNursery] is set, so
+  // this can't wander off into the rest of the heap.
+  for (int i = 0; i < vm->rememberedCount; i++)
+  {
+    wrenScanRemembered(vm, vm->remembered[i]);
+  }
+
+  wrenBlackenObjects(vm);
+
+  vm->collectingNursery = false;
+  vm->bytesAllocated = bytesAllocated;
+
+  // Non-fiber objects can leave the remembered set now: the young objects
+  // they reference are all promoted below, so the references they were
+  // remembered for are old-to-old after this collection. Fibers stay (see
+  // promoteObj()).
+  int kept = 0;
+  for (int i = 0; i < vm->rememberedCount; i++)
+  {
+    Obj* remembered = vm->remembered[i];
+    if (remembered->type == OBJ_FIBER)
+    {
+      vm->remembered[kept++] = remembered;
+    }
+    else
+    {
+      remembered->isRemembered = false;
+    }
+  }
+  vm->rememberedCount = kept;
+
+  // Sweep the nursery, leaving it empty.
+  Obj* obj = vm->nursery;
+  vm->nursery = NULL;
+  while (obj != NULL)
+  {
+    Obj* next = obj->next;
+    if (!obj->isDark)
+    {
+      wrenFreeObj(vm, obj);
+    }
+    else
+    {
+      promoteObj(vm, obj);
+    }
+    obj = next;
+  }
+
+  vm->nextMinorGC = vm->bytesAllocated + vm->config.nurserySize;
+
+  double elapsed = ((double)clock() / CLOCKS_PER_SEC) - startTime;
+
+  vm->gcStats.minorCollections++;
+  vm->gcStats.lastPauseNs = (unsigned long long)(elapsed * 1e9);
+  vm->gcStats.totalPauseNs += vm->gcStats.lastPauseNs;
+  vm->gcStats.bytesBefore = bytesAllocated;
+  vm->gcStats.bytesAfter = vm->bytesAllocated;
+
+  if (vm->config.gcCallbackFn != NULL)
+  {
+    vm->config.gcCallbackFn(vm, &vm->gcStats);
+  }
+}
+
+void wrenGetGCStats(WrenVM* vm, WrenGCStats* stats)
+{
+  *stats = vm->gcStats;
+}
+
+// Frees the profiler's collected samples.
+static void freeProfileEntries(WrenVM* vm)
+{
+  for (int i = 0; i < vm->profileCount; i++)
+  {
+    DEALLOCATE(vm, vm->profileEntries[i].module);
+    DEALLOCATE(vm, vm->profileEntries[i].name);
+  }
+
+  vm->profileEntries =
+      (ProfileEntry*)wrenReallocate(vm, vm->profileEntries,
+          sizeof(ProfileEntry) * vm->profileCapacity, 0);
+  vm->profileCount = 0;
+  vm->profileCapacity = 0;
+  vm->profileSamples = 0;
+}
+
+// Copies [string] into a new null-terminated buffer owned by the VM.
+static char* copyProfileString(WrenVM* vm, const char* string)
+{
+  size_t length = strlen(string);
+  char* copy = ALLOCATE_ARRAY(vm, char, length + 1);
+  memcpy(copy, string, length + 1);
+  return copy;
+}
+
+// Takes a profiler sample -- attributing one sample to [fn] -- and tests the
+// execution and allocation budgets, resetting the countdown to the next
+// sample. Called from the interpreter's sampling hooks whenever the countdown
+// reaches zero, whether or not the profiler is running or a budget is set.
+// Returns true if a budget is exhausted, with the error already stored on the
+// running fiber.
+static bool profileSample(WrenVM* vm, ObjFn* fn)
+{
+  vm->profileCountdown = PROFILE_INTERVAL;
+
+  if (vm->metering && (vm->budgetTicks == 0 || --vm->budgetTicks == 0))
+  {
+    vm->fiber->error = CONST_STRING(vm, "Execution budget exhausted.");
+    return true;
+  }
+
+  if (vm->allocationBudget > 0 && vm->bytesAllocated > vm->allocationBudget)
+  {
+    vm->fiber->error = CONST_STRING(vm, "Allocation budget exhausted.");
+    return true;
+  }
+
+  if (!vm->profiling) return false;
+
+  vm->profileSamples++;
+
+  const char* module = fn->module != NULL && fn->module->name != NULL
+      ? fn->module->name->value : "core";
+  const char* name = fn->debug->name != NULL ? fn->debug->name : "(unknown)";
+
+  // Look for an existing entry for the function. Samples are thousands of
+  // dispatches apart, so a linear scan is cheap enough.
+  for (int i = 0; i < vm->profileCount; i++)
+  {
+    ProfileEntry* entry = &vm->profileEntries[i];
+    if (strcmp(entry->name, name) == 0 && strcmp(entry->module, module) == 0)
+    {
+      entry->samples++;
+      return false;
+    }
+  }
+
+  if (vm->profileCount == vm->profileCapacity)
+  {
+    int capacity = vm->profileCapacity == 0 ? 16 : vm->profileCapacity * 2;
+    vm->profileEntries =
+        (ProfileEntry*)wrenReallocate(vm, vm->profileEntries,
+            sizeof(ProfileEntry) * vm->profileCapacity,
+            sizeof(ProfileEntry) * capacity);
+    vm->profileCapacity = capacity;
+  }
+
+  ProfileEntry* entry = &vm->profileEntries[vm->profileCount++];
+  entry->module = copyProfileString(vm, module);
+  entry->name = copyProfileString(vm, name);
+  entry->line = fn->debug->sourceLines.count > 0
+      ? fn->debug->sourceLines.data[0] : 0;
+  entry->samples = 1;
+  return false;
+}
+
+void wrenProfilerStart(WrenVM* vm)
+{
+  freeProfileEntries(vm);
+  vm->profileCountdown = PROFILE_INTERVAL;
+  vm->profiling = true;
+}
+
+void wrenProfilerStop(WrenVM* vm)
+{
+  vm->profiling = false;
+}
+
+// Appends [count] bytes from [bytes] to the report being built in [buffer].
+static void appendReport(WrenVM* vm, ByteBuffer* buffer, const char* bytes,
+                         int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    wrenByteBufferWrite(vm, buffer, (uint8_t)bytes[i]);
+  }
+}
+
+char* wrenProfilerReportString(WrenVM* vm, size_t* length)
+{
+  // Order the entries by sample count, hottest first. The list is small and
+  // only sorted when a report is asked for, so a selection sort will do.
+  for (int i = 0; i < vm->profileCount - 1; i++)
+  {
+    int hottest = i;
+    for (int j = i + 1; j < vm->profileCount; j++)
+    {
+      if (vm->profileEntries[j].samples >
+          vm->profileEntries[hottest].samples)
+      {
+        hottest = j;
+      }
+    }
+
+    ProfileEntry swap = vm->profileEntries[i];
+    vm->profileEntries[i] = vm->profileEntries[hottest];
+    vm->profileEntries[hottest] = swap;
+  }
+
+  ByteBuffer buffer;
+  wrenByteBufferInit(&buffer);
+
+  // Numbers are formatted into [piece]; the names, whose lengths aren't
+  // bounded, are appended directly.
+  char piece[64];
+  appendReport(vm, &buffer, piece,
+               sprintf(piece, "profiler: %lu samples\n", vm->profileSamples));
+
+  for (int i = 0; i < vm->profileCount; i++)
+  {
+    ProfileEntry* entry = &vm->profileEntries[i];
+    appendReport(vm, &buffer, piece,
+                 sprintf(piece, "%5.1f%% %8lu  [",
+                     entry->samples * 100.0 / vm->profileSamples,
+                     entry->samples));
+    appendReport(vm, &buffer, entry->module, (int)strlen(entry->module));
+    appendReport(vm, &buffer, piece,
+                 sprintf(piece, " line %d] in ", entry->line));
+    appendReport(vm, &buffer, entry->name, (int)strlen(entry->name));
+    appendReport(vm, &buffer, "\n", 1);
+  }
+
+  // Copy the result into a null-terminated buffer of exactly the right size.
+  char* report = ALLOCATE_ARRAY(vm, char, buffer.count + 1);
+  memcpy(report, buffer.data, buffer.count);
+  report[buffer.count] = '\0';
+  *length = (size_t)buffer.count;
+
+  wrenByteBufferClear(vm, &buffer);
+  return report;
+}
+
+void wrenProfilerReport(WrenVM* vm)
+{
+  if (vm->config.writeFn == NULL) return;
+
+  size_t length;
+  char* report = wrenProfilerReportString(vm, &length);
+  vm->config.writeFn(vm, report);
+  DEALLOCATE(vm, report);
+}
+
+// Frees the heap profiler's collected allocation sites.
+static void freeAllocationEntries(WrenVM* vm)
+{
+  for (int i = 0; i < vm->allocEntryCount; i++)
+  {
+    DEALLOCATE(vm, vm->allocEntries[i].module);
+    DEALLOCATE(vm, vm->allocEntries[i].name);
+  }
+
+  vm->allocEntries =
+      (AllocationEntry*)wrenReallocate(vm, vm->allocEntries,
+          sizeof(AllocationEntry) * vm->allocEntryCapacity, 0);
+  vm->allocEntryCount = 0;
+  vm->allocEntryCapacity = 0;
+  vm->allocTotalCount = 0;
+  vm->allocTotalBytes = 0;
+}
+
+// Attributes an allocation of [size] bytes to the Wren function executing
+// when it was made, or to the host when no fiber is running.
+static void recordAllocation(WrenVM* vm, size_t size)
+{
+  // Recording a new site allocates its entry and name copies, and those
+  // allocations must not be attributed themselves or this would recurse.
+  vm->trackingAllocations = false;
+
+  const char* module = "(host)";
+  const char* name = "(host)";
+  int line = 0;
+  if (vm->fiber != NULL && vm->fiber->numFrames > 0)
+  {
+    ObjFn* fn = vm->fiber->frames[vm->fiber->numFrames - 1].closure->fn;
+    module = fn->module != NULL && fn->module->name != NULL
+        ? fn->module->name->value : "core";
+    name = fn->debug->name != NULL ? fn->debug->name : "(unknown)";
+    line = fn->debug->sourceLines.count > 0
+        ? fn->debug->sourceLines.data[0] : 0;
+  }
+
+  vm->allocTotalCount++;
+  vm->allocTotalBytes += size;
+
+  // Unlike the sampling profiler this scan runs on every allocation, but the
+  // site list is as small as the program's set of allocating functions, so
+  // it stays acceptable for a diagnostic mode that is off by default.
+  for (int i = 0; i < vm->allocEntryCount; i++)
+  {
+    AllocationEntry* entry = &vm->allocEntries[i];
+    if (strcmp(entry->name, name) == 0 && strcmp(entry->module, module) == 0)
+    {
+      entry->count++;
+      entry->bytes += size;
+      vm->trackingAllocations = true;
+      return;
+    }
+  }
+
+  if (vm->allocEntryCount == vm->allocEntryCapacity)
+  {
+    int capacity = vm->allocEntryCapacity == 0 ? 16 : vm->allocEntryCapacity * 2;
+    vm->allocEntries =
+        (AllocationEntry*)wrenReallocate(vm, vm->allocEntries,
+            sizeof(AllocationEntry) * vm->allocEntryCapacity,
+            sizeof(AllocationEntry) * capacity);
+    vm->allocEntryCapacity = capacity;
+  }
+
+  AllocationEntry* entry = &vm->allocEntries[vm->allocEntryCount++];
+  entry->module = copyProfileString(vm, module);
+  entry->name = copyProfileString(vm, name);
+  entry->line = line;
+  entry->count = 1;
+  entry->bytes = size;
+  vm->trackingAllocations = true;
+}
+
+void wrenHeapProfilerStart(WrenVM* vm)
+{
+  freeAllocationEntries(vm);
+  vm->trackingAllocations = true;
+}
+
+void wrenHeapProfilerStop(WrenVM* vm)
+{
+  vm->trackingAllocations = false;
+}
+
+char* wrenHeapReportString(WrenVM* vm, size_t* length)
+{
+  static const char* typeNames[] = {
+    "Class", "Closure", "Fiber", "FloatArray", "Fn", "Foreign", "Instance",
+    "List", "Map", "Module", "Range", "String", "StringBuffer", "Upvalue"
+  };
+
+  // Census the heap before building the report: appending to the report
+  // allocates, which could collect some of the objects being counted.
+  size_t counts[OBJ_UPVALUE + 1] = { 0 };
+  size_t bytes[OBJ_UPVALUE + 1] = { 0 };
+  size_t totalCount = 0;
+  size_t totalBytes = 0;
+  for (Obj* obj = vm->first; obj != NULL; obj = obj->next)
+  {
+    counts[obj->type]++;
+    bytes[obj->type] += wrenObjectSize(obj);
+  }
+  for (Obj* obj = vm->nursery; obj != NULL; obj = obj->next)
+  {
+    counts[obj->type]++;
+    bytes[obj->type] += wrenObjectSize(obj);
+  }
+  for (int i = 0; i <= OBJ_UPVALUE; i++)
+  {
+    totalCount += counts[i];
+    totalBytes += bytes[i];
+  }
+
+  ByteBuffer buffer;
+  wrenByteBufferInit(&buffer);
+
+  char piece[96];
+  appendReport(vm, &buffer, piece,
+               sprintf(piece, "heap: %lu objects %lu bytes\n",
+                   (unsigned long)totalCount, (unsigned long)totalBytes));
+
+  for (int i = 0; i <= OBJ_UPVALUE; i++)
+  {
+    if (counts[i] == 0) continue;
+    appendReport(vm, &buffer, piece,
+                 sprintf(piece, "type %s %lu %lu\n", typeNames[i],
+                     (unsigned long)counts[i], (unsigned long)bytes[i]));
+  }
+
+  if (vm->allocTotalCount > 0)
+  {
+    // Order the sites by attributed bytes, largest first, the same way the
+    // sampling profiler orders its report.
+    for (int i = 0; i < vm->allocEntryCount - 1; i++)
+    {
+      int biggest = i;
+      for (int j = i + 1; j < vm->allocEntryCount; j++)
+      {
+        if (vm->allocEntries[j].bytes > vm->allocEntries[biggest].bytes)
+        {
+          biggest = j;
+        }
+      }
+
+      AllocationEntry swap = vm->allocEntries[i];
+      vm->allocEntries[i] = vm->allocEntries[biggest];
+      vm->allocEntries[biggest] = swap;
+    }
+
+    appendReport(vm, &buffer, piece,
+                 sprintf(piece, "allocations: %lu events %lu bytes\n",
+                     vm->allocTotalCount, vm->allocTotalBytes));
+
+    for (int i = 0; i < vm->allocEntryCount; i++)
+    {
+      AllocationEntry* entry = &vm->allocEntries[i];
+      appendReport(vm, &buffer, piece,
+                   sprintf(piece, "site %lu %lu [", entry->count,
+                       entry->bytes));
+      appendReport(vm, &buffer, entry->module, (int)strlen(entry->module));
+      appendReport(vm, &buffer, piece,
+                   sprintf(piece, " line %d] in ", entry->line));
+      appendReport(vm, &buffer, entry->name, (int)strlen(entry->name));
+      appendReport(vm, &buffer, "\n", 1);
+    }
+  }
+
+  // Copy the result into a null-terminated buffer of exactly the right size.
+  char* report = ALLOCATE_ARRAY(vm, char, buffer.count + 1);
+  memcpy(report, buffer.data, buffer.count);
+  report[buffer.count] = '\0';
+  *length = (size_t)buffer.count;
+
+  wrenByteBufferClear(vm, &buffer);
+  return report;
+}
+
+void wrenHeapReport(WrenVM* vm)
+{
+  if (vm->config.writeFn == NULL) return;
+
+  size_t length;
+  char* report = wrenHeapReportString(vm, &length);
+  vm->config.writeFn(vm, report);
+  DEALLOCATE(vm, report);
+}
+
+void wrenSetExecutionBudget(WrenVM* vm, uint64_t operations)
+{
+  vm->metering = operations > 0;
+
+  // The budget is tested once per profiler countdown cycle, so convert it to
+  // cycles, rounding up so a small budget still allows some execution.
+  vm->budgetTicks = operations / PROFILE_INTERVAL + 1;
+}
+
+void wrenSetAllocationBudget(WrenVM* vm, size_t bytes)
+{
+  vm->allocationBudget = bytes;
 }
 
 void* wrenReallocate(WrenVM* vm, void* memory, size_t oldSize, size_t newSize)
@@ -207,12 +1342,43 @@ void* wrenReallocate(WrenVM* vm, void* memory, size_t oldSize, size_t newSize)
   // during the next GC.
   vm->bytesAllocated += newSize - oldSize;
 
+  // Attribute the new bytes to the function allocating them while the heap
+  // profiler is running.
+  if (vm->trackingAllocations && newSize > oldSize)
+  {
+    recordAllocation(vm, newSize - oldSize);
+  }
+
 #if WREN_DEBUG_GC_STRESS
   // Since collecting calls this function to free things, make sure we don't
   // recurse.
   if (newSize > 0) wrenCollectGarbage(vm);
 #else
-  if (newSize > 0 && vm->bytesAllocated > vm->nextGC) wrenCollectGarbage(vm);
+  if (newSize > 0)
+  {
+    if (vm->gcPhase == GC_PHASE_MARKING)
+    {
+      // A collection cycle is in progress, so do a bounded amount of marking
+      // work for it.
+      wrenIncrementalGC(vm);
+    }
+    else if (vm->bytesAllocated > vm->nextGC)
+    {
+      if (vm->config.incrementalGCBudget > 0)
+      {
+        startIncrementalGC(vm);
+      }
+      else
+      {
+        wrenCollectGarbage(vm);
+      }
+    }
+    else if (vm->config.nurserySize > 0 &&
+             vm->bytesAllocated > vm->nextMinorGC)
+    {
+      collectNursery(vm);
+    }
+  }
 #endif
 
   return vm->config.reallocateFn(memory, newSize);
@@ -266,7 +1432,7 @@ static ObjUpvalue* captureUpvalue(WrenVM* vm, ObjFiber* fiber, Value* local)
 
 // Closes any open upvates that have been created for stack slots at [last] and
 // above.
-static void closeUpvalues(ObjFiber* fiber, Value* last)
+static void closeUpvalues(WrenVM* vm, ObjFiber* fiber, Value* last)
 {
   while (fiber->openUpvalues != NULL &&
          fiber->openUpvalues->value >= last)
@@ -276,6 +1442,7 @@ static void closeUpvalues(ObjFiber* fiber, Value* last)
     // Move the value into the upvalue itself and point the upvalue to it.
     upvalue->closed = *upvalue->value;
     upvalue->value = &upvalue->closed;
+    wrenWriteBarrier(vm, (Obj*)upvalue, upvalue->closed);
 
     // Remove it from the open upvalue list.
     fiber->openUpvalues = upvalue->next;
@@ -383,6 +1550,11 @@ static void runtimeError(WrenVM* vm)
 {
   ASSERT(!IS_NULL(vm->fiber->error), "Should only call this after an error.");
 
+  // Record where the error was thrown while the call frames are still live.
+  // This only copies function pointers and instruction offsets; the printable
+  // form is built later, and only if the trace is actually printed or read.
+  wrenDebugCaptureStackTrace(vm, vm->fiber);
+
   // Unhook the caller since we will never resume and return to it.
   ObjFiber* caller = vm->fiber->caller;
   vm->fiber->caller = NULL;
@@ -407,7 +1579,7 @@ static void runtimeError(WrenVM* vm)
 static void methodNotFound(WrenVM* vm, ObjClass* classObj, int symbol)
 {
   vm->fiber->error = wrenStringFormat(vm, "@ does not implement '$'.",
-      OBJ_VAL(classObj->name), vm->methodNames.data[symbol].buffer);
+      OBJ_VAL(classObj->name), vm->methodNames.names.data[symbol].buffer);
 }
 
 // Checks that [value], which must be a closure, does not require more
@@ -437,7 +1609,7 @@ static inline void callFunction(
   // Grow the call frame array if needed.
   if (fiber->numFrames + 1 > fiber->frameCapacity)
   {
-    int max = fiber->frameCapacity * 2;
+    int max = fiber->frameCapacity * vm->config.stackGrowthFactor;
     fiber->frames = (CallFrame*)wrenReallocate(vm, fiber->frames,
         sizeof(CallFrame) * fiber->frameCapacity,
         sizeof(CallFrame) * max);
@@ -452,6 +1624,35 @@ static inline void callFunction(
   wrenAppendCallFrame(vm, fiber, closure, fiber->stackTop - numArgs);
 }
 
+// Replaces the topmost call frame on [fiber]'s callstack with an invocation
+// of [closure], reusing the frame's stack window. Used for calls in tail
+// position: the caller's frame only exists to forward the callee's result,
+// so its locals can be discarded before the callee runs instead of after.
+// Expects [numArgs] arguments (including the receiver) to be on the top of
+// the stack already.
+static inline void tailCallFunction(
+    WrenVM* vm, ObjFiber* fiber, ObjClosure* closure, int numArgs)
+{
+  CallFrame* frame = &fiber->frames[fiber->numFrames - 1];
+
+  // The caller's locals are about to be overwritten, so move any that are
+  // still captured by upvalues to the heap, just like CODE_RETURN would.
+  closeUpvalues(vm, fiber, frame->stackStart);
+
+  // Slide the arguments down into the reused stack window.
+  memmove(frame->stackStart, fiber->stackTop - numArgs,
+          numArgs * sizeof(Value));
+  fiber->stackTop = frame->stackStart + numArgs;
+
+  // Grow the stack if needed.
+  int stackSize = (int)(fiber->stackTop - fiber->stack);
+  int needed = stackSize + closure->fn->maxSlots;
+  wrenEnsureStack(vm, fiber, needed);
+
+  frame->closure = closure;
+  frame->ip = closure->fn->code.data;
+}
+
 // Looks up the previously loaded module with [name].
 //
 // Returns `NULL` if no module with that name has been loaded.
@@ -478,13 +1679,17 @@ static ObjFiber* loadModule(WrenVM* vm, Value name, const char* source)
     for (int i = 0; i < coreModule->variables.count; i++)
     {
       wrenDefineVariable(vm, module,
-                         coreModule->variableNames.data[i].buffer,
-                         coreModule->variableNames.data[i].length,
+                         coreModule->variableNames.names.data[i].buffer,
+                         coreModule->variableNames.names.data[i].length,
                          coreModule->variables.data[i]);
     }
   }
 
-  ObjFn* fn = wrenCompile(vm, module, source, true);
+  // If the host gave us a snapshot instead of source code, we can skip the
+  // compiler entirely.
+  ObjFn* fn = wrenIsSnapshot(source)
+      ? wrenSnapshotLoadModule(vm, module, source)
+      : wrenCompile(vm, module, source, true);
   if (fn == NULL)
   {
     // TODO: Should we still store the module even if it didn't compile?
@@ -492,7 +1697,12 @@ static ObjFiber* loadModule(WrenVM* vm, Value name, const char* source)
   }
 
   wrenPushRoot(vm, (Obj*)fn);
-  
+
+  // Debug builds hold the compiler's output (including the peephole
+  // rewrites) to the same standard the snapshot loader enforces.
+  ASSERT(wrenVerifyFn(vm, fn) == NULL,
+         "Compiled module failed bytecode verification.");
+
   // TODO: Doc.
   ObjClosure* closure = wrenNewClosure(vm, fn);
   wrenPushRoot(vm, (Obj*)closure);
@@ -650,8 +1860,8 @@ static void createForeign(WrenVM* vm, ObjFiber* fiber, Value* stack)
   int symbol = wrenSymbolTableFind(&vm->methodNames, "<allocate>", 10);
   ASSERT(symbol != -1, "Should have defined <allocate> symbol.");
 
-  ASSERT(classObj->methods.count > symbol, "Class should have allocator.");
-  Method* method = &classObj->methods.data[symbol];
+  Method* method = wrenClassGetMethod(classObj, symbol);
+  ASSERT(method != NULL, "Class should have allocator.");
   ASSERT(method->type == METHOD_FOREIGN, "Allocator should be foreign.");
 
   // Pass the constructor arguments to the allocator as well.
@@ -673,10 +1883,8 @@ void wrenFinalizeForeign(WrenVM* vm, ObjForeign* foreign)
 
   // If the class doesn't have a finalizer, bail out.
   ObjClass* classObj = foreign->obj.classObj;
-  if (symbol >= classObj->methods.count) return;
-
-  Method* method = &classObj->methods.data[symbol];
-  if (method->type == METHOD_NONE) return;
+  Method* method = wrenClassGetMethod(classObj, symbol);
+  if (method == NULL) return;
 
   ASSERT(method->type == METHOD_FOREIGN, "Finalizer should be foreign.");
 
@@ -749,6 +1957,26 @@ static WrenInterpretResult runInterpreter(WrenVM* vm, register ObjFiber* fiber)
     #define DEBUG_TRACE_INSTRUCTIONS() do { } while (false)
   #endif
 
+  // The sampling profiler's hooks, placed on loop back-edges and method
+  // calls: putting the countdown in the dispatch path itself costs double
+  // digit percentages, while any code that runs long enough to profile takes
+  // one of these two instructions constantly. The countdown runs whether or
+  // not the profiler is on -- profileSample() just resets it when it's off --
+  // so each hook costs a decrement and a branch.
+  //
+  // The execution and allocation budgets piggyback on the countdown: they're
+  // only tested inside profileSample(), so metering adds nothing to the hot
+  // path and exhaustion is caught within one PROFILE_INTERVAL of the limit.
+  #define PROFILE_SAMPLE()                                        \
+      do                                                          \
+      {                                                           \
+        if (--vm->profileCountdown == 0 && profileSample(vm, fn)) \
+        {                                                         \
+          RUNTIME_ERROR();                                        \
+        }                                                         \
+      }                                                           \
+      while (false)
+
   #if WREN_COMPUTED_GOTO
 
   static void* dispatchTable[] = {
@@ -840,8 +2068,108 @@ static WrenInterpretResult runInterpreter(WrenVM* vm, register ObjFiber* fiber)
       Value* args;
       ObjClass* classObj;
 
+      CallCache* cache;
       Method* method;
 
+    // Superinstructions from the peephole pass: do the push, then fall into
+    // the call instruction that follows without another dispatch.
+    CASE_CODE(LOAD_LOCAL_0_CALL):
+    CASE_CODE(LOAD_LOCAL_1_CALL):
+    CASE_CODE(LOAD_LOCAL_2_CALL):
+    CASE_CODE(LOAD_LOCAL_3_CALL):
+    CASE_CODE(LOAD_LOCAL_4_CALL):
+    CASE_CODE(LOAD_LOCAL_5_CALL):
+    CASE_CODE(LOAD_LOCAL_6_CALL):
+    CASE_CODE(LOAD_LOCAL_7_CALL):
+    CASE_CODE(LOAD_LOCAL_8_CALL):
+      PUSH(stackStart[instruction - CODE_LOAD_LOCAL_0_CALL]);
+      instruction = (Code)READ_BYTE();
+      goto callInstruction;
+
+    CASE_CODE(LOAD_LOCAL_CALL):
+      PUSH(stackStart[READ_BYTE()]);
+      instruction = (Code)READ_BYTE();
+      goto callInstruction;
+
+    CASE_CODE(CONSTANT_CALL):
+      PUSH(fn->constants.data[READ_SHORT()]);
+      instruction = (Code)READ_BYTE();
+      goto callInstruction;
+
+    CASE_CODE(LOAD_FIELD_THIS_CALL):
+    {
+      uint8_t field = READ_BYTE();
+      Value receiver = stackStart[0];
+      ASSERT(IS_INSTANCE(receiver), "Receiver should be instance.");
+      ObjInstance* instance = AS_INSTANCE(receiver);
+      ASSERT(field < instance->obj.classObj->numFields, "Out of bounds field.");
+      PUSH(instance->fields[field]);
+      instruction = (Code)READ_BYTE();
+      goto callInstruction;
+    }
+
+    // Specialized operator sends: when both operands are numbers, do the math
+    // inline and skip the symbol and cache operands. Otherwise fall back to a
+    // generic send, whose operand layout these instructions share.
+    #define NUM_FAST_OP(result)                                        \
+        do                                                             \
+        {                                                              \
+          Value* operands = fiber->stackTop - 2;                       \
+          if (IS_NUM(operands[0]) && IS_NUM(operands[1]))              \
+          {                                                            \
+            double a = AS_NUM(operands[0]);                            \
+            double b = AS_NUM(operands[1]);                            \
+            operands[0] = (result);                                    \
+            DROP();                                                    \
+            ip += 4;                                                   \
+            DISPATCH();                                                \
+          }                                                            \
+          instruction = CODE_CALL_1;                                   \
+          goto callInstruction;                                        \
+        }                                                              \
+        while (false)
+
+    CASE_CODE(ADD):           NUM_FAST_OP(NUM_VAL(a + b));
+    CASE_CODE(SUBTRACT):      NUM_FAST_OP(NUM_VAL(a - b));
+    CASE_CODE(MULTIPLY):      NUM_FAST_OP(NUM_VAL(a * b));
+    CASE_CODE(DIVIDE):        NUM_FAST_OP(NUM_VAL(a / b));
+    CASE_CODE(MOD):           NUM_FAST_OP(NUM_VAL(fmod(a, b)));
+    CASE_CODE(LESS):          NUM_FAST_OP(BOOL_VAL(a < b));
+    CASE_CODE(LESS_EQUAL):    NUM_FAST_OP(BOOL_VAL(a <= b));
+    CASE_CODE(GREATER):       NUM_FAST_OP(BOOL_VAL(a > b));
+    CASE_CODE(GREATER_EQUAL): NUM_FAST_OP(BOOL_VAL(a >= b));
+    CASE_CODE(EQUAL):         NUM_FAST_OP(BOOL_VAL(a == b));
+    CASE_CODE(NOT_EQUAL):     NUM_FAST_OP(BOOL_VAL(a != b));
+
+    #undef NUM_FAST_OP
+
+    // Tail calls from the peephole pass: a call immediately followed by
+    // CODE_RETURN. These dispatch exactly like the corresponding call, but
+    // when the method is a Wren function or closure, callMethod reuses the
+    // current frame instead of pushing a new one. Primitive and foreign
+    // methods return directly into this frame, so for them the CODE_RETURN
+    // that follows runs as usual.
+    CASE_CODE(TAIL_CALL_0):
+    CASE_CODE(TAIL_CALL_1):
+    CASE_CODE(TAIL_CALL_2):
+    CASE_CODE(TAIL_CALL_3):
+    CASE_CODE(TAIL_CALL_4):
+    CASE_CODE(TAIL_CALL_5):
+    CASE_CODE(TAIL_CALL_6):
+    CASE_CODE(TAIL_CALL_7):
+    CASE_CODE(TAIL_CALL_8):
+    CASE_CODE(TAIL_CALL_9):
+    CASE_CODE(TAIL_CALL_10):
+    CASE_CODE(TAIL_CALL_11):
+    CASE_CODE(TAIL_CALL_12):
+    CASE_CODE(TAIL_CALL_13):
+    CASE_CODE(TAIL_CALL_14):
+    CASE_CODE(TAIL_CALL_15):
+    CASE_CODE(TAIL_CALL_16):
+      // Add one for the implicit receiver argument.
+      numArgs = instruction - CODE_TAIL_CALL_0 + 1;
+      goto callSymbol;
+
     CASE_CODE(CALL_0):
     CASE_CODE(CALL_1):
     CASE_CODE(CALL_2):
@@ -859,14 +2187,50 @@ static WrenInterpretResult runInterpreter(WrenVM* vm, register ObjFiber* fiber)
     CASE_CODE(CALL_14):
     CASE_CODE(CALL_15):
     CASE_CODE(CALL_16):
+    callInstruction:
       // Add one for the implicit receiver argument.
       numArgs = instruction - CODE_CALL_0 + 1;
+    callSymbol:
+      PROFILE_SAMPLE();
       symbol = READ_SHORT();
 
       // The receiver is the first argument.
       args = fiber->stackTop - numArgs;
       classObj = wrenGetClassInline(vm, args[0]);
-      goto completeCall;
+
+      // Check the call site's inline cache. If the receiver's class and the
+      // symbol match the last send from this site, we can skip the method
+      // lookup. The symbol is compared too because overflow call sites share
+      // one cache slot between sends of different methods.
+      cache = &fn->callCaches[READ_SHORT()];
+      if (cache->classObj == classObj && cache->symbol == (uint16_t)symbol)
+      {
+        method = &cache->method;
+        goto callMethod;
+      }
+
+      // Cache miss. Do the full lookup and remember the result for next time.
+      if ((method = wrenClassGetMethod(classObj, symbol)) == NULL)
+      {
+        methodNotFound(vm, classObj, symbol);
+        RUNTIME_ERROR();
+      }
+
+      // A frozen function's caches are read by every VM sharing it, so leave
+      // them as they were when the core was frozen. (A live function is also
+      // dark while an incremental cycle is marking; skipping the store until
+      // the cycle ends is harmless.)
+      if (!fn->obj.isDark)
+      {
+        cache->classObj = classObj;
+        cache->symbol = (uint16_t)symbol;
+        cache->method = *method;
+
+        // The function now references the class through the cache. Graying
+        // the class is enough: a dark class keeps its methods alive too.
+        wrenWriteBarrierObj(vm, (Obj*)fn, (Obj*)classObj);
+      }
+      goto callMethod;
 
     CASE_CODE(SUPER_0):
     CASE_CODE(SUPER_1):
@@ -898,13 +2262,13 @@ static WrenInterpretResult runInterpreter(WrenVM* vm, register ObjFiber* fiber)
 
     completeCall:
       // If the class's method table doesn't include the symbol, bail.
-      if (symbol >= classObj->methods.count ||
-          (method = &classObj->methods.data[symbol])->type == METHOD_NONE)
+      if ((method = wrenClassGetMethod(classObj, symbol)) == NULL)
       {
         methodNotFound(vm, classObj, symbol);
         RUNTIME_ERROR();
       }
 
+    callMethod:
       switch (method->type)
       {
         case METHOD_PRIMITIVE:
@@ -933,13 +2297,29 @@ static WrenInterpretResult runInterpreter(WrenVM* vm, register ObjFiber* fiber)
           if (!checkArity(vm, args[0], numArgs)) RUNTIME_ERROR();
 
           STORE_FRAME();
-          callFunction(vm, fiber, AS_CLOSURE(args[0]), numArgs);
+          if (instruction >= CODE_TAIL_CALL_0 &&
+              instruction <= CODE_TAIL_CALL_16)
+          {
+            tailCallFunction(vm, fiber, AS_CLOSURE(args[0]), numArgs);
+          }
+          else
+          {
+            callFunction(vm, fiber, AS_CLOSURE(args[0]), numArgs);
+          }
           LOAD_FRAME();
           break;
 
         case METHOD_BLOCK:
           STORE_FRAME();
-          callFunction(vm, fiber, (ObjClosure*)method->fn.obj, numArgs);
+          if (instruction >= CODE_TAIL_CALL_0 &&
+              instruction <= CODE_TAIL_CALL_16)
+          {
+            tailCallFunction(vm, fiber, (ObjClosure*)method->fn.obj, numArgs);
+          }
+          else
+          {
+            callFunction(vm, fiber, (ObjClosure*)method->fn.obj, numArgs);
+          }
           LOAD_FRAME();
           break;
 
@@ -959,8 +2339,9 @@ static WrenInterpretResult runInterpreter(WrenVM* vm, register ObjFiber* fiber)
 
     CASE_CODE(STORE_UPVALUE):
     {
-      ObjUpvalue** upvalues = frame->closure->upvalues;
-      *upvalues[READ_BYTE()]->value = PEEK();
+      ObjUpvalue* upvalue = frame->closure->upvalues[READ_BYTE()];
+      *upvalue->value = PEEK();
+      wrenWriteBarrier(vm, (Obj*)upvalue, PEEK());
       DISPATCH();
     }
 
@@ -970,6 +2351,7 @@ static WrenInterpretResult runInterpreter(WrenVM* vm, register ObjFiber* fiber)
 
     CASE_CODE(STORE_MODULE_VAR):
       fn->module->variables.data[READ_SHORT()] = PEEK();
+      wrenWriteBarrier(vm, (Obj*)fn->module, PEEK());
       DISPATCH();
 
     CASE_CODE(STORE_FIELD_THIS):
@@ -980,6 +2362,7 @@ static WrenInterpretResult runInterpreter(WrenVM* vm, register ObjFiber* fiber)
       ObjInstance* instance = AS_INSTANCE(receiver);
       ASSERT(field < instance->obj.classObj->numFields, "Out of bounds field.");
       instance->fields[field] = PEEK();
+      wrenWriteBarrier(vm, (Obj*)instance, PEEK());
       DISPATCH();
     }
 
@@ -1002,6 +2385,61 @@ static WrenInterpretResult runInterpreter(WrenVM* vm, register ObjFiber* fiber)
       ObjInstance* instance = AS_INSTANCE(receiver);
       ASSERT(field < instance->obj.classObj->numFields, "Out of bounds field.");
       instance->fields[field] = PEEK();
+      wrenWriteBarrier(vm, (Obj*)instance, PEEK());
+      DISPATCH();
+    }
+
+    CASE_CODE(FOR_RANGE):
+    {
+      uint8_t seqSlot = READ_BYTE();
+      uint8_t iterSlot = READ_BYTE();
+      uint16_t offset = READ_SHORT();
+
+      Value seq = stackStart[seqSlot];
+      Value iter = stackStart[iterSlot];
+      if (IS_RANGE(seq) && (IS_NULL(iter) || IS_NUM(iter)))
+      {
+        // Mirrors range_iterate() and range_iteratorValue() in wren_core.c:
+        // a range's iterator is also its value.
+        ObjRange* range = AS_RANGE(seq);
+        double iterator;
+        bool done = range->from == range->to && !range->isInclusive;
+
+        if (!done && IS_NULL(iter))
+        {
+          iterator = range->from;
+        }
+        else if (!done)
+        {
+          iterator = AS_NUM(iter);
+          if (range->from < range->to)
+          {
+            iterator++;
+            if (iterator > range->to) done = true;
+          }
+          else
+          {
+            iterator--;
+            if (iterator < range->to) done = true;
+          }
+
+          if (!range->isInclusive && iterator == range->to) done = true;
+        }
+
+        if (!done)
+        {
+          stackStart[iterSlot] = NUM_VAL(iterator);
+          PUSH(NUM_VAL(iterator));
+          ip += offset;
+          DISPATCH();
+        }
+
+        // The range is exhausted. Fall through to the protocol below, whose
+        // iterate() call also returns false and exits the loop.
+      }
+
+      // Not a range (or not a numeric iterator): run the loop header through
+      // the regular iterate()/iteratorValue() sends that follow.
       DISPATCH();
     }
 
@@ -1014,6 +2452,8 @@ static WrenInterpretResult runInterpreter(WrenVM* vm, register ObjFiber* fiber)
 
     CASE_CODE(LOOP):
     {
+      PROFILE_SAMPLE();
+
       // Jump back to the top of the loop.
       uint16_t offset = READ_SHORT();
       ip -= offset;
@@ -1067,7 +2507,7 @@ static WrenInterpretResult runInterpreter(WrenVM* vm, register ObjFiber* fiber)
 
     CASE_CODE(CLOSE_UPVALUE):
       // Close the upvalue for the local if we have one.
-      closeUpvalues(fiber, fiber->stackTop - 1);
+      closeUpvalues(vm, fiber, fiber->stackTop - 1);
       DROP();
       DISPATCH();
 
@@ -1077,7 +2517,7 @@ static WrenInterpretResult runInterpreter(WrenVM* vm, register ObjFiber* fiber)
       fiber->numFrames--;
 
       // Close any upvalues still in scope.
-      closeUpvalues(fiber, stackStart);
+      closeUpvalues(vm, fiber, stackStart);
 
       // If the fiber is complete, end it.
       if (fiber->numFrames == 0)
@@ -1115,6 +2555,58 @@ static WrenInterpretResult runInterpreter(WrenVM* vm, register ObjFiber* fiber)
       DISPATCH();
     }
 
+    CASE_CODE(LIST_LITERAL):
+    {
+      int numElements = (int)READ_SHORT();
+
+      // The elements are rooted on the stack, so allocating the list can't
+      // collect them. The list is sized exactly, so the elements can be copied
+      // straight into place. No write barrier is needed: the list is brand new
+      // and nothing can have allocated between creating it and storing into
+      // it.
+      ObjList* list = wrenNewList(vm, (uint32_t)numElements);
+      if (numElements > 0)
+      {
+        memcpy(list->elements.data, fiber->stackTop - numElements,
+               numElements * sizeof(Value));
+      }
+
+      fiber->stackTop -= numElements;
+      PUSH(OBJ_VAL(list));
+      DISPATCH();
+    }
+
+    CASE_CODE(MAP_LITERAL):
+    {
+      int numEntries = (int)READ_SHORT();
+
+      // The entries are rooted on the stack, so allocating the map can't
+      // collect them. Push the map too so that growing it can't collect *it*,
+      // then size it for every entry up front so inserting them never
+      // rehashes.
+      ObjMap* map = wrenNewMap(vm);
+      PUSH(OBJ_VAL(map));
+      wrenMapReserve(vm, map, (uint32_t)numEntries);
+
+      Value* entries = fiber->stackTop - 1 - numEntries * 2;
+      for (int i = 0; i < numEntries; i++)
+      {
+        Value key = entries[i * 2];
+        if (!(IS_BOOL(key) || IS_CLASS(key) || IS_NULL(key) ||
+              IS_NUM(key) || IS_RANGE(key) || IS_STRING(key)))
+        {
+          fiber->error = CONST_STRING(vm, "Key must be a value type.");
+          RUNTIME_ERROR();
+        }
+
+        wrenMapSet(vm, map, key, entries[i * 2 + 1]);
+      }
+
+      fiber->stackTop -= numEntries * 2 + 1;
+      PUSH(OBJ_VAL(map));
+      DISPATCH();
+    }
+
     CASE_CODE(CONSTRUCT):
       ASSERT(IS_CLASS(stackStart[0]), "'this' should be a class.");
       stackStart[0] = wrenNewInstance(vm, AS_CLASS(stackStart[0]));
@@ -1127,9 +2619,19 @@ static WrenInterpretResult runInterpreter(WrenVM* vm, register ObjFiber* fiber)
 
     CASE_CODE(CLOSURE):
     {
+      Value constant = fn->constants.data[READ_SHORT()];
+
+      // A function that captures nothing is compiled to a single canonical
+      // closure, so evaluating it is just a constant load.
+      if (IS_CLOSURE(constant))
+      {
+        PUSH(constant);
+        DISPATCH();
+      }
+
       // Create the closure and push it on the stack before creating upvalues
       // so that it doesn't get collected.
-      ObjFn* function = AS_FN(fn->constants.data[READ_SHORT()]);
+      ObjFn* function = AS_FN(constant);
       ObjClosure* closure = wrenNewClosure(vm, function);
       PUSH(OBJ_VAL(closure));
 
@@ -1226,9 +2728,16 @@ WrenValue* wrenMakeCallHandle(WrenVM* vm, const char* signature)
   wrenByteBufferWrite(vm, &fn->code, (uint8_t)(CODE_CALL_0 + numParams));
   wrenByteBufferWrite(vm, &fn->code, (method >> 8) & 0xff);
   wrenByteBufferWrite(vm, &fn->code, method & 0xff);
+
+  // The call's inline cache slot.
+  wrenByteBufferWrite(vm, &fn->code, 0);
+  wrenByteBufferWrite(vm, &fn->code, 0);
+  fn->numCallCaches = 1;
+  wrenFunctionAllocateCallCaches(vm, fn);
+
   wrenByteBufferWrite(vm, &fn->code, CODE_RETURN);
   wrenByteBufferWrite(vm, &fn->code, CODE_END);
-  wrenIntBufferFill(vm, &fn->debug->sourceLines, 0, 5);
+  wrenIntBufferFill(vm, &fn->debug->sourceLines, 0, 7);
   wrenFunctionBindName(vm, fn, signature, signatureLength);
 
   return value;
@@ -1255,42 +2764,126 @@ WrenInterpretResult wrenCall(WrenVM* vm, WrenValue* method)
   return runInterpreter(vm, vm->fiber);
 }
 
+WrenPreparedCall* wrenPrepareCall(WrenVM* vm, WrenValue* method)
+{
+  ASSERT(method != NULL, "Method cannot be NULL.");
+  ASSERT(IS_CLOSURE(method->value), "Method must be a method handle.");
+
+  ObjClosure* closure = AS_CLOSURE(method->value);
+
+  WrenPreparedCall* call = ALLOCATE(vm, WrenPreparedCall);
+  call->closure = closure;
+  call->numSlots = closure->fn->maxSlots;
+  call->closureHandle = wrenCaptureValue(vm, method->value);
+
+  // One frame is all an invocation pushes up front. Anything the method then
+  // calls grows the frame array like any other code, and the fiber keeps the
+  // grown capacity for later invocations.
+  ObjFiber* fiber = wrenNewFiberWithCapacity(vm, NULL, call->numSlots, 1);
+  call->fiber = fiber;
+  call->fiberHandle = wrenCaptureValue(vm, OBJ_VAL(fiber));
+
+  wrenLoadPreparedCall(vm, call);
+  return call;
+}
+
+void wrenLoadPreparedCall(WrenVM* vm, WrenPreparedCall* call)
+{
+  vm->fiber = call->fiber;
+  vm->apiStack = call->fiber->stack;
+  call->fiber->stackTop = &call->fiber->stack[call->numSlots];
+}
+
+WrenInterpretResult wrenCallPrepared(WrenVM* vm, WrenPreparedCall* call)
+{
+  ObjFiber* fiber = call->fiber;
+  ASSERT(vm->apiStack == fiber->stack,
+         "Must set up arguments on the prepared call's slots first.");
+
+  vm->fiber = fiber;
+
+  // Discard any extra temporary slots, as wrenCall() does.
+  fiber->stackTop = &fiber->stack[call->numSlots];
+
+  callFunction(vm, fiber, call->closure, 0);
+  WrenInterpretResult result = runInterpreter(vm, fiber);
+
+  if (result != WREN_RESULT_SUCCESS)
+  {
+    // An uncaught error aborts the fiber mid-frame, so unwind it by hand to
+    // keep the call reusable.
+    fiber->numFrames = 0;
+    fiber->openUpvalues = NULL;
+    fiber->error = NULL_VAL;
+  }
+
+  // Re-prime the call: the next invocation only needs its arguments written.
+  wrenLoadPreparedCall(vm, call);
+  return result;
+}
+
+void wrenReleasePreparedCall(WrenVM* vm, WrenPreparedCall* call)
+{
+  ASSERT(call != NULL, "Call cannot be NULL.");
+
+  // If the call's slots are the current slot array, drop them so stale
+  // pointers into the released fiber aren't left behind.
+  if (vm->apiStack == call->fiber->stack)
+  {
+    vm->fiber = NULL;
+    vm->apiStack = NULL;
+  }
+
+  wrenReleaseValue(vm, call->closureHandle);
+  wrenReleaseValue(vm, call->fiberHandle);
+  DEALLOCATE(vm, call);
+}
+
 WrenValue* wrenCaptureValue(WrenVM* vm, Value value)
 {
-  if (IS_OBJ(value)) wrenPushRoot(vm, AS_OBJ(value));
-  
-  // Make a handle for it.
-  WrenValue* wrappedValue = ALLOCATE(vm, WrenValue);
-  wrappedValue->value = value;
+  // If every handle is in use, add a slab of fresh ones.
+  if (vm->freeHandles == NULL)
+  {
+    if (IS_OBJ(value)) wrenPushRoot(vm, AS_OBJ(value));
 
-  if (IS_OBJ(value)) wrenPopRoot(vm);
+    WrenHandleSlab* slab = ALLOCATE(vm, WrenHandleSlab);
 
-  // Add it to the front of the linked list of handles.
-  if (vm->valueHandles != NULL) vm->valueHandles->prev = wrappedValue;
-  wrappedValue->prev = NULL;
-  wrappedValue->next = vm->valueHandles;
-  vm->valueHandles = wrappedValue;
-  
+    if (IS_OBJ(value)) wrenPopRoot(vm);
+
+    slab->next = vm->handleSlabs;
+    vm->handleSlabs = slab;
+
+    // Thread the slab's handles onto the free list, in order.
+    for (int i = WREN_HANDLES_PER_SLAB - 1; i >= 0; i--)
+    {
+      slab->handles[i].value = UNDEFINED_VAL;
+      slab->handles[i].nextFree = vm->freeHandles;
+      vm->freeHandles = &slab->handles[i];
+    }
+  }
+
+  // Take a handle off the free list.
+  WrenValue* wrappedValue = vm->freeHandles;
+  vm->freeHandles = wrappedValue->nextFree;
+  vm->handleCount++;
+
+  wrappedValue->value = value;
+  wrappedValue->nextFree = NULL;
   return wrappedValue;
 }
 
 void wrenReleaseValue(WrenVM* vm, WrenValue* value)
 {
   ASSERT(value != NULL, "Value cannot be NULL.");
-
-  // Update the VM's head pointer if we're releasing the first handle.
-  if (vm->valueHandles == value) vm->valueHandles = value->next;
-
-  // Unlink it from the list.
-  if (value->prev != NULL) value->prev->next = value->next;
-  if (value->next != NULL) value->next->prev = value->prev;
-
-  // Clear it out. This isn't strictly necessary since we're going to free it,
-  // but it makes for easier debugging.
-  value->prev = NULL;
-  value->next = NULL;
-  value->value = NULL_VAL;
-  DEALLOCATE(vm, value);
+  ASSERT(!IS_UNDEFINED(value->value), "Value has already been released.");
+
+  // Return the handle to the free list. The slab keeps it, so releasing
+  // doesn't free memory and the pointer can be safely (if incorrectly)
+  // dereferenced by a stale host reference.
+  value->value = UNDEFINED_VAL;
+  value->nextFree = vm->freeHandles;
+  vm->freeHandles = value;
+  vm->handleCount--;
 }
 
 WrenInterpretResult wrenInterpret(WrenVM* vm, const char* source)
@@ -1323,6 +2916,49 @@ WrenInterpretResult wrenInterpretInModule(WrenVM* vm, const char* module,
   return runInterpreter(vm, fiber);
 }
 
+char* wrenSnapshotModule(WrenVM* vm, const char* module, const char* source,
+                         size_t* length)
+{
+  // Compile into a scratch module that isn't registered with the VM, so
+  // creating a snapshot doesn't make the module look loaded (its body never
+  // runs here) and doesn't disturb one that actually is.
+  ObjString* name = AS_STRING(wrenNewString(vm, module, strlen(module)));
+  wrenPushRoot(vm, (Obj*)name);
+  ObjModule* moduleObj = wrenNewModule(vm, name);
+  wrenPopRoot(vm); // name.
+  wrenPushRoot(vm, (Obj*)moduleObj);
+
+  // Implicitly import the core module, mirroring loadModule(), so the
+  // compiled variable table has the core variables as its prefix.
+  ObjModule* coreModule = getModule(vm, NULL_VAL);
+  for (int i = 0; i < coreModule->variables.count; i++)
+  {
+    wrenDefineVariable(vm, moduleObj,
+                       coreModule->variableNames.names.data[i].buffer,
+                       coreModule->variableNames.names.data[i].length,
+                       coreModule->variables.data[i]);
+  }
+
+  ObjFn* fn = wrenCompile(vm, moduleObj, source, true);
+  if (fn == NULL)
+  {
+    wrenPopRoot(vm); // moduleObj.
+    return NULL;
+  }
+
+  wrenPushRoot(vm, (Obj*)fn);
+  char* snapshot = wrenSnapshotSerialize(vm, fn, length);
+  wrenPopRoot(vm); // fn.
+  wrenPopRoot(vm); // moduleObj.
+
+  return snapshot;
+}
+
+void wrenFreeSnapshot(WrenVM* vm, char* snapshot)
+{
+  DEALLOCATE(vm, snapshot);
+}
+
 Value wrenImportModule(WrenVM* vm, Value name)
 {
   // If the module is already loaded, we don't need to do anything.
@@ -1421,12 +3057,14 @@ int wrenDefineVariable(WrenVM* vm, ObjModule* module, const char* name,
     // Brand new variable.
     symbol = wrenSymbolTableAdd(vm, &module->variableNames, name, length);
     wrenValueBufferWrite(vm, &module->variables, value);
+    wrenWriteBarrier(vm, (Obj*)module, value);
   }
   else if (IS_NUM(module->variables.data[symbol]))
   {
     // An implicitly declared variable's value will always be a number. Now we
     // have a real definition.
     module->variables.data[symbol] = value;
+    wrenWriteBarrier(vm, (Obj*)module, value);
   }
   else
   {
@@ -1480,6 +3118,30 @@ void wrenEnsureSlots(WrenVM* vm, int numSlots)
   vm->fiber->stackTop = vm->apiStack + numSlots;
 }
 
+void wrenReserveStack(WrenVM* vm, int numSlots, int numFrames)
+{
+  // If we don't have a fiber accessible, create one for the API to use with
+  // the requested capacity baked in.
+  if (vm->apiStack == NULL)
+  {
+    vm->fiber = wrenNewFiberWithCapacity(vm, NULL, numSlots, numFrames);
+    vm->apiStack = vm->fiber->stack;
+    return;
+  }
+
+  ObjFiber* fiber = vm->fiber;
+  int needed = (int)(vm->apiStack - fiber->stack) + numSlots;
+  wrenEnsureStack(vm, fiber, needed);
+
+  if (numFrames > fiber->frameCapacity)
+  {
+    fiber->frames = (CallFrame*)wrenReallocate(vm, fiber->frames,
+        sizeof(CallFrame) * fiber->frameCapacity,
+        sizeof(CallFrame) * numFrames);
+    fiber->frameCapacity = numFrames;
+  }
+}
+
 // Ensures that [slot] is a valid index into the API's stack of slots.
 static void validateApiSlot(WrenVM* vm, int slot)
 {
@@ -1527,6 +3189,35 @@ double wrenGetSlotDouble(WrenVM* vm, int slot)
   return AS_NUM(vm->apiStack[slot]);
 }
 
+int wrenGetSlotDoubleList(WrenVM* vm, int slot, double* values, int capacity)
+{
+  validateApiSlot(vm, slot);
+  ASSERT(IS_LIST(vm->apiStack[slot]), "Slot must hold a list.");
+  ASSERT(values != NULL || capacity == 0, "Values cannot be NULL.");
+
+  ObjList* list = AS_LIST(vm->apiStack[slot]);
+  int count = list->elements.count < capacity ? list->elements.count
+                                              : capacity;
+  for (int i = 0; i < count; i++)
+  {
+    ASSERT(IS_NUM(list->elements.data[i]), "List elements must be numbers.");
+    values[i] = AS_NUM(list->elements.data[i]);
+  }
+
+  return list->elements.count;
+}
+
+double* wrenGetSlotFloatArray(WrenVM* vm, int slot, int* count)
+{
+  validateApiSlot(vm, slot);
+  ASSERT(IS_FLOAT_ARRAY(vm->apiStack[slot]), "Slot must hold a float array.");
+  ASSERT(count != NULL, "Count cannot be NULL.");
+
+  ObjFloatArray* array = AS_FLOAT_ARRAY(vm->apiStack[slot]);
+  *count = (int)array->count;
+  return array->elements;
+}
+
 void* wrenGetSlotForeign(WrenVM* vm, int slot)
 {
   validateApiSlot(vm, slot);
@@ -1588,11 +3279,40 @@ void* wrenSetSlotNewForeign(WrenVM* vm, int slot, int classSlot, size_t size)
   return (void*)foreign->data;
 }
 
+void wrenSetSlotNewDoubleList(WrenVM* vm, int slot, const double* values,
+                              int count)
+{
+  ASSERT(values != NULL || count == 0, "Values cannot be NULL.");
+  ASSERT(count >= 0, "Count cannot be negative.");
+
+  ObjList* list = wrenNewList(vm, (uint32_t)count);
+  for (int i = 0; i < count; i++)
+  {
+    list->elements.data[i] = NUM_VAL(values[i]);
+  }
+
+  setSlot(vm, slot, OBJ_VAL(list));
+}
+
+double* wrenSetSlotNewFloatArray(WrenVM* vm, int slot, int count)
+{
+  ASSERT(count >= 0, "Count cannot be negative.");
+
+  ObjFloatArray* array = wrenNewFloatArray(vm, (uint32_t)count);
+  setSlot(vm, slot, OBJ_VAL(array));
+  return array->elements;
+}
+
 void wrenSetSlotNewList(WrenVM* vm, int slot)
 {
   setSlot(vm, slot, OBJ_VAL(wrenNewList(vm, 0)));
 }
 
+void wrenSetSlotNewStringBuffer(WrenVM* vm, int slot)
+{
+  setSlot(vm, slot, OBJ_VAL(wrenNewStringBuffer(vm)));
+}
+
 void wrenSetSlotNull(WrenVM* vm, int slot)
 {
   setSlot(vm, slot, NULL_VAL);
@@ -1612,6 +3332,30 @@ void wrenSetSlotValue(WrenVM* vm, int slot, WrenValue* value)
   setSlot(vm, slot, value->value);
 }
 
+int wrenGetListCount(WrenVM* vm, int slot)
+{
+  validateApiSlot(vm, slot);
+  ASSERT(IS_LIST(vm->apiStack[slot]), "Slot must hold a list.");
+
+  return AS_LIST(vm->apiStack[slot])->elements.count;
+}
+
+void wrenGetListElement(WrenVM* vm, int listSlot, int index, int elementSlot)
+{
+  validateApiSlot(vm, listSlot);
+  validateApiSlot(vm, elementSlot);
+  ASSERT(IS_LIST(vm->apiStack[listSlot]), "Slot must hold a list.");
+
+  ObjList* list = AS_LIST(vm->apiStack[listSlot]);
+
+  // Negative indices count from the end.
+  if (index < 0) index = list->elements.count + index;
+
+  ASSERT(index >= 0 && index < list->elements.count, "Index out of bounds.");
+
+  vm->apiStack[elementSlot] = list->elements.data[index];
+}
+
 void wrenInsertInList(WrenVM* vm, int listSlot, int index, int elementSlot)
 {
   validateApiSlot(vm, listSlot);
@@ -1628,6 +3372,18 @@ void wrenInsertInList(WrenVM* vm, int listSlot, int index, int elementSlot)
   wrenListInsert(vm, list, vm->apiStack[elementSlot], index);
 }
 
+void wrenAppendToStringBuffer(WrenVM* vm, int bufferSlot, const char* text,
+                              size_t length)
+{
+  validateApiSlot(vm, bufferSlot);
+  ASSERT(text != NULL, "Text cannot be NULL.");
+  ASSERT(IS_STRING_BUFFER(vm->apiStack[bufferSlot]),
+         "Must append to a string buffer.");
+
+  wrenStringBufferAppend(vm, AS_STRING_BUFFER(vm->apiStack[bufferSlot]),
+                         text, length);
+}
+
 // TODO: Maybe just have this always return a WrenValue* instead of having to
 // deal with slots?
 void wrenGetVariable(WrenVM* vm, const char* module, const char* name,
@@ -17,15 +17,124 @@ typedef enum
   #undef OPCODE
 } Code;
 
-// A handle to a value, basically just a linked list of extra GC roots.
+// The phases of an incremental garbage collection cycle. When incremental
+// collection is disabled, the collector goes through an entire cycle within a
+// single call to wrenCollectGarbage() and the phase is always GC_PHASE_IDLE
+// between allocations.
+typedef enum
+{
+  // No collection cycle is in progress.
+  GC_PHASE_IDLE,
+
+  // The roots have been marked and the collector is incrementally marking the
+  // rest of the reachable objects, interleaved with program execution.
+  GC_PHASE_MARKING
+} GCPhase;
+
+// A dead fiber's reusable allocations: its value stack and call frame array,
+// kept in the fiber pool so that a later fiber can adopt them instead of
+// allocating fresh ones.
+typedef struct
+{
+  Value* stack;
+  int stackCapacity;
+
+  CallFrame* frames;
+  int frameCapacity;
+} FiberAllocation;
+
+// One function's accumulated samples from the sampling profiler. The names
+// are copied out of the function's debug info so an entry stays valid if the
+// function itself is collected.
+typedef struct
+{
+  // The name of the module the function was declared in.
+  char* module;
+
+  // The function's name from its debug info.
+  char* name;
+
+  // The source line the function starts on.
+  int line;
+
+  // The number of samples attributed to the function.
+  unsigned long samples;
+} ProfileEntry;
+
+// One allocation site's accumulated counts from the heap profiler. Like
+// ProfileEntry, the names are copied out of the function's debug info so an
+// entry stays valid if the function itself is collected.
+typedef struct
+{
+  // The name of the module the allocating function was declared in.
+  char* module;
+
+  // The allocating function's name from its debug info.
+  char* name;
+
+  // The source line the function starts on.
+  int line;
+
+  // The number of allocation events attributed to the site.
+  unsigned long count;
+
+  // The total number of bytes those events requested.
+  unsigned long bytes;
+} AllocationEntry;
+
+#if WREN_OPT_META
+// One compiled Meta.eval() snippet. Defined in wren_opt_meta.c, which owns
+// all of the cache logic; the VM only stores and frees the array.
+typedef struct MetaCacheEntry MetaCacheEntry;
+#endif
+
+// A handle to a value: an extra GC root held by the host application.
 //
 // Note that even non-heap-allocated values can be stored here.
 struct WrenValue
 {
+  // The captured value, or UNDEFINED_VAL if the handle is free.
   Value value;
 
-  WrenValue* prev;
-  WrenValue* next;
+  // When the handle is free, the next free handle, or NULL if this is the
+  // last one. Unused while the handle is held.
+  WrenValue* nextFree;
+};
+
+// The number of handles in each slab of the handle table.
+#define WREN_HANDLES_PER_SLAB 1024
+
+// A slab of handles. Handles are allocated in these fixed-size chunks so
+// that capturing a value usually doesn't allocate, handle pointers stay
+// stable, and the garbage collector can scan the handles linearly instead of
+// chasing a linked list of individually malloc'd nodes.
+typedef struct WrenHandleSlab
+{
+  WrenValue handles[WREN_HANDLES_PER_SLAB];
+
+  // The next slab in the VM's list of slabs.
+  struct WrenHandleSlab* next;
+} WrenHandleSlab;
+
+// A primed, reusable method invocation. See wrenPrepareCall(). The fiber is
+// dedicated to the call and sized for the stub up front, so invoking it
+// pushes a frame and enters the interpreter without any other setup.
+struct WrenPreparedCall
+{
+  // The call stub built by wrenMakeCallHandle().
+  ObjClosure* closure;
+
+  // The fiber invocations run on. The receiver and argument slots are at the
+  // bottom of its stack.
+  ObjFiber* fiber;
+
+  // The number of slots the stub uses: one for the receiver plus one per
+  // argument.
+  int numSlots;
+
+  // Handles keeping [closure] and [fiber] alive.
+  WrenValue* closureHandle;
+  WrenValue* fiberHandle;
 };
 
 struct WrenVM
@@ -33,6 +142,7 @@ struct WrenVM
   ObjClass* boolClass;
   ObjClass* classClass;
   ObjClass* fiberClass;
+  ObjClass* floatArrayClass;
   ObjClass* fnClass;
   ObjClass* listClass;
   ObjClass* mapClass;
@@ -40,6 +150,7 @@ struct WrenVM
   ObjClass* numClass;
   ObjClass* objectClass;
   ObjClass* rangeClass;
+  ObjClass* stringBufferClass;
   ObjClass* stringClass;
 
   // The fiber that is currently running.
@@ -50,6 +161,81 @@ struct WrenVM
   // for the module.
   ObjMap* modules;
 
+  // The table of interned strings. Every live ObjString is in here, so two
+  // strings with the same contents are always the same object and equality is
+  // a pointer comparison. It's open-addressed and keyed by the strings' own
+  // hashes.
+  //
+  // The table holds its entries weakly: it isn't traced by the garbage
+  // collector, and a string is removed when it's collected.
+  ObjString** interned;
+
+  // The number of live strings in [interned].
+  uint32_t internedCount;
+
+  // The number of tombstones in [interned] left by collected strings. They
+  // are discarded when the table is resized.
+  uint32_t internedTombstones;
+
+  // The number of slots allocated in [interned]. Zero or a power of two.
+  uint32_t internedCapacity;
+
+  // Stack and call frame arrays retained from collected fibers, so that new
+  // fibers can reuse them instead of allocating fresh ones. Holds up to
+  // [config.fiberPoolCapacity] entries.
+  FiberAllocation* fiberPool;
+
+  // The number of entries in [fiberPool].
+  int fiberPoolCount;
+
+  // Sampling profiler data:
+
+  // True while the profiler is collecting samples.
+  bool profiling;
+
+  // The number of loop iterations and method calls until the next sample.
+  // Counts down even while the profiler is stopped -- taking a "sample" then
+  // just resets it -- so the interpreter only pays for a decrement and a
+  // branch.
+  int profileCountdown;
+
+  // The per-function sample counts, and the total number of samples taken.
+  ProfileEntry* profileEntries;
+  int profileCount;
+  int profileCapacity;
+  unsigned long profileSamples;
+
+  // True while an execution budget is set. Kept separate from the tick count
+  // so that an exhausted budget (zero ticks) keeps failing fibers instead of
+  // reading as "no budget".
+  bool metering;
+
+  // The number of profiler countdown cycles left before the execution budget
+  // is exhausted.
+  uint64_t budgetTicks;
+
+  // The managed heap size above which fibers fail, or 0 for no limit.
+  size_t allocationBudget;
+
+  // Heap profiler data:
+
+  // True while allocations are being attributed to the function making them.
+  bool trackingAllocations;
+
+  // The per-site allocation counts, and the totals across all sites.
+  AllocationEntry* allocEntries;
+  int allocEntryCount;
+  int allocEntryCapacity;
+  unsigned long allocTotalCount;
+  unsigned long allocTotalBytes;
+
+#if WREN_OPT_META
+  // The compile cache for Meta.eval(). See wren_opt_meta.c.
+  MetaCacheEntry* metaCacheEntries;
+  int metaCacheCount;
+  int metaCacheCapacity;
+#endif
+
   // Memory management data:
 
   // The number of bytes that are known to be currently allocated. Includes all
@@ -62,14 +248,57 @@ struct WrenVM
   size_t nextGC;
 
   // The first object in the linked list of all currently allocated objects.
+  // When generational collection is enabled, this holds only the old
+  // generation; new objects live in [nursery] until they're promoted.
   Obj* first;
 
+  // The first object in the linked list of nursery objects, or NULL if
+  // generational collection is disabled.
+  Obj* nursery;
+
+  // The objects frozen by wrenFreezeCore(), or NULL if the VM hasn't been
+  // frozen. They are permanently dark and live on this list instead of
+  // [first], so the collector never traces, sweeps, or counts them. Other
+  // VMs created with this one as their [sharedCoreVM] reference them
+  // directly.
+  Obj* permanent;
+
+  // The number of total allocated bytes that will trigger the next minor
+  // collection. Only used when generational collection is enabled.
+  size_t nextMinorGC;
+
+  // True while a minor collection is tracing the nursery. Makes wrenGrayObj()
+  // ignore old objects.
+  bool collectingNursery;
+
+  // The remembered set: old objects that young objects have been stored into
+  // since the last collection, plus all old fibers. A minor collection scans
+  // these to find the old-to-young references.
+  Obj** remembered;
+  int rememberedCount;
+  int rememberedCapacity;
+
   // The "gray" set for the garbage collector. This is the stack of unprocessed
   // objects while a garbage collection pass is in process.
   Obj** gray;
   int grayCount;
   int grayCapacity;
 
+  // The garbage collector's current phase.
+  GCPhase gcPhase;
+
+  // Counters describing the collector's behavior, updated after every
+  // collection and exposed through wrenGetGCStats().
+  WrenGCStats gcStats;
+
+  // The fibers that have been blackened during the current incremental
+  // collection cycle. Stores into a fiber's stack are too frequent to put a
+  // write barrier on, so instead every fiber that was marked during the cycle
+  // is re-scanned when the cycle finishes.
+  ObjFiber** grayAgainFibers;
+  int grayAgainCount;
+  int grayAgainCapacity;
+
   // The list of temporary roots. This is for temporary or new objects that are
   // not otherwise reachable but should not be collected.
   //
@@ -80,9 +309,16 @@ struct WrenVM
 
   int numTempRoots;
   
-  // Pointer to the first node in the linked list of active value handles or
-  // NULL if there are no handles.
-  WrenValue* valueHandles;
+  // The slabs backing the value handle table, or NULL if no handle has ever
+  // been captured. Slabs live until the VM is freed.
+  WrenHandleSlab* handleSlabs;
+
+  // The head of the free list threaded through the slabs' unused handles, or
+  // NULL if a new slab is needed.
+  WrenValue* freeHandles;
+
+  // The number of handles currently held by the host.
+  int handleCount;
   
   // Pointer to the bottom of the range of stack slots available for use from
   // the C API. During a foreign method, this will be in the stack of the fiber
@@ -125,6 +361,90 @@ struct WrenVM
 //   [oldSize] will be zero. It should return NULL.
 void* wrenReallocate(WrenVM* vm, void* memory, size_t oldSize, size_t newSize);
 
+// Performs one bounded increment of marking work for an in-progress
+// incremental collection cycle, finishing the cycle if everything reachable
+// has been marked.
+void wrenIncrementalGC(WrenVM* vm);
+
+// Records that [fiber] has been blackened during an incremental collection
+// cycle so its stack is re-scanned when the cycle finishes.
+void wrenRememberBlackenedFiber(WrenVM* vm, ObjFiber* fiber);
+
+#if WREN_PARALLEL_MARK
+// The per-thread state of one worker in an in-progress parallel mark phase.
+// Defined in wren_vm.c.
+typedef struct MarkWorker MarkWorker;
+
+// The worker the current thread is marking for, or NULL outside a parallel
+// mark phase. wrenGrayObj() checks this to route newly reached objects onto
+// the worker's local stack instead of the VM's gray stack.
+extern __thread MarkWorker* wrenCurrentMarkWorker;
+
+// Atomically claims [obj] for [worker] and pushes it onto the worker's local
+// stack, or does nothing if another worker already reached it.
+void wrenMarkWorkerGray(MarkWorker* worker, Obj* obj);
+#endif
+
+// Adds [obj] to the remembered set so the next minor collection scans it.
+void wrenRememberObj(WrenVM* vm, Obj* obj);
+
+// Takes ownership of [fiber]'s stack and call frame arrays and adds them to
+// the fiber pool for a later fiber to reuse. Returns false if the pool is
+// full, in which case the caller is still responsible for freeing them.
+bool wrenPoolFiberAllocations(WrenVM* vm, ObjFiber* fiber);
+
+// Removes a pooled fiber allocation, or returns false if the pool is empty.
+bool wrenReuseFiberAllocation(WrenVM* vm, FiberAllocation* allocation);
+
+// Formats the profiler's collected samples as a report, one function per
+// line ordered by sample count. Returns a null-terminated string allocated
+// with the VM's allocator and stores its length (not counting the
+// terminator) in [length]. The caller must free it with DEALLOCATE().
+char* wrenProfilerReportString(WrenVM* vm, size_t* length);
+
+// Formats a report of the heap's current contents: one line per object type
+// with its live count and bytes, followed by one line per allocation site if
+// the heap profiler has attributed any. Returns a null-terminated string
+// allocated with the VM's allocator and stores its length (not counting the
+// terminator) in [length]. The caller must free it with DEALLOCATE().
+char* wrenHeapReportString(WrenVM* vm, size_t* length);
+
+// The garbage collector's write barrier. This must be called whenever [obj]
+// is stored into a field, element, or other slot of [container]. It does two
+// jobs:
+//
+// - If [container] has already been marked during an in-progress incremental
+//   collection cycle, it won't be scanned again, so the reference to [obj]
+//   would be missed; marking [obj] here keeps it alive.
+//
+// - If [container] is in the old generation and [obj] in the nursery, a minor
+//   collection wouldn't see the reference either since it doesn't traverse
+//   old objects. Adding [container] to the remembered set gets it scanned.
+//
+// Stores into fiber stacks don't need the barrier: fibers marked during an
+// incremental cycle are re-scanned when the cycle finishes, and old fibers
+// are permanently in the remembered set.
+static inline void wrenWriteBarrierObj(WrenVM* vm, Obj* container, Obj* obj)
+{
+  if (vm->gcPhase == GC_PHASE_MARKING && container->isDark)
+  {
+    wrenGrayObj(vm, obj);
+  }
+
+  if (obj != NULL && obj->isYoung &&
+      !container->isYoung && !container->isRemembered)
+  {
+    wrenRememberObj(vm, container);
+  }
+}
+
+// Like wrenWriteBarrierObj(), but for storing a [Value] that may not be an
+// object.
+static inline void wrenWriteBarrier(WrenVM* vm, Obj* container, Value value)
+{
+  if (IS_OBJ(value)) wrenWriteBarrierObj(vm, container, AS_OBJ(value));
+}
+
 // Invoke the finalizer for the foreign object referenced by [foreign].
 void wrenFinalizeForeign(WrenVM* vm, ObjForeign* foreign);
 
@@ -0,0 +1,86 @@
+#include <string.h>
+
+#include "budget.h"
+
+// A harmless loop that is long enough to cross the interpreter's periodic
+// budget check at least once.
+static const char* busyWork =
+    "var n = 0\n"
+    "for (i in 0...5000) n = n + 1\n";
+
+// Checks that a runaway loop fails with the documented error, that Fiber.try()
+// observes it, and that the budget keeps failing fibers until the host sets a
+// new one.
+static void execution(WrenVM* vm)
+{
+  WrenVM* otherVM = wrenNewVM(NULL);
+  wrenSetExecutionBudget(otherVM, 100000);
+
+  // An unbounded top-level loop fails instead of hanging.
+  bool ok = wrenInterpret(otherVM, "while (true) {}\n") ==
+      WREN_RESULT_RUNTIME_ERROR;
+
+  // The exhausted budget keeps failing new fibers until the host intervenes.
+  ok = ok && wrenInterpret(otherVM, busyWork) == WREN_RESULT_RUNTIME_ERROR;
+
+  wrenSetExecutionBudget(otherVM, 1000000);
+  ok = ok && wrenInterpret(otherVM, busyWork) == WREN_RESULT_SUCCESS;
+
+  // The error is catchable. The checking code after try() runs because the
+  // exhausting fiber failed at a periodic check, so a fresh countdown stands
+  // between the catch and the next one.
+  wrenSetExecutionBudget(otherVM, 100000);
+  ok = ok && wrenInterpret(otherVM,
+      "var error = Fiber.new {\n"
+      "  while (true) {}\n"
+      "}.try()\n"
+      "if (error != \"Execution budget exhausted.\") Fiber.abort(error)\n") ==
+          WREN_RESULT_SUCCESS;
+
+  wrenSetSlotBool(vm, 0, ok);
+
+  wrenFreeVM(otherVM);
+}
+
+// Checks that an allocation storm fails with the documented error, that
+// Fiber.try() observes it, and that the error stops recurring once the heap
+// drops back under the limit.
+static void allocation(WrenVM* vm)
+{
+  WrenVM* otherVM = wrenNewVM(NULL);
+
+  // Measure the live heap and allow modest growth over it.
+  wrenCollectGarbage(otherVM);
+  WrenGCStats stats;
+  wrenGetGCStats(otherVM, &stats);
+  wrenSetAllocationBudget(otherVM, stats.bytesAfter + 512 * 1024);
+
+  // A fiber retaining an unbounded pile of strings fails with a catchable
+  // error instead of growing forever.
+  bool ok = wrenInterpret(otherVM,
+      "var error = Fiber.new {\n"
+      "  var keep = []\n"
+      "  while (true) {\n"
+      "    keep.add(\"thirty-two bytes of ballast... \" + keep.count.toString)\n"
+      "  }\n"
+      "}.try()\n"
+      "if (error != \"Allocation budget exhausted.\") Fiber.abort(error)\n") ==
+          WREN_RESULT_SUCCESS;
+
+  // The dead fiber's pile is garbage now. Once it is collected the heap is
+  // back under the limit, so the budget stops failing fibers.
+  wrenCollectGarbage(otherVM);
+  ok = ok && wrenInterpret(otherVM, busyWork) == WREN_RESULT_SUCCESS;
+
+  wrenSetSlotBool(vm, 0, ok);
+
+  wrenFreeVM(otherVM);
+}
+
+WrenForeignMethodFn budgetBindMethod(const char* signature)
+{
+  if (strcmp(signature, "static Budget.execution()") == 0) return execution;
+  if (strcmp(signature, "static Budget.allocation()") == 0) return allocation;
+
+  return NULL;
+}
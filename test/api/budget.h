@@ -0,0 +1,3 @@
+#include "wren.h"
+
+WrenForeignMethodFn budgetBindMethod(const char* signature);
@@ -0,0 +1,109 @@
+#include <string.h>
+
+#include "gc_stats.h"
+
+// The number of times the callback has fired and the stats it saw last, for
+// comparison against wrenGetGCStats() afterwards.
+static int callbackCalls = 0;
+static WrenGCStats callbackStats;
+
+static void gcCallback(WrenVM* vm, const WrenGCStats* stats)
+{
+  callbackCalls++;
+  callbackStats = *stats;
+}
+
+// A loop that churns through a few megabytes of short-lived strings.
+static const char* churnSource =
+    "var keep = []\n"
+    "for (i in 0...100) keep.add(\"live data %(i)\")\n"
+    "for (i in 0...30000) {\n"
+    "  var garbage = \"garbage \" + i.toString\n"
+    "}\n";
+
+// Runs a collection and checks that the stats counters and the callback both
+// reflect it.
+static void collect(WrenVM* vm)
+{
+  WrenConfiguration config;
+  wrenInitConfiguration(&config);
+  config.gcCallbackFn = gcCallback;
+
+  callbackCalls = 0;
+
+  WrenVM* otherVM = wrenNewVM(&config);
+
+  WrenGCStats before;
+  wrenGetGCStats(otherVM, &before);
+
+  bool ok = wrenInterpret(otherVM, "var list = []\n"
+      "for (i in 0...1000) list.add(\"string %(i)\")\n") == WREN_RESULT_SUCCESS;
+  wrenCollectGarbage(otherVM);
+
+  WrenGCStats after;
+  wrenGetGCStats(otherVM, &after);
+
+  // The explicit collection is counted, timed, and measured.
+  ok = ok && after.collections == before.collections + 1;
+  ok = ok && after.liveObjects > 0;
+  ok = ok && after.bytesAfter > 0;
+  ok = ok && after.bytesAfter <= after.bytesBefore;
+  ok = ok && after.totalPauseNs >= after.lastPauseNs;
+
+  // The callback fired once per collection and saw the same counters the
+  // query reports.
+  ok = ok && callbackCalls == (int)after.collections;
+  ok = ok && callbackStats.collections == after.collections;
+  ok = ok && callbackStats.bytesAfter == after.bytesAfter;
+
+  wrenSetSlotBool(vm, 0, ok);
+
+  wrenFreeVM(otherVM);
+}
+
+// Runs the same garbage-heavy workload with and without a soft heap limit and
+// checks that the limit forces collections instead of letting the heap grow
+// past it.
+static void softLimit(WrenVM* vm)
+{
+  const size_t limit = 512 * 1024;
+
+  WrenConfiguration config;
+  wrenInitConfiguration(&config);
+
+  WrenVM* unlimitedVM = wrenNewVM(&config);
+  bool ok = wrenInterpret(unlimitedVM, churnSource) == WREN_RESULT_SUCCESS;
+
+  WrenGCStats unlimited;
+  wrenGetGCStats(unlimitedVM, &unlimited);
+  wrenFreeVM(unlimitedVM);
+
+  config.softHeapLimit = limit;
+  config.initialHeapSize = limit;
+
+  WrenVM* limitedVM = wrenNewVM(&config);
+  ok = ok && wrenInterpret(limitedVM, churnSource) == WREN_RESULT_SUCCESS;
+
+  WrenGCStats limited;
+  wrenGetGCStats(limitedVM, &limited);
+  wrenFreeVM(limitedVM);
+
+  // The workload's garbage fits in the default heap but is several times the
+  // limit, so only the limited VM is forced to collect repeatedly.
+  ok = ok && limited.collections >= 3;
+  ok = ok && limited.collections > unlimited.collections;
+
+  // The collections were scheduled by the limit, not by normal growth: the
+  // heap never grew past the limit plus the allowed headroom.
+  ok = ok && limited.bytesBefore < limit * 2;
+
+  wrenSetSlotBool(vm, 0, ok);
+}
+
+WrenForeignMethodFn gcStatsBindMethod(const char* signature)
+{
+  if (strcmp(signature, "static GCStats.collect()") == 0) return collect;
+  if (strcmp(signature, "static GCStats.softLimit()") == 0) return softLimit;
+
+  return NULL;
+}
@@ -0,0 +1,3 @@
+#include "wren.h"
+
+WrenForeignMethodFn gcStatsBindMethod(const char* signature);
@@ -37,10 +37,30 @@ static void insert(WrenVM* vm)
   insertNumber(vm, -3, 9.0);
 }
 
+static void doubleList(WrenVM* vm)
+{
+  double values[] = { 1.0, 2.0, 3.0 };
+  wrenSetSlotNewDoubleList(vm, 0, values, 3);
+}
+
+static void roundTripDoubleList(WrenVM* vm)
+{
+  // Read the list out in one call, double every element, and send it back.
+  double values[8];
+  int count = wrenGetSlotDoubleList(vm, 1, values, 8);
+  for (int i = 0; i < count; i++) values[i] *= 2.0;
+  wrenSetSlotNewDoubleList(vm, 0, values, count);
+}
+
 WrenForeignMethodFn listsBindMethod(const char* signature)
 {
   if (strcmp(signature, "static Lists.newList()") == 0) return newList;
   if (strcmp(signature, "static Lists.insert()") == 0) return insert;
+  if (strcmp(signature, "static Lists.doubleList()") == 0) return doubleList;
+  if (strcmp(signature, "static Lists.roundTripDoubleList(_)") == 0)
+  {
+    return roundTripDoubleList;
+  }
 
   return NULL;
 }
@@ -5,11 +5,15 @@
 #include "wren.h"
 
 #include "benchmark.h"
+#include "budget.h"
 #include "call.h"
 #include "get_variable.h"
 #include "foreign_class.h"
+#include "gc_stats.h"
 #include "lists.h"
 #include "new_vm.h"
+#include "prepared_call.h"
+#include "shared_core.h"
 #include "slots.h"
 #include "value.h"
 
@@ -36,18 +40,27 @@ static WrenForeignMethodFn bindForeignMethod(
   method = benchmarkBindMethod(fullName);
   if (method != NULL) return method;
 
+  method = budgetBindMethod(fullName);
+  if (method != NULL) return method;
+
   method = getVariableBindMethod(fullName);
   if (method != NULL) return method;
 
   method = foreignClassBindMethod(fullName);
   if (method != NULL) return method;
-  
+
+  method = gcStatsBindMethod(fullName);
+  if (method != NULL) return method;
+
   method = listsBindMethod(fullName);
   if (method != NULL) return method;
   
   method = newVMBindMethod(fullName);
   if (method != NULL) return method;
-  
+
+  method = sharedCoreBindMethod(fullName);
+  if (method != NULL) return method;
+
   method = slotsBindMethod(fullName);
   if (method != NULL) return method;
   
@@ -81,6 +94,7 @@ static WrenForeignClassMethods bindForeignClass(
 
 static void afterLoad(WrenVM* vm) {
   if (strstr(testName, "/call.wren") != NULL) callRunTests(vm);
+  if (strstr(testName, "/prepared_call.wren") != NULL) preparedCallRunTests(vm);
 }
 
 int main(int argc, const char* argv[])
@@ -0,0 +1,70 @@
+#include <string.h>
+
+#include "prepared_call.h"
+#include "vm.h"
+
+void preparedCallRunTests(WrenVM* vm)
+{
+  wrenEnsureSlots(vm, 1);
+  wrenGetVariable(vm, "main", "PreparedCall", 0);
+  WrenValue* callClass = wrenGetSlotValue(vm, 0);
+
+  WrenValue* addMethod = wrenMakeCallHandle(vm, "add(_,_)");
+  WrenPreparedCall* add = wrenPrepareCall(vm, addMethod);
+
+  // The call keeps its own reference to the method.
+  wrenReleaseValue(vm, addMethod);
+
+  wrenSetSlotValue(vm, 0, callClass);
+  wrenSetSlotDouble(vm, 1, 1.0);
+  wrenSetSlotDouble(vm, 2, 2.0);
+  wrenCallPrepared(vm, add);
+
+  // Invoking again reuses the primed fiber. The return value replaced the
+  // receiver in slot zero, so that is rewritten along with the arguments.
+  wrenSetSlotValue(vm, 0, callClass);
+  wrenSetSlotDouble(vm, 1, 3.0);
+  wrenSetSlotDouble(vm, 2, 4.0);
+  wrenCallPrepared(vm, add);
+
+  // The return value is readable from slot zero.
+  WrenValue* valueMethod = wrenMakeCallHandle(vm, "value()");
+  WrenPreparedCall* value = wrenPrepareCall(vm, valueMethod);
+  wrenReleaseValue(vm, valueMethod);
+
+  wrenSetSlotValue(vm, 0, callClass);
+  wrenCallPrepared(vm, value);
+  WrenValue* result = wrenGetSlotValue(vm, 0);
+
+  WrenValue* echoMethod = wrenMakeCallHandle(vm, "echo(_)");
+  WrenPreparedCall* echo = wrenPrepareCall(vm, echoMethod);
+  wrenReleaseValue(vm, echoMethod);
+
+  wrenSetSlotValue(vm, 0, callClass);
+  wrenSetSlotValue(vm, 1, result);
+  wrenCallPrepared(vm, echo);
+  wrenReleaseValue(vm, result);
+
+  // A runtime error leaves the call reusable, and another call can be
+  // re-selected after it.
+  WrenValue* failMethod = wrenMakeCallHandle(vm, "fail()");
+  WrenPreparedCall* fail = wrenPrepareCall(vm, failMethod);
+  wrenReleaseValue(vm, failMethod);
+
+  wrenSetSlotValue(vm, 0, callClass);
+  if (wrenCallPrepared(vm, fail) == WREN_RESULT_RUNTIME_ERROR)
+  {
+    wrenLoadPreparedCall(vm, add);
+    wrenSetSlotValue(vm, 0, callClass);
+    wrenSetSlotDouble(vm, 1, 5.0);
+    wrenSetSlotDouble(vm, 2, 7.0);
+    wrenCallPrepared(vm, add);
+  }
+
+  wrenReleasePreparedCall(vm, add);
+  wrenReleasePreparedCall(vm, value);
+  wrenReleasePreparedCall(vm, echo);
+  wrenReleasePreparedCall(vm, fail);
+
+  wrenReleaseValue(vm, callClass);
+}
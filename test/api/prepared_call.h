@@ -0,0 +1,3 @@
+#include "wren.h"
+
+void preparedCallRunTests(WrenVM* vm);
@@ -0,0 +1,77 @@
+#include <string.h>
+
+#include "shared_core.h"
+
+// The module the donor VM loads and freezes for the sharing VMs.
+static const char* sharedSource =
+    "class Shared {\n"
+    "  static tag { \"frozen\" }\n"
+    "  static double(n) { n * 2 }\n"
+    "}\n"
+    "var SharedList = [1, 2, 3]\n";
+
+static char* loadSharedModule(WrenVM* vm, const char* name)
+{
+  if (strcmp(name, "shared") == 0) return (char*)sharedSource;
+  return NULL;
+}
+
+// Runs tenant code in a VM sharing [donor]'s frozen core and returns whether
+// it all succeeded, including after a full collection in the sharing VM.
+static bool runSharingVM(WrenVM* donor)
+{
+  WrenConfiguration config;
+  wrenInitConfiguration(&config);
+  config.sharedCoreVM = donor;
+
+  WrenVM* vm = wrenNewVM(&config);
+
+  // The import resolves to the frozen module without a loadModuleFn.
+  bool ok = wrenInterpret(vm,
+      "import \"shared\" for Shared, SharedList\n"
+      "var sum = 0\n"
+      "for (n in SharedList) sum = sum + Shared.double(n)\n"
+      "if (sum != 12) Fiber.abort(\"wrong sum\")\n"
+      "if (Shared.tag != \"frozen\") Fiber.abort(\"wrong tag\")\n") ==
+          WREN_RESULT_SUCCESS;
+
+  // The frozen objects are exempt from this VM's collector, so they must
+  // still be intact after a full collection.
+  wrenCollectGarbage(vm);
+  ok = ok && wrenInterpret(vm,
+      "if (Shared.double(21) != 42) Fiber.abort(\"lost shared module\")\n") ==
+          WREN_RESULT_SUCCESS;
+
+  wrenFreeVM(vm);
+  return ok;
+}
+
+static void shareCore(WrenVM* vm)
+{
+  WrenConfiguration config;
+  wrenInitConfiguration(&config);
+  config.loadModuleFn = loadSharedModule;
+
+  WrenVM* donor = wrenNewVM(&config);
+  bool ok = wrenInterpret(donor, "import \"shared\"") == WREN_RESULT_SUCCESS;
+  wrenFreezeCore(donor);
+
+  // Two sharing VMs in sequence, to check that freeing one doesn't disturb
+  // the frozen region the next one references.
+  ok = ok && runSharingVM(donor);
+  ok = ok && runSharingVM(donor);
+
+  wrenSetSlotBool(vm, 0, ok);
+
+  wrenFreeVM(donor);
+}
+
+WrenForeignMethodFn sharedCoreBindMethod(const char* signature)
+{
+  if (strcmp(signature, "static SharedCore.shareCore()") == 0)
+  {
+    return shareCore;
+  }
+
+  return NULL;
+}
@@ -0,0 +1,3 @@
+#include "wren.h"
+
+WrenForeignMethodFn sharedCoreBindMethod(const char* signature);
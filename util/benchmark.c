@@ -0,0 +1,205 @@
+// An in-process benchmark harness for the VM. Unlike util/benchmark.py,
+// which launches a whole interpreter process per iteration and so measures
+// process startup as much as the VM, this creates a single WrenVM per
+// benchmark and runs the script in it repeatedly. Each run executes the
+// script in a fresh module so its top-level definitions don't collide with
+// the previous run's.
+//
+// For every benchmark it reports the minimum, mean, and standard deviation
+// of the per-run CPU time, and how much the VM's bytesAllocated counter grew
+// over the run. Build and run it with:
+//
+//     make -f util/wren.mk benchmark_harness
+//     bin/wren_benchmark [-n runs] [path/to/benchmark.wren...]
+//
+// With no paths, runs the standard suite in test/benchmark.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "wren.h"
+#include "wren_vm.h"
+
+// The standard suite, relative to the repository root. The api_* benchmarks
+// need the CLI's foreign methods, so they are left to util/benchmark.py.
+static const char* standardBenchmarks[] = {
+  "test/benchmark/binary_trees.wren",
+  "test/benchmark/binary_trees_gc.wren",
+  "test/benchmark/delta_blue.wren",
+  "test/benchmark/fib.wren",
+  "test/benchmark/fibers.wren",
+  "test/benchmark/for.wren",
+  "test/benchmark/method_call.wren",
+  "test/benchmark/map_numeric.wren",
+  "test/benchmark/map_string.wren",
+  "test/benchmark/string_equals.wren",
+  NULL
+};
+
+// The source of the benchmark currently being run, handed to the VM each
+// time it imports one of the per-run "bench" modules.
+static char* benchmarkSource = NULL;
+
+static char* readFile(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) return NULL;
+
+  fseek(file, 0, SEEK_END);
+  size_t size = (size_t)ftell(file);
+  rewind(file);
+
+  char* source = (char*)malloc(size + 1);
+  size_t read = fread(source, 1, size, file);
+  fclose(file);
+
+  if (read < size)
+  {
+    free(source);
+    return NULL;
+  }
+
+  source[size] = '\0';
+  return source;
+}
+
+// The benchmarks print their results so the scripted harness can check them.
+// Here the output is discarded: a run's time shouldn't include the host's
+// terminal.
+static void discardWrite(WrenVM* vm, const char* text)
+{
+  (void)vm;
+  (void)text;
+}
+
+static void reportError(WrenErrorType type, const char* module, int line,
+                        const char* message)
+{
+  switch (type)
+  {
+    case WREN_ERROR_COMPILE:
+      fprintf(stderr, "[%s line %d] %s\n", module, line, message);
+      break;
+    case WREN_ERROR_RUNTIME:
+      fprintf(stderr, "%s\n", message);
+      break;
+    case WREN_ERROR_STACK_TRACE:
+      fprintf(stderr, "[%s line %d] in %s\n", module, line, message);
+      break;
+  }
+}
+
+// Serves the current benchmark's source for every per-run module import.
+static char* loadBenchmarkModule(WrenVM* vm, const char* name)
+{
+  (void)vm;
+  if (strncmp(name, "bench", 5) != 0) return NULL;
+  return benchmarkSource;
+}
+
+// Runs the benchmark at [path] [runs] times in one VM and prints its
+// statistics. Returns false if the benchmark failed.
+static bool runBenchmark(const char* path, int runs)
+{
+  benchmarkSource = readFile(path);
+  if (benchmarkSource == NULL)
+  {
+    fprintf(stderr, "Could not read benchmark '%s'.\n", path);
+    return false;
+  }
+
+  WrenConfiguration configuration;
+  wrenInitConfiguration(&configuration);
+  configuration.writeFn = discardWrite;
+  configuration.errorFn = reportError;
+  configuration.loadModuleFn = loadBenchmarkModule;
+
+  WrenVM* vm = wrenNewVM(&configuration);
+
+  // Pull the benchmark's file name out of its path for the report.
+  const char* name = strrchr(path, '/');
+  name = name != NULL ? name + 1 : path;
+
+  double minTime = 0.0;
+  double totalTime = 0.0;
+  double totalSquares = 0.0;
+  double totalBytes = 0.0;
+  bool failed = false;
+
+  for (int run = 0; run < runs && !failed; run++)
+  {
+    // Run the script in a module of its own so its top-level definitions
+    // don't collide with the previous run's.
+    char import[64];
+    sprintf(import, "import \"bench%d\"", run);
+
+    // Collect first so one run's garbage isn't counted against the next.
+    wrenCollectGarbage(vm);
+    size_t bytesBefore = vm->bytesAllocated;
+
+    clock_t start = clock();
+    WrenInterpretResult result = wrenInterpret(vm, import);
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    failed = result != WREN_RESULT_SUCCESS;
+
+    if (run == 0 || elapsed < minTime) minTime = elapsed;
+    totalTime += elapsed;
+    totalSquares += elapsed * elapsed;
+    totalBytes += (double)vm->bytesAllocated - (double)bytesBefore;
+  }
+
+  if (!failed)
+  {
+    double mean = totalTime / runs;
+    double variance = totalSquares / runs - mean * mean;
+    double stddev = variance > 0.0 ? sqrt(variance) : 0.0;
+
+    printf("%-25s min %.4fs  mean %.4fs  stddev %.4fs  %.0f bytes/run\n",
+           name, minTime, mean, stddev, totalBytes / runs);
+  }
+
+  wrenFreeVM(vm);
+  free(benchmarkSource);
+  benchmarkSource = NULL;
+  return !failed;
+}
+
+int main(int argc, const char* argv[])
+{
+  int runs = 10;
+
+  int argIndex = 1;
+  if (argIndex + 1 < argc && strcmp(argv[argIndex], "-n") == 0)
+  {
+    runs = atoi(argv[argIndex + 1]);
+    if (runs <= 0)
+    {
+      fprintf(stderr, "Invalid number of runs '%s'.\n", argv[argIndex + 1]);
+      return 64; // EX_USAGE.
+    }
+
+    argIndex += 2;
+  }
+
+  bool success = true;
+  if (argIndex < argc)
+  {
+    for (int i = argIndex; i < argc; i++)
+    {
+      success = runBenchmark(argv[i], runs) && success;
+    }
+  }
+  else
+  {
+    for (int i = 0; standardBenchmarks[i] != NULL; i++)
+    {
+      success = runBenchmark(standardBenchmarks[i], runs) && success;
+    }
+  }
+
+  return success ? 0 : 1;
+}
@@ -1,7 +1,7 @@
 #!/usr/bin/env python
 
 import sys
-from os.path import basename, dirname, join, realpath
+from os.path import basename, dirname, exists, join, realpath
 from glob import iglob
 import re
 
@@ -12,6 +12,25 @@ WREN_DIR = dirname(dirname(realpath(__file__)))
 seen_files = set()
 out = sys.stdout
 
+# The source directories searched for an include that isn't next to the file
+# including it. The VM and the optional modules include each other's headers.
+INCLUDE_DIRS = [
+  join(WREN_DIR, 'src', 'include'),
+  join(WREN_DIR, 'src', 'vm'),
+  join(WREN_DIR, 'src', 'optional'),
+]
+
+# Finds the file an `#include "name"` in [path] refers to.
+def resolve_include(path, name):
+  candidate = join(path, name)
+  if exists(candidate):
+    return candidate
+  for include_dir in INCLUDE_DIRS:
+    candidate = join(include_dir, name)
+    if exists(candidate):
+      return candidate
+  raise Exception('Could not resolve #include "{0}" in {1}'.format(name, path))
+
 # Prints a plain text file, adding comment markers.
 def add_comment_file(filename):
   with open(filename, 'r') as f:
@@ -33,7 +52,7 @@ def add_file(filename):
     for line in f:
       m = INCLUDE_PATTERN.match(line)
       if m:
-        add_file(join(path, m.group(1)))
+        add_file(resolve_include(path, m.group(1)))
       else:
         out.write(line)
       if GUARD_PATTERN.match(line):
@@ -54,6 +73,10 @@ add_file(join(WREN_DIR, 'src', 'include', 'wren.h'))
 
 # Must be included here because of conditional compilation.
 add_file(join(WREN_DIR, 'src', 'vm', 'wren_debug.h'))
+add_file(join(WREN_DIR, 'src', 'vm', 'wren_snapshot.h'))
 
 for f in iglob(join(WREN_DIR, 'src', 'vm', '*.c')):
   add_file(f)
+
+for f in iglob(join(WREN_DIR, 'src', 'optional', '*.c')):
+  add_file(f)
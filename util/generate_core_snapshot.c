@@ -0,0 +1,59 @@
+// Generates "src/vm/wren_core.snapshot.inc", the precompiled image of the
+// core module that wrenInitializeCore() loads when WREN_CORE_SNAPSHOT is
+// enabled. This spares every wrenNewVM() call from parsing and compiling the
+// core library's source.
+//
+// This program must be compiled with WREN_CORE_SNAPSHOT=0 and
+// WREN_CORE_SNAPSHOT_GENERATOR=1 so that creating a VM compiles the core
+// source and captures the resulting image. Run it whenever
+// "src/vm/wren_core.wren" changes:
+//
+//     make -f util/wren.mk core_snapshot
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "wren.h"
+#include "wren_core.h"
+
+int main(int argc, const char* argv[])
+{
+  if (argc != 2)
+  {
+    fprintf(stderr, "Usage: generate_core_snapshot <output>\n");
+    return 64; // EX_USAGE.
+  }
+
+  // Creating the VM compiles the core module and captures its image.
+  WrenVM* vm = wrenNewVM(NULL);
+  if (wrenCapturedCoreSnapshot == NULL)
+  {
+    fprintf(stderr, "Failed to capture the core module image.\n");
+    return 1;
+  }
+
+  FILE* file = fopen(argv[1], "w");
+  if (file == NULL)
+  {
+    fprintf(stderr, "Could not open '%s' to write.\n", argv[1]);
+    return 66; // EX_NOINPUT.
+  }
+
+  fprintf(file, "// Generated automatically from src/vm/wren_core.wren by\n");
+  fprintf(file, "// util/generate_core_snapshot.c. Do not edit.\n");
+  fprintf(file, "static const uint8_t coreModuleSnapshot[] =\n{");
+
+  for (size_t i = 0; i < wrenCapturedCoreSnapshotLength; i++)
+  {
+    // Wrap at 12 bytes per line to stay under 80 columns.
+    if (i % 12 == 0) fprintf(file, "\n ");
+    fprintf(file, " 0x%02x,", (unsigned char)wrenCapturedCoreSnapshot[i]);
+  }
+
+  fprintf(file, "\n};\n");
+  fclose(file);
+
+  wrenFreeSnapshot(vm, wrenCapturedCoreSnapshot);
+  wrenFreeVM(vm);
+  return 0;
+}
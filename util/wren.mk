@@ -28,7 +28,8 @@ CLI_SOURCES  := $(wildcard src/cli/*.c)
 MODULE_HEADERS   := $(wildcard src/module/*.h) $(wildcard src/module/*.wren.inc)
 MODULE_SOURCES   := $(wildcard src/module/*.c)
 
-VM_HEADERS   := $(wildcard src/vm/*.h) $(wildcard src/vm/*.wren.inc)
+VM_HEADERS   := $(wildcard src/vm/*.h) $(wildcard src/vm/*.wren.inc) \
+                $(wildcard src/vm/*.snapshot.inc)
 VM_SOURCES   := $(wildcard src/vm/*.c)
 
 TEST_HEADERS := $(wildcard test/api/*.h)
@@ -158,6 +159,7 @@ bin/$(WREN): $(OPT_OBJECTS) $(CLI_OBJECTS) $(MODULE_OBJECTS) $(VM_OBJECTS) \
 lib/lib$(WREN).a: $(OPT_OBJECTS) $(VM_OBJECTS)
 	@ printf "%10s %-30s %s\n" $(AR) $@ "rcu"
 	@ mkdir -p lib
+	@ rm -f $@ # A PGO build may have left an amalgamation archive behind.
 	@ $(AR) rcu $@ $^
 
 # Shared library.
@@ -227,4 +229,64 @@ src/module/%.wren.inc: src/module/%.wren util/wren_to_c_string.py
 	@ printf "%10s %-30s %s\n" str $<
 	@ ./util/wren_to_c_string.py $@ $<
 
-.PHONY: all cli test vm
+# The precompiled core module image. The generator is built from the VM
+# sources with the image disabled, so that its own bootstrap compiles the core
+# source and captures the result.
+core_snapshot: src/vm/wren_core.wren.inc
+	@ printf "%10s %-30s %s\n" $(CC) bin/generate_core_snapshot \
+			"$(C_OPTIONS)"
+	@ mkdir -p bin
+	@ $(CC) $(CFLAGS) -DWREN_CORE_SNAPSHOT=0 -DWREN_CORE_SNAPSHOT_GENERATOR=1 \
+			-Isrc/include -Isrc/optional -Isrc/vm \
+			-o bin/generate_core_snapshot util/generate_core_snapshot.c \
+			$(VM_SOURCES) $(OPT_SOURCES) -lm
+	@ printf "%10s %-30s %s\n" snap src/vm/wren_core.snapshot.inc
+	@ ./bin/generate_core_snapshot src/vm/wren_core.snapshot.inc
+
+# The in-process benchmark harness. Built straight from the VM sources so it
+# measures the VM itself without the CLI or libuv.
+benchmark_harness: $(VM_SOURCES) $(OPT_SOURCES) util/benchmark.c
+	@ printf "%10s %-30s %s\n" $(CC) bin/wren_benchmark "$(C_OPTIONS)"
+	@ mkdir -p bin
+	@ $(CC) $(CFLAGS) -Isrc/include -Isrc/optional -Isrc/vm \
+			-o bin/wren_benchmark util/benchmark.c \
+			$(VM_SOURCES) $(OPT_SOURCES) -lm
+
+# A profile-guided, link-time-optimized build of the VM amalgamation. An
+# instrumented build of the benchmark harness runs the benchmark suite as the
+# training workload, then the interpreter and the static library are rebuilt
+# using the collected profile. The interpreter loop's dispatch branches are
+# where the profile pays off most.
+PGO_DIR   := $(BUILD_DIR)/pgo
+PGO_FLAGS := -flto -fprofile-dir=$(PGO_DIR) -fprofile-correction
+
+# The profile data files are keyed to the object paths, so the instrumented
+# and optimized compiles go through the same $(PGO_DIR) objects.
+PGO_COMPILE = $(CC) -c $(CFLAGS) $(PGO_FLAGS) -ffat-lto-objects \
+		-Isrc/include -Isrc/optional -Isrc/vm
+
+optimized: util/benchmark.c $(CLI_OBJECTS) $(MODULE_OBJECTS) $(LIBUV)
+	@ mkdir -p bin build lib $(PGO_DIR)
+	@ printf "%10s %-30s %s\n" gen build/wren.c
+	@ ./util/generate_amalgamation.py > build/wren.c
+	@ printf "%10s %-30s %s\n" $(CC) bin/wren_benchmark "$(C_OPTIONS) -fprofile-generate"
+	@ $(PGO_COMPILE) -fprofile-generate -o $(PGO_DIR)/wren.o build/wren.c
+	@ $(PGO_COMPILE) -fprofile-generate -o $(PGO_DIR)/benchmark.o util/benchmark.c
+	@ $(CC) $(CFLAGS) $(PGO_FLAGS) -fprofile-generate \
+			$(PGO_DIR)/wren.o $(PGO_DIR)/benchmark.o -o bin/wren_benchmark -lm
+	@ printf "%10s %-30s %s\n" train test/benchmark
+	@ ./bin/wren_benchmark -n 2 > /dev/null
+	@ printf "%10s %-30s %s\n" $(CC) bin/wren_benchmark "$(C_OPTIONS) -fprofile-use"
+	@ $(PGO_COMPILE) -fprofile-use -o $(PGO_DIR)/wren.o build/wren.c
+	@ $(PGO_COMPILE) -fprofile-use -o $(PGO_DIR)/benchmark.o util/benchmark.c
+	@ $(CC) $(CFLAGS) $(PGO_FLAGS) -fprofile-use \
+			$(PGO_DIR)/wren.o $(PGO_DIR)/benchmark.o -o bin/wren_benchmark -lm
+	@ printf "%10s %-30s %s\n" $(AR) lib/lib$(WREN).a "rcu"
+	@ rm -f lib/lib$(WREN).a # A per-object build may have left one behind.
+	@ $(AR) rcu lib/lib$(WREN).a $(PGO_DIR)/wren.o
+	@ printf "%10s %-30s %s\n" $(CC) bin/$(WREN) "$(C_OPTIONS) -fprofile-use"
+	@ $(CC) $(CFLAGS) $(PGO_FLAGS) -fprofile-use \
+			$(PGO_DIR)/wren.o $(CLI_OBJECTS) $(MODULE_OBJECTS) $(LIBUV) \
+			-o bin/$(WREN) -lm $(LIBUV_LIBS)
+
+.PHONY: all benchmark_harness cli core_snapshot optimized test vm